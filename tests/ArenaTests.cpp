@@ -0,0 +1,74 @@
+#include <cstdint>
+#include <vector>
+#include "Test.h"
+#include "ysen/core/Arena.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+
+using namespace ysen;
+
+namespace {
+
+	struct Recorder
+	{
+		Recorder(std::vector<int>& destroyed, int id)
+			: destroyed(destroyed), id(id)
+		{}
+
+		~Recorder()
+		{
+			destroyed.push_back(id);
+		}
+
+		std::vector<int>& destroyed;
+		int id{};
+	};
+
+	struct alignas(32) Wide
+	{
+		char bytes[40];
+	};
+
+}
+
+TEST(arena_destroys_objects_in_reverse_order)
+{
+	std::vector<int> destroyed{};
+	{
+		core::Arena arena{ 64 };
+		for (auto i = 0; i < 100; ++i) {
+			arena.make<Recorder>(destroyed, i);
+		}
+		EXPECT(arena.chunk_count() > 1);
+		EXPECT(destroyed.empty());
+	}
+
+	EXPECT(destroyed.size() == 100);
+	for (auto i = 0; i < 100; ++i) {
+		EXPECT(destroyed[i] == 99 - i);
+	}
+}
+
+TEST(arena_aligns_and_grows_past_large_objects)
+{
+	core::Arena arena{ 16 };
+	arena.make<char>('a');
+	auto* wide = arena.make<Wide>();
+	auto* large = static_cast<char*>(arena.allocate(1024 * 1024, 8));
+	auto* after = arena.make<int>(7);
+
+	EXPECT(reinterpret_cast<uintptr_t>(wide) % 32 == 0);
+	EXPECT(large != nullptr);
+	large[1024 * 1024 - 1] = 'z';
+	EXPECT(*after == 7);
+	EXPECT(arena.size() >= 1024 * 1024 + sizeof(Wide) + sizeof(int) + 1);
+}
+
+TEST(parsed_programs_own_their_nodes)
+{
+	auto lexer = lang::Lexer::lex("var a = 1; fun f(x) { ret x + a; } ret f(2);");
+	auto program = lang::Parser{}.parse(lexer->tokens());
+
+	EXPECT(program->children().size() == 3);
+	EXPECT(program->arena().size() > 0);
+}
@@ -0,0 +1,73 @@
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/ArrayFunctions.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	// Large enough for the functions to split the work across the pool
+	constexpr auto LARGE = astvm::ARRAY_PARALLEL_THRESHOLD + 1000;
+
+	core::String eval_formatted(const char* code)
+	{
+		auto env = core::adopt_nonnull(new ScriptEnvironment);
+		env->eval("fun square(x) { ret x * x; } fun is_odd(x) { ret x - (x / 2) * 2 > 0; }");
+		return env->eval(code)->to_formatted_string();
+	}
+
+	bool is_sorted(const astvm::Value::Array& values)
+	{
+		for (size_t i = 1; i < values.size(); ++i) {
+			if (values[i] < values[i - 1]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+}
+
+TEST(array_functions_take_function_values_and_names)
+{
+	EXPECT(eval_formatted("ret map([1, 2, 3], square);") == eval_formatted("ret [1, 4, 9];"));
+	EXPECT(eval_formatted("ret map([1, 2, 3], 'square');") == eval_formatted("ret [1, 4, 9];"));
+	EXPECT(eval_formatted("ret filter(1..7, is_odd);") == eval_formatted("ret [1, 3, 5, 7];"));
+	EXPECT(eval_formatted("ret find([4, 6, 7, 9], is_odd);") == eval_formatted("ret 7;"));
+	EXPECT(eval_formatted("ret reduce([1, 2, 3, 4], fun(a, b) { ret a * b; });") == eval_formatted("ret 24;"));
+	EXPECT(eval_formatted("ret reduce([], fun(a, b) { ret a * b; }, 5);") == eval_formatted("ret 5;"));
+	EXPECT(eval_formatted("ret join(['a', 'b', 'c'], '-');") == eval_formatted("ret 'a-b-c';"));
+}
+
+TEST(sort_is_stable)
+{
+	auto sorted = eval_formatted(R"(
+var pairs = [['k': 2, 'v': 'a'], ['k': 1, 'v': 'b'], ['k': 2, 'v': 'c'], ['k': 1, 'v': 'd']];
+ret join(map(sort(pairs, fun(a, b) { ret a.k < b.k; }), fun(p) { ret p.v; }), '');
+)");
+	EXPECT(sorted == eval_formatted("ret 'bdac';"));
+	EXPECT(eval_formatted("ret sort([3, 1, 2]);") == eval_formatted("ret [1, 2, 3];"));
+}
+
+TEST(large_arrays_give_the_results_of_small_ones)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	env->eval(core::format("var data = map(1..{}, fun(x) {{ var y = x * 7919; ret y - (y / {}) * {}; }});", LARGE, LARGE, LARGE));
+
+	auto sorted = env->eval("ret sort(data);");
+	EXPECT(sorted->array().size() == static_cast<size_t>(LARGE));
+	EXPECT(is_sorted(sorted->array()));
+
+	auto total = env->eval("var total = 0; for (var x : data) total = total + x; ret total;")->cast<int>();
+	EXPECT(env->eval("ret sum(data);")->cast<int>() == total);
+	EXPECT(env->eval("ret sum(sort(data));")->cast<int>() == total);
+	EXPECT(env->eval("ret min(data);")->cast<int>() == sorted->array().front().cast<int>());
+	EXPECT(env->eval("ret max(data);")->cast<int>() == sorted->array().back().cast<int>());
+
+	// Strings are added up in order, as a loop would
+	auto joined = env->eval("ret join(map(data, to_string), '');")->to_string();
+	EXPECT(env->eval("ret sum(map(data, to_string));")->to_string() == joined);
+}
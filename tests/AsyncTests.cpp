@@ -0,0 +1,123 @@
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Test.h"
+#include "ysen/lang/Isolate.h"
+#include "ysen/lang/astvm/Async.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	// Holds back every lookup until count of them are waiting, then answers them all
+	// from a thread of its own. Scripts blocking their thread on a lookup would never
+	// get there.
+	class Gate
+	{
+	public:
+		explicit Gate(size_t count)
+			: m_count(count)
+		{}
+
+		~Gate()
+		{
+			if (m_thread.joinable()) {
+				m_thread.join();
+			}
+		}
+
+		astvm::PendingPtr get(int key)
+		{
+			auto pending = core::make_shared<astvm::Pending>();
+			std::lock_guard lock{m_mutex};
+			m_waiting.push_back({ key, pending });
+			if (m_waiting.size() == m_count) {
+				m_thread = std::thread([waiting = m_waiting]() mutable {
+					for (auto& [key, pending] : waiting) {
+						if (key < 0) {
+							pending->fail("negative key");
+						}
+						else {
+							pending->resolve(key * 10);
+						}
+					}
+				});
+			}
+			return pending;
+		}
+	private:
+		size_t m_count{};
+		std::mutex m_mutex{};
+		std::vector<std::pair<int, astvm::PendingPtr>> m_waiting{};
+		std::thread m_thread{};
+	};
+
+	astvm::Value handle(const SharedScriptPtr& script, Gate& gate, int key)
+	{
+		Isolate isolate{ script };
+		isolate.interpreter().add(astvm::function("lookup", [&gate](int key) -> astvm::Task {
+			co_return co_await gate.get(key);
+		}));
+		isolate.run();
+
+		astvm::Value argument{ key };
+		return isolate.call("handle", { &argument, 1 });
+	}
+
+}
+
+TEST(scripts_awaiting_natives_park_on_the_scheduler)
+{
+	auto script = SharedScript::compile("fun handle(key) { var value = lookup(key); ret value + 1; }");
+	constexpr auto SCRIPTS = 50;
+	Gate gate{ SCRIPTS };
+
+	astvm::Scheduler scheduler{};
+	std::vector<astvm::PendingPtr> results{};
+	for (auto i = 0; i < SCRIPTS; ++i) {
+		results.push_back(scheduler.spawn([&script, &gate, i]() {
+			return handle(script, gate, i == 7 ? -1 : i);
+		}));
+	}
+	scheduler.run();
+
+	EXPECT(scheduler.size() == 0);
+	for (auto i = 0; i < SCRIPTS; ++i) {
+		EXPECT(results[i]->is_ready());
+		if (i == 7) {
+			EXPECT_THROWS(results[i]->result(), astvm::AsyncError);
+		}
+		else {
+			EXPECT(results[i]->result().cast<int>() == i * 10 + 1);
+		}
+	}
+}
+
+TEST(natives_block_outside_of_a_scheduler)
+{
+	auto script = SharedScript::compile("fun handle(key) { ret lookup(key) + 1; }");
+	Gate gate{ 1 };
+
+	EXPECT(handle(script, gate, 4).cast<int>() == 41);
+	EXPECT(astvm::await(astvm::Pending::resolved(astvm::Value{ 5 })).cast<int>() == 5);
+}
+
+TEST(yield_runs_the_other_scripts_first)
+{
+	std::vector<int> order{};
+	astvm::Scheduler scheduler{};
+	for (auto script = 0; script < 2; ++script) {
+		scheduler.spawn([&order, script]() {
+			order.push_back(script);
+			astvm::Scheduler::yield();
+			order.push_back(script + 10);
+			return astvm::Value{};
+		});
+	}
+	scheduler.run();
+
+	EXPECT((order == std::vector<int>{ 0, 1, 10, 11 }));
+	EXPECT(astvm::Scheduler::current() == nullptr);
+}
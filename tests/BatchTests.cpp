@@ -0,0 +1,91 @@
+#include <span>
+#include <vector>
+#include "Test.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	// Declares a local, takes either branch and returns from the middle of the body
+	constexpr auto SCORE = R"(
+fun score(amount, limit) {
+	var doubled = amount * 2;
+	if (amount > limit) {
+		var excess = amount - limit;
+		ret doubled + excess;
+	}
+	ret doubled - limit;
+}
+)";
+
+	astvm::FunctionPtr declare(astvm::Interpreter& vm, const char* code, const char* name)
+	{
+		auto lexer = Lexer::lex(code);
+		vm.execute(Parser{}.parse(lexer->tokens()));
+		return vm.current_scope()->find_function(name);
+	}
+
+}
+
+TEST(batches_match_single_invokes)
+{
+	astvm::Interpreter vm{};
+	auto score = declare(vm, SCORE, "score");
+
+	std::vector<astvm::Value> amounts{};
+	std::vector<astvm::Value> limits{};
+	for (auto i = 0; i < 50; ++i) {
+		amounts.emplace_back(i);
+		limits.emplace_back(20 + i % 10);
+	}
+
+	std::vector<astvm::Value> expected{};
+	std::vector<std::vector<astvm::Value>> rows{};
+	for (size_t i = 0; i < amounts.size(); ++i) {
+		rows.push_back({ amounts[i], limits[i] });
+		expected.push_back(score->invoke(vm, rows.back()));
+	}
+
+	std::vector<std::span<const astvm::Value>> row_spans(rows.begin(), rows.end());
+	std::vector<astvm::Value> batch(rows.size());
+	score->invoke_batch(vm, row_spans, batch);
+
+	std::span<const astvm::Value> columns[] = { amounts, limits };
+	std::vector<astvm::Value> columnar(rows.size());
+	score->invoke_columns(vm, columns, columnar);
+
+	for (size_t i = 0; i < rows.size(); ++i) {
+		EXPECT(batch[i].cast<int>() == expected[i].cast<int>());
+		EXPECT(columnar[i].cast<int>() == expected[i].cast<int>());
+	}
+
+	// The batch left nothing behind in the scope it was called from
+	EXPECT(!vm.current_scope()->find_variable("doubled"));
+	EXPECT(!vm.current_scope()->returning());
+}
+
+TEST(batches_of_natives_match_single_invokes)
+{
+	astvm::Interpreter vm{};
+	auto multiply = astvm::function("multiply", [](int a, int b) { return a * b; });
+
+	std::vector<astvm::Value> lhs{};
+	std::vector<astvm::Value> rhs{};
+	for (auto i = 0; i < 10; ++i) {
+		lhs.emplace_back(i);
+		rhs.emplace_back(i + 1);
+	}
+
+	std::span<const astvm::Value> columns[] = { lhs, rhs };
+	std::vector<astvm::Value> results(lhs.size());
+	multiply->invoke_columns(vm, columns, results);
+
+	for (auto i = 0; i < 10; ++i) {
+		EXPECT(results[i].cast<int>() == i * (i + 1));
+	}
+}
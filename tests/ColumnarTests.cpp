@@ -0,0 +1,120 @@
+#include <span>
+#include <vector>
+#include "Test.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+#include "ysen/lang/columnar/Kernel.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	// Rows over more than one block, so that the last one is partial
+	constexpr size_t ROWS = 2 * columnar::Kernel::BLOCK_SIZE + 123;
+
+	struct Records
+	{
+		std::vector<double> prices{};
+		std::vector<int> quantities{};
+		std::vector<double> limits{};
+		std::vector<core::String> names{};
+
+		Records()
+		{
+			for (size_t i = 0; i < ROWS; ++i) {
+				prices.push_back((i % 100) * 0.5);
+				quantities.push_back(static_cast<int>(i % 7));
+				limits.push_back(100.0);
+				names.push_back(core::format("item{}", static_cast<unsigned int>(i % 13)));
+			}
+		}
+
+		columnar::Batch batch() const
+		{
+			columnar::Batch batch{ ROWS };
+			batch.bind("price", columnar::Column{ std::span<const double>{ prices } });
+			batch.bind("qty", columnar::Column{ std::span<const int>{ quantities } });
+			batch.bind("limit", columnar::Column{ std::span<const double>{ limits } });
+			batch.bind("name", columnar::Column{ std::span<const core::String>{ names } });
+			return batch;
+		}
+
+		// The interpreter's value of a function of (price, qty, limit, name) for each row
+		std::vector<astvm::Value> interpret(const char* function) const
+		{
+			auto lexer = Lexer::lex(function);
+			astvm::Interpreter vm{};
+			vm.execute(Parser{}.parse(lexer->tokens()));
+
+			std::vector<astvm::Value> price_values(prices.begin(), prices.end());
+			std::vector<astvm::Value> quantity_values(quantities.begin(), quantities.end());
+			std::vector<astvm::Value> limit_values(limits.begin(), limits.end());
+			std::vector<astvm::Value> name_values(names.begin(), names.end());
+			std::span<const astvm::Value> columns[] = { price_values, quantity_values, limit_values, name_values };
+
+			std::vector<astvm::Value> results(ROWS);
+			vm.current_scope()->find_function("f")->invoke_columns(vm, columns, results);
+			return results;
+		}
+	};
+
+}
+
+TEST(kernels_select_the_rows_the_interpreter_does)
+{
+	Records records{};
+	auto expected = records.interpret("fun f(price, qty, limit, name) { ret price * qty > limit; }");
+	auto selected = columnar::Kernel::compile("price * qty > limit").select(records.batch());
+
+	std::vector<uint32_t> matching{};
+	for (size_t i = 0; i < ROWS; ++i) {
+		if (expected[i].is_trueish()) {
+			matching.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	EXPECT(!matching.empty());
+	EXPECT(selected == matching);
+}
+
+TEST(kernels_cast_like_the_interpreter)
+{
+	Records records{};
+	auto expected = records.interpret("fun f(price, qty, limit, name) { ret qty * price + qty / 2; }");
+	auto kernel = columnar::Kernel::compile("qty * price + qty / 2");
+	auto batch = records.batch();
+
+	EXPECT(kernel.result_type(batch) == columnar::ColumnType::Int);
+	auto column = kernel.evaluate(batch);
+	EXPECT(column.size() == ROWS);
+	for (size_t i = 0; i < ROWS; ++i) {
+		EXPECT(column.ints()[i] == expected[i].cast<int>());
+	}
+
+	// Where the interpreter's integer division by zero is undefined
+	auto quotients = columnar::Kernel::compile("qty / 0").evaluate(batch);
+	for (auto quotient : quotients.ints()) {
+		EXPECT(quotient == 0);
+	}
+}
+
+TEST(kernels_concatenate_strings)
+{
+	Records records{};
+	auto column = columnar::Kernel::compile("name + '-' + qty").evaluate(records.batch());
+
+	EXPECT(column.type() == columnar::ColumnType::String);
+	EXPECT(column.strings()[8] == "item8-1");
+}
+
+TEST(kernels_reject_what_the_interpreter_has_no_value_for)
+{
+	Records records{};
+	auto batch = records.batch();
+
+	EXPECT_THROWS(columnar::Kernel::compile("name * 2").evaluate(batch), columnar::ColumnarError);
+	EXPECT_THROWS(columnar::Kernel::compile("missing + 1").evaluate(batch), columnar::ColumnarError);
+	EXPECT_THROWS(columnar::Kernel::compile("f(price)"), columnar::ColumnarError);
+}
@@ -0,0 +1,126 @@
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/lang/Isolate.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/ast/ConstantFolder.h"
+#include "ysen/lang/astvm/Value.h"
+#include "ysen/lang/bytecode/BytecodeInterpreter.h"
+#include "ysen/lang/ir/Builder.h"
+#include "ysen/lang/ir/Compiler.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	ast::ProgramPtr parse(const char* code)
+	{
+		auto lexer = Lexer::lex(code);
+		return Parser{}.parse(lexer->tokens());
+	}
+
+	astvm::Value run_bytecode(const char* code, const ir::PassOptions& options = {})
+	{
+		auto program = parse(code);
+		ast::ConstantFolder::fold(*program);
+		bytecode::Generator generator;
+		ir::compile(*program, generator, options);
+		return bytecode::BytecodeInterpreter{}.execute(generator.program());
+	}
+
+	constexpr auto SCORES = R"(
+fun square(x) { ret x * x; }
+fun score(n) {
+	var total = 0;
+	for (var i : 1..10) {
+		var scale = n * 2 + 1;
+		if (i > 5) {
+			total = total + square(i) * scale;
+		}
+		else {
+			total = total + i;
+		}
+	}
+	ret total;
+}
+ret score(3) + score(4);
+)";
+
+	constexpr auto COUNT = "fun count(n, total) { if (n > 0) { ret count(n - 1, total + 1); } ret total; } ret count(100000, 0);";
+
+}
+
+TEST(folding_replaces_operations_over_literals)
+{
+	auto program = parse("ret 2 * 3 + 4;");
+	ast::ConstantFolder::fold(*program);
+
+	EXPECT(program->children().size() == 1);
+	const auto& ret = static_cast<const ast::ReturnExpression&>(*program->children()[0]);
+	EXPECT(ret.expression()->is_integer_expression());
+	EXPECT(static_cast<const ast::IntegerExpression&>(*ret.expression()).value() == 10);
+}
+
+TEST(folding_prunes_dead_branches)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	EXPECT(env->eval("if (1 > 2) { ret missing(); } else if (2 > 1) { ret 7; } ret 0;")->cast<int>() == 7);
+	EXPECT(run_bytecode("if (1 > 2) { ret missing(); } ret 5;").cast<int>() == 5);
+}
+
+TEST(ir_passes_keep_results)
+{
+	constexpr auto expected = 15 + 330 * 7 + 15 + 330 * 9;
+
+	ir::PassOptions none{};
+	none.constant_propagation = false;
+	none.common_subexpression_elimination = false;
+	none.loop_invariant_code_motion = false;
+	none.dead_code_elimination = false;
+	none.inlining = false;
+
+	EXPECT(run_bytecode(SCORES).cast<int>() == expected);
+	EXPECT(run_bytecode(SCORES, none).cast<int>() == expected);
+	EXPECT(core::adopt_nonnull(new ScriptEnvironment)->eval(SCORES)->cast<int>() == expected);
+}
+
+TEST(ir_reports_falling_back_to_the_ast)
+{
+	constexpr auto LAMBDA = "var add = fun(x) { ret x + 1; }; ret add(2);";
+	auto program = parse(LAMBDA);
+
+	bytecode::Generator generator;
+	auto unsupported = ir::compile(*program, generator);
+	EXPECT(unsupported.has_value());
+	EXPECT(unsupported.value().contains("UnsupportedConstruct"));
+
+	ir::PassOptions strict{};
+	strict.ast_fallback = false;
+	bytecode::Generator strict_generator;
+	EXPECT_THROWS(ir::compile(*program, strict_generator, strict), ir::UnsupportedConstruct);
+
+	bytecode::Generator supported;
+	EXPECT(!ir::compile(*parse(SCORES), supported).has_value());
+	EXPECT(!SharedScript::compile(SCORES, ExecutionMode::Bytecode)->ast_fallback().has_value());
+	EXPECT(SharedScript::compile(LAMBDA, ExecutionMode::Bytecode)->ast_fallback().has_value());
+}
+
+TEST(tail_calls_run_in_constant_depth)
+{
+	EXPECT(run_bytecode(COUNT).cast<int>() == 100000);
+	EXPECT(core::adopt_nonnull(new ScriptEnvironment)->eval(COUNT)->cast<int>() == 100000);
+}
+
+TEST(tail_calls_keep_what_the_callee_can_see)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	env->eval("fun g() { ret a + 0; } fun f(a) { ret g(); }");
+	EXPECT(env->eval("ret f(5);")->cast<int>() == 5);
+
+	env->eval("fun h(n) { var seen = n; if (n > 0) { ret h(n - 1); } ret seen; }");
+	EXPECT(env->eval("ret h(3);")->cast<int>() == 0);
+	env->eval("fun k(n) { if (n > 0) { var last = n; ret k(n - 1); } ret last; }");
+	EXPECT(env->eval("ret k(3);")->cast<int>() == 1);
+}
@@ -0,0 +1,88 @@
+#include <vector>
+#include "Test.h"
+#include "ysen/core/SharedPtr.h"
+#include "ysen/core/ThreadPool.h"
+#include "ysen/lang/FrontEnd.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	// Several lexer chunks long, with strings and comments spanning lines so
+	// that chunk starts fall inside them
+	core::String generate_functions(size_t count)
+	{
+		core::String code{};
+		for (auto i = 0u; i < count; ++i) {
+			code.append(core::format(R"(
+// function {}
+fun f_{}(x) {
+	var text = 'first line
+second line {}';
+	/* a comment
+	   over lines */
+	ret x + {};
+}
+)", i, i, i, i));
+		}
+		code.append(core::format("ret f_3(1) + f_{}(2);", count - 1));
+		return code;
+	}
+
+	int run(const ast::ProgramPtr& program)
+	{
+		astvm::Interpreter interpreter{};
+		return interpreter.execute(program)->cast<int>();
+	}
+
+}
+
+TEST(chunked_lexing_matches_serial_lexing)
+{
+	auto code = generate_functions(12000);
+	EXPECT(code.length() > 3 * Lexer::PARALLEL_CHUNK_SIZE);
+
+	core::ThreadPool pool{ 4 };
+	auto serial = Lexer::lex(code);
+	auto chunked = Lexer::lex(code, pool);
+
+	const auto& expected = serial->tokens();
+	const auto& tokens = chunked->tokens();
+	EXPECT(tokens.size() == expected.size());
+	for (size_t i = 0; i < tokens.size(); ++i) {
+		EXPECT(tokens[i].type() == expected[i].type());
+		EXPECT(tokens[i].offset() == expected[i].offset());
+		EXPECT(tokens[i].end_offset() == expected[i].end_offset());
+		EXPECT(tokens[i].content() == expected[i].content());
+	}
+}
+
+TEST(front_end_loads_like_the_serial_parser)
+{
+	auto code = generate_functions(12000);
+	core::ThreadPool pool{ 4 };
+
+	auto serial = Parser{}.parse(core::adopt_shared(Lexer::lex(code).release()));
+	auto parallel = FrontEnd{ pool }.load(code);
+
+	EXPECT(parallel->children().size() == serial->children().size());
+	for (size_t i = 0; i < serial->children().size(); ++i) {
+		EXPECT(parallel->children()[i]->source_range().offset() == serial->children()[i]->source_range().offset());
+	}
+	EXPECT(run(serial) == 4 + 11999 + 2);
+	EXPECT(run(parallel) == 4 + 11999 + 2);
+}
+
+TEST(front_end_keeps_sources_in_order)
+{
+	core::ThreadPool pool{ 2 };
+	auto program = FrontEnd{ pool }.load(std::vector<core::String>{ "var a = 1;", "var b = a + 1;", "ret b * 10;" });
+
+	EXPECT(program->children().size() == 3);
+	EXPECT(run(program) == 20);
+}
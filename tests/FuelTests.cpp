@@ -0,0 +1,128 @@
+#include <vector>
+#include "Test.h"
+#include "ysen/lang/Isolate.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/astvm/Async.h"
+#include "ysen/lang/astvm/Fuel.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	constexpr auto FUNCTIONS = R"(
+fun spin() {
+	var total = 0;
+	for (var i : 1..200000) {
+		if (i > 0) {
+			total = total + i / 1000;
+		}
+	}
+	ret total;
+}
+fun tick() {
+	var total = 0;
+	for (var i : 1..100) total = total + i / 1000;
+	ret total;
+}
+fun count(n) {
+	if (n > 0) {
+		ret count(n - 1);
+	}
+	ret n;
+}
+)";
+
+	astvm::ValuePtr execute(astvm::Interpreter& vm, const char* code)
+	{
+		auto lexer = Lexer::lex(code);
+		return vm.execute(Parser{}.parse(lexer->tokens()));
+	}
+
+}
+
+TEST(fuel_counts_steps_up_to_its_limit)
+{
+	astvm::Fuel fuel{ { 10, 0 } };
+	for (auto i = 0; i < 10; ++i) {
+		fuel.burn();
+	}
+	EXPECT(fuel.used() == 10);
+	EXPECT_THROWS(fuel.burn(), astvm::OutOfFuel);
+
+	fuel.set_budget({ 10, 0 });
+	EXPECT(fuel.used() == 0);
+	EXPECT_THROWS(fuel.burn(11), astvm::OutOfFuel);
+
+	// Slices only yield, outside of a scheduler that does nothing
+	fuel.set_budget({ 0, 3 });
+	for (auto i = 0; i < 10; ++i) {
+		fuel.burn();
+	}
+	EXPECT(fuel.used() == 10);
+}
+
+TEST(out_of_fuel_reports_limits_past_32_bits)
+{
+	astvm::OutOfFuel error{ 5000000000 };
+	EXPECT(core::String{ error.what() } == "OutOfFuel: script used up its budget of 5000000000 steps");
+}
+
+TEST(scripts_out_of_fuel_leave_their_scopes)
+{
+	astvm::Interpreter vm{};
+	execute(vm, FUNCTIONS);
+	const auto* global = vm.current_scope().ptr();
+
+	vm.fuel().set_budget({ 10000, 0 });
+	EXPECT_THROWS(execute(vm, "ret spin();"), astvm::OutOfFuel);
+	EXPECT(vm.current_scope().ptr() == global);
+	EXPECT(!vm.in_function());
+
+	vm.fuel().set_budget({ 1000, 0 });
+	EXPECT_THROWS(execute(vm, "ret count(5000);"), astvm::OutOfFuel);
+	EXPECT(vm.current_scope().ptr() == global);
+
+	vm.fuel().set_budget({});
+	EXPECT(execute(vm, "ret tick();")->cast<int>() == 0);
+	EXPECT(execute(vm, "ret count(5000);")->cast<int>() == 0);
+}
+
+TEST(bytecode_runs_out_of_fuel_too)
+{
+	Isolate isolate{ SharedScript::compile("fun count(n) { if (n > 0) { ret count(n - 1); } ret n; } ret count(5000);", ExecutionMode::Bytecode) };
+
+	isolate.set_fuel({ 1000, 0 });
+	EXPECT_THROWS(isolate.run_bytecode(), astvm::OutOfFuel);
+
+	isolate.set_fuel({});
+	EXPECT(isolate.run_bytecode().cast<int>() == 0);
+}
+
+TEST(slices_let_short_scripts_go_first)
+{
+	auto script = SharedScript::compile(FUNCTIONS);
+
+	auto finishing_order = [&script](astvm::FuelBudget budget) {
+		std::vector<core::String> finished{};
+		astvm::Scheduler scheduler{};
+		for (const auto* function : { "spin", "tick", "tick" }) {
+			scheduler.spawn([&, function]() {
+				Isolate isolate{ script };
+				isolate.set_fuel(budget);
+				isolate.run();
+				auto result = isolate.call(function, {});
+				finished.push_back(function);
+				return result;
+			});
+		}
+		scheduler.run();
+		return finished;
+	};
+
+	EXPECT((finishing_order({}) == std::vector<core::String>{ "spin", "tick", "tick" }));
+	EXPECT((finishing_order({ 0, 1000 }) == std::vector<core::String>{ "tick", "tick", "spin" }));
+}
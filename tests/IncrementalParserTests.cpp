@@ -0,0 +1,97 @@
+#include <string_view>
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/lang/IncrementalParser.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	core::String generate_functions(size_t count)
+	{
+		core::String code{};
+		for (auto i = 0u; i < count; ++i) {
+			code.append(core::format("fun f_{}(x) {\n\tret x * {} + 1;\n}\n", i, i));
+		}
+		code.append("ret f_7(2) + f_8(3);");
+		return code;
+	}
+
+	size_t find(const core::String& code, const char* text)
+	{
+		auto offset = std::string_view{ code.c_str(), code.length() }.find(text);
+		if (offset == std::string_view::npos) {
+			throw tests::Failure(__FILE__, __LINE__, core::format("'{}' isn't in the code", text));
+		}
+		return offset;
+	}
+
+	int run(const ast::ProgramPtr& program)
+	{
+		astvm::Interpreter interpreter{};
+		return interpreter.execute(program)->cast<int>();
+	}
+
+	int run(const core::String& code)
+	{
+		auto lexer = Lexer::lex(code);
+		return run(Parser{}.parse(lexer->tokens()));
+	}
+
+}
+
+TEST(incremental_reparse_matches_a_full_parse)
+{
+	IncrementalParser script{ generate_functions(50) };
+	auto offset = find(script.code(), "ret x * 7 + 1;") + 8;
+	auto result = script.apply(TextEdit{ offset, 1, "70" });
+
+	EXPECT(result.changed_functions.size() == 1);
+	EXPECT(result.changed_functions[0]->name() == "f_7");
+	EXPECT(result.removed_functions.empty());
+	EXPECT(result.reused_statements >= 48);
+
+	auto expected = generate_functions(50);
+	expected = core::format("{}70{}", core::StringView{ expected.c_str(), offset }, expected.c_str() + offset + 1);
+	EXPECT(script.code() == expected);
+	EXPECT(result.program->children().size() == 51);
+	EXPECT(run(result.program) == run(expected));
+	EXPECT(run(result.program) == 2 * 70 + 1 + 3 * 8 + 1);
+}
+
+TEST(edits_reaching_past_their_statements_reparse_everything)
+{
+	IncrementalParser script{ generate_functions(20) };
+	auto result = script.apply(TextEdit{ find(script.code(), "fun f_3("), 0, "/* " });
+
+	EXPECT(result.program->children().size() == 3);
+	EXPECT(result.reused_statements == 3);
+	EXPECT(result.removed_functions.size() == 17);
+}
+
+TEST(edits_which_dont_parse_leave_the_script_alone)
+{
+	auto code = generate_functions(20);
+	IncrementalParser script{ code };
+
+	EXPECT_THROWS(script.apply(TextEdit{ find(script.code(), "x * 5 + 1") + 6, 1, ")" }), ParseError);
+	EXPECT(script.code() == code);
+	EXPECT(run(script.program()) == run(code));
+}
+
+TEST(reload_swaps_the_changed_functions)
+{
+	auto code = generate_functions(20);
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	IncrementalParser script{ code };
+	EXPECT(env->eval(code)->cast<int>() == 2 * 7 + 1 + 3 * 8 + 1);
+
+	env->reload(script, TextEdit{ find(script.code(), "x * 8 + 1") + 4, 1, "100" });
+	EXPECT(env->eval("ret f_8(3);")->cast<int>() == 301);
+	EXPECT(env->eval("ret f_7(2);")->cast<int>() == 15);
+}
@@ -0,0 +1,102 @@
+#include <future>
+#include <stdexcept>
+#include <vector>
+#include "Test.h"
+#include "ysen/core/ThreadPool.h"
+#include "ysen/lang/Isolate.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	constexpr auto SCORE = R"(
+var calls = 0;
+fun score(a, b) {
+	calls = calls + 1;
+	var total = a * 3 + b;
+	if (total > 100) {
+		ret total - 100;
+	}
+	ret total;
+}
+fun call_count() {
+	ret calls;
+}
+)";
+
+	// Calls score count times with the given offset, and returns the sum of the scores
+	int run(const SharedScriptPtr& script, int count, int offset)
+	{
+		Isolate isolate{ script };
+		isolate.run();
+
+		auto total = 0;
+		for (auto i = 0; i < count; ++i) {
+			astvm::Value arguments[] = { (i + offset) % 50, 7 };
+			total += isolate.call("score", arguments).cast<int>();
+		}
+
+		if (isolate.call("call_count", {}).cast<int>() != count) {
+			throw std::logic_error("An isolate saw the calls of another one");
+		}
+		return total;
+	}
+
+}
+
+TEST(isolates_on_threads_match_one_isolate)
+{
+	auto script = SharedScript::compile(SCORE);
+	constexpr auto THREADS = 4;
+	constexpr auto CALLS = 2000;
+
+	std::vector<int> expected{};
+	for (auto i = 0; i < THREADS; ++i) {
+		expected.push_back(run(script, CALLS, i));
+	}
+
+	core::ThreadPool pool{ THREADS };
+	std::vector<std::future<int>> futures{};
+	for (auto i = 0; i < THREADS; ++i) {
+		futures.push_back(pool.submit([&script, i]() {
+			return run(script, CALLS, i);
+		}));
+	}
+
+	for (auto i = 0; i < THREADS; ++i) {
+		EXPECT(futures[i].get() == expected[i]);
+	}
+}
+
+TEST(isolates_run_shared_bytecode)
+{
+	auto script = SharedScript::compile(R"(
+var a = 5 + 5;
+var b = a + 10;
+fun testing(a, b) {
+	if (a >= 10) {
+		ret (a / 2) + b;
+	}
+	ret a + b;
+}
+ret testing(a, b);
+)", ExecutionMode::Bytecode);
+	EXPECT(script->has_bytecode());
+
+	Isolate first{ script };
+	Isolate second{ script };
+	EXPECT(first.run_bytecode().cast<int>() == 25);
+	EXPECT(second.run_bytecode().cast<int>() == 25);
+	EXPECT(second.run()->cast<int>() == 25);
+}
+
+TEST(isolates_report_what_they_cant_run)
+{
+	Isolate isolate{ SharedScript::compile(SCORE) };
+	isolate.run();
+
+	EXPECT_THROWS(isolate.run_bytecode(), std::logic_error);
+	EXPECT_THROWS(isolate.call("missing", {}), std::invalid_argument);
+}
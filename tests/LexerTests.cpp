@@ -0,0 +1,169 @@
+#include <string>
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/Scanner.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	template<typename Predicate>
+	size_t skip_slowly(const char* data, size_t offset, size_t length, Predicate in_run)
+	{
+		while (offset < length && in_run(data[offset])) {
+			++offset;
+		}
+		return offset;
+	}
+
+	bool is_whitespace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+	}
+
+	bool is_identifier(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+
+	bool is_digit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+}
+
+// Runs of every length up to a few vector widths, ended at every position, match a plain loop
+TEST(scanners_match_a_plain_loop)
+{
+	const char* fills[] = { " \t\n\r", "ab_Z09", "0123456789" };
+	const char enders[] = { 'x', '+', '"', '\x80' };
+
+	for (const auto* fill : fills) {
+		for (auto length = 0u; length < 100; ++length) {
+			for (auto ender : enders) {
+				for (auto end = 0u; end <= length; ++end) {
+					core::String data{};
+					for (auto i = 0u; i < length; ++i) {
+						data.push(i == end ? ender : fill[i % std::char_traits<char>::length(fill)]);
+					}
+
+					const auto* bytes = data.c_str();
+					for (auto offset : { 0u, 1u }) {
+						if (offset > length) {
+							continue;
+						}
+						EXPECT(scan::skip_whitespace(bytes, offset, length) == skip_slowly(bytes, offset, length, is_whitespace));
+						EXPECT(scan::skip_identifier(bytes, offset, length) == skip_slowly(bytes, offset, length, is_identifier));
+						EXPECT(scan::skip_digits(bytes, offset, length) == skip_slowly(bytes, offset, length, is_digit));
+						EXPECT(scan::find(bytes, offset, length, ender) == skip_slowly(bytes, offset, length, [&](char c) { return c != ender; }));
+						EXPECT(scan::find_any_of(bytes, offset, length, ender, '\\') == skip_slowly(bytes, offset, length, [&](char c) { return c != ender && c != '\\'; }));
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST(count_matches_a_plain_loop)
+{
+	core::String data{};
+	for (auto i = 0u; i < 200; ++i) {
+		data.push(i % 7 == 0 ? '\n' : 'a');
+	}
+
+	for (auto offset = 0u; offset < 40; ++offset) {
+		size_t expected{};
+		for (auto i = offset; i < data.length(); ++i) {
+			expected += data.c_str()[i] == '\n';
+		}
+		EXPECT(scan::count(data.c_str(), offset, data.length(), '\n') == expected);
+	}
+}
+
+TEST(lexes_runs_into_whole_tokens)
+{
+	auto lexer = Lexer::lex("var long_identifier_name_of_more_than_thirty_two_bytes = 1234567890123 + 1.5;");
+	const auto& tokens = lexer->tokens();
+
+	EXPECT(tokens.size() == 7);
+	EXPECT(tokens[0].is_keyword(Keyword::Var));
+	EXPECT(tokens[1].is_identifier());
+	EXPECT(tokens[1].content() == "long_identifier_name_of_more_than_thirty_two_bytes");
+	EXPECT(tokens[3].is_integer());
+	EXPECT(tokens[3].content() == "1234567890123");
+	EXPECT(tokens[5].is_floating_point_number());
+	EXPECT(tokens[5].content() == "1.5");
+}
+
+TEST(block_comments_end_at_the_first_close)
+{
+	auto lexer = Lexer::lex("a /* b * c / d \n * e */ f");
+	const auto& tokens = lexer->tokens();
+
+	EXPECT(tokens.size() == 2);
+	EXPECT(tokens[0].content() == "a");
+	EXPECT(tokens[1].content() == "f");
+}
+
+TEST(strings_and_comments_keep_their_lines)
+{
+	auto lexer = Lexer::lex("// first\n'two\nlines' 'it\\'s'\n\n  last");
+	const auto& tokens = lexer->tokens();
+
+	EXPECT(tokens.size() == 3);
+	EXPECT(tokens[0].content() == "two\nlines");
+	EXPECT(tokens[1].content() == "it's");
+	EXPECT(tokens[2].content() == "last");
+
+	auto position = lexer->line_table().position(tokens[2].offset());
+	EXPECT(position.row() == 4);
+	EXPECT(position.column() == 2);
+}
+
+TEST(line_table_resolves_offsets)
+{
+	LineTable table{ core::StringView{ "ab\n\ncd\n" } };
+
+	EXPECT(table.line_count() == 4);
+	EXPECT(table.position(0).row() == 0);
+	EXPECT(table.position(2).row() == 0);
+	EXPECT(table.position(2).column() == 2);
+	EXPECT(table.position(3).row() == 1);
+	EXPECT(table.position(3).column() == 0);
+	EXPECT(table.position(5).row() == 2);
+	EXPECT(table.position(5).column() == 1);
+	EXPECT(table.to_string({ 4, 7 }) == "2:0-3:0");
+}
+
+TEST(parse_errors_point_at_their_token)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+
+	try {
+		env->eval("var a = 1;\n  var = 2;");
+		throw tests::Failure(__FILE__, __LINE__, "parsed a var without a name");
+	}
+	catch (const ParseError& error) {
+		EXPECT(error.position().has_value());
+		EXPECT(error.position().value().row() == 1);
+		EXPECT(error.position().value().column() == 6);
+		EXPECT(core::String{ error.what() }.contains("at 1:6,"));
+		EXPECT(error.content() == "=");
+		EXPECT(error.source_range().offset() == 17);
+	}
+
+	auto lexer = Lexer::lex("var = 2;");
+	EXPECT_THROWS(Parser{}.parse(lexer->tokens()), ParseError);
+	try {
+		Parser{}.parse(*lexer);
+		throw tests::Failure(__FILE__, __LINE__, "parsed a var without a name");
+	}
+	catch (const ParseError& error) {
+		EXPECT(error.position().value().column() == 4);
+	}
+}
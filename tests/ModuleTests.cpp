@@ -0,0 +1,81 @@
+#include <filesystem>
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/core/ScopeExit.h"
+#include "ysen/fs/io.h"
+#include "ysen/lang/ModuleCache.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	// A directory of modules in the temp directory, removed again with the object
+	class ModuleDirectory
+	{
+	public:
+		explicit ModuleDirectory(const char* name)
+			: m_path(std::filesystem::temp_directory_path() / name)
+		{
+			std::filesystem::create_directories(m_path);
+		}
+
+		~ModuleDirectory()
+		{
+			std::error_code error{};
+			std::filesystem::remove_all(m_path, error);
+		}
+
+		// Forward slashes, so that the path can go into a script's string as is
+		core::String path(const char* filename) const
+		{
+			return (m_path / filename).generic_string().c_str();
+		}
+
+		void write(const char* filename, const char* code) const
+		{
+			EXPECT(fs::write_file(path(filename), code));
+		}
+	private:
+		std::filesystem::path m_path{};
+	};
+
+}
+
+TEST(modules_load_once_with_what_they_require)
+{
+	ModuleDirectory directory{ "ysen_module_test" };
+	directory.write("math.ys", "fun square(x) { ret x * x; } var base = 10;");
+	directory.write("geometry.ys", "require 'math.ys'; fun area(x) { ret square(x) + base; }");
+
+	ModuleCache cache{ 2 };
+	auto script = core::format("require '{}'; ret area(3);", directory.path("geometry.ys"));
+
+	auto first = core::adopt_nonnull(new ScriptEnvironment(ParserOptions{}, cache));
+	EXPECT(first->eval(script)->cast<int>() == 19);
+	EXPECT(cache.size() == 2);
+
+	auto geometry = cache.find(ModuleCache::resolve(directory.path("geometry.ys")));
+	EXPECT(geometry);
+	EXPECT(geometry->dependencies().size() == 1);
+	EXPECT(geometry->dependencies()[0]->path() == ModuleCache::resolve(directory.path("math.ys")));
+
+	auto second = core::adopt_nonnull(new ScriptEnvironment(ParserOptions{}, cache));
+	EXPECT(second->eval(script)->cast<int>() == 19);
+	EXPECT(cache.size() == 2);
+	EXPECT(cache.find(ModuleCache::resolve(directory.path("geometry.ys"))).ptr() == geometry.ptr());
+}
+
+TEST(cyclic_requires_are_rejected)
+{
+	ModuleDirectory directory{ "ysen_cycle_test" };
+	directory.write("a.ys", "require 'b.ys'; fun a() { ret 1; }");
+	directory.write("b.ys", "require 'a.ys'; fun b() { ret 2; }");
+
+	ModuleCache cache{ 2 };
+	auto env = core::adopt_nonnull(new ScriptEnvironment(ParserOptions{}, cache));
+	EXPECT_THROWS(env->eval(core::format("require '{}'; ret a();", directory.path("a.ys"))), ModuleError);
+	EXPECT(cache.size() == 0);
+}
@@ -0,0 +1,83 @@
+#include <span>
+#include <string_view>
+#include <vector>
+#include "Test.h"
+#include "ysen/core/SharedPtr.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	astvm::ValuePtr execute(astvm::Interpreter& vm, const char* code)
+	{
+		auto lexer = Lexer::lex(code);
+		return vm.execute(Parser{}.parse(lexer->tokens()));
+	}
+
+}
+
+TEST(natives_convert_their_arguments)
+{
+	astvm::Interpreter vm{};
+	vm.add(astvm::function("add", [](int a, int b) { return a + b; }));
+	vm.add(astvm::function("length", [](std::string_view string) { return static_cast<int>(string.length()); }));
+	vm.add(astvm::function("view_length", [](core::StringView string) { return static_cast<int>(string.length()); }));
+	vm.add(astvm::function("sum", [](std::span<const astvm::Value> values) {
+		auto sum = 0;
+		for (const auto& value : values) {
+			sum += value.cast<int>();
+		}
+		return sum;
+	}));
+	vm.add(astvm::function("six", [](int a, int b, int c, int d, int e, int f) { return a + b + c + d + e + f; }));
+
+	auto result = execute(vm, R"(
+var total = 0;
+var name = 'native';
+for (var i : 1..100) {
+	total = add(total, i);
+}
+ret total + length(name) + view_length(1234) + sum([1, 2, 3]) + six(1, 2, 3, 4, 5, 6);
+)");
+	EXPECT(result->cast<int>() == 5050 + 6 + 4 + 6 + 21);
+}
+
+TEST(natives_get_strings_and_arrays_by_reference)
+{
+	const core::String* seen_string{};
+	const astvm::Value::Array* seen_array{};
+	auto native = astvm::function("look", [&](const core::String& string, const astvm::Value::Array& array) {
+		seen_string = &string;
+		seen_array = &array;
+		return 0;
+	});
+
+	std::vector<astvm::Value> arguments{ astvm::Value{ core::String{ "text" } }, astvm::Value{ astvm::Value::Array{ astvm::Value{ core::String{ "a" } } } } };
+	astvm::Interpreter vm{};
+	native->invoke(vm, arguments);
+
+	EXPECT(seen_string == &arguments[0].string());
+	EXPECT(seen_array == &arguments[1].array());
+}
+
+TEST(natives_reject_missing_arguments)
+{
+	astvm::Interpreter vm{};
+	vm.add(astvm::function("add", [](int a, int b) { return a + b; }));
+
+	EXPECT_THROWS(execute(vm, "ret add(1);"), std::out_of_range);
+}
+
+TEST(script_functions_cast_to_callables)
+{
+	astvm::Interpreter vm{};
+	execute(vm, "fun scale(x, factor) { ret x * factor; }");
+	auto scale = vm.current_scope()->find_function("scale");
+
+	EXPECT(scale->cast<int(int, int)>(vm)(6, 7) == 42);
+}
@@ -0,0 +1,74 @@
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/core/ThreadPool.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	constexpr auto WORK = R"(
+fun work(n) {
+	var total = 0;
+	for (var i : 1..40) total = total + (n * i) / 7;
+	ret total;
+}
+)";
+
+	astvm::ValuePtr eval(const core::String& code)
+	{
+		auto env = core::adopt_nonnull(new ScriptEnvironment);
+		return env->eval(code);
+	}
+
+	// On a pool of its own, so that the loop is split however many cores there are
+	astvm::ValuePtr run_on_pool(const core::String& code)
+	{
+		core::ThreadPool pool{ 3 };
+		astvm::Interpreter vm{};
+		vm.set_thread_pool(&pool);
+		auto lexer = Lexer::lex(code);
+		return vm.execute(Parser{}.parse(lexer->tokens()));
+	}
+
+}
+
+TEST(parallel_loops_match_sequential_loops)
+{
+	auto sequential = eval(core::String{ WORK } + "var sum = 0; for (var x : 1..2000) sum = sum + work(x); ret sum;");
+	auto parallel = run_on_pool(core::String{ WORK } + "ret parallel(+) for (var x : 1..2000) work(x);");
+	EXPECT(parallel->cast<int>() == sequential->cast<int>());
+
+	auto values = run_on_pool("var xs = [3, 1, 2]; ret parallel for (var x : xs) x * 10;");
+	EXPECT(values->to_formatted_string() == eval("ret [30, 10, 20];")->to_formatted_string());
+}
+
+TEST(parallel_loops_are_expressions)
+{
+	EXPECT(eval("var product = parallel(*) for (var x : 1..5) x; ret product;")->cast<int>() == 120);
+	EXPECT(eval("fun f() { ret parallel(*) for (var x : 1..5) x; } ret f() + 1;")->cast<int>() == 121);
+}
+
+TEST(parallel_is_still_an_identifier)
+{
+	EXPECT(eval("var parallel = 3; ret parallel + 1;")->cast<int>() == 4);
+	EXPECT(eval("fun parallel(x) { ret x * 2; } ret parallel(21);")->cast<int>() == 42);
+}
+
+TEST(parallel_bodies_cant_leave_or_write_shared_variables)
+{
+	EXPECT_THROWS(eval("fun f() { parallel for (var x : 1..5) { ret x; } } ret f();"), ParseError);
+	EXPECT(eval("ret parallel(+) for (var x : 1..3) { var g = fun(y) { ret y + 1; }; g(x); };")->cast<int>() == 9);
+	EXPECT_THROWS(run_on_pool("var total = 0; parallel for (var x : 1..100) total = total + x;"), astvm::SharedVariableWrite);
+}
+
+TEST(loops_over_non_iterables_throw)
+{
+	EXPECT_THROWS(eval("parallel for (var x : 5) x;"), astvm::NotIterable);
+	EXPECT_THROWS(eval("for (var x : 5) x;"), astvm::NotIterable);
+}
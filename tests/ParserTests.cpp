@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/core/SharedPtr.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	ast::ProgramPtr parse(const char* code, ParserOptions options = {})
+	{
+		return Parser{ options }.parse(core::adopt_shared(Lexer::lex(code).release()));
+	}
+
+	const ast::FunctionDeclarationStatement& function(const ast::ProgramPtr& program, size_t index)
+	{
+		return static_cast<const ast::FunctionDeclarationStatement&>(*program->children()[index]);
+	}
+
+	constexpr auto FUNCTIONS = R"(
+fun add(a, b) { ret a + b; }
+fun apply(x) {
+	var inner = fun(y) { ret y * 3; };
+	ret inner(add(x, 1));
+}
+ret apply(4);
+)";
+
+}
+
+TEST(lazy_bodies_are_parsed_on_first_call)
+{
+	auto program = parse(FUNCTIONS, ParserOptions{ true });
+	EXPECT(!function(program, 0).is_body_parsed());
+	EXPECT(!function(program, 1).is_body_parsed());
+
+	auto eager = core::adopt_nonnull(new ScriptEnvironment);
+	auto lazy = core::adopt_nonnull(new ScriptEnvironment(ParserOptions{ true }));
+	EXPECT(eager->eval(FUNCTIONS)->cast<int>() == 15);
+	EXPECT(lazy->eval(FUNCTIONS)->cast<int>() == 15);
+}
+
+TEST(lazy_bodies_report_syntax_errors_when_used)
+{
+	constexpr auto broken = "fun broken() { ret 1 +; } var fine = 2;";
+
+	auto program = parse(broken, ParserOptions{ true });
+	EXPECT(!function(program, 0).is_body_parsed());
+	EXPECT_THROWS(function(program, 0).body(), ParseError);
+
+	EXPECT_THROWS(parse(broken, ParserOptions{ true, true }), ParseError);
+	EXPECT_THROWS(parse(broken), ParseError);
+}
+
+TEST(lazy_bodies_are_parsed_once_across_threads)
+{
+	auto program = parse(FUNCTIONS, ParserOptions{ true });
+	const auto& add = function(program, 0);
+
+	std::vector<ast::ExpressionPtr> bodies(8);
+	std::vector<std::thread> threads{};
+	for (auto& body : bodies) {
+		threads.emplace_back([&add, &body]() {
+			if (!add.is_body_parsed()) {
+				body = add.body();
+			}
+			body = add.body();
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT(add.is_body_parsed());
+	EXPECT(std::all_of(bodies.begin(), bodies.end(), [&](auto body) { return body == bodies[0]; }));
+}
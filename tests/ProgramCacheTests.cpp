@@ -0,0 +1,74 @@
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ProgramCache.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	ast::ProgramPtr parse(const char* code)
+	{
+		auto lexer = Lexer::lex(code);
+		return Parser{}.parse(lexer->tokens());
+	}
+
+}
+
+TEST(repeated_evals_hit_the_program_cache)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	env->eval("var counter = 0;");
+	env->program_cache().reset_statistics();
+
+	for (auto i = 1; i <= 3; ++i) {
+		EXPECT(env->eval("counter = counter + 1; ret counter;")->cast<int>() == i);
+	}
+
+	EXPECT(env->program_cache().misses() == 1);
+	EXPECT(env->program_cache().hits() == 2);
+}
+
+TEST(program_cache_only_returns_the_same_source)
+{
+	ProgramCache cache{};
+	auto program = parse("ret 1;");
+	cache.insert("ret 1;", program);
+
+	EXPECT(cache.find("ret 1;").ptr() == program.ptr());
+	EXPECT(!cache.find("ret 2;"));
+	EXPECT(cache.invalidate("ret 1;"));
+	EXPECT(!cache.find("ret 1;"));
+	EXPECT(cache.size() == 0);
+	EXPECT(cache.bytes() == 0);
+}
+
+TEST(program_cache_evicts_the_least_recently_used)
+{
+	ProgramCache cache{ 2 };
+	cache.insert("a;", parse("a;"));
+	cache.insert("b;", parse("b;"));
+	cache.find("a;");
+	cache.insert("c;", parse("c;"));
+
+	EXPECT(cache.size() == 2);
+	EXPECT(cache.evictions() == 1);
+	EXPECT(cache.find("a;"));
+	EXPECT(!cache.find("b;"));
+	EXPECT(cache.find("c;"));
+}
+
+TEST(functions_outlive_their_evicted_program)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	env->program_cache().set_limits(1, ProgramCache::DEFAULT_MAX_BYTES);
+	env->eval("fun twice(x) { ret x * 2; }");
+	env->eval("var other = 1;");
+
+	EXPECT(env->program_cache().evictions() == 1);
+	EXPECT(env->eval("ret twice(21);")->cast<int>() == 42);
+}
@@ -0,0 +1,15 @@
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+TEST(evals_after_a_top_level_ret_run_every_statement)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	EXPECT(env->eval("var data = [1, 2, 3]; ret 0;")->cast<int>() == 0);
+	EXPECT(env->eval("var total = 0; for (var x : data) total = total + x; ret total;")->cast<int>() == 6);
+	EXPECT(env->eval("var doubled = total * 2; ret doubled;")->cast<int>() == 12);
+}
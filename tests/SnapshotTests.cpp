@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/core/ScopeExit.h"
+#include "ysen/lang/Lexer.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/Snapshot.h"
+#include "ysen/lang/astvm/Interpreter.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	constexpr auto DECLARATIONS = R"(
+var count = 3;
+var name = 'snapshot';
+var values = [1, 2, 3];
+var settings = ['depth': 2, 'label': 'deep'];
+var triple = fun(x) { ret x * 3; };
+fun describe(x) {
+	if (x > count) {
+		ret name + ' ' + x;
+	}
+	ret triple(x) + settings.depth;
+}
+)";
+
+	astvm::ValuePtr execute(astvm::Interpreter& interpreter, const char* code)
+	{
+		auto lexer = Lexer::lex(code);
+		return interpreter.execute(Parser{}.parse(lexer->tokens()));
+	}
+
+}
+
+TEST(snapshots_declare_what_was_saved)
+{
+	astvm::Interpreter original{};
+	execute(original, DECLARATIONS);
+	auto data = Snapshot::serialize(original);
+
+	astvm::Interpreter restored{};
+	Snapshot::deserialize(restored, data.data(), data.size());
+
+	EXPECT(execute(restored, "ret describe(2);")->cast<int>() == 2 * 3 + 2);
+	EXPECT(execute(restored, "ret describe(5);")->to_formatted_string() == execute(original, "ret describe(5);")->to_formatted_string());
+	EXPECT(execute(restored, "ret values;")->to_formatted_string() == execute(original, "ret values;")->to_formatted_string());
+	EXPECT(execute(restored, "ret settings.label;")->cast<core::String>() == "deep");
+}
+
+TEST(snapshot_files_round_trip)
+{
+	auto filename = (std::filesystem::temp_directory_path() / "ysen_snapshot_test.bin").string();
+	core::ScopeExit remove_file{ [&]() { std::remove(filename.c_str()); } };
+
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	env->eval(DECLARATIONS);
+	EXPECT(env->save_snapshot(filename.c_str()));
+
+	auto restored = core::adopt_nonnull(new ScriptEnvironment);
+	EXPECT(restored->restore_snapshot(filename.c_str()));
+	EXPECT(restored->eval("ret describe(1);")->cast<int>() == 3 + 2);
+}
+
+TEST(restoring_checks_the_snapshot)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	EXPECT(!env->restore_snapshot("no_such_snapshot.bin"));
+
+	astvm::Interpreter interpreter{};
+	std::vector<char> garbage(64, 'x');
+	EXPECT_THROWS(Snapshot::deserialize(interpreter, garbage.data(), garbage.size()), SnapshotError);
+
+	astvm::Interpreter original{};
+	execute(original, DECLARATIONS);
+	auto data = Snapshot::serialize(original);
+	for (auto size : { size_t{ 0 }, size_t{ 7 }, data.size() / 2, data.size() - 1 }) {
+		EXPECT_THROWS(Snapshot::deserialize(interpreter, data.data(), size), SnapshotError);
+	}
+}
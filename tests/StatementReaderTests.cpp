@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstring>
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/fs/InputReader.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/StatementReader.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	// Hands out a few bytes per read, so statements, tokens and comments get cut anywhere
+	class TrickleReader : public fs::InputReader
+	{
+	public:
+		TrickleReader(core::String string, size_t step)
+			: m_string(std::move(string)), m_step(step)
+		{}
+
+		size_t read(char* buffer, size_t capacity) override
+		{
+			auto count = std::min({ capacity, m_step, m_string.length() - m_cursor });
+			std::memcpy(buffer, m_string.c_str() + m_cursor, count);
+			m_cursor += count;
+			return count;
+		}
+	private:
+		core::String m_string{};
+		size_t m_step{};
+		size_t m_cursor{};
+	};
+
+	core::String generate_statements(size_t count)
+	{
+		core::String code{ "var total = 0;\n" };
+		for (auto i = 0u; i < count; ++i) {
+			code.append(core::format(R"(
+/* statement
+   {} */
+fun add_{}(x) { ret x + {}; }
+total = add_{}(total); // running total
+)", i, i, i, i));
+		}
+		code.append("ret total;");
+		return code;
+	}
+
+	size_t count_statements(StatementReader& reader)
+	{
+		size_t statements{};
+		while (auto program = reader.next()) {
+			statements += program->children().size();
+		}
+		return statements;
+	}
+
+}
+
+TEST(statements_cut_anywhere_read_like_the_whole_input)
+{
+	auto code = generate_statements(100);
+	auto lexer = Lexer::lex(code);
+	auto expected = Parser{}.parse(lexer->tokens())->children().size();
+
+	for (auto step : { 1u, 7u, 64u }) {
+		TrickleReader input{ code, step };
+		StatementReader reader{ input };
+		EXPECT(count_statements(reader) == expected);
+	}
+}
+
+TEST(statement_reader_buffers_only_what_it_hasnt_returned)
+{
+	auto code = generate_statements(10000);
+	EXPECT(code.length() > 8 * StatementReader::CHUNK_SIZE);
+
+	fs::StringReader input{ code };
+	StatementReader reader{ input };
+	size_t max_buffered{};
+	while (auto program = reader.next()) {
+		max_buffered = std::max(max_buffered, reader.buffered());
+	}
+	EXPECT(max_buffered <= 2 * StatementReader::CHUNK_SIZE);
+}
+
+TEST(streamed_evals_match_whole_evals)
+{
+	auto code = generate_statements(300);
+	auto whole = core::adopt_nonnull(new ScriptEnvironment);
+	auto streamed = core::adopt_nonnull(new ScriptEnvironment);
+	TrickleReader input{ code, 13 };
+
+	EXPECT(whole->eval(code)->cast<int>() == 299 * 300 / 2);
+	EXPECT(streamed->eval_stream(input)->cast<int>() == 299 * 300 / 2);
+}
+
+TEST(streamed_syntax_errors_stand_once_the_input_is_read)
+{
+	TrickleReader input{ "var a = 1; var b = ;", 3 };
+	StatementReader reader{ input };
+
+	EXPECT(reader.next());
+	EXPECT_THROWS(reader.next(), ParseError);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <exception>
+#include <vector>
+#include "ysen/core/format.h"
+#include "ysen/core/String.h"
+
+namespace ysen::tests {
+
+	// Thrown by a failed EXPECT, ends the test it is in
+	class Failure : public std::exception
+	{
+	public:
+		Failure(const char* file, int line, const core::String& message)
+			: m_message(core::format("{}:{}: {}", file, line, message))
+		{}
+
+		char const* what() const override
+		{
+			return m_message.c_str();
+		}
+	private:
+		core::String m_message{};
+	};
+
+	struct TestCase
+	{
+		const char* name{};
+		void (*run)() {};
+	};
+
+	// Every TEST of the program, in no particular order
+	std::vector<TestCase>& test_cases();
+
+	struct Registration
+	{
+		Registration(const char* name, void (*run)())
+		{
+			test_cases().push_back({ name, run });
+		}
+	};
+
+}
+
+#define TEST(name) \
+	static void name(); \
+	static ysen::tests::Registration name##_registration{ #name, &name }; \
+	static void name()
+
+#define EXPECT(condition) \
+	do { \
+		if (!(condition)) { \
+			throw ysen::tests::Failure(__FILE__, __LINE__, #condition); \
+		} \
+	} while (false)
+
+#define EXPECT_THROWS(statement, Exception) \
+	do { \
+		bool thrown{}; \
+		try { \
+			statement; \
+		} \
+		catch (const Exception&) { \
+			thrown = true; \
+		} \
+		if (!thrown) { \
+			throw ysen::tests::Failure(__FILE__, __LINE__, #statement " didn't throw " #Exception); \
+		} \
+	} while (false)
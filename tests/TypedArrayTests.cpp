@@ -0,0 +1,107 @@
+#include <stdexcept>
+#include <utility>
+#include "Test.h"
+#include "ysen/core/NonnullOwnPtr.h"
+#include "ysen/lang/ScriptEnvironment.h"
+#include "ysen/lang/astvm/TypedArray.h"
+#include "ysen/lang/astvm/Value.h"
+
+using namespace ysen;
+using namespace ysen::lang;
+
+namespace {
+
+	astvm::ValuePtr eval(const char* code)
+	{
+		auto env = core::adopt_nonnull(new ScriptEnvironment);
+		env->eval("var xs = [3, 1, 2];");
+		return env->eval(code);
+	}
+
+	bool same(const char* code, const char* expected)
+	{
+		return eval(code)->to_formatted_string() == eval(expected)->to_formatted_string();
+	}
+
+}
+
+TEST(arrays_of_numbers_are_packed_wherever_they_are_made)
+{
+	EXPECT(eval("ret xs;")->is_packed());
+	EXPECT(eval("ret sort(xs);")->is_packed());
+	EXPECT(eval("ret map(xs, fun(x) { ret 1.5 * x; });")->packed()->element_type() == astvm::ElementType::Float);
+	EXPECT(!eval("ret ['a', 'b'];")->is_packed());
+	EXPECT(!eval("ret [1, 'b'];")->is_packed());
+}
+
+TEST(operators_apply_elementwise_to_any_array_of_numbers)
+{
+	EXPECT(same("ret xs * 2;", "ret [6, 2, 4];"));
+	EXPECT(same("ret sort(xs) * 2;", "ret [2, 4, 6];"));
+	EXPECT(same("ret map(xs, fun(x) { ret x * x; }) + 1;", "ret [10, 2, 5];"));
+	EXPECT(same("ret 10 - xs;", "ret [7, 9, 8];"));
+	EXPECT(same("ret xs + xs;", "ret [6, 2, 4];"));
+	EXPECT(same("ret xs / 0;", "ret [0, 0, 0];"));
+	EXPECT(same("ret [1.5, 2.5] * 2;", "ret [3.0, 5.0];"));
+
+	auto greater = eval("ret xs > 1;");
+	EXPECT(greater->packed()->element_type() == astvm::ElementType::Bool);
+	EXPECT(greater->array()[0].cast<bool>());
+	EXPECT(!greater->array()[1].cast<bool>());
+	EXPECT(greater->array()[2].cast<bool>());
+}
+
+TEST(elementwise_operators_reject_what_they_cant_apply)
+{
+	EXPECT_THROWS(eval("ret xs + [1, 2];"), std::invalid_argument);
+	EXPECT_THROWS(eval("ret ['a', 'b'] * 2;"), astvm::BadValueCast);
+}
+
+TEST(packed_sums_match_a_loop)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	env->eval("var xs = 1..1000;");
+
+	auto looped = env->eval("var total = 0; for (var x : xs) total = total + x * x; ret total;")->cast<int>();
+	EXPECT(looped == 333833500);
+	EXPECT(env->eval("ret sum(xs * xs);")->cast<int>() == looped);
+	EXPECT(env->eval("ret dot(xs, xs);")->cast<double>() == looped);
+	EXPECT(env->eval("ret min(xs);")->cast<int>() == 1);
+	EXPECT(env->eval("ret max(xs);")->cast<int>() == 1000);
+}
+
+TEST(writing_an_array_unpacks_it)
+{
+	astvm::Value value{ astvm::Value::Array{ astvm::Value{ 1 }, astvm::Value{ 2 } } };
+	auto copy = value;
+	EXPECT(value.is_packed());
+
+	value.array().push_back(astvm::Value{ core::String{ "three" } });
+	EXPECT(!value.is_packed());
+	EXPECT(value.array().size() == 3);
+	EXPECT(copy.is_packed());
+	EXPECT(copy.array().size() == 2);
+}
+
+TEST(reading_an_array_leaves_it_packed)
+{
+	auto env = core::adopt_nonnull(new ScriptEnvironment);
+	env->eval("var xs = [1.5, 2.5, 3.5];");
+
+	EXPECT(env->eval("var total = 0.0; for (var x : xs) total = total + x; ret total;")->cast<double>() == 7.5);
+	EXPECT(env->eval("ret sum(map(xs, fun(x) { ret x * 2; }));")->cast<double>() == 15.0);
+	auto xs = env->eval("ret xs;");
+	EXPECT(xs->is_packed());
+	EXPECT(std::as_const(*xs).array_size() == 3);
+	EXPECT(std::as_const(*xs).array_at(1).cast<double>() == 2.5);
+	EXPECT(std::as_const(*xs).to_formatted_string() == "[1.500000, 2.500000, 3.500000,]");
+	EXPECT(xs->is_packed());
+
+	const astvm::Value& value = *xs;
+	{
+		auto elements = value.array();
+		EXPECT(elements.size() == 3);
+		EXPECT(elements[2].cast<double>() == 3.5);
+	}
+	EXPECT(value.is_packed());
+}
@@ -0,0 +1,29 @@
+#include <exception>
+#include "Test.h"
+#include "ysen/core/format.h"
+
+std::vector<ysen::tests::TestCase>& ysen::tests::test_cases()
+{
+	static std::vector<TestCase> cases{};
+	return cases;
+}
+
+int main()
+{
+	using namespace ysen;
+
+	auto failed = 0u;
+	for (const auto& test : tests::test_cases()) {
+		try {
+			test.run();
+		}
+		catch (const std::exception& error) {
+			++failed;
+			core::println("FAIL {}: {}", test.name, error.what());
+		}
+	}
+
+	auto count = static_cast<unsigned int>(tests::test_cases().size());
+	core::println("{} of {} tests passed", count - failed, count);
+	return failed == 0 ? 0 : 1;
+}
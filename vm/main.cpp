@@ -10,6 +10,7 @@
 #include <ysen/fs/io.h>
 #include <ysen/lang/Lexer.h>
 #include <ysen/lang/ast/node.h>
+#include "ysen/lang/ast/ConstantFolder.h"
 #include "ysen/lang/Parser.h"
 #include "ysen/lang/astvm/Interpreter.h"
 #include "ysen/lang/astvm/Value.h"
@@ -17,17 +18,21 @@
 #include "ysen/lang/ScriptEnvironment.h"
 #include "ysen/lang/bytecode/BytecodeInterpreter.h"
 #include "ysen/lang/bytecode/Instruction.h"
+#include "ysen/lang/ir/Compiler.h"
 
 using namespace ysen;
 using namespace ysen::lang;
 
-void bytecode_test(const char* code)
+void bytecode_test(const char* code, const ir::PassOptions& options = {})
 {
 	bytecode::Generator generator;
 	auto lexer = Lexer::lex(code);
 	Parser p;
-	auto node = p.parse(lexer->tokens());
-	node->generate_bytecode(generator);
+	auto node = p.parse(*lexer);
+	ast::ConstantFolder::fold(*node);
+	if (auto unsupported = ir::compile(*node, generator, options); unsupported.has_value()) {
+		core::println("Generated from the AST, {}", unsupported.value());
+	}
 
 	bytecode::BytecodeInterpreter interpreter;
 	auto result = interpreter.execute(generator.program());
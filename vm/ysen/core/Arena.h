@@ -0,0 +1,130 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace ysen::core {
+
+	// Bump allocator for objects which all die together. Memory comes in
+	// chunks, each one at least twice the size of the previous, and objects
+	// are laid out in allocation order. Destructors of non-trivial objects
+	// run in reverse allocation order when the arena goes away; nothing is
+	// ever freed individually.
+	class Arena
+	{
+	public:
+		explicit Arena(size_t initial_capacity = 16 * 1024);
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+		~Arena();
+
+		template<typename T, typename...Args>
+		T* make(Args&&...args);
+
+		void* allocate(size_t size, size_t alignment);
+
+		// Bytes handed out so far, and the number of chunks backing them
+		size_t size() const { return m_size; }
+		size_t chunk_count() const { return m_chunk_count; }
+	private:
+		struct Chunk
+		{
+			Chunk* previous;
+			size_t capacity;
+		};
+
+		// Kept in the arena itself, right before the object it destroys
+		struct Finalizer
+		{
+			void (*destroy)(void*);
+			void* object;
+			Finalizer* next;
+		};
+
+		void grow(size_t minimum);
+
+		Chunk* m_chunk{};
+		char* m_cursor{};
+		char* m_end{};
+		Finalizer* m_finalizers{};
+		size_t m_size{};
+		size_t m_chunk_count{};
+		size_t m_next_capacity{};
+	};
+
+	inline Arena::Arena(size_t initial_capacity)
+		: m_next_capacity(initial_capacity)
+	{}
+
+	inline Arena::~Arena()
+	{
+		for (auto* finalizer = m_finalizers; finalizer; finalizer = finalizer->next) {
+			finalizer->destroy(finalizer->object);
+		}
+
+		while (m_chunk) {
+			auto* previous = m_chunk->previous;
+			std::free(m_chunk);
+			m_chunk = previous;
+		}
+	}
+
+	template<typename T, typename...Args>
+	T* Arena::make(Args&&...args)
+	{
+		Finalizer* finalizer{};
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			finalizer = static_cast<Finalizer*>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+		}
+
+		auto* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			finalizer->destroy = [](void* object) { static_cast<T*>(object)->~T(); };
+			finalizer->object = object;
+			finalizer->next = m_finalizers;
+			m_finalizers = finalizer;
+		}
+
+		return object;
+	}
+
+	inline void* Arena::allocate(size_t size, size_t alignment)
+	{
+		auto aligned = [&] {
+			auto address = reinterpret_cast<uintptr_t>(m_cursor);
+			return reinterpret_cast<char*>((address + alignment - 1) & ~(alignment - 1));
+		};
+
+		if (!m_chunk || aligned() + size > m_end) {
+			grow(size + alignment);
+		}
+
+		auto* memory = aligned();
+		m_cursor = memory + size;
+		m_size += size;
+		return memory;
+	}
+
+	inline void Arena::grow(size_t minimum)
+	{
+		auto capacity = m_next_capacity > minimum ? m_next_capacity : minimum;
+		m_next_capacity = capacity * 2;
+
+		auto* chunk = static_cast<Chunk*>(std::malloc(sizeof(Chunk) + capacity));
+		if (!chunk) {
+			throw std::bad_alloc{};
+		}
+
+		chunk->previous = m_chunk;
+		chunk->capacity = capacity;
+		m_chunk = chunk;
+		m_cursor = reinterpret_cast<char*>(chunk + 1);
+		m_end = m_cursor + capacity;
+		++m_chunk_count;
+	}
+
+}
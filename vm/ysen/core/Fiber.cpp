@@ -0,0 +1,140 @@
+#include "Fiber.h"
+
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	thread_local ysen::core::Fiber* t_current{};
+}
+
+#ifdef _WIN32
+struct ysen::core::Fiber::Context
+{
+	void* fiber{};
+	void* caller{};
+
+	static VOID CALLBACK entry(LPVOID parameter)
+	{
+		auto& fiber = *static_cast<Fiber*>(parameter);
+		run(fiber);
+		// Returning would end the thread
+		SwitchToFiber(fiber.m_context->caller);
+	}
+};
+#else
+struct ysen::core::Fiber::Context
+{
+	ucontext_t context{};
+	ucontext_t caller{};
+	void* stack{};
+	size_t stack_size{};
+
+	// Only ever started by resume(), which made the fiber current
+	static void entry()
+	{
+		auto& fiber = *t_current;
+		run(fiber);
+		setcontext(&fiber.m_context->caller);
+	}
+};
+#endif
+
+ysen::core::Fiber::Fiber(std::function<void()> body, size_t stack_size)
+	: m_body(std::move(body)), m_context(std::make_unique<Context>())
+{
+#ifdef _WIN32
+	// The stack is only reserved, pages are committed as it grows
+	m_context->fiber = CreateFiberEx(0, stack_size, FIBER_FLAG_FLOAT_SWITCH, &Context::entry, this);
+	if (!m_context->fiber) {
+		throw std::bad_alloc();
+	}
+#else
+	// Mapped, so that pages are only committed as the stack grows, with an inaccessible
+	// page below it that a stack overflow faults on instead of writing over the heap
+	auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	m_context->stack_size = (stack_size + page - 1) / page * page + page;
+	m_context->stack = mmap(nullptr, m_context->stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m_context->stack == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	mprotect(m_context->stack, page, PROT_NONE);
+
+	getcontext(&m_context->context);
+	m_context->context.uc_stack.ss_sp = m_context->stack;
+	m_context->context.uc_stack.ss_size = m_context->stack_size;
+	m_context->context.uc_link = nullptr;
+	makecontext(&m_context->context, &Context::entry, 0);
+#endif
+}
+
+ysen::core::Fiber::~Fiber()
+{
+#ifdef _WIN32
+	DeleteFiber(m_context->fiber);
+#else
+	munmap(m_context->stack, m_context->stack_size);
+#endif
+}
+
+void ysen::core::Fiber::resume()
+{
+	if (m_finished) {
+		return;
+	}
+
+	m_resumer = t_current;
+	t_current = this;
+#ifdef _WIN32
+	if (!IsThreadAFiber()) {
+		ConvertThreadToFiber(nullptr);
+	}
+	m_context->caller = GetCurrentFiber();
+	SwitchToFiber(m_context->fiber);
+#else
+	swapcontext(&m_context->caller, &m_context->context);
+#endif
+	t_current = std::exchange(m_resumer, nullptr);
+
+	if (m_exception) {
+		std::rethrow_exception(std::exchange(m_exception, nullptr));
+	}
+}
+
+void ysen::core::Fiber::suspend()
+{
+	auto fiber = t_current;
+	if (!fiber) {
+		return;
+	}
+
+#ifdef _WIN32
+	SwitchToFiber(fiber->m_context->caller);
+#else
+	swapcontext(&fiber->m_context->context, &fiber->m_context->caller);
+#endif
+}
+
+ysen::core::Fiber* ysen::core::Fiber::current()
+{
+	return t_current;
+}
+
+void ysen::core::Fiber::run(Fiber& fiber)
+{
+	try {
+		fiber.m_body();
+	}
+	catch (...) {
+		fiber.m_exception = std::current_exception();
+	}
+	fiber.m_finished = true;
+}
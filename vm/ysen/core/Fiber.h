@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+
+namespace ysen::core {
+
+	// A function running on a stack of its own, which can stop anywhere in it and
+	// continue later on the same thread. The interpreters recurse on the C++ stack, so
+	// a script waiting for a native has all of its frames kept this way.
+	class Fiber
+	{
+	public:
+		// Only reserved, pages are committed as the stack grows. A script function call
+		// nests a few KB deeper.
+		static constexpr size_t DEFAULT_STACK_SIZE = 1024 * 1024;
+
+		explicit Fiber(std::function<void()> body, size_t stack_size = DEFAULT_STACK_SIZE);
+		Fiber(const Fiber&) = delete;
+		Fiber& operator=(const Fiber&) = delete;
+		// A fiber destroyed before finishing never unwinds its stack
+		~Fiber();
+
+		// Runs the fiber until it suspends or its body returns, an exception thrown by
+		// the body is rethrown here
+		void resume();
+		bool is_finished() const { return m_finished; }
+
+		// Returns to the resume() that ran the current fiber
+		static void suspend();
+		// nullptr outside of any fiber
+		static Fiber* current();
+	private:
+		struct Context;
+
+		static void run(Fiber&);
+
+		std::function<void()> m_body{};
+		std::unique_ptr<Context> m_context{};
+		Fiber* m_resumer{};
+		bool m_finished{};
+		std::exception_ptr m_exception{};
+	};
+
+}
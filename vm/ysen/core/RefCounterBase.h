@@ -55,8 +55,8 @@ namespace ysen::core {
 	inline bool RefCounterBase::decrement()
 	{
 		if (!m_cnt) return true;
-		*m_cnt -= 1;
-		if (*m_cnt == 0) {
+		// One atomic step, with a separate load two owners on different threads could both see 0
+		if (--*m_cnt == 0) {
 			delete m_cnt;
 			m_cnt = nullptr;
 			return true;
@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <ostream>
 #include "fnv1a.h"
@@ -11,6 +13,7 @@ namespace ysen::core {
 
 	static String to_string(int);
 	static String to_string(unsigned int);
+	static String to_string(int64_t);
 	static String to_string(float);
 	static String to_string(double);
 	
@@ -120,8 +123,9 @@ namespace ysen::core {
 		T* m_buffer{nullptr};
 		size_t m_capacity{};
 		size_t m_length{};
-		mutable size_t m_hash{};
-		mutable bool m_hashed{};
+		// Cached by whichever thread hashes first, strings of shared code are hashed by several
+		mutable std::atomic<size_t> m_hash{};
+		mutable std::atomic<bool> m_hashed{};
 	};
 
 	template <typename T>
@@ -149,7 +153,7 @@ namespace ysen::core {
 		other.m_buffer = nullptr;
 		other.m_length = 0;
 		other.m_capacity = 0;
-		other.m_hashed = false;
+		other.m_hashed.store(false, std::memory_order_relaxed);
 	}
 
 	template <typename T>
@@ -165,7 +169,7 @@ namespace ysen::core {
 		m_buffer[m_length] = value;
 		m_buffer[m_length + 1] = 0;
 		++m_length;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 	}
 
 	template <typename T>
@@ -173,7 +177,7 @@ namespace ysen::core {
 	{
 		auto v = m_buffer[--m_length];
 		m_buffer[m_length] = 0;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 		return v;
 	}
 
@@ -185,7 +189,7 @@ namespace ysen::core {
 			m_buffer[i - 1] = m_buffer[i];
 		}
 		--m_length;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 		return v;
 	}
 
@@ -202,7 +206,7 @@ namespace ysen::core {
 		::memcpy(end(), buffer, length);
 		m_length += length;
 		*end() = 0;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 	}
 
 	template <typename T>
@@ -223,7 +227,7 @@ namespace ysen::core {
 		::memcpy(m_buffer, buffer, length - 1);
 		m_length += length;
 		*end() = 0;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 	}
 
 	template <typename T>
@@ -430,7 +434,7 @@ namespace ysen::core {
 		}
 
 		m_length = length;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 	}
 
 	template <typename T>
@@ -514,8 +518,8 @@ namespace ysen::core {
 	template <typename T>
 	size_t BasicString<T>::hash() const
 	{
-		if (m_hashed) {
-			return m_hash;
+		if (m_hashed.load(std::memory_order_acquire)) {
+			return m_hash.load(std::memory_order_relaxed);
 		}
 
 		return compute_hash();
@@ -527,7 +531,7 @@ namespace ysen::core {
 		ensure_capacity(length + 1);
 		::memcpy(m_buffer, buffer, length);
 		m_length = length;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 	}
 
 	template <typename T>
@@ -537,7 +541,7 @@ namespace ysen::core {
 			delete[] m_buffer;
 			m_capacity = m_length = 0;
 			m_buffer = nullptr;
-			m_hashed = false;
+			m_hashed.store(false, std::memory_order_relaxed);
 		}
 	}
 
@@ -565,7 +569,7 @@ namespace ysen::core {
 
 		m_buffer = buffer;
 		m_capacity = capacity;
-		m_hashed = false;
+		m_hashed.store(false, std::memory_order_relaxed);
 	}
 
 	template <typename T>
@@ -583,9 +587,10 @@ namespace ysen::core {
 			return 0;
 		}
 
-		m_hash = core::fnv1a(reinterpret_cast<const unsigned char*>(c_str()), length() * sizeof(T));
-		m_hashed = true;
-		return m_hash;
+		auto hash = core::fnv1a(reinterpret_cast<const unsigned char*>(c_str()), length() * sizeof(T));
+		m_hash.store(hash, std::memory_order_relaxed);
+		m_hashed.store(true, std::memory_order_release);
+		return hash;
 	}
 
 	static String to_string(int value)
@@ -602,6 +607,13 @@ namespace ysen::core {
 		return buffer;
 	}
 	
+	static String to_string(int64_t value)
+	{
+		char buffer[256]{0};
+		sprintf(buffer, "%lld", static_cast<long long>(value));
+		return buffer;
+	}
+	
 	static String to_string(float value)
 	{
 		char buffer[256]{0};
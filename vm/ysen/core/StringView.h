@@ -1,8 +1,11 @@
 #pragma once
+#include <charconv>
 #include <ysen/core/String.h>
 
 namespace ysen::core {
 
+	// Non-owning view into a character buffer which has to outlive it. Views
+	// into a larger buffer are not null terminated at length().
 	template<typename T>
 	class BasicStringView
 	{
@@ -11,10 +14,37 @@ namespace ysen::core {
 		BasicStringView(const BasicStringView&) = default;
 		BasicStringView(BasicStringView&&) = default;
 		BasicStringView(const T*);
+		BasicStringView(const T*, size_t);
 		BasicStringView(const BasicString<T>&);
 
+		BasicStringView& operator=(const BasicStringView&) = default;
+		BasicStringView& operator=(BasicStringView&&) = default;
+
+		bool empty() const { return m_length == 0; }
 		size_t length() const { return m_length; }
 		const T* c_str() const { return m_str; }
+		const T* begin() const { return m_str; }
+		const T* end() const { return m_str + m_length; }
+
+		T at(size_t i) const { return m_str[i]; }
+		BasicStringView substr(size_t offset, size_t length) const { return { m_str + offset, length }; }
+		bool contains(T) const;
+
+		bool operator==(const T*) const;
+		bool operator==(const BasicStringView&) const;
+		bool operator!=(const T* s) const { return !(*this == s); }
+		bool operator!=(const BasicStringView& s) const { return !(*this == s); }
+
+		template<typename...Ts>
+		bool is_equal_to_any_of(const Ts&...ts) const
+		{
+			return ((*this == ts) || ...);
+		}
+
+		// Conversion, bounded by the view since the buffer may go on past it
+		int to_integer() const;
+		float to_float() const;
+		BasicString<T> to_string() const { return { m_str, m_length }; }
 	private:
 		const T* m_str{nullptr};
 		size_t m_length{0};
@@ -25,11 +55,56 @@ namespace ysen::core {
 		: m_str(str), m_length(::strlen(str))
 	{}
 
+	template <typename T>
+	BasicStringView<T>::BasicStringView(const T* str, size_t length)
+		: m_str(str), m_length(length)
+	{}
+
 	template <typename T>
 	BasicStringView<T>::BasicStringView(const BasicString<T>& str)
 		: m_str(str.c_str()), m_length(str.length())
 	{}
 
+	template <typename T>
+	bool BasicStringView<T>::contains(T value) const
+	{
+		for (auto c : *this) {
+			if (c == value) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	template <typename T>
+	bool BasicStringView<T>::operator==(const T* rhs) const
+	{
+		return ::strncmp(m_str, rhs, m_length) == 0 && rhs[m_length] == 0;
+	}
+
+	template <typename T>
+	bool BasicStringView<T>::operator==(const BasicStringView& other) const
+	{
+		return m_length == other.m_length && ::memcmp(m_str, other.m_str, m_length) == 0;
+	}
+
+	template <typename T>
+	int BasicStringView<T>::to_integer() const
+	{
+		int value{};
+		std::from_chars(begin(), end(), value);
+		return value;
+	}
+
+	template <typename T>
+	float BasicStringView<T>::to_float() const
+	{
+		float value{};
+		std::from_chars(begin(), end(), value);
+		return value;
+	}
+
 	using StringView = BasicStringView<char>;
-	
-}
\ No newline at end of file
+
+}
@@ -0,0 +1,212 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+
+ysen::core::ThreadPool::ThreadPool(size_t thread_count)
+{
+	m_threads.reserve(thread_count);
+	for (auto i = 0u; i < thread_count; ++i) {
+		m_threads.emplace_back([this]() { work(); });
+	}
+}
+
+ysen::core::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock{m_mutex};
+		m_stopping = true;
+	}
+
+	m_condition.notify_all();
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+size_t ysen::core::ThreadPool::default_thread_count()
+{
+	auto count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void ysen::core::ThreadPool::work()
+{
+	while (true) {
+		std::function<void()> task{};
+
+		{
+			std::unique_lock lock{m_mutex};
+			m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+
+			if (m_tasks.empty()) {
+				return;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+namespace {
+
+	// Remaining ranges of the workers of a parallel_for, begin and end packed into
+	// one word so that the owner taking from the front and thieves splitting off
+	// the back agree through a single compare and swap
+	class StealingRanges
+	{
+	public:
+		StealingRanges(size_t workers, size_t count, size_t grain)
+			: m_ranges(std::make_unique<std::atomic<uint64_t>[]>(workers)), m_workers(workers), m_grain(grain)
+		{
+			for (auto i = 0u; i < workers; ++i) {
+				m_ranges[i] = pack(count * i / workers, count * (i + 1) / workers);
+			}
+		}
+
+		size_t workers() const { return m_workers; }
+
+		bool next(size_t worker, size_t& begin, size_t& end)
+		{
+			if (take(worker, begin, end)) {
+				return true;
+			}
+
+			for (auto i = 1u; i < m_workers; ++i) {
+				if (steal((worker + i) % m_workers, worker)) {
+					return take(worker, begin, end);
+				}
+			}
+
+			return false;
+		}
+	private:
+		static uint64_t pack(size_t begin, size_t end) { return static_cast<uint64_t>(begin) << 32 | end; }
+		static size_t begin_of(uint64_t range) { return static_cast<size_t>(range >> 32); }
+		static size_t end_of(uint64_t range) { return static_cast<size_t>(range & 0xffffffff); }
+
+		bool take(size_t worker, size_t& begin, size_t& end)
+		{
+			auto& slot = m_ranges[worker];
+			auto range = slot.load();
+
+			while (begin_of(range) < end_of(range)) {
+				auto taken_end = std::min(begin_of(range) + m_grain, end_of(range));
+				if (slot.compare_exchange_weak(range, pack(taken_end, end_of(range)))) {
+					begin = begin_of(range);
+					end = taken_end;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// Moves the back half of the victim's range, or all of it when that is no more
+		// than a grain, into the thief's slot, which is empty
+		bool steal(size_t victim, size_t thief)
+		{
+			auto& slot = m_ranges[victim];
+			auto range = slot.load();
+
+			while (begin_of(range) < end_of(range)) {
+				auto size = end_of(range) - begin_of(range);
+				auto middle = size > m_grain ? begin_of(range) + size / 2 : begin_of(range);
+				if (slot.compare_exchange_weak(range, pack(begin_of(range), middle))) {
+					m_ranges[thief] = pack(middle, end_of(range));
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		std::unique_ptr<std::atomic<uint64_t>[]> m_ranges;
+		size_t m_workers{};
+		size_t m_grain{};
+	};
+
+	struct ParallelFor
+	{
+		ParallelFor(size_t workers, size_t count, size_t grain, const ysen::core::ThreadPool::RangeBody& body)
+			: ranges(workers, count, grain), body(body)
+		{}
+
+		void run(size_t worker)
+		{
+			size_t begin{}, end{};
+			while (!failed && ranges.next(worker, begin, end)) {
+				try {
+					body(worker, begin, end);
+				}
+				catch (...) {
+					std::lock_guard lock{mutex};
+					if (!error) {
+						error = std::current_exception();
+					}
+					failed = true;
+				}
+			}
+		}
+
+		StealingRanges ranges;
+		// Only called for a range taken, there are none left once parallel_for returns
+		const ysen::core::ThreadPool::RangeBody& body;
+		std::atomic<size_t> next_worker{1};
+		std::atomic<size_t> active{};
+		std::atomic<bool> failed{};
+		std::exception_ptr error{};
+		std::mutex mutex{};
+		std::condition_variable finished{};
+	};
+
+}
+
+void ysen::core::ThreadPool::parallel_for(size_t count, size_t grain, const RangeBody& body)
+{
+	if (count == 0) {
+		return;
+	}
+	if (count > 0xffffffff) {
+		throw std::length_error("Too many indices for a parallel for");
+	}
+
+	grain = std::max<size_t>(grain, 1);
+	auto helpers = std::min(size(), (count - 1) / grain);
+	if (helpers == 0) {
+		body(0, 0, count);
+		return;
+	}
+
+	// Helpers which start late find nothing left, but still hold the state
+	auto state = std::make_shared<ParallelFor>(helpers + 1, count, grain, body);
+	for (auto i = 0u; i < helpers; ++i) {
+		{
+			std::lock_guard lock{m_mutex};
+			m_tasks.emplace_back([state]() {
+				++state->active;
+				state->run(state->next_worker++);
+				if (--state->active == 0) {
+					std::lock_guard lock{state->mutex};
+					state->finished.notify_all();
+				}
+			});
+		}
+		m_condition.notify_one();
+	}
+
+	state->run(0);
+
+	std::unique_lock lock{state->mutex};
+	state->finished.wait(lock, [&state]() { return state->active == 0; });
+
+	if (state->error) {
+		std::rethrow_exception(state->error);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ysen::core {
+
+	// Fixed set of worker threads taking tasks from one FIFO queue. Tasks
+	// must not block on futures of other tasks of the same pool, all workers
+	// could end up waiting.
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(size_t thread_count = default_thread_count());
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		// Runs the tasks still queued before joining
+		~ThreadPool();
+
+		size_t size() const { return m_threads.size(); }
+
+		template<typename Callable>
+		auto submit(Callable&& callable) -> std::future<std::invoke_result_t<Callable>>;
+
+		// Calls body(worker, begin, end) for ranges of at most grain indices covering
+		// [0, count), worker being 0 for the calling thread and 1 to size() for the
+		// pool's. Each starts on an even slice of its own and steals half of what is
+		// left of another's once it runs out. Waits only for workers which already
+		// started, so tasks of this pool may call it too. The first exception thrown
+		// by body stops the others and is rethrown.
+		using RangeBody = std::function<void(size_t worker, size_t begin, size_t end)>;
+		void parallel_for(size_t count, size_t grain, const RangeBody& body);
+
+		static size_t default_thread_count();
+	private:
+		void work();
+
+		std::vector<std::thread> m_threads{};
+		std::deque<std::function<void()>> m_tasks{};
+		std::mutex m_mutex{};
+		std::condition_variable m_condition{};
+		bool m_stopping{false};
+	};
+
+	template<typename Callable>
+	auto ThreadPool::submit(Callable&& callable) -> std::future<std::invoke_result_t<Callable>>
+	{
+		using Result = std::invoke_result_t<Callable>;
+
+		// std::function needs a copyable target, packaged_task is move only
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Callable>(callable));
+		auto future = task->get_future();
+
+		{
+			std::lock_guard lock{m_mutex};
+			m_tasks.emplace_back([task]() { (*task)(); });
+		}
+
+		m_condition.notify_one();
+		return future;
+	}
+
+}
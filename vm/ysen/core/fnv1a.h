@@ -1,10 +1,13 @@
 #pragma once
+#include <cstdint>
 
 namespace ysen::core {
 
 	namespace details {
 		static constexpr auto PRIME = 0x01000193u;
 		static constexpr auto SEED = 0x811C9DC5u;
+		static constexpr auto PRIME_64 = 0x00000100000001B3ull;
+		static constexpr auto SEED_64 = 0xCBF29CE484222325ull;
 	}
 
 	// ReSharper disable once CppInconsistentNaming
@@ -18,6 +21,17 @@ namespace ysen::core {
 		return hash;
 	}
 
+	// ReSharper disable once CppInconsistentNaming
+	inline uint64_t fnv1a_64(const unsigned char* ptr, size_t length)
+	{
+		auto hash = details::SEED_64;
+		const auto *end = ptr + length;
+		while (ptr < end) {
+			hash = (*ptr++ ^ hash) * details::PRIME_64;
+		}
+		return hash;
+	}
+
 	template<typename T>
 	// ReSharper disable once CppInconsistentNaming
 	size_t fnv1a_trivial(T t)
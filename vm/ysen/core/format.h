@@ -1,6 +1,7 @@
 #pragma once
 #include <any>
 #include <ysen/Core/String.h>
+#include <ysen/core/StringView.h>
 #include <vector>
 #include <iostream>
 
@@ -140,6 +141,11 @@ namespace ysen::core::details {
 		static String format(unsigned int x) { return to_string(x); }
 	};
 	template<>
+	struct Formatter<int64_t>
+	{
+		static String format(int64_t x) { return to_string(x); }
+	};
+	template<>
 	struct Formatter<float>
 	{
 		static String format(float x) { return to_string(x); }
@@ -156,6 +162,12 @@ namespace ysen::core::details {
 		static String format(const String& cs) { return cs; }
 	};
 
+	template<>
+	struct Formatter<StringView>
+	{
+		static String format(const StringView& view) { return view.to_string(); }
+	};
+
 	template<>
 	struct Formatter<std::string_view>
 	{
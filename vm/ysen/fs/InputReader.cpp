@@ -0,0 +1,25 @@
+#include "InputReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+ysen::fs::StreamReader::StreamReader(FILE* stream)
+	: m_stream(stream)
+{}
+
+size_t ysen::fs::StreamReader::read(char* buffer, size_t capacity)
+{
+	return fread(buffer, 1, capacity, m_stream);
+}
+
+ysen::fs::StringReader::StringReader(core::String string)
+	: m_string(std::move(string))
+{}
+
+size_t ysen::fs::StringReader::read(char* buffer, size_t capacity)
+{
+	auto count = std::min(capacity, m_string.length() - m_cursor);
+	::memcpy(buffer, m_string.c_str() + m_cursor, count);
+	m_cursor += count;
+	return count;
+}
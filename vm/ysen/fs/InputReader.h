@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdio>
+#include <ysen/core/String.h>
+#include <ysen/core/StringView.h>
+
+namespace ysen::fs {
+
+	// Text read a piece at a time, for input which can't or shouldn't be held
+	// in memory as a whole
+	class InputReader
+	{
+	public:
+		virtual ~InputReader() = default;
+		// Fills buffer with up to capacity bytes, returns 0 once the input is exhausted
+		virtual size_t read(char* buffer, size_t capacity) = 0;
+	};
+
+	// Reads from a stdio stream, such as stdin, which it doesn't close
+	class StreamReader : public InputReader
+	{
+	public:
+		explicit StreamReader(FILE* stream);
+		size_t read(char* buffer, size_t capacity) override;
+	private:
+		FILE* m_stream{};
+	};
+
+	class StringReader : public InputReader
+	{
+	public:
+		explicit StringReader(core::String string);
+		size_t read(char* buffer, size_t capacity) override;
+	private:
+		core::String m_string{};
+		size_t m_cursor{};
+	};
+
+}
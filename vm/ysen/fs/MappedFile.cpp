@@ -0,0 +1,84 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ysen::core::SharedPtr<ysen::fs::MappedFile> ysen::fs::MappedFile::open(const core::StringView& filename)
+{
+	auto file = core::adopt_shared(new MappedFile{});
+
+#ifdef _WIN32
+	file->m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file->m_file == INVALID_HANDLE_VALUE) {
+		file->m_file = nullptr;
+		return nullptr;
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file->m_file, &size)) {
+		return nullptr;
+	}
+	file->m_size = static_cast<size_t>(size.QuadPart);
+
+	// Empty files can't be mapped, there is nothing to point at either
+	if (file->m_size == 0) {
+		return file;
+	}
+
+	file->m_mapping = CreateFileMappingA(file->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!file->m_mapping) {
+		return nullptr;
+	}
+
+	file->m_data = static_cast<const char*>(MapViewOfFile(file->m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	file->m_file = ::open(filename.c_str(), O_RDONLY);
+	if (file->m_file < 0) {
+		return nullptr;
+	}
+
+	struct stat status{};
+	if (fstat(file->m_file, &status) != 0) {
+		return nullptr;
+	}
+	file->m_size = static_cast<size_t>(status.st_size);
+
+	if (file->m_size == 0) {
+		return file;
+	}
+
+	auto* data = mmap(nullptr, file->m_size, PROT_READ, MAP_PRIVATE, file->m_file, 0);
+	file->m_data = data == MAP_FAILED ? nullptr : static_cast<const char*>(data);
+#endif
+
+	return file->m_data ? file : nullptr;
+}
+
+ysen::fs::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+	}
+	if (m_file) {
+		CloseHandle(m_file);
+	}
+#else
+	if (m_data) {
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+	if (m_file >= 0) {
+		::close(m_file);
+	}
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <ysen/core/SharedPtr.h>
+#include <ysen/core/StringView.h>
+
+namespace ysen::fs {
+
+	// A file mapped read-only into memory, pages are only read in as they are touched
+	class MappedFile
+	{
+	public:
+		// nullptr if the file can't be opened or mapped
+		static core::SharedPtr<MappedFile> open(const core::StringView& filename);
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		const char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+	private:
+		MappedFile() = default;
+
+		const char* m_data{};
+		size_t m_size{};
+#ifdef _WIN32
+		void* m_file{};
+		void* m_mapping{};
+#else
+		int m_file{ -1 };
+#endif
+	};
+
+}
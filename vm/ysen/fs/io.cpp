@@ -1,5 +1,7 @@
 #include "io.h"
 
+#include <vector>
+
 ysen::core::Optional<ysen::core::String> ysen::fs::read_file(const core::StringView& filename)
 {
 	auto *handle = fopen(filename.c_str(), "rb");
@@ -11,11 +13,11 @@ ysen::core::Optional<ysen::core::String> ysen::fs::read_file(const core::StringV
 	auto length = ftell(handle);
 	fseek(handle, 0, SEEK_SET);
 
-	core::String string{};
-	string.resize(length + 1, 0);
-	fread(string.buffer(), 1, length, handle);
+	// Resizing a string would count the terminator it needs as part of the text
+	std::vector<char> buffer(length);
+	auto read = fread(buffer.data(), 1, buffer.size(), handle);
 	fclose(handle);
-	return string;
+	return core::String{ buffer.data(), read };
 }
 
 bool ysen::fs::write_file(const core::StringView& filename, const core::StringView& content)
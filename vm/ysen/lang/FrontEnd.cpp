@@ -0,0 +1,134 @@
+#include "FrontEnd.h"
+
+#include <algorithm>
+#include <exception>
+
+#include "Parser.h"
+#include "ast/ConstantFolder.h"
+#include "ysen/fs/io.h"
+
+namespace {
+
+	ysen::lang::ast::ProgramPtr parse_and_fold(ysen::core::SharedPtr<ysen::lang::Lexer> lexer, size_t first, size_t end, ysen::lang::ParserOptions options)
+	{
+		auto program = ysen::lang::Parser{options}.parse(std::move(lexer), first, end);
+		ysen::lang::ast::ConstantFolder::fold(*program);
+		return program;
+	}
+
+}
+
+ysen::lang::FrontEnd::FrontEnd(core::ThreadPool& pool, ParserOptions options)
+	: m_pool(pool), m_options(options)
+{}
+
+ysen::lang::ast::ProgramPtr ysen::lang::FrontEnd::load(core::String code)
+{
+	auto lexer = core::adopt_shared(Lexer::lex(std::move(code), m_pool).release());
+	// Splitting only costs when there's nobody to share the pieces with
+	auto piece_count = m_pool.size() > 1 ? std::min(lexer->tokens().size() / MIN_PIECE_TOKENS, m_pool.size() * 4) : 1;
+	auto splits = split_points(lexer->tokens(), piece_count);
+
+	std::vector<std::future<ast::ProgramPtr>> pieces{};
+	for (auto i = 0u; i + 1 < splits.size(); ++i) {
+		pieces.emplace_back(m_pool.submit([lexer, first = splits[i], end = splits[i + 1], options = m_options]() {
+			return parse_and_fold(lexer, first, end, options);
+		}));
+	}
+
+	return merge(pieces);
+}
+
+ysen::lang::ast::ProgramPtr ysen::lang::FrontEnd::load(std::vector<core::String> sources)
+{
+	std::vector<std::future<ast::ProgramPtr>> programs{};
+	for (auto& source : sources) {
+		programs.emplace_back(m_pool.submit([source = std::move(source), options = m_options]() mutable {
+			auto lexer = core::adopt_shared(Lexer::lex(std::move(source)).release());
+			auto end = lexer->tokens().size();
+			return parse_and_fold(std::move(lexer), 0, end, options);
+		}));
+	}
+
+	return merge(programs);
+}
+
+ysen::lang::ast::ProgramPtr ysen::lang::FrontEnd::load_files(const std::vector<core::String>& filenames)
+{
+	std::vector<std::future<ast::ProgramPtr>> programs{};
+	for (const auto& filename : filenames) {
+		programs.emplace_back(m_pool.submit([filename, options = m_options]() -> ast::ProgramPtr {
+			auto file_or_error = fs::read_file(filename);
+			if (!file_or_error.has_value()) {
+				return nullptr;
+			}
+
+			auto lexer = core::adopt_shared(Lexer::lex(file_or_error.release_value()).release());
+			auto end = lexer->tokens().size();
+			return parse_and_fold(std::move(lexer), 0, end, options);
+		}));
+	}
+
+	return merge(programs);
+}
+
+std::vector<size_t> ysen::lang::FrontEnd::split_points(const std::vector<Token>& tokens, size_t piece_count)
+{
+	std::vector<size_t> splits{ 0 };
+	auto piece_size = tokens.size() / std::max<size_t>(piece_count, 1);
+	size_t depth{};
+
+	for (auto i = 0u; i < tokens.size() && splits.size() < piece_count; ++i) {
+		const auto& token = tokens[i];
+
+		// A declaration right after a ';' or '}' closing a top-level block always starts
+		// a statement, the parser is in the same state there whatever came before
+		if (depth == 0 && i > 0 && i >= splits.back() + piece_size && i + 1 < tokens.size() &&
+			token.is_keyword(Keyword::Fun) && tokens[i + 1].is_identifier() &&
+			(tokens[i - 1].is_semi_colon() || tokens[i - 1].is_squiggly_close())) {
+			splits.push_back(i);
+		}
+
+		if (token.is_paren_open() || token.is_bracket_open() || token.is_squiggly_open()) {
+			++depth;
+		}
+		else if ((token.is_paren_close() || token.is_bracket_close() || token.is_squiggly_close()) && depth > 0) {
+			--depth;
+		}
+	}
+
+	splits.push_back(tokens.size());
+	return splits;
+}
+
+ysen::lang::ast::ProgramPtr ysen::lang::FrontEnd::merge(std::vector<std::future<ast::ProgramPtr>>& parts)
+{
+	// Waits for every part before the first error is rethrown, tasks can't outlive the call
+	std::vector<ast::ProgramPtr> programs{};
+	std::exception_ptr error{};
+	for (auto& part : parts) {
+		try {
+			programs.emplace_back(part.get());
+		}
+		catch (...) {
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	auto program = core::adopt_shared(new ast::Program{ SourceRange{}, 0 });
+	for (auto& part : programs) {
+		if (!part) {
+			return nullptr;
+		}
+
+		program->adopt(std::move(part));
+	}
+
+	return program;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+
+#include "Lexer.h"
+#include "ParserOptions.h"
+#include "ast/node.h"
+#include "ysen/core/String.h"
+#include "ysen/core/ThreadPool.h"
+
+namespace ysen::lang {
+
+	// Lexes, parses and constant folds on a thread pool. The result is always
+	// a single program holding the top-level statements in source order, the
+	// programs of the separately parsed parts are adopted by it.
+	class FrontEnd
+	{
+	public:
+		static constexpr size_t MIN_PIECE_TOKENS = 16 * 1024;
+
+		explicit FrontEnd(core::ThreadPool& pool, ParserOptions options = {});
+
+		// One large source: lexed in chunks, then parsed in pieces of at least
+		// MIN_PIECE_TOKENS split before top-level function declarations
+		ast::ProgramPtr load(core::String code);
+		// Many sources: each one is lexed and parsed as a whole by one task
+		ast::ProgramPtr load(std::vector<core::String> sources);
+		// Reads the files on the pool as well, nullptr if one can't be read
+		ast::ProgramPtr load_files(const std::vector<core::String>& filenames);
+
+	private:
+		static std::vector<size_t> split_points(const std::vector<Token>&, size_t piece_count);
+		ast::ProgramPtr merge(std::vector<std::future<ast::ProgramPtr>>&);
+
+		core::ThreadPool& m_pool;
+		ParserOptions m_options{};
+	};
+
+}
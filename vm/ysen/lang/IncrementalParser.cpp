@@ -0,0 +1,168 @@
+#include "IncrementalParser.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+
+#include "Parser.h"
+#include "ast/ConstantFolder.h"
+
+ysen::lang::IncrementalParser::IncrementalParser(core::String code, ParserOptions options)
+	: m_code(std::move(code)), m_options(options)
+{
+	m_statements = parse_region(m_code, 0, m_code.length()).release_value();
+	m_program = assemble(m_code.length());
+}
+
+ysen::lang::ReparseResult ysen::lang::IncrementalParser::apply(const TextEdit& edit)
+{
+	if (edit.offset > m_code.length() || edit.removed > m_code.length() - edit.offset) {
+		throw std::out_of_range("Edit past the end of the code");
+	}
+
+	auto edit_end = edit.offset + edit.removed;
+	core::String code{ m_code.c_str(), edit.offset };
+	code.append(edit.inserted);
+	code.append(m_code.c_str() + edit_end, m_code.length() - edit_end);
+	auto delta = static_cast<ptrdiff_t>(code.length()) - static_cast<ptrdiff_t>(m_code.length());
+
+	// Statements [first, last) touch the edit, the region takes in one more on either side
+	auto first = std::partition_point(m_statements.begin(), m_statements.end(), [&](const Statement& statement) {
+		return statement.offset + statement.length < edit.offset;
+	}) - m_statements.begin();
+	auto last = std::partition_point(m_statements.begin(), m_statements.end(), [&](const Statement& statement) {
+		return statement.offset <= edit_end;
+	}) - m_statements.begin();
+	size_t region_first = first > 0 ? first - 1 : 0;
+	size_t region_last = std::min<size_t>(last + 1, m_statements.size());
+
+	auto region_offset = region_first > 0 ? m_statements[region_first - 1].offset + m_statements[region_first - 1].length : 0;
+	auto region_end = region_last < m_statements.size() ? m_statements[region_last].offset : m_code.length();
+
+	core::Optional<std::vector<Statement>> region{};
+	try {
+		region = parse_region(code, region_offset, region_end + delta);
+	}
+	catch (ParseError&) {
+		// May well be down to the edit reaching past the region
+	}
+
+	// The parser takes running out of tokens for the end of a statement, the region only
+	// stands on its own if the untouched statement it ends with came out as before
+	auto parsed = region.has_value();
+	auto statements = region.release_value();
+	auto stands_alone = region_last == m_statements.size() || (!statements.empty() &&
+		statements.back().offset == m_statements[region_last - 1].offset + delta &&
+		statements.back().length == m_statements[region_last - 1].length);
+
+	if (!parsed || !stands_alone) {
+		region_first = 0;
+		region_last = m_statements.size();
+		statements = parse_region(code, 0, code.length()).release_value();
+	}
+
+	ReparseResult result{};
+
+	// Reparsed statements whose text is unchanged keep their nodes, only the rest count as changed
+	std::vector<bool> matched(region_last - region_first);
+	auto next = region_first;
+	std::set<core::String> declared{};
+	for (auto& statement : statements) {
+		auto is_reused = false;
+		for (auto i = next; i < region_last; ++i) {
+			const auto& previous = m_statements[i];
+			if (previous.length == statement.length &&
+				::memcmp(m_code.c_str() + previous.offset, code.c_str() + statement.offset, statement.length) == 0) {
+				statement.node = previous.node;
+				statement.owner = previous.owner;
+				matched[i - region_first] = true;
+				next = i + 1;
+				is_reused = true;
+				break;
+			}
+		}
+
+		if (auto* declaration = dynamic_cast<ast::FunctionDeclarationStatement*>(statement.node)) {
+			declared.insert(declaration->name());
+			if (!is_reused) {
+				result.changed_functions.push_back(declaration);
+			}
+		}
+
+		if (!is_reused) {
+			++result.reparsed_statements;
+		}
+	}
+
+	for (auto i = region_first; i < region_last; ++i) {
+		auto* declaration = dynamic_cast<ast::FunctionDeclarationStatement*>(m_statements[i].node);
+		if (declaration && !matched[i - region_first] && !declared.contains(declaration->name())) {
+			result.removed_functions.push_back(declaration->name());
+			declared.insert(declaration->name());
+		}
+	}
+
+	// Statements past the region only move
+	for (auto i = region_last; i < m_statements.size(); ++i) {
+		m_statements[i].offset = static_cast<uint32_t>(m_statements[i].offset + delta);
+	}
+	m_statements.erase(m_statements.begin() + region_first, m_statements.begin() + region_last);
+	m_statements.insert(m_statements.begin() + region_first, statements.begin(), statements.end());
+
+	m_code = std::move(code);
+	m_program = assemble(m_code.length());
+
+	result.program = m_program;
+	result.reused_statements = m_statements.size() - result.reparsed_statements;
+	return result;
+}
+
+ysen::core::Optional<std::vector<ysen::lang::IncrementalParser::Statement>> ysen::lang::IncrementalParser::parse_region(const core::String& code, size_t offset, size_t end) const
+{
+	core::String text{ code.c_str() + offset, end - offset };
+
+	if (end < code.length()) {
+		// A token running up to the end, a comment or string left open say, could go
+		// on past it; the code that follows would then no longer lex as it did
+		auto comments = Lexer::lex(text, WhitespacePolicy::Ignore, CommentPolicy::Keep);
+		if (!comments->tokens().empty() && comments->tokens().back().end_offset() >= text.length()) {
+			return {};
+		}
+	}
+
+	auto lexer = core::adopt_shared(Lexer::lex(std::move(text)).release());
+	auto [program, spans] = Parser{m_options}.parse_statements(lexer);
+
+	std::vector<Statement> statements{};
+	for (auto i = 0u; i < spans.size(); ++i) {
+		auto* node = program->children()[i];
+		if (auto* expression = dynamic_cast<ast::Expression*>(node)) {
+			node = ast::ConstantFolder::fold(*program, expression);
+		}
+
+		const auto& tokens = lexer->tokens();
+		auto [first, last] = spans[i];
+		auto start = tokens[first].offset();
+		statements.push_back({ node, static_cast<uint32_t>(offset + start), tokens[last - 1].end_offset() - start, program });
+	}
+
+	return statements;
+}
+
+ysen::lang::ast::ProgramPtr ysen::lang::IncrementalParser::assemble(size_t length) const
+{
+	auto program = core::adopt_shared(new ast::Program{ SourceRange{ 0, static_cast<uint32_t>(length) }, 0 });
+	for (const auto& statement : m_statements) {
+		program->emit(statement.node);
+		program->retain(statement.owner);
+
+		// The folder drops what follows a top-level ret, the statements stay around for later edits
+		if (statement.node->is_return_expression()) {
+			break;
+		}
+	}
+
+	return program;
+}
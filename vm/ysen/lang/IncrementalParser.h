@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+
+#include "Lexer.h"
+#include "ParserOptions.h"
+#include "ast/node.h"
+#include "ysen/core/Optional.h"
+
+namespace ysen::lang {
+
+	// Replaces the removed bytes at offset with inserted
+	struct TextEdit
+	{
+		size_t offset{};
+		size_t removed{};
+		core::String inserted{};
+	};
+
+	struct ReparseResult
+	{
+		ast::ProgramPtr program{};
+		// Declarations which are new or whose text changed, and names no longer declared
+		std::vector<ast::FunctionDeclarationStatementPtr> changed_functions{};
+		std::vector<core::String> removed_functions{};
+		size_t reparsed_statements{};
+		size_t reused_statements{};
+	};
+
+	// Keeps a source along with its top-level statements, so that an edit only
+	// relexes and reparses the statements it touches and one on either side of
+	// them, which an edit next to them may have joined (an added 'else'). The
+	// other statements are reused, and so are reparsed ones whose text turns
+	// out unchanged. Should the edit reach further, through an unterminated
+	// comment or string or a brace that makes the region not parse on its own,
+	// the whole source is parsed again.
+	//
+	// Statements live in the program of the region they were parsed from, which
+	// the assembled program keeps alive; source ranges of their nodes are
+	// relative to that region.
+	class IncrementalParser
+	{
+	public:
+		explicit IncrementalParser(core::String code, ParserOptions options = {});
+
+		// Leaves the parser as it was if the edited source doesn't parse
+		ReparseResult apply(const TextEdit&);
+
+		const core::String& code() const { return m_code; }
+		const ast::ProgramPtr& program() const { return m_program; }
+	private:
+		struct Statement
+		{
+			ast::AstNodePtr node{};
+			uint32_t offset{};
+			uint32_t length{};
+			core::SharedPtr<ast::Program> owner{};
+		};
+
+		// Statements of bytes [offset, end) of code, with offsets into code. Nothing if the
+		// region can't be lexed on its own, as its last token may continue past end.
+		core::Optional<std::vector<Statement>> parse_region(const core::String& code, size_t offset, size_t end) const;
+		ast::ProgramPtr assemble(size_t length) const;
+
+		core::String m_code{};
+		ParserOptions m_options{};
+		std::vector<Statement> m_statements{};
+		ast::ProgramPtr m_program{};
+	};
+
+}
@@ -0,0 +1,61 @@
+#include "Isolate.h"
+
+#include <stdexcept>
+
+#include "Lexer.h"
+#include "Parser.h"
+#include "ast/ConstantFolder.h"
+#include "ir/Compiler.h"
+
+ysen::lang::SharedScriptPtr ysen::lang::SharedScript::compile(const core::String& code, ExecutionMode mode)
+{
+	auto script = core::adopt_shared(new SharedScript{});
+
+	// Bodies are parsed now, a lazy body would be parsed by whichever isolate calls it first
+	auto lexer = core::adopt_shared(Lexer::lex(code).release());
+	script->m_program = Parser{ParserOptions{}}.parse(std::move(lexer));
+	ast::ConstantFolder::fold(*script->m_program);
+
+	if (mode == ExecutionMode::Bytecode) {
+		bytecode::Generator generator{};
+		script->m_ast_fallback = ir::compile(*script->m_program, generator);
+		script->m_executable = std::move(generator.program());
+		script->m_has_bytecode = true;
+	}
+
+	return script;
+}
+
+ysen::lang::Isolate::Isolate(SharedScriptPtr script)
+	: m_script(std::move(script))
+{}
+
+ysen::lang::astvm::ValuePtr ysen::lang::Isolate::run()
+{
+	return m_interpreter.execute(m_script->program());
+}
+
+ysen::lang::astvm::Value ysen::lang::Isolate::run_bytecode()
+{
+	if (!m_script->has_bytecode()) {
+		throw std::logic_error("The script wasn't compiled to bytecode");
+	}
+
+	return m_bytecode_interpreter.execute(m_script->executable());
+}
+
+ysen::lang::astvm::Value ysen::lang::Isolate::call(const core::String& name, std::span<const astvm::Value> arguments)
+{
+	auto function = m_interpreter.global_scope()->find_function(name);
+	if (!function) {
+		throw std::invalid_argument(core::format("No function '{}' in the isolate", name).c_str());
+	}
+
+	return function->invoke(m_interpreter, arguments);
+}
+
+void ysen::lang::Isolate::set_fuel(astvm::FuelBudget budget)
+{
+	m_interpreter.fuel().set_budget(budget);
+	m_bytecode_interpreter.fuel().set_budget(budget);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <span>
+
+#include "astvm/Interpreter.h"
+#include "ast/node.h"
+#include "bytecode/BytecodeInterpreter.h"
+#include "bytecode/Generator.h"
+#include "ysen/core/Optional.h"
+#include "ysen/core/SharedPtr.h"
+#include "ysen/core/String.h"
+
+namespace ysen::lang {
+
+	enum class ExecutionMode
+	{
+		Tree,
+		// Also generates the program's bytecode, for the constructs the compiler supports
+		Bytecode,
+	};
+
+	class SharedScript;
+	using SharedScriptPtr = core::SharedPtr<SharedScript>;
+
+	// A program compiled once and never changed afterwards: its syntax tree, parsed
+	// with all function bodies and folded, and its bytecode. Any number of isolates
+	// on any threads run it at the same time, none of them copies it.
+	class SharedScript
+	{
+	public:
+		static SharedScriptPtr compile(const core::String& code, ExecutionMode = ExecutionMode::Tree);
+
+		const ast::ProgramPtr& program() const { return m_program; }
+		bool has_bytecode() const { return m_has_bytecode; }
+		const bytecode::ExecutableProgram& executable() const { return m_executable; }
+		// The construct the IR couldn't express, when the bytecode was generated from the AST
+		const core::Optional<core::String>& ast_fallback() const { return m_ast_fallback; }
+	private:
+		SharedScript() = default;
+
+		ast::ProgramPtr m_program{};
+		bool m_has_bytecode{};
+		bytecode::ExecutableProgram m_executable{};
+		core::Optional<core::String> m_ast_fallback{};
+	};
+
+	// One thread's instance of a shared script. Scopes, values and the bytecode stack
+	// are the isolate's own, the code is only read; running it takes no locks. An
+	// isolate is used by one thread at a time, natives are added to each.
+	class Isolate
+	{
+	public:
+		explicit Isolate(SharedScriptPtr script);
+		Isolate(const Isolate&) = delete;
+		Isolate& operator=(const Isolate&) = delete;
+
+		const SharedScriptPtr& script() const { return m_script; }
+		astvm::Interpreter& interpreter() { return m_interpreter; }
+
+		// Runs the top level of the script, declaring its functions and variables in this isolate
+		astvm::ValuePtr run();
+		// Runs the script's bytecode instead, the script has to have been compiled for it
+		astvm::Value run_bytecode();
+
+		// Calls a function declared by run()
+		astvm::Value call(const core::String& name, std::span<const astvm::Value> arguments);
+
+		// The budget of both interpreters, each counts the steps it runs from here on
+		void set_fuel(astvm::FuelBudget);
+	private:
+		SharedScriptPtr m_script{};
+		astvm::Interpreter m_interpreter{};
+		bytecode::BytecodeInterpreter m_bytecode_interpreter{};
+	};
+
+}
@@ -1,6 +1,7 @@
 #include "Lexer.h"
+#include "Scanner.h"
 
-#include <set>
+#include <algorithm>
 #include <ysen/core/format.h>
 
 ysen::core::String ysen::lang::to_string(TokenType type)
@@ -14,6 +15,61 @@ ysen::core::String ysen::lang::to_string(TokenType type)
 	return {};
 }
 
+ysen::core::String ysen::lang::to_string(Keyword keyword)
+{
+	switch(keyword) {
+	case Keyword::None: return {};
+#define __KEYWORD_ENUMERATOR(Camel, spelling) case Keyword::Camel: return #spelling; 
+	KEYWORD_ENUMERATOR
+#undef __KEYWORD_ENUMERATOR
+	}
+
+	return {};
+}
+
+ysen::lang::Keyword ysen::lang::to_keyword(core::StringView word)
+{
+	// Length and first character leave at most two candidates to compare
+	auto is = [&word](const char* keyword) {
+		return ::memcmp(word.c_str(), keyword, word.length()) == 0;
+	};
+
+	switch (word.length()) {
+	case 2:
+		return is("if") ? Keyword::If : Keyword::None;
+	case 3:
+		switch (word.at(0)) {
+		case 'v': return is("var") ? Keyword::Var : Keyword::None;
+		case 'r': return is("ret") ? Keyword::Ret : Keyword::None;
+		case 'i': return is("int") ? Keyword::Int : Keyword::None;
+		case 'f': return is("fun") ? Keyword::Fun : is("for") ? Keyword::For : Keyword::None;
+		}
+		break;
+	case 4:
+		switch (word.at(0)) {
+		case 'e': return is("else") ? Keyword::Else : Keyword::None;
+		case 't': return is("true") ? Keyword::True : Keyword::None;
+		}
+		break;
+	case 5:
+		switch (word.at(0)) {
+		case 'w': return is("while") ? Keyword::While : Keyword::None;
+		case 'c': return is("class") ? Keyword::Class : Keyword::None;
+		case 'b': return is("break") ? Keyword::Break : Keyword::None;
+		case 'f': return is("float") ? Keyword::Float : is("false") ? Keyword::False : Keyword::None;
+		}
+		break;
+	case 6:
+		return is("string") ? Keyword::String : Keyword::None;
+	case 7:
+		return is("require") ? Keyword::Require : Keyword::None;
+	case 8:
+		return is("continue") ? Keyword::Continue : Keyword::None;
+	}
+
+	return Keyword::None;
+}
+
 ysen::lang::SourcePosition::SourcePosition() = default;
 ysen::lang::SourcePosition::SourcePosition(uint32_t row, uint32_t column)
 	: m_row(row), m_column(column)
@@ -34,32 +90,52 @@ void ysen::lang::SourcePosition::set_column(uint32_t column)
 	m_column = column;
 }
 
-ysen::lang::SourcePosition ysen::lang::SourcePosition::increment() const
+ysen::lang::SourceRange::SourceRange(uint32_t start_offset, uint32_t end_offset)
+	: m_offset(start_offset), m_length(end_offset - start_offset)
+{}
+
+ysen::core::String ysen::lang::SourceRange::to_string() const
 {
-	return { m_row, m_column + 1 };
+	return core::format("{}..{}", offset(), end_offset());
 }
 
-ysen::lang::SourcePosition ysen::lang::SourcePosition::new_line() const
+ysen::lang::LineTable::LineTable(core::StringView source)
 {
-	return { m_row + 1, 0 };
+	const auto* code = source.c_str();
+	auto length = source.length();
+
+	m_line_starts.reserve(scan::count(code, 0, length, '\n') + 1);
+	m_line_starts.push_back(0);
+	for (auto offset = scan::find(code, 0, length, '\n'); offset < length; offset = scan::find(code, offset + 1, length, '\n')) {
+		m_line_starts.push_back(static_cast<uint32_t>(offset + 1));
+	}
 }
 
-ysen::lang::SourceRange::SourceRange(SourcePosition start, SourcePosition end)
-	: m_start_position(start), m_end_position(end)
-{}
+ysen::lang::SourcePosition ysen::lang::LineTable::position(uint32_t offset) const
+{
+	// The line is the last one starting at or before offset
+	auto line = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset) - 1;
+	return { static_cast<uint32_t>(line - m_line_starts.begin()), offset - *line };
+}
 
-ysen::core::String ysen::lang::SourceRange::to_string() const
+ysen::core::String ysen::lang::LineTable::to_string(SourceRange range) const
 {
-	return core::format("{}:{}-{}:{}", start_position().row(), start_position().column(), end_position().row(), end_position().column());
+	auto start = position(range.offset());
+	auto end = position(range.end_offset());
+	return core::format("{}:{}-{}:{}", start.row(), start.column(), end.row(), end.column());
 }
 
-ysen::lang::Token::Token(SourcePosition start, SourcePosition end, TokenType type, core::String content)
-	: m_start_position(start), m_end_position(end), m_type(type), m_content(std::move(content))
+ysen::lang::Token::Token(uint32_t start_offset, uint32_t end_offset, TokenType type, core::StringView content)
+	: m_offset(start_offset), m_length(end_offset - start_offset), m_type(type), m_content(content)
+{}
+
+ysen::lang::Token::Token(uint32_t start_offset, uint32_t end_offset, Keyword keyword, core::StringView content)
+	: m_offset(start_offset), m_length(end_offset - start_offset), m_type(TokenType::Keyword), m_keyword(keyword), m_content(content)
 {}
 
 ysen::core::String ysen::lang::Token::to_string() const
 {
-	return core::format("Token{{ '{}', {}, start={}, end={} }}", content(), lang::to_string(type()), start_position().to_string(), end_position().to_string());
+	return core::format("Token{{ '{}', {}, range={} }}", content(), lang::to_string(type()), source_range().to_string());
 }
 
 ysen::core::NonnullOwnPtr<ysen::lang::Lexer> ysen::lang::Lexer::lex(core::String code, WhitespacePolicy whitespace_policy, CommentPolicy comment_policy)
@@ -69,156 +145,227 @@ ysen::core::NonnullOwnPtr<ysen::lang::Lexer> ysen::lang::Lexer::lex(core::String
 	return lexer;
 }
 
+ysen::core::NonnullOwnPtr<ysen::lang::Lexer> ysen::lang::Lexer::lex(core::String code, core::ThreadPool& pool, WhitespacePolicy whitespace_policy, CommentPolicy comment_policy)
+{
+	auto chunk_count = std::min(code.length() / PARALLEL_CHUNK_SIZE, pool.size() * 4);
+	if (chunk_count < 2 || pool.size() < 2) {
+		return lex(std::move(code), whitespace_policy, comment_policy);
+	}
+
+	auto lexer = core::adopt_nonnull(new Lexer());
+	lexer->reset(std::move(code), whitespace_policy, comment_policy);
+	const auto* source = lexer->m_source.c_str();
+	auto length = lexer->m_source.length();
+
+	// Chunks start right after a newline
+	std::vector<size_t> boundaries{ 0 };
+	for (auto i = 1u; i < chunk_count; ++i) {
+		auto boundary = scan::find(source, std::max(i * (length / chunk_count), boundaries.back()), length, '\n') + 1;
+		if (boundary >= length) {
+			break;
+		}
+		boundaries.push_back(boundary);
+	}
+	boundaries.push_back(length);
+
+	std::vector<core::NonnullOwnPtr<Lexer>> chunks{};
+	std::vector<std::future<void>> lexed{};
+	for (auto i = 0u; i + 1 < boundaries.size(); ++i) {
+		auto& chunk = chunks.emplace_back(new Lexer());
+		chunk->m_whitespace_policy = whitespace_policy;
+		chunk->m_comment_policy = comment_policy;
+		chunk->m_source = lexer->m_source;
+		chunk->m_cursor = boundaries[i];
+
+		lexed.emplace_back(pool.submit([chunk = chunk.ptr(), end = boundaries[i + 1]]() {
+			chunk->m_tokens.reserve((end - chunk->m_cursor) / 8);
+			chunk->lex_range(end);
+		}));
+	}
+
+	size_t token_count{};
+	for (auto i = 0u; i < chunks.size(); ++i) {
+		lexed[i].get();
+		token_count += chunks[i]->m_tokens.size();
+	}
+
+	lexer->m_tokens.reserve(token_count);
+	for (auto i = 0u; i < chunks.size(); ++i) {
+		lexer->stitch(*chunks[i], boundaries[i], boundaries[i + 1]);
+	}
+
+	return lexer;
+}
+
+const ysen::lang::LineTable& ysen::lang::Lexer::line_table() const
+{
+	if (m_line_table.empty()) {
+		m_line_table = LineTable{ m_code };
+	}
+
+	return m_line_table;
+}
+
 bool ysen::lang::Lexer::eof(int offset) const
 {
-	return m_cursor + offset >= m_code.length();
+	return m_cursor + offset >= m_source.length();
 }
 
 void ysen::lang::Lexer::lex_ws()
 {
-	auto [start, end, content] = consume_while(core::is_whitespace);
+	auto start = position();
+	m_cursor = scan::skip_whitespace(m_source.c_str(), m_cursor, m_source.length());
 
 	if (m_whitespace_policy == WhitespacePolicy::Keep) {
-		emit_token(start, end, TokenType::Whitespace, std::move(content));
+		emit_token(start, position(), TokenType::Whitespace, view(start));
 	}
 }
 
 void ysen::lang::Lexer::lex_simple_comment()
 {
-	auto [start, end, content] = consume_while([](auto&& c) {
-		return c != '\n';
-	});
+	auto start = position();
+	m_cursor = scan::find(m_source.c_str(), m_cursor, m_source.length(), '\n');
 
 	if (comment_policy() == CommentPolicy::Keep) {
-		emit_token(start, end, TokenType::SimpleComment, std::move(content));
+		emit_token(start, position(), TokenType::SimpleComment, view(start));
 	}
 }
 
 void ysen::lang::Lexer::lex_multiline_comment()
 {
-	auto [start, _, content] = consume_while([&](auto&& c) {
-		return c != '*' && peek(1) != '/';
-	});
-	consume();
+	auto start = position();
+	const auto* code = m_source.c_str();
+	auto length = m_source.length();
+
+	// Past the opening /*, an unterminated comment runs to the end of the code
+	auto end = m_cursor + 2;
+	while (true) {
+		end = scan::find(code, end, length, '*');
+		if (end + 1 >= length) {
+			end = length;
+			break;
+		}
+		if (code[end + 1] == '/') {
+			end += 2;
+			break;
+		}
+		++end;
+	}
+	m_cursor = end;
 
 	if (comment_policy() == CommentPolicy::Keep) {
-		emit_token(start, m_position, TokenType::MultilineComment, std::move(content));
+		emit_token(start, position(), TokenType::MultilineComment, view(start));
 	}
 }
 
 void ysen::lang::Lexer::lex_id()
 {
-	static std::set<core::String> keyword_set{
-		"var",
-		"if",
-		"else",
-		"while",
-		"for",
-		"class",
-		"fun",
-		"ret",
-		"int",
-		"float",
-		"string",
-		"continue",
-		"break",
-		"require",
-		"true",
-		"false",
-	};
-	
+	auto start = position();
+
 	// We already know the very first character is either alphabetical or _
 	// Hence we can check alpha_numeric here, since numbers are allowed anywhere
 	// but at the start of an identifier
-	auto [start, end, content] = consume_while([](auto&& c) {
-		return c == '_' || core::is_alpha_numeric(c);
-	});
+	m_cursor = scan::skip_identifier(m_source.c_str(), m_cursor + 1, m_source.length());
+	auto content = view(start);
 
-	auto type = TokenType::Identifier;
-	if (keyword_set.contains(content)) {
-		type = TokenType::Keyword;
+	if (auto keyword = to_keyword(content); keyword != Keyword::None) {
+		m_tokens.emplace_back(start, position(), keyword, content);
+		return;
 	}
 
-	emit_token(start, end, type, std::move(content));
+	emit_token(start, position(), TokenType::Identifier, content);
 }
 
 void ysen::lang::Lexer::lex_number()
 {
-	auto start = m_position;
-	core::String content{};
-	while (!eof()) {
-		auto ch = peek();
+	auto start = position();
+	const auto* code = m_source.c_str();
+	auto length = m_source.length();
 
-		if (ch == '.' && peek(1) == '.') {
-			break;
-		}
-		if (ch == '.' || core::is_numeric(ch)) {
-			content.push(consume());
-		}
-		else {
-			break;
+	auto end = m_cursor;
+	while (true) {
+		end = scan::skip_digits(code, end, length);
+
+		// A single dot continues the number, two of them start a range
+		if (end < length && code[end] == '.' && !(end + 1 < length && code[end + 1] == '.')) {
+			++end;
+			continue;
 		}
+		break;
 	}
-	auto end = m_position;
+	m_cursor = end;
 
+	auto content = view(start);
 	auto type = TokenType::Integer;
 	if (content.contains('.')) {
 		type = TokenType::FloatingPointNumber;
 	}
 
-	emit_token(start, end, type, std::move(content));
+	emit_token(start, position(), type, content);
 }
 
 void ysen::lang::Lexer::lex_string()
 {
-	auto start = m_position;
-	core::String content{};
+	auto start = position();
 	auto delim = consume();
+	auto content_start = m_cursor;
+	const auto* code = m_source.c_str();
+
+	// Only strings with escape sequences get their own copy, from the first escape on
+	core::String* unescaped{};
 
 	while (!eof()) {
-		if (peek() == '\\') {
-			switch (peek(1)) {
-			case '\'': 
-				content.push('\'');
-				break;
-			case '"': 
-				content.push('\'');
-				break;
-			case 'n':
-				content.push('\n');
-				break;
-			case 't':
-				content.push('\t');
-				break;
-			case 'r':
-				content.push('\r');
-				break;
-			default:
-				break;
-			}
+		auto stop = scan::find_any_of(code, m_cursor, m_source.length(), delim, '\\');
+		if (unescaped) {
+			unescaped->append(code + m_cursor, stop - m_cursor);
+		}
+		m_cursor = stop;
 
-			consume(); consume(); // consume x2
-			continue;
+		if (eof() || peek() == delim) {
+			break;
 		}
-		else if (peek() == delim) {
-			consume();
+
+		if (!unescaped) {
+			unescaped = &m_unescaped_strings.emplace_back(view(content_start).to_string());
+		}
+
+		switch (peek(1)) {
+		case '\'': 
+			unescaped->push('\'');
+			break;
+		case '"': 
+			unescaped->push('\'');
+			break;
+		case 'n':
+			unescaped->push('\n');
+			break;
+		case 't':
+			unescaped->push('\t');
+			break;
+		case 'r':
+			unescaped->push('\r');
+			break;
+		default:
 			break;
 		}
 
-		content.push(consume());
+		consume(); consume(); // consume x2
 	}
 
-	emit_token(start, m_position, TokenType::String, std::move(content));
+	auto content = unescaped ? core::StringView{ *unescaped } : view(content_start);
+	consume(); // closing delimiter
+
+	emit_token(start, position(), TokenType::String, content);
 }
 
 void ysen::lang::Lexer::lex_other()
 {
 	switch (peek()) {
 	case '.':
-		emit_token(m_position, m_position.increment(), TokenType::Dot, consume());
+		lex_single(TokenType::Dot);
 		break;
 	case ',':
-		emit_token(m_position, m_position.increment(), TokenType::Comma, consume());
+		lex_single(TokenType::Comma);
 		break;
 		
 	case '+':
@@ -229,63 +376,82 @@ void ysen::lang::Lexer::lex_other()
 	case '>':
 	case '<':
 		if (!eof(1) && peek(1) == '=') {
-			core::String op{};
-			auto start = m_position;
-			op.push(consume());
-			op.push(consume());
-			emit_token(start, m_position, TokenType::BinOp, std::move(op));
+			auto start = position();
+			consume();
+			consume();
+			emit_token(start, position(), TokenType::BinOp, view(start));
 			break;
 		}
 		
-		emit_token(m_position, m_position.increment(), TokenType::BinOp, consume());
+		lex_single(TokenType::BinOp);
 		break;
 
 	case '=':
-		emit_token(m_position, m_position.increment(), TokenType::Equals, consume());
+		lex_single(TokenType::Equals);
 		break;
 
 	case ':':
-		emit_token(m_position, m_position.increment(), TokenType::Colon, consume());
+		lex_single(TokenType::Colon);
 		break;
 	case ';':
-		emit_token(m_position, m_position.increment(), TokenType::SemiColon, consume());
+		lex_single(TokenType::SemiColon);
 		break;
 
 	case '(':
-		emit_token(m_position, m_position.increment(), TokenType::ParenOpen, consume());
+		lex_single(TokenType::ParenOpen);
 		break;
 	case ')':
-		emit_token(m_position, m_position.increment(), TokenType::ParenClose, consume());
+		lex_single(TokenType::ParenClose);
 		break;
 	case '{':
-		emit_token(m_position, m_position.increment(), TokenType::SquigglyOpen, consume());
+		lex_single(TokenType::SquigglyOpen);
 		break;
 	case '}':
-		emit_token(m_position, m_position.increment(), TokenType::SquigglyClose, consume());
+		lex_single(TokenType::SquigglyClose);
 		break;
 
 	case '[':
-		emit_token(m_position, m_position.increment(), TokenType::BracketOpen, consume());
+		lex_single(TokenType::BracketOpen);
 		break;
 	case ']':
-		emit_token(m_position, m_position.increment(), TokenType::BracketClose, consume());
+		lex_single(TokenType::BracketClose);
 		break;
 
 	default:
-		emit_token(m_position, m_position.increment(), TokenType::Unknown, consume());
+		lex_single(TokenType::Unknown);
 	}
 }
 
+void ysen::lang::Lexer::lex_single(TokenType type)
+{
+	auto start = position();
+	consume();
+	emit_token(start, position(), type, view(start));
+}
+
 void ysen::lang::Lexer::lex_impl(core::String code, WhitespacePolicy whitespace_policy, CommentPolicy comment_policy)
+{
+	reset(std::move(code), whitespace_policy, comment_policy);
+	// Real code averages a token every 6-10 bytes, growing the vector costs more than the lexing
+	m_tokens.reserve(m_code.length() / 8);
+	lex_range(m_source.length());
+}
+
+void ysen::lang::Lexer::reset(core::String code, WhitespacePolicy whitespace_policy, CommentPolicy comment_policy)
 {
 	m_whitespace_policy = whitespace_policy;
 	m_comment_policy = comment_policy;
 	m_code = std::move(code);
+	m_source = m_code;
 	m_cursor = 0;
 	m_tokens.clear();
-	m_position = {};
+	m_unescaped_strings.clear();
+	m_line_table = {};
+}
 
-	while (!eof()) {
+void ysen::lang::Lexer::lex_range(size_t end)
+{
+	while (m_cursor < end && !eof()) {
 		auto ch = peek();
 		if (core::is_whitespace(ch)) {
 			lex_ws();
@@ -314,9 +480,36 @@ void ysen::lang::Lexer::lex_impl(core::String code, WhitespacePolicy whitespace_
 	}
 }
 
+void ysen::lang::Lexer::stitch(Lexer& chunk, size_t chunk_start, size_t chunk_end)
+{
+	// Lexing has no state between tokens, so once this lexer and the chunk agree on
+	// where a token starts the chunk's tokens from there on are the right ones
+	auto first = chunk.m_tokens.begin();
+	if (m_cursor > chunk_start) {
+		first = std::lower_bound(chunk.m_tokens.begin(), chunk.m_tokens.end(), m_cursor, [](const Token& token, size_t offset) {
+			return token.offset() < offset;
+		});
+
+		if (first == chunk.m_tokens.end() || first->offset() != m_cursor) {
+			// The chunk started inside a token of the previous one and never fell in step
+			if (m_cursor < chunk_end) {
+				lex_range(chunk_end);
+			}
+			return;
+		}
+	}
+
+	m_tokens.insert(m_tokens.end(), first, chunk.m_tokens.end());
+	// Moving a String keeps its buffer, the tokens' views stay valid
+	for (auto& string : chunk.m_unescaped_strings) {
+		m_unescaped_strings.emplace_back(std::move(string));
+	}
+	m_cursor = chunk.m_cursor;
+}
+
 char ysen::lang::Lexer::peek(int offset) const
 {
-	return m_code.at(m_cursor + offset);
+	return m_source.at(m_cursor + offset);
 }
 
 char ysen::lang::Lexer::consume()
@@ -324,22 +517,11 @@ char ysen::lang::Lexer::consume()
 	if (eof()) return 0;
 	
 	auto c = peek();
-	m_position = c == '\n'
-		? m_position.new_line()
-		: m_position.increment();
-	
 	++m_cursor;
 	return c;
 }
 
-ysen::lang::Token& ysen::lang::Lexer::emit_token(SourcePosition start, SourcePosition end, TokenType type, core::String content)
-{
-	return m_tokens.emplace_back(start, end, type, std::move(content));
-}
-
-ysen::lang::Token& ysen::lang::Lexer::emit_token(SourcePosition start, SourcePosition end, TokenType type, char c)
+ysen::lang::Token& ysen::lang::Lexer::emit_token(uint32_t start, uint32_t end, TokenType type, core::StringView content)
 {
-	core::String content{};
-	content.push(c);
-	return m_tokens.emplace_back(start, end, type, std::move(content));
+	return m_tokens.emplace_back(start, end, type, content);
 }
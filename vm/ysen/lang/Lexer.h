@@ -1,10 +1,13 @@
 #pragma once
+#include <deque>
 #include <string_view>
 #include <vector>
 
 
 #include "ysen/core/NonnullOwnPtr.h"
 #include "ysen/Core/String.h"
+#include "ysen/core/StringView.h"
+#include "ysen/core/ThreadPool.h"
 
 namespace ysen::lang {
 
@@ -32,7 +35,7 @@ namespace ysen::lang {
 	__TOKEN_TYPE_ENUMERATOR(BinOp, bin_op) \
 	__TOKEN_TYPE_ENUMERATOR(Dot, dot) \
 	
-	enum class TokenType
+	enum class TokenType : uint8_t
 	{
 #define __TOKEN_TYPE_ENUMERATOR(c, ...) c,
 		TOKEN_TYPE_ENUMERATOR
@@ -40,6 +43,37 @@ namespace ysen::lang {
 	};
 
 	static core::String to_string(TokenType);
+
+#define KEYWORD_ENUMERATOR \
+	__KEYWORD_ENUMERATOR(Var, var) \
+	__KEYWORD_ENUMERATOR(If, if) \
+	__KEYWORD_ENUMERATOR(Else, else) \
+	__KEYWORD_ENUMERATOR(While, while) \
+	__KEYWORD_ENUMERATOR(For, for) \
+	__KEYWORD_ENUMERATOR(Class, class) \
+	__KEYWORD_ENUMERATOR(Fun, fun) \
+	__KEYWORD_ENUMERATOR(Ret, ret) \
+	__KEYWORD_ENUMERATOR(Int, int) \
+	__KEYWORD_ENUMERATOR(Float, float) \
+	__KEYWORD_ENUMERATOR(String, string) \
+	__KEYWORD_ENUMERATOR(Continue, continue) \
+	__KEYWORD_ENUMERATOR(Break, break) \
+	__KEYWORD_ENUMERATOR(Require, require) \
+	__KEYWORD_ENUMERATOR(True, true) \
+	__KEYWORD_ENUMERATOR(False, false) \
+
+	enum class Keyword : uint8_t
+	{
+		None,
+#define __KEYWORD_ENUMERATOR(c, ...) c,
+		KEYWORD_ENUMERATOR
+#undef __KEYWORD_ENUMERATOR
+	};
+
+	core::String to_string(Keyword);
+
+	// Keyword::None for anything that isn't a keyword
+	Keyword to_keyword(core::StringView);
 	
 	class SourcePosition
 	{
@@ -53,46 +87,66 @@ namespace ysen::lang {
 		void set_column(uint32_t);
 		const auto& row() const { return m_row; }
 		const auto& column() const { return m_column; }
-
-		SourcePosition increment() const;
-		SourcePosition new_line() const;
 	private:
 		uint32_t m_row{0},
 			m_column{0};
 	};
 
+	// Byte offsets into the source, rows and columns are resolved through the
+	// LineTable of that source when they have to be shown.
 	class SourceRange
 	{
 	public:
 		SourceRange() = default;
-		SourceRange(SourcePosition, SourcePosition);
+		SourceRange(uint32_t start_offset, uint32_t end_offset);
 
-		SourcePosition start_position() const { return m_start_position; }
-		SourcePosition end_position() const { return m_end_position; }
+		uint32_t offset() const { return m_offset; }
+		uint32_t length() const { return m_length; }
+		uint32_t end_offset() const { return m_offset + m_length; }
 
 		core::String to_string() const;
 	private:
-		SourcePosition m_start_position{};
-		SourcePosition m_end_position{};
+		uint32_t m_offset{};
+		uint32_t m_length{};
+	};
+
+	class LineTable
+	{
+	public:
+		LineTable() = default;
+		explicit LineTable(core::StringView source);
+
+		bool empty() const { return m_line_starts.empty(); }
+		size_t line_count() const { return m_line_starts.size(); }
+
+		SourcePosition position(uint32_t offset) const;
+		core::String to_string(SourceRange) const;
+	private:
+		std::vector<uint32_t> m_line_starts{};
 	};
 	
+	// The content of a token is a view into the source kept by the Lexer (or
+	// into the Lexer's copy of an unescaped string), tokens must not outlive it.
 	class Token
 	{
 	public:
 		Token() = default;
-		Token(SourcePosition, SourcePosition, TokenType, core::String);
+		Token(uint32_t start_offset, uint32_t end_offset, TokenType, core::StringView);
+		Token(uint32_t start_offset, uint32_t end_offset, Keyword, core::StringView);
 
 		core::String to_string() const;
 		
-		SourcePosition start_position() const { return m_start_position; }
-		SourcePosition end_position() const { return m_end_position; }
-		SourceRange source_range() const { return { start_position(), end_position() }; }
+		uint32_t offset() const { return m_offset; }
+		uint32_t end_offset() const { return m_offset + m_length; }
+		SourceRange source_range() const { return { offset(), end_offset() }; }
 		TokenType type() const { return m_type; }
-		const core::String& content() const { return m_content; }
+		Keyword keyword() const { return m_keyword; }
+		core::StringView content() const { return m_content; }
 
 #define __TOKEN_TYPE_ENUMERATOR(camel, snake) bool is_##snake() const { return m_type == TokenType::camel; } 
 		TOKEN_TYPE_ENUMERATOR
 #undef __TOKEN_TYPE_ENUMERATOR
+		bool is_keyword(Keyword keyword) const { return m_keyword == keyword; }
 
 		template<typename...Ts>
 		bool is_any_of(const Ts&...ts) const
@@ -100,10 +154,13 @@ namespace ysen::lang {
 			return ((ts == m_type) || ...);
 		}
 	private:
-		SourcePosition m_start_position{};
-		SourcePosition m_end_position{};
+		// The range in the source. Not derived from m_content: a token doesn't know the
+		// source's start, and a string's content leaves out the quotes or is a copy.
+		uint32_t m_offset{};
+		uint32_t m_length{};
 		TokenType m_type{};
-		core::String m_content{};
+		Keyword m_keyword{};
+		core::StringView m_content{};
 	};
 
 	enum class WhitespacePolicy
@@ -123,10 +180,22 @@ namespace ysen::lang {
 	private:
 		Lexer() = default;
 	public:
+		// Tokens point into m_code
+		Lexer(const Lexer&) = delete;
+		Lexer& operator=(const Lexer&) = delete;
+
 		static core::NonnullOwnPtr<Lexer> lex(core::String, WhitespacePolicy = WhitespacePolicy::Ignore, CommentPolicy = CommentPolicy::Ignore);
+		// Same tokens, but code of PARALLEL_CHUNK_SIZE bytes or more is split at line
+		// starts and the chunks are lexed on the pool. A chunk whose start turns out to
+		// be inside a token of the previous one (a string or comment spanning lines) is
+		// resynchronised or lexed again while stitching.
+		static core::NonnullOwnPtr<Lexer> lex(core::String, core::ThreadPool&, WhitespacePolicy = WhitespacePolicy::Ignore, CommentPolicy = CommentPolicy::Ignore);
+		static constexpr size_t PARALLEL_CHUNK_SIZE = 256 * 1024;
 
 		const auto& tokens() const { return m_tokens; }
 		const auto& code() const { return m_code; }
+		// Built on first use, lexing itself never tracks lines
+		const LineTable& line_table() const;
 		auto whitespace_policy() const { return m_whitespace_policy; }
 		auto comment_policy() const { return m_comment_policy; }
 		
@@ -140,28 +209,28 @@ namespace ysen::lang {
 		void lex_number();
 		void lex_string();
 		void lex_other();
+		void lex_single(TokenType);
 		void lex_impl(core::String, WhitespacePolicy, CommentPolicy);
+		void reset(core::String, WhitespacePolicy, CommentPolicy);
+		// Lexes from the cursor until it reaches end, the last token may run past it
+		void lex_range(size_t end);
+		void stitch(Lexer& chunk, size_t chunk_start, size_t chunk_end);
 		char peek(int offset = 0) const;
 		char consume();
-		
-		template<typename Callable>
-		std::tuple<SourcePosition, SourcePosition, core::String> consume_while(Callable&& pred)
-		{
-			auto start = m_position;
-			core::String content;
-			do {
-				content.push(consume());
-			} while(!eof() && pred(peek()));
-			return { start, m_position, content };
-		}
 
-		Token& emit_token(SourcePosition, SourcePosition, TokenType, core::String);
-		Token& emit_token(SourcePosition, SourcePosition, TokenType, char);
+		core::StringView view(size_t start) const { return { m_source.c_str() + start, m_cursor - start }; }
+		uint32_t position() const { return static_cast<uint32_t>(m_cursor); }
+
+		Token& emit_token(uint32_t, uint32_t, TokenType, core::StringView);
 	private:
 		core::String m_code{};
+		// Lexing reads from here, chunk lexers point it into the code of the lexer they work for
+		core::StringView m_source{};
+		// Strings with escape sequences can't be a view of the source, deque keeps them in place
+		std::deque<core::String> m_unescaped_strings{};
 		std::vector<Token> m_tokens{};
-		SourcePosition m_position{};
 		size_t m_cursor{};
+		mutable LineTable m_line_table{};
 		WhitespacePolicy m_whitespace_policy{};
 		CommentPolicy m_comment_policy{};
 	};
@@ -0,0 +1,280 @@
+#include "ModuleCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <set>
+
+#include "Lexer.h"
+#include "Parser.h"
+#include "ast/ConstantFolder.h"
+#include "ysen/fs/io.h"
+
+ysen::lang::Module::Module(core::String path, ast::ProgramPtr program, std::vector<ModulePtr> dependencies)
+	: m_path(std::move(path)), m_program(std::move(program)), m_dependencies(std::move(dependencies))
+{}
+
+void ysen::lang::Module::declare(astvm::Interpreter& vm) const
+{
+	for (const auto& dependency : m_dependencies) {
+		dependency->declare(vm);
+	}
+
+	for (const auto& function : m_functions) {
+		vm.add(function);
+	}
+
+	const auto& variables = vm.global_scope()->variables();
+	for (const auto& [name, value] : m_variables) {
+		if (!variables.contains(name)) {
+			vm.add(astvm::var(name, astvm::value(value)));
+		}
+	}
+}
+
+void ysen::lang::Module::run(astvm::Interpreter& vm)
+{
+	vm.execute(m_program);
+
+	// Functions are its own if they were declared by its program, variables unless
+	// one of the modules it requires exports them
+	std::set<core::String> required{};
+	std::function<void(const Module&)> collect = [&](const Module& module) {
+		for (const auto& dependency : module.m_dependencies) {
+			for (const auto& [name, value] : dependency->m_variables) {
+				required.insert(name);
+			}
+			collect(*dependency);
+		}
+	};
+	collect(*this);
+
+	const auto& global = vm.global_scope();
+	for (const auto& [name, function] : global->functions()) {
+		if (function->program().ptr() == m_program.ptr()) {
+			m_functions.push_back(function);
+		}
+	}
+
+	for (const auto& [name, variable] : global->variables()) {
+		if (!required.contains(name)) {
+			m_variables.emplace(name, *variable->value());
+		}
+	}
+}
+
+ysen::lang::ModuleCache::ModuleCache(size_t thread_count)
+	: m_pool(thread_count)
+{}
+
+ysen::lang::ModuleCache& ysen::lang::ModuleCache::shared()
+{
+	static ModuleCache cache{};
+	return cache;
+}
+
+ysen::core::String ysen::lang::ModuleCache::resolve(const core::String& path, const core::String& from)
+{
+	if (path.length() == 0) {
+		throw ModuleError("Empty module path");
+	}
+
+	std::filesystem::path resolved{ path.c_str() };
+	if (resolved.is_relative() && from.length() > 0) {
+		resolved = std::filesystem::path{ from.c_str() }.parent_path() / resolved;
+	}
+
+	return std::filesystem::absolute(resolved).lexically_normal().string().c_str();
+}
+
+std::vector<ysen::core::String> ysen::lang::ModuleCache::required_paths(const ast::Program& program, const core::String& from)
+{
+	std::vector<core::String> paths{};
+	for (const auto* child : program.children()) {
+		if (child->is_require_statement()) {
+			paths.push_back(resolve(static_cast<const ast::RequireStatement*>(child)->path(), from));
+		}
+	}
+
+	return paths;
+}
+
+std::vector<ysen::lang::ModulePtr> ysen::lang::ModuleCache::load(const std::vector<core::String>& paths, const astvm::Interpreter& host)
+{
+	std::lock_guard load_lock{m_load_mutex};
+
+	// Parses a level of the dependency graph at a time, the modules not loaded yet
+	std::map<core::String, Parsed> parsed{};
+	std::vector<core::String> level{};
+	for (const auto& path : paths) {
+		if (!find(path) && parsed.emplace(path, Parsed{}).second) {
+			level.push_back(path);
+		}
+	}
+
+	while (!level.empty()) {
+		std::vector<std::future<Parsed>> futures{};
+		for (const auto& path : level) {
+			futures.push_back(m_pool.submit([path]() {
+				return parse(path);
+			}));
+		}
+
+		std::vector<core::String> next{};
+		for (auto i = 0u; i < futures.size(); ++i) {
+			auto module = futures[i].get();
+			for (const auto& dependency : module.dependencies) {
+				if (!find(dependency) && parsed.emplace(dependency, Parsed{}).second) {
+					next.push_back(dependency);
+				}
+			}
+			parsed[level[i]] = std::move(module);
+		}
+
+		level = std::move(next);
+	}
+
+	check_cycles(parsed);
+
+	// Natives are taken from the host before anything runs on the pool
+	std::vector<astvm::FunctionPtr> natives{};
+	for (const auto& [name, function] : host.global_scope()->functions()) {
+		if (!function->ast_node()) {
+			natives.push_back(function);
+		}
+	}
+
+	// Runs the modules whose dependencies are all loaded, there is one at least without a cycle
+	while (!parsed.empty()) {
+		std::vector<core::String> ready{};
+		for (const auto& [path, module] : parsed) {
+			auto is_ready = std::all_of(module.dependencies.begin(), module.dependencies.end(), [&](const core::String& dependency) {
+				return !parsed.contains(dependency);
+			});
+			if (is_ready) {
+				ready.push_back(path);
+			}
+		}
+
+		std::vector<std::future<ModulePtr>> futures{};
+		for (const auto& path : ready) {
+			futures.push_back(m_pool.submit([this, &path, &parsed, &natives]() {
+				return run(path, parsed.at(path), natives);
+			}));
+		}
+
+		// Tasks refer to parsed, none may be left running when one of them throws
+		for (auto& future : futures) {
+			future.wait();
+		}
+
+		for (auto i = 0u; i < futures.size(); ++i) {
+			auto module = futures[i].get();
+			{
+				std::lock_guard lock{m_mutex};
+				m_modules[ready[i]] = std::move(module);
+			}
+			parsed.erase(ready[i]);
+		}
+	}
+
+	std::vector<ModulePtr> modules{};
+	for (const auto& path : paths) {
+		modules.push_back(find(path));
+	}
+
+	return modules;
+}
+
+ysen::lang::ModulePtr ysen::lang::ModuleCache::find(const core::String& path) const
+{
+	std::lock_guard lock{m_mutex};
+	auto it = m_modules.find(path);
+	return it != m_modules.end() ? it->second : nullptr;
+}
+
+void ysen::lang::ModuleCache::clear()
+{
+	std::lock_guard lock{m_mutex};
+	m_modules.clear();
+}
+
+size_t ysen::lang::ModuleCache::size() const
+{
+	std::lock_guard lock{m_mutex};
+	return m_modules.size();
+}
+
+ysen::lang::ModuleCache::Parsed ysen::lang::ModuleCache::parse(const core::String& path)
+{
+	auto code = fs::read_file(path);
+	if (!code.has_value()) {
+		throw ModuleError(core::format("Cannot read module '{}'", path));
+	}
+
+	auto lexer = core::adopt_shared(Lexer::lex(code.release_value()).release());
+	auto program = Parser{}.parse(std::move(lexer));
+	ast::ConstantFolder::fold(*program);
+
+	auto dependencies = required_paths(*program, path);
+	return { std::move(program), std::move(dependencies) };
+}
+
+void ysen::lang::ModuleCache::check_cycles(const std::map<core::String, Parsed>& parsed)
+{
+	// Modules loaded before can't lead back to the ones being loaded
+	std::set<core::String> done{};
+	std::vector<core::String> stack{};
+	std::function<void(const core::String&)> visit = [&](const core::String& path) {
+		if (done.contains(path) || !parsed.contains(path)) {
+			return;
+		}
+
+		if (auto it = std::find(stack.begin(), stack.end(), path); it != stack.end()) {
+			core::String cycle{};
+			for (; it != stack.end(); ++it) {
+				cycle.append(*it);
+				cycle.append(" -> ");
+			}
+			cycle.append(path);
+			throw ModuleError(core::format("Cyclic require: {}", cycle));
+		}
+
+		stack.push_back(path);
+		for (const auto& dependency : parsed.at(path).dependencies) {
+			visit(dependency);
+		}
+		stack.pop_back();
+		done.insert(path);
+	};
+
+	for (const auto& [path, module] : parsed) {
+		visit(path);
+	}
+}
+
+ysen::lang::ModulePtr ysen::lang::ModuleCache::run(const core::String& path, const Parsed& parsed, const std::vector<astvm::FunctionPtr>& natives)
+{
+	std::vector<ModulePtr> dependencies{};
+	for (const auto& dependency : parsed.dependencies) {
+		dependencies.push_back(find(dependency));
+	}
+
+	auto module = core::adopt_shared(new Module{ path, parsed.program, std::move(dependencies) });
+
+	astvm::Interpreter vm{};
+	for (const auto& native : natives) {
+		vm.add(native);
+	}
+	vm.set_require_handler([this, &path](astvm::Interpreter& vm, const core::String& required) {
+		auto dependency = find(resolve(required, path));
+		if (!dependency) {
+			throw ModuleError(core::format("'{}' isn't required at the top level of '{}'", required, path));
+		}
+		dependency->declare(vm);
+	});
+
+	module->run(vm);
+	return module;
+}
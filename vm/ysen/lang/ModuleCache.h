@@ -0,0 +1,111 @@
+#pragma once
+#include <exception>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "astvm/Interpreter.h"
+#include "ast/node.h"
+#include "ysen/core/format.h"
+#include "ysen/core/String.h"
+#include "ysen/core/ThreadPool.h"
+
+namespace ysen::lang {
+
+	class ModuleError : public std::exception
+	{
+	public:
+		ModuleError(core::String message)
+			: m_message(core::format("ModuleError: {}", message))
+		{}
+
+		char const* what() const override
+		{
+			return m_message.c_str();
+		}
+	private:
+		core::String m_message{};
+	};
+
+	class Module;
+	using ModulePtr = core::SharedPtr<Module>;
+
+	// A script run once, in an interpreter of its own; the functions and variables
+	// its top level declares are what it exports. A module doesn't change once
+	// loaded, every environment requiring it shares it.
+	class Module
+	{
+	public:
+		Module(core::String path, ast::ProgramPtr program, std::vector<ModulePtr> dependencies);
+
+		const core::String& path() const { return m_path; }
+		const ast::ProgramPtr& program() const { return m_program; }
+		const std::vector<ModulePtr>& dependencies() const { return m_dependencies; }
+		const std::vector<astvm::FunctionPtr>& functions() const { return m_functions; }
+		const std::map<core::String, astvm::Value>& variables() const { return m_variables; }
+
+		// Declares the exports of the modules it requires and then its own in the global
+		// scope, the functions of a module call each other by name. Variables declared
+		// already are left as they are.
+		void declare(astvm::Interpreter&) const;
+	private:
+		friend class ModuleCache;
+		void run(astvm::Interpreter&);
+
+		core::String m_path{};
+		ast::ProgramPtr m_program{};
+		std::vector<ModulePtr> m_dependencies{};
+		std::vector<astvm::FunctionPtr> m_functions{};
+		std::map<core::String, astvm::Value> m_variables{};
+	};
+
+	// Modules by absolute path, each loaded once; ScriptEnvironments share the
+	// process wide cache. A load parses the modules asked for and whatever they
+	// require, a level of the dependency graph at a time on the pool, and throws
+	// a ModuleError if they require each other in a cycle. Then the modules whose
+	// dependencies are loaded run in parallel, until all of them are.
+	//
+	// Functions of a module may be called from any thread, modules are therefore
+	// parsed with their bodies. Only requires at the top level of a module are
+	// loaded along with it, a module can't require anything else while it runs.
+	class ModuleCache
+	{
+	public:
+		explicit ModuleCache(size_t thread_count = core::ThreadPool::default_thread_count());
+		ModuleCache(const ModuleCache&) = delete;
+		ModuleCache& operator=(const ModuleCache&) = delete;
+
+		static ModuleCache& shared();
+
+		// The path of a module required from the module at from, from the working
+		// directory if from is empty
+		static core::String resolve(const core::String& path, const core::String& from = {});
+		// Resolved paths of the require statements at the top level of program
+		static std::vector<core::String> required_paths(const ast::Program& program, const core::String& from = {});
+
+		// Loads the modules at the resolved paths and what they require, unless they
+		// are already. Modules are run with the natives of host.
+		std::vector<ModulePtr> load(const std::vector<core::String>& paths, const astvm::Interpreter& host);
+		ModulePtr find(const core::String& path) const;
+
+		void clear();
+		size_t size() const;
+	private:
+		struct Parsed
+		{
+			ast::ProgramPtr program{};
+			std::vector<core::String> dependencies{};
+		};
+
+		static Parsed parse(const core::String& path);
+		static void check_cycles(const std::map<core::String, Parsed>&);
+		ModulePtr run(const core::String& path, const Parsed&, const std::vector<astvm::FunctionPtr>& natives);
+
+		mutable std::mutex m_mutex{};
+		// Held for a whole load, so that two loads never load one module twice
+		std::mutex m_load_mutex{};
+		std::map<core::String, ModulePtr> m_modules{};
+		core::ThreadPool m_pool;
+	};
+
+}
@@ -1,20 +1,138 @@
+#include <algorithm>
+
 #include <ysen/lang/Parser.h>
 #include <ysen/lang/ast/node.h>
 
 #include "ysen/core/format.h"
 
-ysen::lang::ast::ProgramPtr ysen::lang::Parser::parse(std::vector<Token> tokens)
+ysen::lang::Parser::Parser(ParserOptions options)
+	: m_options(options)
+{}
+
+ysen::lang::ast::ProgramPtr ysen::lang::Parser::parse(const std::vector<Token>& tokens)
 {
-	m_tokens = std::move(tokens);
-	m_root_node = core::adopt_shared(new ast::Program{{}});
+	m_lexer = nullptr;
+	m_defer_bodies = false;
+	return parse_top_level(tokens, 0, tokens.size());
+}
 
-	parse_inner_block();
-	return m_root_node;
+ysen::lang::ast::ProgramPtr ysen::lang::Parser::parse(const Lexer& lexer)
+{
+	m_lexer = &lexer;
+	m_defer_bodies = false;
+	return parse_top_level(lexer.tokens(), 0, lexer.tokens().size());
+}
+
+ysen::lang::ast::ProgramPtr ysen::lang::Parser::parse(core::SharedPtr<Lexer> lexer)
+{
+	auto end = lexer->tokens().size();
+	return parse(std::move(lexer), 0, end);
+}
+
+ysen::lang::ast::ProgramPtr ysen::lang::Parser::parse(core::SharedPtr<Lexer> lexer, size_t first, size_t end)
+{
+	m_lexer = lexer.ptr();
+	m_defer_bodies = m_options.lazy_function_bodies;
+	auto program = parse_top_level(lexer->tokens(), first, end);
+	m_defer_bodies = false;
+
+	if (m_options.lazy_function_bodies) {
+		program->defer_bodies(std::move(lexer), m_options);
+	}
+
+	return program;
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_deferred(ast::Program& program, const Lexer& lexer, size_t first, size_t end)
+{
+	m_program = &program;
+	m_lexer = &lexer;
+	m_tokens = &lexer.tokens();
+	m_cursor = first;
+	m_end = end;
+	m_in_parallel_body = false;
+	m_defer_bodies = m_options.lazy_function_bodies;
+
+	auto body = parse_statement_or_expression();
+	if (!eof()) {
+		throw ParseError("Unexpected token after function body", peek(), line_table());
+	}
+
+	return body;
+}
+
+std::tuple<ysen::lang::ast::ProgramPtr, size_t> ysen::lang::Parser::parse_statement(core::SharedPtr<Lexer> lexer, size_t first)
+{
+	m_lexer = lexer.ptr();
+	m_tokens = &lexer->tokens();
+	m_cursor = first;
+	m_end = m_tokens->size();
+	m_in_parallel_body = false;
+	m_defer_bodies = m_options.lazy_function_bodies;
+
+	auto program = core::adopt_shared(new ast::Program{ SourceRange{}, 1024 });
+	m_program = program.ptr();
+
+	auto skip_semi_colons = [this]() {
+		while (!eof() && peek().is_semi_colon()) {
+			consume();
+		}
+	};
+
+	skip_semi_colons();
+	if (!eof()) {
+		if (auto node = parse_statement_or_expression(); node) {
+			program->emit(node);
+		}
+		skip_semi_colons();
+	}
+
+	m_defer_bodies = false;
+	if (m_options.lazy_function_bodies) {
+		program->defer_bodies(std::move(lexer), m_options);
+	}
+
+	return { program, m_cursor };
+}
+
+std::tuple<ysen::lang::ast::ProgramPtr, std::vector<std::pair<size_t, size_t>>> ysen::lang::Parser::parse_statements(core::SharedPtr<Lexer> lexer)
+{
+	m_lexer = lexer.ptr();
+	m_tokens = &lexer->tokens();
+	m_cursor = 0;
+	m_end = m_tokens->size();
+	m_in_parallel_body = false;
+	m_defer_bodies = m_options.lazy_function_bodies;
+
+	auto program = core::adopt_shared(new ast::Program{ SourceRange{}, m_end * 48 });
+	m_program = program.ptr();
+
+	std::vector<std::pair<size_t, size_t>> spans{};
+	while (!eof()) {
+		if (peek().is_semi_colon()) {
+			consume();
+			continue;
+		}
+
+		auto first = m_cursor;
+		if (auto node = parse_statement_or_expression(); node) {
+			program->emit(node);
+			// Missing tokens at the end read as None, which the cursor may have stepped over
+			spans.emplace_back(first, std::min(m_cursor, m_end));
+		}
+	}
+
+	m_defer_bodies = false;
+	if (m_options.lazy_function_bodies) {
+		program->defer_bodies(std::move(lexer), m_options);
+	}
+
+	return { program, std::move(spans) };
 }
 
 bool ysen::lang::Parser::eof(int offset) const
 {
-	return m_cursor + offset >= m_tokens.size();
+	return m_cursor + offset >= m_end;
 }
 
 void ysen::lang::Parser::unwind()
@@ -24,13 +142,17 @@ void ysen::lang::Parser::unwind()
 	}
 }
 
-ysen::lang::Token ysen::lang::Parser::peek(int offset) const
+const ysen::lang::Token& ysen::lang::Parser::peek(int offset) const
 {
-	return m_tokens[m_cursor + offset];
+	// Past the end (or before the start) there is a None token, which matches nothing
+	static const Token none{};
+	auto index = m_cursor + offset;
+	return index < m_end ? (*m_tokens)[index] : none;
 }
-ysen::lang::Token ysen::lang::Parser::consume()
+
+const ysen::lang::Token& ysen::lang::Parser::consume()
 {
-	auto tok = peek();
+	const auto& tok = peek();
 	++m_cursor;
 	return tok;
 }
@@ -52,23 +174,19 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_function_call(const Tok
 			continue;
 		}
 
-		throw ParseError("Unexpected token", peek());
+		throw ParseError("Unexpected token", peek(), line_table());
 	}
 
 	consume(); // Consume )
 
-	return core::dynamic_shared_cast<ast::Expression>(
-		core::adopt_shared(
-			new ast::FunctionCallExpression(
-				{ token.start_position(), peek(-1).end_position() }, token.content(), std::move(arguments)
-			)
-		)
+	return make<ast::FunctionCallExpression>(
+		SourceRange{ token.offset(), peek(-1).end_offset() }, token.content().to_string(), std::move(arguments)
 	);
 }
 
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_array_or_object()
 {
-	auto start = consume().start_position();
+	auto start = consume().offset();
 
 	std::vector<ast::ExpressionPtr> expressions{};
 	std::vector<ast::KeyValueExpressionPtr> object_map{};
@@ -77,18 +195,18 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_array_or_object()
 		auto expr = parse_expression();
 
 		if (eof()) {
-			throw ParseError("Unexpected EOF when parsing array or object", peek(-1));
+			throw ParseError("Unexpected EOF when parsing array or object", peek(-1), line_table());
 		}
 
 		if (is_object || peek().is_colon()) {
 			if (!peek().is_colon()) {
-				throw ParseError("Cannot mix array and object notation", peek());
+				throw ParseError("Cannot mix array and object notation", peek(), line_table());
 			}
 			
 			is_object = true;
 			consume(); // :
 			auto value = parse_expression();
-			object_map.emplace_back(core::adopt_shared(new ast::KeyValueExpression({}, std::move(expr), std::move(value))));
+			object_map.emplace_back(make<ast::KeyValueExpression>(SourceRange{}, expr, value));
 		}
 		else {
 			expressions.emplace_back(std::move(expr));
@@ -98,70 +216,63 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_array_or_object()
 			consume();
 		}
 		else if (!peek().is_bracket_close()) {
-			throw ParseError("Unexpected token when parsing array or object", peek());
+			throw ParseError("Unexpected token when parsing array or object", peek(), line_table());
 		}
 	}
 	 
 	if (eof()) {
-		throw ParseError("Unexpected EOF when parsing array or object", peek(-1));
+		throw ParseError("Unexpected EOF when parsing array or object", peek(-1), line_table());
 	}
 	
 	if (!peek().is_bracket_close()) {
-		throw ParseError("Unexpected token when parsing array or object", peek());
+		throw ParseError("Unexpected token when parsing array or object", peek(), line_table());
 	}
 
-	auto end = consume().end_position(); // ]
+	auto end = consume().end_offset(); // ]
 
 	if (is_object) {
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::ObjectExpression({start, end}, std::move(object_map)))
-		);
+		return make<ast::ObjectExpression>(SourceRange{start, end}, std::move(object_map));
 	}
 
-	return core::dynamic_shared_cast<ast::Expression>(
-		core::adopt_shared(new ast::ArrayExpression{{start, end}, std::move(expressions)})	
-	);
+	return make<ast::ArrayExpression>(SourceRange{start, end}, std::move(expressions));
 }
 
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_factor()
 {
-	auto token = consume();
+	// An expression too, var total = parallel(+) for ... reads its reduction
+	if (is_parallel_for()) {
+		return parse_parallel_for();
+	}
+
+	const auto& token = consume();
 	if (token.is_integer()) {
 		auto number = token.content().to_integer();
 
 		if (!eof() && peek().is_dot() && !eof(1) && peek(1).is_dot() && !eof(2) && peek(2).is_integer()) {
 			consume(); // ..
 			consume();
-			auto max_tok = consume();
-
-			return core::dynamic_shared_cast<ast::Expression>(
-				core::adopt_shared(new ast::NumericRangeExpression(
-					{token.start_position(), max_tok.end_position()},
-					number,
-					max_tok.content().to_integer()
-				))
+			const auto& max_tok = consume();
+
+			return make<ast::NumericRangeExpression>(
+				SourceRange{token.offset(), max_tok.end_offset()},
+				number,
+				max_tok.content().to_integer()
 			);
 		}
 
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::IntegerExpression(token.source_range(), number))
-		);
+		return make<ast::IntegerExpression>(token.source_range(), number);
 	}
 	else if (token.is_floating_point_number()) {
 		auto number = token.content().to_float();
 
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::FloatExpression(token.source_range(), number))
-		);
+		return make<ast::FloatExpression>(token.source_range(), number);
 	}
 	else if (token.is_string()) {
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::StringExpression(token.source_range(), token.content()))
-		);
+		return make<ast::StringExpression>(token.source_range(), token.content().to_string());
 	}
 	else if (token.is_paren_open()) {
 		auto node = parse_expression();
-		auto ending_paren = consume();
+		const auto& ending_paren = consume();
 		return node;
 	}
 	else if (token.is_identifier()) {
@@ -171,25 +282,19 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_factor()
 		}
 
 		if (!eof() && peek().is_dot() && !eof(1) && peek(1).is_identifier()) {
-			SourceRange range{token.start_position(), peek(1).end_position()};
+			SourceRange range{token.offset(), peek(1).end_offset()};
 			consume(); // .
-			auto field = consume();
-			return core::dynamic_shared_cast<ast::Expression>(
-				core::adopt_shared(new ast::AccessExpression(range, token.content(), field.content()))
-			);
+			const auto& field = consume();
+			return make<ast::AccessExpression>(range, token.content().to_string(), field.content().to_string());
 		}
 
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::IdentifierExpression(token.source_range(), token.content()))
-		);
+		return make<ast::IdentifierExpression>(token.source_range(), token.content().to_string());
 	}
 	else if (token.is_string()) {
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::StringExpression(token.source_range(), token.content()))
-		);
+		return make<ast::StringExpression>(token.source_range(), token.content().to_string());
 	}
 	else if (token.is_squiggly_open()) {
-		auto scope = core::adopt_shared(new ast::ScopeStatement{ {} });
+		auto* scope = make<ast::ScopeStatement>(SourceRange{});
 
 		while (!eof() && !peek().is_squiggly_close()) {
 			auto expr = parse_statement_or_expression();
@@ -198,27 +303,31 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_factor()
 				continue;
 			}
 
-			scope->emit(core::reinterpret_shared_cast<ast::Statement>(expr));
+			scope->emit(expr);
 		}
 
 		if (eof()) {
-			throw ParseError("Unexpected EOF when parsing '{' block", peek(-1));
+			throw ParseError("Unexpected EOF when parsing '{' block", peek(-1), line_table());
 		}
 
 		if (!peek().is_squiggly_close()) {
-			throw ParseError("Unexpected token when expected closing '}'", peek());
+			throw ParseError("Unexpected token when expected closing '}'", peek(), line_table());
 		}
  
 		consume(); // }
-		return core::dynamic_shared_cast<ast::Expression>(scope);
+		return scope;
 	}
-	else if (token.is_keyword() && token.content() == "ret") {
+	else if (token.is_keyword(Keyword::Ret)) {
+		// The workers would each return on their own, with no function to return from
+		if (m_in_parallel_body) {
+			throw ParseError("ret inside the body of a parallel loop", token, line_table());
+		}
+
 		auto expr = parse_expression();
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::ReturnExpression({ token.start_position(), expr->source_range().end_position() }, std::move(expr)))
-		);
+		SourceRange source_range{ token.offset(), expr->source_range().end_offset() };
+		return make<ast::ReturnExpression>(source_range, expr);
 	}
-	else if (token.is_keyword() && token.content() == "fun") {
+	else if (token.is_keyword(Keyword::Fun)) {
 		// Parse function
 		unwind();
 		return parse_fun_decl_or_expr();
@@ -228,7 +337,7 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_factor()
 		return parse_array_or_object();
 	}
 
-	throw ParseError("Unknown token when parsing factor", token);
+	throw ParseError("Unknown token when parsing factor", token, line_table());
 }
 
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_term()
@@ -236,16 +345,14 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_term()
 	auto node = parse_factor();
 
 	while (!eof() && peek().is_bin_op() && peek().content().is_equal_to_any_of("*", "/")) {
-		auto token = consume();
+		const auto& token = consume();
 		auto op{ ast::BinOp::Division };
 
 		if (token.content() == "*") {
 			op = ast::BinOp::Multiplication;
 		}
 
-		node = core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::BinOpExpression(token.source_range(), node, parse_factor(), op))
-		);
+		node = make<ast::BinOpExpression>(token.source_range(), node, parse_factor(), op);
 	}
 
 	return node;
@@ -256,7 +363,7 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_expression()
 	auto node = parse_term();
 
 	while (!eof() && peek().is_bin_op()) {
-		auto token = consume();
+		const auto& token = consume();
 		ast::BinOp op{};
 
 		if (token.content() == "+") {
@@ -278,9 +385,7 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_expression()
 			op = ast::BinOp::LessEqual;
 		}
 
-		node = core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::BinOpExpression(token.source_range(), node, parse_term(), op))
-		);
+		node = make<ast::BinOpExpression>(token.source_range(), node, parse_term(), op);
 	}
 
 	return node;
@@ -288,33 +393,27 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_expression()
 
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_var_declaration()
 {
-	auto start = peek().start_position();
+	auto start = peek().offset();
 	consume();
 
 	if (!peek().is_identifier()) {
-		throw ParseError("var without identifier", peek());
+		throw ParseError("var without identifier", peek(), line_table());
 	}
 
-	auto name = consume().content();
+	auto name = consume().content().to_string();
 
 	if (peek().is_semi_colon() || peek().is_colon()) {
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(new ast::VarDeclaration(SourceRange{ start, consume().end_position() }, std::move(name)))
-		);
+		return make<ast::VarDeclaration>(SourceRange{ start, consume().end_offset() }, std::move(name));
 	}
 
 	consume(); // Consume '='
 	auto expression = parse_expression();
-	auto declaration = core::adopt_shared(
-		new ast::VarDeclaration{ {start, expression->source_range().end_position()}, std::move(name), expression }
-	);
-
-	return core::dynamic_shared_cast<ast::Expression>(declaration);
+	return make<ast::VarDeclaration>(SourceRange{start, expression->source_range().end_offset()}, std::move(name), expression);
 }
 
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_fun_decl_or_expr()
 {
-	auto start = consume().start_position();
+	auto start = consume().offset();
 	core::String name{};
 	auto is_anon_expr = false;
 
@@ -322,11 +421,11 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_fun_decl_or_expr()
 		is_anon_expr = true;
 	}
 	else {
-		name = consume().content();
+		name = consume().content().to_string();
 	}
 
 	if (!peek().is_paren_open()) {
-		throw ParseError("fun without paren", peek());
+		throw ParseError("fun without paren", peek(), line_table());
 	}
 
 	consume();
@@ -335,29 +434,29 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_fun_decl_or_expr()
 	while (!eof() && !peek().is_paren_close()) {
 		if (!peek().is_identifier()) {
 			error("Unknown token in param list");
-			throw ParseError(core::format("Unknown token in param list"), peek());
+			throw ParseError(core::format("Unknown token in param list"), peek(), line_table());
 		}
-		auto name_tok = consume();
-		auto parameter_name = name_tok.content();
+		const auto& name_tok = consume();
+		auto parameter_name = name_tok.content().to_string();
 		core::String type_name{};
-		auto end_tok = name_tok;
+		const auto* end_tok = &name_tok;
 		
 		if (eof()) {
-			throw ParseError("Unexpected EOF", peek(-1));
+			throw ParseError("Unexpected EOF", peek(-1), line_table());
 		}
 
 		if (peek().is_colon() && peek(1).is_any_of(TokenType::Keyword, TokenType::Identifier)) {
 			consume(); // :
-			end_tok = consume();
-			type_name = end_tok.content();
+			end_tok = &consume();
+			type_name = end_tok->content().to_string();
 		}
 
-		params.emplace_back(core::adopt_shared(new ast::FunctionParameterExpression{
-			{name_tok.start_position(), end_tok.end_position()},
+		params.emplace_back(make<ast::FunctionParameterExpression>(
+			SourceRange{name_tok.offset(), end_tok->end_offset()},
 			std::move(parameter_name),
 			std::move(type_name),
 			false
-		}));
+		));
 
 		if (peek().is_comma()) {
 			consume();		
@@ -365,50 +464,115 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_fun_decl_or_expr()
 	}
 
 	if (eof()) {
-		throw ParseError("Unexpected EOF after param list", peek(-1));
+		throw ParseError("Unexpected EOF after param list", peek(-1), line_table());
 	}
 
 	if (!peek().is_paren_close()) {
-		throw ParseError("Expected ) after parameter list", peek());
+		throw ParseError("Expected ) after parameter list", peek(), line_table());
 	}
 	
 	consume(); // consume )
 
-	auto body = parse_statement_or_expression();
+	// A function declared in the body of a parallel loop returns from itself
+	auto in_parallel_body = std::exchange(m_in_parallel_body, false);
+	auto body = m_defer_bodies && !eof() && peek().is_squiggly_open() ?
+		skip_function_body() : ast::FunctionBody{ parse_statement_or_expression() };
+	m_in_parallel_body = in_parallel_body;
+	SourceRange source_range{ start, peek(-1).end_offset() };
 
 	if (is_anon_expr) {
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(
-				new ast::FunctionExpression(
-					{ start, body->source_range().end_position() },
-					std::move(params),
-					body
-				)
-			)
-		);
+		return make<ast::FunctionExpression>(source_range, std::move(params), body);
 	}
 	
-	return core::dynamic_shared_cast<ast::Expression>(
-		core::adopt_shared(
-			new ast::FunctionDeclarationStatement(
-				{ start, body->source_range().end_position() },
-				std::move(name),
-				std::move(params),
-				body
-			)
-		)
-	);
+	return make<ast::FunctionDeclarationStatement>(source_range, std::move(name), std::move(params), body);
+}
+
+ysen::lang::ast::FunctionBody ysen::lang::Parser::skip_function_body()
+{
+	auto first = m_cursor;
+	size_t depth{};
+
+	do {
+		if (eof()) {
+			throw ParseError("Unexpected EOF when parsing '{' block", peek(-1), line_table());
+		}
+
+		const auto& token = consume();
+		if (token.is_squiggly_open()) {
+			++depth;
+		}
+		else if (token.is_squiggly_close()) {
+			--depth;
+		}
+	} while (depth > 0);
+
+	if (m_options.eager_validate) {
+		// Parsed into a scratch program which is thrown away right after
+		ast::Program scratch{ SourceRange{}, (m_cursor - first) * 48 };
+		Parser{m_options}.parse_deferred(scratch, *m_lexer, first, m_cursor);
+	}
+
+	return ast::FunctionBody{ *m_program, static_cast<uint32_t>(first), static_cast<uint32_t>(m_cursor) };
+}
+
+bool ysen::lang::Parser::is_parallel_for() const
+{
+	if (!peek().is_identifier() || peek().content() != "parallel") {
+		return false;
+	}
+
+	// parallel(x) stays a call, only an operator alone in the parentheses reduces
+	return peek(1).is_keyword(Keyword::For) ||
+		(peek(1).is_paren_open() && peek(2).is_bin_op() && peek(3).is_paren_close());
 }
 
-ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_for_ranged_or_conditional()
+ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_parallel_for()
 {
-	auto start_pos = consume().start_position(); // for
+	ParallelPrefix prefix{ consume().offset() }; // parallel
 
 	if (eof()) {
-		throw ParseError("Unexpected EOF", peek(-1));
+		throw ParseError("Unexpected EOF", peek(-1), line_table());
+	}
+	if (peek().is_paren_open()) {
+		consume();
+
+		if (eof()) {
+			throw ParseError("Unexpected EOF", peek(-1), line_table());
+		}
+		// Only operators whose folds don't depend on how the elements are grouped
+		if (!peek().is_bin_op() || !peek().content().is_equal_to_any_of("+", "*")) {
+			throw ParseError("Unexpected token when expecting + or * to reduce with", peek(), line_table());
+		}
+		prefix.reduction = consume().content() == "+" ? ast::BinOp::Addition : ast::BinOp::Multiplication;
+
+		if (eof()) {
+			throw ParseError("Unexpected EOF", peek(-1), line_table());
+		}
+		if (!peek().is_paren_close()) {
+			throw ParseError("Unexpected token when expecting closing parentheses", peek(), line_table());
+		}
+		consume();
+	}
+
+	if (eof()) {
+		throw ParseError("Unexpected EOF", peek(-1), line_table());
+	}
+	if (!peek().is_keyword(Keyword::For)) {
+		throw ParseError("Unexpected token when expecting for", peek(), line_table());
+	}
+
+	return parse_for_ranged_or_conditional(&prefix);
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_for_ranged_or_conditional(const ParallelPrefix* parallel)
+{
+	auto start_pos = consume().offset(); // for
+
+	if (eof()) {
+		throw ParseError("Unexpected EOF", peek(-1), line_table());
 	}
 	if (!peek().is_paren_open()) {
-		throw ParseError("Unexpected token when expecting opening parentheses", peek());
+		throw ParseError("Unexpected token when expecting opening parentheses", peek(), line_table());
 	}
 
 	consume();
@@ -418,7 +582,7 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_for_ranged_or_condition
 	/*
 	// TODO: this isn't needed for now because of a quick hack in parse_var_declaration()
 	if (!peek().is_colon()) {
-		throw ParseError("Unexpected token when expecting colon", peek());	
+		throw ParseError("Unexpected token when expecting colon", peek(), line_table());	
 	}
 	consume(); // :
 	*/
@@ -426,44 +590,46 @@ ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_for_ranged_or_condition
 	auto expr = parse_expression();
 
 	if (!peek().is_paren_close()) {
-		throw ParseError("Unexpected token when expecting closing parentheses", peek());
+		throw ParseError("Unexpected token when expecting closing parentheses", peek(), line_table());
 	}
-	auto paren_close = consume(); // )
+	const auto& paren_close = consume(); // )
 	
+	auto in_parallel_body = std::exchange(m_in_parallel_body, m_in_parallel_body || parallel);
 	auto body = parse_statement_or_expression();
+	m_in_parallel_body = in_parallel_body;
 
-	return core::dynamic_shared_cast<ast::Expression>(
-		core::adopt_shared(new ast::RangedLoopExpression({start_pos, paren_close.end_position()}, decl, expr, body))
-	);
+	if (parallel) {
+		return make<ast::ParallelLoopExpression>(SourceRange{parallel->start, paren_close.end_offset()}, decl, expr, body, parallel->reduction);
+	}
+
+	return make<ast::RangedLoopExpression>(SourceRange{start_pos, paren_close.end_offset()}, decl, expr, body);
 }
 
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_assignment()
 {
-	auto start_pos = peek().start_position();
-	auto identifier = consume().content();
+	auto start_pos = peek().offset();
+	auto identifier = consume().content().to_string();
 	consume(); // =
 	auto expr = parse_expression();
 
-	return core::dynamic_shared_cast<ast::Expression>(
-		core::adopt_shared(new ast::AssignmentExpression({start_pos, expr->source_range().end_position()}, identifier, expr))
-	);
+	return make<ast::AssignmentExpression>(SourceRange{start_pos, expr->source_range().end_offset()}, identifier, expr);
 }
 
 std::tuple<ysen::lang::ast::VarDeclarationPtr, ysen::lang::ast::ExpressionPtr> ysen::lang::Parser::
 parse_if_decl_and_condition()
 {
 	if (eof() || !peek().is_paren_open()) {
-		throw ParseError("Expected opening parentheses after if keyword", eof() ? peek(-1) : peek());
+		throw ParseError("Expected opening parentheses after if keyword", eof() ? peek(-1) : peek(), line_table());
 	}
 	
 	consume(); // (
 	ast::VarDeclarationPtr var_declaration{};
 	
-	if (peek().is_keyword() && peek().content() == "var") {
-		var_declaration = core::dynamic_shared_cast<ast::VarDeclaration>(parse_var_declaration());
+	if (peek().is_keyword(Keyword::Var)) {
+		var_declaration = dynamic_cast<ast::VarDeclaration*>(parse_var_declaration());
 
 		if (eof() || !peek().is_semi_colon()) {
-			throw ParseError("Expected semi-colon after var decl in if", eof() ? peek(-1) : peek());
+			throw ParseError("Expected semi-colon after var decl in if", eof() ? peek(-1) : peek(), line_table());
 		}
 
 		consume(); // ;
@@ -472,101 +638,117 @@ parse_if_decl_and_condition()
 	auto condition = parse_expression();
 
 	if (eof() || !peek().is_paren_close()) {
-		throw ParseError("Expected closing parentheses after condition in if", eof() ? peek(-1) : peek());
+		throw ParseError("Expected closing parentheses after condition in if", eof() ? peek(-1) : peek(), line_table());
 	}
 
 	consume(); // )
 
-	return { std::move(var_declaration), std::move(condition) };
+	return { var_declaration, condition };
 }
 
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_if_stmt()
 {
-	auto if_start_pos = consume().start_position();
+	auto if_start_pos = consume().offset();
 	auto [if_declaration, if_condition] = parse_if_decl_and_condition();
 
+	// A lone ';' parses to nothing, which no branch can do without
+	auto parse_body = [this]() {
+		const auto& token = peek();
+		auto body = parse_statement_or_expression();
+		if (!body) {
+			throw ParseError("Expected body in if", token, line_table());
+		}
+		return body;
+	};
+
 	// Parse body
-	auto if_body = parse_statement_or_expression();
-	SourceRange source_range{if_start_pos, if_body->source_range().end_position()};
-
-	if (eof() || !(peek().is_keyword() && peek().content() == "else")) {
-		return core::dynamic_shared_cast<ast::Expression>(
-			core::adopt_shared(
-				new ast::IfStatement(source_range, std::move(if_declaration), std::move(if_condition), std::move(if_body), {}, nullptr)	
-			)
+	auto if_body = parse_body();
+	SourceRange source_range{if_start_pos, if_body->source_range().end_offset()};
+
+	if (eof() || !peek().is_keyword(Keyword::Else)) {
+		return make<ast::IfStatement>(
+			source_range, if_declaration, if_condition, if_body, std::vector<ast::ElseIfStatementPtr>{}, nullptr
 		);
 	}
 
 	std::vector<ast::ElseIfStatementPtr> else_if_statements{};
-	ast::ElseStatementPtr else_statement;
+	ast::ElseStatementPtr else_statement{};
 	
 	while (true) {
-		if (eof() || !(peek().is_keyword() && peek().content() == "else")) {
+		if (eof() || !peek().is_keyword(Keyword::Else)) {
 			break; // End of if block
 		}
 
-		auto start_pos = consume().start_position(); // else
+		auto start_pos = consume().offset(); // else
 
-		if (peek().is_keyword() && peek().content() == "if") {
+		if (peek().is_keyword(Keyword::If)) {
 			consume(); // if
 
 			auto [if_else_decl, if_else_cond] = parse_if_decl_and_condition();
-			auto if_else_body = parse_statement_or_expression();
-			SourceRange if_else_range{start_pos, if_else_body->source_range().end_position()};
+			auto if_else_body = parse_body();
+			SourceRange if_else_range{start_pos, if_else_body->source_range().end_offset()};
 			
-			else_if_statements.emplace_back(core::adopt_shared(new ast::ElseIfStatement(
+			else_if_statements.emplace_back(make<ast::ElseIfStatement>(
 				if_else_range,
-				std::move(if_else_decl),
-				std::move(if_else_cond),
-				std::move(if_else_body)
-			)));
+				if_else_decl,
+				if_else_cond,
+				if_else_body
+			));
 		}
 		else {
-			auto else_body = parse_statement_or_expression();
-			SourceRange else_range{start_pos, else_body->source_range().end_position()};
+			auto else_body = parse_body();
+			SourceRange else_range{start_pos, else_body->source_range().end_offset()};
 
-			else_statement = core::adopt_shared(new ast::ElseStatement(
-				else_range, 
-				std::move(else_body)
-			));
+			else_statement = make<ast::ElseStatement>(else_range, else_body);
 		}
 	}
 	
-	return core::dynamic_shared_cast<ast::Expression>(
-		core::adopt_shared(
-			new ast::IfStatement(
-				source_range,
-				std::move(if_declaration), 
-				std::move(if_condition), 
-				std::move(if_body), 
-				std::move(else_if_statements), 
-				std::move(else_statement)
-			)	
-		)
+	return make<ast::IfStatement>(
+		source_range,
+		if_declaration,
+		if_condition,
+		if_body,
+		std::move(else_if_statements),
+		else_statement
 	);
 }
 
+ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_require()
+{
+	auto start = consume().offset();
+
+	if (eof() || !peek().is_string()) {
+		throw ParseError("Expected module path after require", peek(), line_table());
+	}
+
+	const auto& path = consume();
+	return make<ast::RequireStatement>(SourceRange{ start, path.end_offset() }, path.content().to_string());
+}
+
 ysen::lang::ast::ExpressionPtr ysen::lang::Parser::parse_statement_or_expression()
 {
-	if (peek().is_keyword() && peek().content() == "var") {
+	if (peek().is_keyword(Keyword::Var)) {
 		return parse_var_declaration();
 	}
-	if (peek().is_keyword() && peek().content() == "fun" && peek(1).is_identifier()) {
+	if (peek().is_keyword(Keyword::Fun) && peek(1).is_identifier()) {
 		return parse_fun_decl_or_expr();
 	}
-	if (peek().is_keyword() && peek().content() == "for") {
+	if (peek().is_keyword(Keyword::For)) {
 		return parse_for_ranged_or_conditional();
 	}
 	if (peek().is_semi_colon()) {
 		consume();
-		return {};
+		return nullptr;
 	}
 	if (peek().is_identifier() && peek(1).is_equals()) {
 		return parse_assignment();
 	}
-	if (peek().is_keyword() && peek().content() == "if") {
+	if (peek().is_keyword(Keyword::If)) {
 		return parse_if_stmt();
 	}
+	if (peek().is_keyword(Keyword::Require)) {
+		return parse_require();
+	}
 	
 	auto expression = parse_expression();
 	return expression;
@@ -579,11 +761,30 @@ void ysen::lang::Parser::parse_inner_block()
 			consume();
 		}
 		else if (auto node = parse_statement_or_expression(); node) {
-			m_root_node->emit(core::reinterpret_shared_cast<ast::AstNode>(node));
+			m_program->emit(node);
 		}
 	}
 }
 
+ysen::lang::ast::ProgramPtr ysen::lang::Parser::parse_top_level(const std::vector<Token>& tokens, size_t first, size_t end)
+{
+	m_tokens = &tokens;
+	m_cursor = first;
+	m_end = end;
+	m_in_parallel_body = false;
+	// Roughly what the nodes of an average token take, so that most programs fit the first chunk
+	auto program = core::adopt_shared(new ast::Program{ SourceRange{}, (end - first) * 48 });
+	m_program = program.ptr();
+
+	parse_inner_block();
+	return program;
+}
+
+const ysen::lang::LineTable* ysen::lang::Parser::line_table() const
+{
+	return m_lexer ? &m_lexer->line_table() : nullptr;
+}
+
 void ysen::lang::Parser::error(core::StringView error)
 {
 	core::print("Error: {}\n", error.c_str());
@@ -1,11 +1,15 @@
 #pragma once
 #include <stack>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 
 #include "Lexer.h"
+#include "ParserOptions.h"
 #include "ast/node.h"
 #include "ysen/core/format.h"
+#include "ysen/core/Optional.h"
 #include "ysen/core/SharedPtr.h"
 #include "ysen/core/StringView.h"
 
@@ -15,15 +19,37 @@ namespace ysen::lang {
 	class Parser
 	{
 	public:
-		Parser() = default;
+		explicit Parser(ParserOptions options = {});
 
-		ast::ProgramPtr parse(std::vector<Token>);
+		// The tokens are borrowed for the duration of the call, the AST owns copies
+		// of every name and string it keeps. Function bodies are always parsed.
+		// Without the lexer a ParseError can't tell the row and column of its token.
+		ast::ProgramPtr parse(const std::vector<Token>&);
+		// As above, with the row and column of a ParseError resolved through the lexer
+		ast::ProgramPtr parse(const Lexer&);
+		// Takes the lexer along, so function bodies may be deferred
+		ast::ProgramPtr parse(core::SharedPtr<Lexer>);
+		// Only the top-level statements in tokens [first, end) of the lexer
+		ast::ProgramPtr parse(core::SharedPtr<Lexer>, size_t first, size_t end);
+
+		// Parses the deferred function body in tokens [first, end) into the program
+		ast::ExpressionPtr parse_deferred(ast::Program&, const Lexer&, size_t first, size_t end);
+		// A program of the one top-level statement starting at token first, and the
+		// index of the token following it (past any ';')
+		std::tuple<ast::ProgramPtr, size_t> parse_statement(core::SharedPtr<Lexer>, size_t first);
+
+		// The whole program, along with the tokens [first, end) of each of its top-level
+		// statements, not counting the ';'s between them
+		std::tuple<ast::ProgramPtr, std::vector<std::pair<size_t, size_t>>> parse_statements(core::SharedPtr<Lexer>);
+
+		// Index of the next token to consume, where the parser stopped after an error
+		size_t cursor() const { return m_cursor; }
 
 	private:
 		bool eof(int offset = 0) const;
 		void unwind();
-		Token peek(int offset = 0) const;
-		Token consume();
+		const Token& peek(int offset = 0) const;
+		const Token& consume();
 
 		ast::ExpressionPtr parse_function_call(const Token& token);
 		ast::ExpressionPtr parse_array_or_object();
@@ -32,37 +58,81 @@ namespace ysen::lang {
 		ast::ExpressionPtr parse_expression();
 		ast::ExpressionPtr parse_var_declaration();
 		ast::ExpressionPtr parse_fun_decl_or_expr();
-		ast::ExpressionPtr parse_for_ranged_or_conditional();
+		ast::FunctionBody skip_function_body();
+		// What parse_parallel_for read ahead of the for
+		struct ParallelPrefix
+		{
+			uint32_t start{};
+			core::Optional<ast::BinOp> reduction{};
+		};
+		// parallel is an identifier, followed by for or by (op) it starts a parallel loop
+		bool is_parallel_for() const;
+		ast::ExpressionPtr parse_parallel_for();
+		ast::ExpressionPtr parse_for_ranged_or_conditional(const ParallelPrefix* parallel = nullptr);
 		ast::ExpressionPtr parse_assignment();
 		std::tuple<ast::VarDeclarationPtr, ast::ExpressionPtr> parse_if_decl_and_condition();
 		ast::ExpressionPtr parse_if_stmt();
+		ast::ExpressionPtr parse_require();
 		ast::ExpressionPtr parse_statement_or_expression();
 		void parse_inner_block();
+		ast::ProgramPtr parse_top_level(const std::vector<Token>&, size_t first, size_t end);
 
 
 		void error(core::StringView);
+		// Of the lexer being parsed, to resolve the position of a ParseError
+		const LineTable* line_table() const;
+
+		// Nodes are allocated in the arena of the program being parsed
+		template<typename T, typename...Args>
+		T* make(Args&&...args) { return m_program->make<T>(std::forward<Args>(args)...); }
 	private:
-		ast::ProgramPtr m_root_node{nullptr};
-		std::vector<Token> m_tokens{};
+		ParserOptions m_options{};
+		bool m_defer_bodies{};
+		// Set while parsing the body of a parallel loop, outside of the functions in it
+		bool m_in_parallel_body{};
+		ast::Program* m_program{};
+		// Null when only the tokens were given
+		const Lexer* m_lexer{};
+		const std::vector<Token>* m_tokens{};
 		size_t m_cursor{};
+		size_t m_end{};
 	};
 
 	class ParseError : public std::exception
 	{
 	public:
-		ParseError(core::String message, Token token)
-			: m_message(core::format("ParseError: '{}' at token {}", message, token.to_string())),
-			m_token(token)
-		{}
+		// The position is resolved through lines right away, the lexer they
+		// belong to may be gone by the time the error is caught
+		ParseError(core::String message, Token token, const LineTable* lines = nullptr)
+			: m_source_range(token.source_range()), m_content(token.content().to_string())
+		{
+			if (lines) {
+				auto position = lines->position(token.offset());
+				m_message = core::format("ParseError: '{}' at {}:{}, token {}", message, position.row(), position.column(), token.to_string());
+				m_position = position;
+			}
+			else {
+				m_message = core::format("ParseError: '{}' at token {}", message, token.to_string());
+			}
+		}
 
 		char const* what() const override
 		{
 			return m_message.c_str();
 		}
 
+		// Of the token the error is at. Its content is copied, the token itself
+		// points into the lexer's source.
+		const SourceRange& source_range() const { return m_source_range; }
+		const core::String& content() const { return m_content; }
+		// Row and column of the token, when the parser had the lexer
+		const core::Optional<SourcePosition>& position() const { return m_position; }
+
 	private:
 		core::String m_message{};
-		Token m_token{};
+		SourceRange m_source_range{};
+		core::String m_content{};
+		core::Optional<SourcePosition> m_position{};
 	};
 	
 }
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace ysen::lang {
+
+	struct ParserOptions
+	{
+		// Only brace-match '{' function bodies and parse them the first time
+		// they are needed. The program keeps the lexer's tokens for that, so
+		// this takes effect with Parser::parse(SharedPtr<Lexer>) only.
+		bool lazy_function_bodies{false};
+		// Syntax check skipped bodies up front instead of on first use,
+		// without keeping the nodes around
+		bool eager_validate{false};
+	};
+
+}
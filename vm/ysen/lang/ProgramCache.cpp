@@ -0,0 +1,102 @@
+#include "ProgramCache.h"
+#include "ysen/core/fnv1a.h"
+
+ysen::lang::ProgramCache::ProgramCache(size_t max_entries, size_t max_bytes)
+	: m_max_entries(max_entries), m_max_bytes(max_bytes)
+{}
+
+ysen::lang::ast::ProgramPtr ysen::lang::ProgramCache::find(core::StringView source)
+{
+	auto entry = lookup(source, hash(source));
+	if (entry == m_entries.end()) {
+		++m_misses;
+		return nullptr;
+	}
+
+	++m_hits;
+	m_entries.splice(m_entries.begin(), m_entries, entry);
+	return entry->program;
+}
+
+void ysen::lang::ProgramCache::insert(core::StringView source, ast::ProgramPtr program)
+{
+	auto key = hash(source);
+	if (auto existing = lookup(source, key); existing != m_entries.end()) {
+		erase(existing);
+	}
+
+	auto bytes = source.length() + program->arena().size();
+	m_entries.push_front(Entry{ key, source.to_string(), std::move(program), bytes });
+	m_index.emplace(key, m_entries.begin());
+	m_bytes += bytes;
+	evict();
+}
+
+bool ysen::lang::ProgramCache::invalidate(core::StringView source)
+{
+	auto entry = lookup(source, hash(source));
+	if (entry == m_entries.end()) {
+		return false;
+	}
+
+	erase(entry);
+	return true;
+}
+
+void ysen::lang::ProgramCache::clear()
+{
+	m_index.clear();
+	m_entries.clear();
+	m_bytes = 0;
+}
+
+void ysen::lang::ProgramCache::set_limits(size_t max_entries, size_t max_bytes)
+{
+	m_max_entries = max_entries;
+	m_max_bytes = max_bytes;
+	evict();
+}
+
+void ysen::lang::ProgramCache::reset_statistics()
+{
+	m_hits = m_misses = m_evictions = 0;
+}
+
+uint64_t ysen::lang::ProgramCache::hash(core::StringView source)
+{
+	return core::fnv1a_64(reinterpret_cast<const unsigned char*>(source.c_str()), source.length());
+}
+
+ysen::lang::ProgramCache::EntryList::iterator ysen::lang::ProgramCache::lookup(core::StringView source, uint64_t hash)
+{
+	auto [begin, end] = m_index.equal_range(hash);
+	for (auto it = begin; it != end; ++it) {
+		if (core::StringView{it->second->source} == source) {
+			return it->second;
+		}
+	}
+
+	return m_entries.end();
+}
+
+void ysen::lang::ProgramCache::erase(EntryList::iterator entry)
+{
+	auto [begin, end] = m_index.equal_range(entry->hash);
+	for (auto it = begin; it != end; ++it) {
+		if (it->second == entry) {
+			m_index.erase(it);
+			break;
+		}
+	}
+
+	m_bytes -= entry->bytes;
+	m_entries.erase(entry);
+}
+
+void ysen::lang::ProgramCache::evict()
+{
+	while (!m_entries.empty() && (m_entries.size() > m_max_entries || m_bytes > m_max_bytes)) {
+		erase(std::prev(m_entries.end()));
+		++m_evictions;
+	}
+}
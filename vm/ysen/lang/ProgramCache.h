@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+#include "ast/node.h"
+#include "ysen/core/String.h"
+#include "ysen/core/StringView.h"
+
+namespace ysen::lang {
+
+	// Least recently used cache of parsed and folded programs, keyed by their
+	// source text. Lookups hash the source and confirm a hit by comparing it
+	// with the stored copy, so colliding sources never share a program.
+	// Evicting a program only drops the cache's reference: functions declared
+	// by it keep it alive for as long as they exist.
+	class ProgramCache
+	{
+	public:
+		static constexpr size_t DEFAULT_MAX_ENTRIES = 256;
+		static constexpr size_t DEFAULT_MAX_BYTES = 16 * 1024 * 1024;
+
+		explicit ProgramCache(size_t max_entries = DEFAULT_MAX_ENTRIES, size_t max_bytes = DEFAULT_MAX_BYTES);
+
+		ast::ProgramPtr find(core::StringView source);
+		void insert(core::StringView source, ast::ProgramPtr program);
+
+		bool invalidate(core::StringView source);
+		void clear();
+
+		// Either limit being exceeded evicts the least recently used programs.
+		// Bytes are those of the source plus the program's arena.
+		void set_limits(size_t max_entries, size_t max_bytes);
+		size_t max_entries() const { return m_max_entries; }
+		size_t max_bytes() const { return m_max_bytes; }
+
+		size_t size() const { return m_entries.size(); }
+		size_t bytes() const { return m_bytes; }
+		size_t hits() const { return m_hits; }
+		size_t misses() const { return m_misses; }
+		size_t evictions() const { return m_evictions; }
+		void reset_statistics();
+	private:
+		struct Entry
+		{
+			uint64_t hash{};
+			core::String source{};
+			ast::ProgramPtr program{};
+			size_t bytes{};
+		};
+		using EntryList = std::list<Entry>;
+
+		static uint64_t hash(core::StringView source);
+		EntryList::iterator lookup(core::StringView source, uint64_t hash);
+		void erase(EntryList::iterator);
+		void evict();
+
+		// Most recently used first
+		EntryList m_entries{};
+		std::unordered_multimap<uint64_t, EntryList::iterator> m_index{};
+		size_t m_max_entries{};
+		size_t m_max_bytes{};
+		size_t m_bytes{};
+		size_t m_hits{};
+		size_t m_misses{};
+		size_t m_evictions{};
+	};
+
+}
@@ -0,0 +1,181 @@
+#include "Scanner.h"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define YSEN_SCAN_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define YSEN_SCAN_SSE2 1
+#endif
+
+namespace {
+
+	// Every class below only matches ASCII, so signed byte compares are enough
+	// for the range checks: bytes >= 0x80 are negative and never in range.
+
+	struct Whitespace
+	{
+		static bool matches(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+#ifdef YSEN_SCAN_SSE2
+		static __m128i matches(__m128i v)
+		{
+			auto space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+			auto control = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+			return _mm_or_si128(space, control);
+		}
+#endif
+#ifdef YSEN_SCAN_AVX2
+		static __m256i matches(__m256i v)
+		{
+			auto space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+			auto control = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+			return _mm256_or_si256(space, control);
+		}
+#endif
+	};
+
+	struct Digit
+	{
+		static bool matches(char c) { return c >= '0' && c <= '9'; }
+#ifdef YSEN_SCAN_SSE2
+		static __m128i matches(__m128i v)
+		{
+			return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+		}
+#endif
+#ifdef YSEN_SCAN_AVX2
+		static __m256i matches(__m256i v)
+		{
+			return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+		}
+#endif
+	};
+
+	struct IdentifierCharacter
+	{
+		static bool matches(char c)
+		{
+			// Setting 0x20 folds upper case onto lower case
+			auto lower = static_cast<char>(c | 0x20);
+			return (lower >= 'a' && lower <= 'z') || Digit::matches(c) || c == '_';
+		}
+#ifdef YSEN_SCAN_SSE2
+		static __m128i matches(__m128i v)
+		{
+			auto lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+			auto alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+			auto underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+			return _mm_or_si128(_mm_or_si128(alpha, Digit::matches(v)), underscore);
+		}
+#endif
+#ifdef YSEN_SCAN_AVX2
+		static __m256i matches(__m256i v)
+		{
+			auto lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+			auto alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+			auto underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+			return _mm256_or_si256(_mm256_or_si256(alpha, Digit::matches(v)), underscore);
+		}
+#endif
+	};
+
+	struct AnyOf
+	{
+		char a;
+		char b;
+
+		bool matches(char c) const { return c == a || c == b; }
+#ifdef YSEN_SCAN_SSE2
+		__m128i matches(__m128i v) const
+		{
+			return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(a)), _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+		}
+#endif
+#ifdef YSEN_SCAN_AVX2
+		__m256i matches(__m256i v) const
+		{
+			return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(a)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b)));
+		}
+#endif
+	};
+
+	// Advances while bytes do (Inside = true) or don't (Inside = false) match the class
+	template<bool Inside, typename Class>
+	size_t advance(const Class& character_class, const char* data, size_t offset, size_t length)
+	{
+#ifdef YSEN_SCAN_AVX2
+		for (; offset + 32 <= length; offset += 32) {
+			auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+			auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(character_class.matches(v)));
+			auto stop = Inside ? ~mask : mask;
+			if (stop != 0) {
+				return offset + std::countr_zero(stop);
+			}
+		}
+#endif
+#ifdef YSEN_SCAN_SSE2
+		for (; offset + 16 <= length; offset += 16) {
+			auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+			auto mask = static_cast<uint32_t>(_mm_movemask_epi8(character_class.matches(v)));
+			auto stop = (Inside ? ~mask : mask) & 0xFFFF;
+			if (stop != 0) {
+				return offset + std::countr_zero(stop);
+			}
+		}
+#endif
+		for (; offset < length; ++offset) {
+			if (character_class.matches(data[offset]) != Inside) {
+				return offset;
+			}
+		}
+
+		return length;
+	}
+
+}
+
+size_t ysen::lang::scan::skip_whitespace(const char* data, size_t offset, size_t length)
+{
+	return advance<true>(Whitespace{}, data, offset, length);
+}
+
+size_t ysen::lang::scan::skip_identifier(const char* data, size_t offset, size_t length)
+{
+	return advance<true>(IdentifierCharacter{}, data, offset, length);
+}
+
+size_t ysen::lang::scan::skip_digits(const char* data, size_t offset, size_t length)
+{
+	return advance<true>(Digit{}, data, offset, length);
+}
+
+size_t ysen::lang::scan::find(const char* data, size_t offset, size_t length, char c)
+{
+	return advance<false>(AnyOf{ c, c }, data, offset, length);
+}
+
+size_t ysen::lang::scan::find_any_of(const char* data, size_t offset, size_t length, char a, char b)
+{
+	return advance<false>(AnyOf{ a, b }, data, offset, length);
+}
+
+size_t ysen::lang::scan::count(const char* data, size_t offset, size_t end, char c)
+{
+	size_t occurrences{};
+#ifdef YSEN_SCAN_SSE2
+	auto needle = _mm_set1_epi8(c);
+	for (; offset + 16 <= end; offset += 16) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+		occurrences += std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle))));
+	}
+#endif
+	for (; offset < end; ++offset) {
+		occurrences += data[offset] == c;
+	}
+
+	return occurrences;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+
+namespace ysen::lang::scan {
+
+	// Byte classifiers used by the Lexer to skip whole runs of a character
+	// class at once. Each function looks at data[offset, length) and returns
+	// the offset of the first byte ending the run, or length if there is none.
+	// They process 32 (AVX2) or 16 (SSE2) bytes per step when the target
+	// supports it, and fall back to a plain loop otherwise.
+
+	// ' ', \t, \n, \v, \f, \r
+	size_t skip_whitespace(const char* data, size_t offset, size_t length);
+	// [A-Za-z0-9_]
+	size_t skip_identifier(const char* data, size_t offset, size_t length);
+	// [0-9]
+	size_t skip_digits(const char* data, size_t offset, size_t length);
+
+	// First offset holding c
+	size_t find(const char* data, size_t offset, size_t length, char c);
+	// First offset holding either a or b
+	size_t find_any_of(const char* data, size_t offset, size_t length, char a, char b);
+
+	// Occurrences of c in data[offset, end)
+	size_t count(const char* data, size_t offset, size_t end, char c);
+
+}
@@ -1,37 +1,87 @@
 #include "ScriptEnvironment.h"
+#include <algorithm>
 #include "Parser.h"
+#include "Snapshot.h"
+#include "StatementReader.h"
+#include "ast/ConstantFolder.h"
+#include "astvm/ArrayFunctions.h"
 #include "astvm/Interpreter.h"
 #include "ysen/fs/io.h"
 
-ysen::lang::ScriptEnvironment::ScriptEnvironment()
-	: m_interpreter(core::adopt_shared(new astvm::Interpreter{}))
+ysen::lang::ScriptEnvironment::ScriptEnvironment(ParserOptions parser_options, ModuleCache& module_cache)
+	: m_interpreter(core::adopt_shared(new astvm::Interpreter{})), m_parser_options(parser_options), m_module_cache(module_cache)
 {
-	m_interpreter->add(astvm::function("print", [](astvm::VariadicFunction, const std::vector<astvm::Value>& arguments) -> int {
-		const auto& fmt = arguments.at(0);
+	m_interpreter->add(astvm::function("print", [](astvm::VariadicFunction, std::span<const astvm::Value> arguments) -> int {
+		if (arguments.empty()) {
+			return 1;
+		}
+		const auto& fmt = arguments[0];
 		if (!fmt.is_string() && arguments.size() > 1) {
 			return 1;
 		}
 		core::details::FormatterContext<> context{fmt.to_string()};
 		for (auto i = 1u; i < arguments.size(); ++i) {
-			context.formatter_arguments().collect(arguments.at(i).to_string());
+			context.formatter_arguments().collect(arguments[i].to_string());
 		}
 		core::println(context.format());
 		return 0;
 	}));
-	m_interpreter->add(astvm::function("to_string", [](const astvm::Value& value) -> core::String {
-		return value.to_string();
-	}));
-	m_interpreter->add(astvm::function("to_formatted_string", [](const astvm::Value& value) -> core::String {
-		return value.to_formatted_string();
-	}));
+	for (auto function : {
+		astvm::function("to_string", [](const astvm::Value& value) -> core::String {
+			return value.to_string();
+		}),
+		astvm::function("to_formatted_string", [](const astvm::Value& value) -> core::String {
+			return value.to_formatted_string();
+		}),
+	}) {
+		function->mark_pure();
+		m_interpreter->add(function);
+	}
+	astvm::add_array_functions(*m_interpreter);
+	m_interpreter->set_require_handler([this](astvm::Interpreter& vm, const core::String& path) {
+		require(vm, path);
+	});
 }
 
 ysen::lang::astvm::ValuePtr ysen::lang::ScriptEnvironment::eval(const core::String& code)
 {
-	auto lexer = Lexer::lex(code);
-	auto parser = core::adopt_nonnull(new Parser);
-	auto program = parser->parse(lexer->tokens());
-	return m_interpreter->execute(program.ptr());
+	auto program = compile(code);
+
+	// Loads everything required at the top level up front, so that the modules load in parallel
+	auto paths = ModuleCache::required_paths(*program);
+	auto is_loaded = std::all_of(paths.begin(), paths.end(), [this](const core::String& path) {
+		return !m_module_cache.find(path).is_null();
+	});
+	if (!is_loaded) {
+		m_module_cache.load(paths, *m_interpreter);
+	}
+
+	return m_interpreter->execute(program);
+}
+
+void ysen::lang::ScriptEnvironment::require(astvm::Interpreter& vm, const core::String& path)
+{
+	auto resolved = ModuleCache::resolve(path);
+	auto module = m_module_cache.find(resolved);
+	if (!module) {
+		module = m_module_cache.load({ resolved }, vm).front();
+	}
+
+	module->declare(vm);
+}
+
+ysen::lang::ast::ProgramPtr ysen::lang::ScriptEnvironment::compile(const core::String& code)
+{
+	if (auto program = m_program_cache.find(code)) {
+		return program;
+	}
+
+	auto lexer = core::adopt_shared(Lexer::lex(code).release());
+	auto parser = core::adopt_nonnull(new Parser{m_parser_options});
+	auto program = parser->parse(std::move(lexer));
+	ast::ConstantFolder::fold(*program);
+	m_program_cache.insert(code, program);
+	return program;
 }
 
 ysen::lang::astvm::ValuePtr ysen::lang::ScriptEnvironment::eval_file(const core::String& filename)
@@ -43,3 +93,34 @@ ysen::lang::astvm::ValuePtr ysen::lang::ScriptEnvironment::eval_file(const core:
 
 	return nullptr;
 }
+
+ysen::lang::astvm::ValuePtr ysen::lang::ScriptEnvironment::eval_stream(fs::InputReader& input)
+{
+	StatementReader reader{input, m_parser_options};
+	astvm::ValuePtr result{};
+	while (auto program = reader.next()) {
+		result = m_interpreter->execute(program);
+		if (m_interpreter->current_scope()->returning()) {
+			break;
+		}
+	}
+
+	return result;
+}
+
+ysen::lang::ReparseResult ysen::lang::ScriptEnvironment::reload(IncrementalParser& script, const TextEdit& edit)
+{
+	auto result = script.apply(edit);
+	m_interpreter->reload_functions(result.program, result.changed_functions, result.removed_functions);
+	return result;
+}
+
+bool ysen::lang::ScriptEnvironment::save_snapshot(const core::String& filename) const
+{
+	return Snapshot::save(*m_interpreter, filename);
+}
+
+bool ysen::lang::ScriptEnvironment::restore_snapshot(const core::String& filename)
+{
+	return Snapshot::restore(*m_interpreter, filename);
+}
@@ -1,5 +1,10 @@
 #pragma once
 #include "IEnvironment.h"
+#include "IncrementalParser.h"
+#include "ModuleCache.h"
+#include "ParserOptions.h"
+#include "ProgramCache.h"
+#include "ysen/fs/InputReader.h"
 
 namespace ysen::lang {namespace astvm {
 		class Interpreter;
@@ -8,13 +13,36 @@ namespace ysen::lang {namespace astvm {
 	class ScriptEnvironment : public IEnvironment
 	{
 	public:
-		ScriptEnvironment();
+		// Modules required by scripts are loaded into module_cache, once for all environments sharing it
+		explicit ScriptEnvironment(ParserOptions parser_options = {}, ModuleCache& module_cache = ModuleCache::shared());
 	
 		astvm::ValuePtr eval(const core::String& code) override;
 		astvm::ValuePtr eval_file(const core::String& filename) override;
+		// Executes each top-level statement as soon as it has been read, the input is
+		// never held as a whole. Returns the value of the last statement executed
+		astvm::ValuePtr eval_stream(fs::InputReader& input);
+		// Applies an edit to a script executed before, only the functions it changed are
+		// declared again; top-level code doesn't run again
+		ReparseResult reload(IncrementalParser& script, const TextEdit& edit);
+
+		// Writes out the functions and variables declared so far, see Snapshot
+		bool save_snapshot(const core::String& filename) const;
+		// Declares them again in place of running the code that did; false if there is no such file
+		bool restore_snapshot(const core::String& filename);
+
+		// Repeated evals of the same source skip lexing, parsing and folding
+		ProgramCache& program_cache() { return m_program_cache; }
+		const ProgramCache& program_cache() const { return m_program_cache; }
+		ModuleCache& module_cache() { return m_module_cache; }
 
 	private:
+		ast::ProgramPtr compile(const core::String& code);
+		void require(astvm::Interpreter&, const core::String& path);
+
 		core::SharedPtr<astvm::Interpreter> m_interpreter{};
+		ParserOptions m_parser_options{};
+		ProgramCache m_program_cache{};
+		ModuleCache& m_module_cache;
 	};
 	
 }
\ No newline at end of file
@@ -0,0 +1,831 @@
+#include "Snapshot.h"
+
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+#include "ysen/fs/io.h"
+#include "ysen/fs/MappedFile.h"
+
+namespace {
+
+	using namespace ysen;
+	using namespace ysen::lang;
+
+	enum class NodeTag : uint8_t
+	{
+		Scope,
+		FunctionParameter,
+		Function,
+		FunctionDeclaration,
+		VarDeclaration,
+		FunctionCall,
+		Return,
+		BinOp,
+		String,
+		Integer,
+		Float,
+		Identifier,
+		Array,
+		Access,
+		Object,
+		KeyValue,
+		NumericRange,
+		RangedLoop,
+		Assignment,
+		ElseIf,
+		Else,
+		If,
+		Require,
+		ParallelLoop,
+	};
+
+	// In place of the operator of a parallel loop without a reduction
+	constexpr uint8_t NO_REDUCTION = 0xff;
+
+	enum class FunctionKind : uint8_t
+	{
+		Native,
+		Script,
+	};
+
+	// Nodes are written children first and refer to each other by index, 0 being nullptr;
+	// strings and functions are written once and referred to by index as well
+	class Writer
+	{
+	public:
+		std::vector<char> finish(const astvm::Scope& global);
+
+	private:
+		template<typename T>
+		static void put(std::vector<char>& out, T value)
+		{
+			auto size = out.size();
+			out.resize(size + sizeof(T));
+			::memcpy(out.data() + size, &value, sizeof(T));
+		}
+
+		template<typename T>
+		void put(T value) { put(m_nodes, value); }
+
+		uint32_t string(const core::String&);
+		uint32_t node(const ast::AstNode*);
+		template<typename T>
+		void nodes(const std::vector<T*>&);
+		uint32_t function(const astvm::FunctionPtr&);
+		void value(std::vector<char>& out, const astvm::Value&);
+		void begin(NodeTag, const ast::AstNode*);
+
+		std::vector<char> m_strings{};
+		std::vector<char> m_nodes{};
+		std::vector<char> m_functions{};
+		// Views of the strings held by the interpreter, an empty core::String has no buffer to compare
+		std::unordered_map<std::string_view, uint32_t> m_string_indices{};
+		std::unordered_map<const ast::AstNode*, uint32_t> m_node_indices{};
+		std::unordered_map<const astvm::Function*, uint32_t> m_function_indices{};
+	};
+
+	std::vector<char> Writer::finish(const astvm::Scope& global)
+	{
+		// Written first, functions and values may pull in nodes and strings
+		std::vector<char> globals{};
+		put(globals, static_cast<uint32_t>(global.functions().size()));
+		for (const auto& [name, function] : global.functions()) {
+			put(globals, this->function(function));
+		}
+
+		put(globals, static_cast<uint32_t>(global.variables().size()));
+		for (const auto& [name, variable] : global.variables()) {
+			put(globals, string(name));
+			value(globals, *variable->value());
+		}
+
+		std::vector<char> out{};
+		put(out, Snapshot::MAGIC);
+		put(out, Snapshot::VERSION);
+		put(out, static_cast<uint32_t>(m_string_indices.size()));
+		put(out, static_cast<uint32_t>(m_node_indices.size()));
+		put(out, static_cast<uint32_t>(m_function_indices.size()));
+		for (const auto* section : { &m_strings, &m_nodes, &m_functions, &globals }) {
+			out.insert(out.end(), section->begin(), section->end());
+		}
+
+		return out;
+	}
+
+	uint32_t Writer::string(const core::String& string)
+	{
+		std::string_view view{ string.c_str(), string.length() };
+		if (auto it = m_string_indices.find(view); it != m_string_indices.end()) {
+			return it->second;
+		}
+
+		put(m_strings, static_cast<uint32_t>(view.length()));
+		m_strings.insert(m_strings.end(), view.begin(), view.end());
+		return m_string_indices[view] = static_cast<uint32_t>(m_string_indices.size());
+	}
+
+	template<typename T>
+	void Writer::nodes(const std::vector<T*>& children)
+	{
+		std::vector<uint32_t> indices{};
+		for (const auto* child : children) {
+			indices.push_back(node(child));
+		}
+
+		put(static_cast<uint32_t>(indices.size()));
+		for (auto index : indices) {
+			put(index);
+		}
+	}
+
+	void Writer::begin(NodeTag tag, const ast::AstNode* node)
+	{
+		put(tag);
+		put(node->source_range().offset());
+		put(node->source_range().length());
+	}
+
+	uint32_t Writer::node(const ast::AstNode* node)
+	{
+		if (!node) {
+			return 0;
+		}
+		if (auto it = m_node_indices.find(node); it != m_node_indices.end()) {
+			return it->second;
+		}
+
+		// Children and strings are resolved before the node itself is written, nodes go
+		// out in one stream and strings in another
+		if (auto* scope = dynamic_cast<const ast::ScopeStatement*>(node)) {
+			auto name = string(scope->name());
+			std::vector<uint32_t> statements{};
+			for (const auto* statement : scope->statements()) {
+				statements.push_back(this->node(statement));
+			}
+			begin(NodeTag::Scope, node);
+			put(name);
+			put(static_cast<uint32_t>(statements.size()));
+			for (auto statement : statements) {
+				put(statement);
+			}
+		}
+		else if (auto* parameter = dynamic_cast<const ast::FunctionParameterExpression*>(node)) {
+			auto name = string(parameter->name());
+			auto type_name = string(parameter->type_name());
+			begin(NodeTag::FunctionParameter, node);
+			put(name);
+			put(type_name);
+			put(static_cast<uint8_t>(parameter->variadic()));
+		}
+		else if (auto* lambda = dynamic_cast<const ast::FunctionExpression*>(node)) {
+			// Bodies the parser deferred are parsed now, they are part of the code restored
+			auto body = this->node(lambda->body());
+			std::vector<uint32_t> parameters{};
+			for (const auto* parameter : lambda->parameters()) {
+				parameters.push_back(this->node(parameter));
+			}
+			begin(NodeTag::Function, node);
+			put(body);
+			put(static_cast<uint32_t>(parameters.size()));
+			for (auto parameter : parameters) {
+				put(parameter);
+			}
+		}
+		else if (auto* declaration = dynamic_cast<const ast::FunctionDeclarationStatement*>(node)) {
+			auto name = string(declaration->name());
+			auto body = this->node(declaration->body());
+			std::vector<uint32_t> parameters{};
+			for (const auto* parameter : declaration->parameters()) {
+				parameters.push_back(this->node(parameter));
+			}
+			begin(NodeTag::FunctionDeclaration, node);
+			put(name);
+			put(body);
+			put(static_cast<uint32_t>(parameters.size()));
+			for (auto parameter : parameters) {
+				put(parameter);
+			}
+		}
+		else if (auto* var = dynamic_cast<const ast::VarDeclaration*>(node)) {
+			auto name = string(var->name());
+			auto expression = this->node(var->expression());
+			begin(NodeTag::VarDeclaration, node);
+			put(name);
+			put(expression);
+		}
+		else if (auto* call = dynamic_cast<const ast::FunctionCallExpression*>(node)) {
+			auto name = string(call->name());
+			std::vector<uint32_t> arguments{};
+			for (const auto* argument : call->arguments()) {
+				arguments.push_back(this->node(argument));
+			}
+			begin(NodeTag::FunctionCall, node);
+			put(name);
+			put(static_cast<uint32_t>(arguments.size()));
+			for (auto argument : arguments) {
+				put(argument);
+			}
+		}
+		else if (auto* ret = dynamic_cast<const ast::ReturnExpression*>(node)) {
+			auto expression = this->node(ret->expression());
+			begin(NodeTag::Return, node);
+			put(expression);
+		}
+		else if (auto* bin_op = dynamic_cast<const ast::BinOpExpression*>(node)) {
+			auto left = this->node(bin_op->left());
+			auto right = this->node(bin_op->right());
+			begin(NodeTag::BinOp, node);
+			put(left);
+			put(right);
+			put(static_cast<uint8_t>(bin_op->op()));
+		}
+		else if (auto* string_expression = dynamic_cast<const ast::StringExpression*>(node)) {
+			auto value = string(string_expression->value());
+			begin(NodeTag::String, node);
+			put(value);
+		}
+		else if (auto* integer = dynamic_cast<const ast::IntegerExpression*>(node)) {
+			begin(NodeTag::Integer, node);
+			put(integer->value());
+		}
+		else if (auto* floating = dynamic_cast<const ast::FloatExpression*>(node)) {
+			begin(NodeTag::Float, node);
+			put(floating->value());
+		}
+		else if (auto* identifier = dynamic_cast<const ast::IdentifierExpression*>(node)) {
+			auto name = string(identifier->name());
+			begin(NodeTag::Identifier, node);
+			put(name);
+		}
+		else if (auto* array = dynamic_cast<const ast::ArrayExpression*>(node)) {
+			std::vector<uint32_t> elements{};
+			for (const auto* element : array->expressions()) {
+				elements.push_back(this->node(element));
+			}
+			begin(NodeTag::Array, node);
+			put(static_cast<uint32_t>(elements.size()));
+			for (auto element : elements) {
+				put(element);
+			}
+		}
+		else if (auto* access = dynamic_cast<const ast::AccessExpression*>(node)) {
+			auto object = string(access->object());
+			auto field = string(access->field());
+			begin(NodeTag::Access, node);
+			put(object);
+			put(field);
+		}
+		else if (auto* object = dynamic_cast<const ast::ObjectExpression*>(node)) {
+			std::vector<uint32_t> key_values{};
+			for (const auto* key_value : object->key_value_expressions()) {
+				key_values.push_back(this->node(key_value));
+			}
+			begin(NodeTag::Object, node);
+			put(static_cast<uint32_t>(key_values.size()));
+			for (auto key_value : key_values) {
+				put(key_value);
+			}
+		}
+		else if (auto* key_value = dynamic_cast<const ast::KeyValueExpression*>(node)) {
+			auto key = this->node(key_value->key());
+			auto value = this->node(key_value->value());
+			begin(NodeTag::KeyValue, node);
+			put(key);
+			put(value);
+		}
+		else if (auto* range = dynamic_cast<const ast::NumericRangeExpression*>(node)) {
+			begin(NodeTag::NumericRange, node);
+			put(range->min());
+			put(range->max());
+		}
+		else if (auto* loop = dynamic_cast<const ast::ParallelLoopExpression*>(node)) {
+			auto declaration = this->node(loop->declaration());
+			auto range_expression = this->node(loop->range_expression());
+			auto body = this->node(loop->body());
+			begin(NodeTag::ParallelLoop, node);
+			put(declaration);
+			put(range_expression);
+			put(body);
+			put(loop->reduction().has_value() ? static_cast<uint8_t>(loop->reduction().value()) : NO_REDUCTION);
+		}
+		else if (auto* loop = dynamic_cast<const ast::RangedLoopExpression*>(node)) {
+			auto declaration = this->node(loop->declaration());
+			auto range_expression = this->node(loop->range_expression());
+			auto body = this->node(loop->body());
+			begin(NodeTag::RangedLoop, node);
+			put(declaration);
+			put(range_expression);
+			put(body);
+		}
+		else if (auto* assignment = dynamic_cast<const ast::AssignmentExpression*>(node)) {
+			auto name = string(assignment->name());
+			auto body = this->node(assignment->body());
+			begin(NodeTag::Assignment, node);
+			put(name);
+			put(body);
+		}
+		else if (auto* else_if = dynamic_cast<const ast::ElseIfStatement*>(node)) {
+			auto declaration = this->node(else_if->declaration());
+			auto condition = this->node(else_if->condition());
+			auto body = this->node(else_if->body());
+			begin(NodeTag::ElseIf, node);
+			put(declaration);
+			put(condition);
+			put(body);
+		}
+		else if (auto* else_statement = dynamic_cast<const ast::ElseStatement*>(node)) {
+			auto body = this->node(else_statement->body());
+			begin(NodeTag::Else, node);
+			put(body);
+		}
+		else if (auto* if_statement = dynamic_cast<const ast::IfStatement*>(node)) {
+			auto declaration = this->node(if_statement->declaration());
+			auto condition = this->node(if_statement->condition());
+			auto body = this->node(if_statement->body());
+			std::vector<uint32_t> else_ifs{};
+			for (const auto* else_if : if_statement->else_if_statements()) {
+				else_ifs.push_back(this->node(else_if));
+			}
+			auto else_body = this->node(if_statement->else_statement());
+			begin(NodeTag::If, node);
+			put(declaration);
+			put(condition);
+			put(body);
+			put(static_cast<uint32_t>(else_ifs.size()));
+			for (auto else_if : else_ifs) {
+				put(else_if);
+			}
+			put(else_body);
+		}
+		else if (auto* require = dynamic_cast<const ast::RequireStatement*>(node)) {
+			auto path = string(require->path());
+			begin(NodeTag::Require, node);
+			put(path);
+		}
+		else {
+			throw SnapshotError("Node without a snapshot representation");
+		}
+
+		return m_node_indices[node] = static_cast<uint32_t>(m_node_indices.size() + 1);
+	}
+
+	uint32_t Writer::function(const astvm::FunctionPtr& function)
+	{
+		if (auto it = m_function_indices.find(function.ptr()); it != m_function_indices.end()) {
+			return it->second;
+		}
+
+		auto name = string(function->name());
+		auto node = this->node(function->ast_node());
+
+		put(m_functions, node ? FunctionKind::Script : FunctionKind::Native);
+		put(m_functions, name);
+		put(m_functions, node);
+		return m_function_indices[function.ptr()] = static_cast<uint32_t>(m_function_indices.size());
+	}
+
+	void Writer::value(std::vector<char>& out, const astvm::Value& value)
+	{
+		// Null has no way in, it's written as undefined
+		auto type = value.is_null() ? astvm::Value::ValueType::Undefined : value.type();
+		put(out, static_cast<uint8_t>(type));
+
+		switch (type) {
+		case astvm::Value::ValueType::Array:
+			put(out, static_cast<uint32_t>(value.array_size()));
+			for (auto i = 0u; i < value.array_size(); ++i) {
+				this->value(out, value.array_at(i));
+			}
+			break;
+		case astvm::Value::ValueType::Object:
+			put(out, static_cast<uint32_t>(value.object().size()));
+			for (const auto& [key, element] : value.object()) {
+				this->value(out, key);
+				this->value(out, element);
+			}
+			break;
+		case astvm::Value::ValueType::String:
+			put(out, string(value.string()));
+			break;
+		case astvm::Value::ValueType::Function:
+			put(out, function(value.function()));
+			break;
+		case astvm::Value::ValueType::Bool:
+			put(out, static_cast<uint8_t>(value.get<bool>()));
+			break;
+		case astvm::Value::ValueType::Int:
+			put(out, value.get<int>());
+			break;
+		case astvm::Value::ValueType::Float:
+			put(out, value.get<float>());
+			break;
+		case astvm::Value::ValueType::Double:
+			put(out, value.get<double>());
+			break;
+		default:
+			break;
+		}
+	}
+
+	class Reader
+	{
+	public:
+		// Tag and source range
+		static constexpr size_t MIN_NODE_SIZE = sizeof(uint8_t) + 2 * sizeof(uint32_t);
+
+		Reader(astvm::Interpreter& vm, const char* data, size_t size);
+		void read();
+
+	private:
+		template<typename T>
+		T get()
+		{
+			if (sizeof(T) > static_cast<size_t>(m_end - m_cursor)) {
+				throw SnapshotError("Unexpected end of snapshot");
+			}
+
+			T value{};
+			::memcpy(&value, m_cursor, sizeof(T));
+			m_cursor += sizeof(T);
+			return value;
+		}
+
+		// A count of entries taking at least size bytes each, which have to fit in what is left
+		uint32_t count(size_t size);
+		const core::String& string();
+		template<typename T = ast::Expression>
+		T* node();
+		template<typename T>
+		std::vector<T*> nodes();
+		void read_node();
+		astvm::FunctionPtr function();
+		astvm::Value value();
+
+		template<typename T, typename...Args>
+		void make(Args&&...args)
+		{
+			m_nodes.push_back(m_program->make<T>(std::forward<Args>(args)...));
+		}
+
+		astvm::Interpreter& m_vm;
+		const char* m_cursor{};
+		const char* m_end{};
+		ast::ProgramPtr m_program{};
+		std::vector<core::String> m_strings{};
+		std::vector<ast::AstNode*> m_nodes{};
+		std::vector<astvm::FunctionPtr> m_functions{};
+	};
+
+	Reader::Reader(astvm::Interpreter& vm, const char* data, size_t size)
+		: m_vm(vm), m_cursor(data), m_end(data + size)
+	{}
+
+	void Reader::read()
+	{
+		if (get<uint32_t>() != Snapshot::MAGIC || get<uint32_t>() != Snapshot::VERSION) {
+			throw SnapshotError("Not a snapshot of this version");
+		}
+
+		auto string_count = count(sizeof(uint32_t));
+		auto node_count = get<uint32_t>();
+		auto function_count = get<uint32_t>();
+
+		m_strings.reserve(string_count);
+		for (auto i = 0u; i < string_count; ++i) {
+			auto length = get<uint32_t>();
+			if (length > static_cast<size_t>(m_end - m_cursor)) {
+				throw SnapshotError("Unexpected end of snapshot");
+			}
+			m_strings.emplace_back(m_cursor, length);
+			m_cursor += length;
+		}
+
+		if (node_count > static_cast<size_t>(m_end - m_cursor) / MIN_NODE_SIZE) {
+			throw SnapshotError("Unexpected end of snapshot");
+		}
+
+		// Roughly what a node takes, with its vectors and strings outside the arena
+		m_program = core::adopt_shared(new ast::Program{ SourceRange{}, node_count * 96 });
+		m_nodes.reserve(node_count);
+		for (auto i = 0u; i < node_count; ++i) {
+			read_node();
+		}
+
+		for (auto i = 0u; i < function_count; ++i) {
+			auto kind = get<FunctionKind>();
+			const auto& name = string();
+			auto* node = this->node<ast::AstNode>();
+
+			if (kind == FunctionKind::Native) {
+				auto native = m_vm.global_scope()->find_function(name);
+				if (!native) {
+					throw SnapshotError(core::format("Native function '{}' isn't registered", name));
+				}
+				m_functions.push_back(std::move(native));
+				continue;
+			}
+
+			const auto* parameters = [&]() -> const std::vector<ast::FunctionParameterExpressionPtr>* {
+				if (auto* declaration = dynamic_cast<ast::FunctionDeclarationStatement*>(node)) {
+					return &declaration->parameters();
+				}
+				if (auto* lambda = dynamic_cast<ast::FunctionExpression*>(node)) {
+					return &lambda->parameters();
+				}
+				return nullptr;
+			}();
+			if (!parameters) {
+				throw SnapshotError(core::format("Function '{}' has no declaration", name));
+			}
+
+			astvm::FunctionParameterList list{};
+			for (const auto* parameter : *parameters) {
+				list.emplace_back(core::adopt_shared(new astvm::FunctionParameter{ parameter->name(), parameter->type_name(), parameter }));
+			}
+			m_functions.push_back(astvm::function(name, std::move(list), node, m_program));
+		}
+
+		auto& global = m_vm.global_scope();
+		auto global_function_count = count(sizeof(uint32_t));
+		for (auto i = 0u; i < global_function_count; ++i) {
+			global->declare_function(function());
+		}
+
+		auto variable_count = count(sizeof(uint32_t) + sizeof(uint8_t));
+		for (auto i = 0u; i < variable_count; ++i) {
+			const auto& name = string();
+			global->declare_variable(astvm::var(name, astvm::value(value())));
+		}
+	}
+
+	uint32_t Reader::count(size_t size)
+	{
+		auto count = get<uint32_t>();
+		if (count > static_cast<size_t>(m_end - m_cursor) / size) {
+			throw SnapshotError("Unexpected end of snapshot");
+		}
+		return count;
+	}
+
+	const core::String& Reader::string()
+	{
+		auto index = get<uint32_t>();
+		if (index >= m_strings.size()) {
+			throw SnapshotError("String index out of range");
+		}
+		return m_strings[index];
+	}
+
+	template<typename T>
+	T* Reader::node()
+	{
+		// Children always come before the nodes referring to them
+		auto index = get<uint32_t>();
+		if (index == 0) {
+			return nullptr;
+		}
+		if (index > m_nodes.size()) {
+			throw SnapshotError("Node index out of range");
+		}
+
+		auto* node = dynamic_cast<T*>(m_nodes[index - 1]);
+		if (!node) {
+			throw SnapshotError("Node of unexpected type");
+		}
+		return node;
+	}
+
+	template<typename T>
+	std::vector<T*> Reader::nodes()
+	{
+		auto count = this->count(sizeof(uint32_t));
+		std::vector<T*> nodes{};
+		for (auto i = 0u; i < count; ++i) {
+			nodes.push_back(node<T>());
+		}
+		return nodes;
+	}
+
+	void Reader::read_node()
+	{
+		auto tag = get<NodeTag>();
+		auto offset = get<uint32_t>();
+		auto length = get<uint32_t>();
+		SourceRange range{ offset, offset + length };
+
+		// Fields are read into locals first, arguments aren't evaluated in any particular order
+		switch (tag) {
+		case NodeTag::Scope: {
+			const auto& name = string();
+			auto statements = nodes<ast::Expression>();
+			auto* scope = m_program->make<ast::ScopeStatement>(range);
+			scope->set_name(name);
+			scope->statements() = std::move(statements);
+			m_nodes.push_back(scope);
+			break;
+		}
+		case NodeTag::FunctionParameter: {
+			const auto& name = string();
+			const auto& type_name = string();
+			auto variadic = get<uint8_t>() != 0;
+			make<ast::FunctionParameterExpression>(range, name, type_name, variadic);
+			break;
+		}
+		case NodeTag::Function: {
+			auto* body = node();
+			auto parameters = nodes<ast::FunctionParameterExpression>();
+			make<ast::FunctionExpression>(range, std::move(parameters), ast::FunctionBody{ body });
+			break;
+		}
+		case NodeTag::FunctionDeclaration: {
+			const auto& name = string();
+			auto* body = node();
+			auto parameters = nodes<ast::FunctionParameterExpression>();
+			make<ast::FunctionDeclarationStatement>(range, name, std::move(parameters), ast::FunctionBody{ body });
+			break;
+		}
+		case NodeTag::VarDeclaration: {
+			const auto& name = string();
+			auto* expression = node();
+			make<ast::VarDeclaration>(range, name, expression);
+			break;
+		}
+		case NodeTag::FunctionCall: {
+			const auto& name = string();
+			auto arguments = nodes<ast::Expression>();
+			make<ast::FunctionCallExpression>(range, name, std::move(arguments));
+			break;
+		}
+		case NodeTag::Return:
+			make<ast::ReturnExpression>(range, node());
+			break;
+		case NodeTag::BinOp: {
+			auto* left = node();
+			auto* right = node();
+			auto op = get<uint8_t>();
+			if (op > static_cast<uint8_t>(ast::BinOp::LessEqual)) {
+				throw SnapshotError("Unknown binary operator");
+			}
+			make<ast::BinOpExpression>(range, left, right, static_cast<ast::BinOp>(op));
+			break;
+		}
+		case NodeTag::String:
+			make<ast::StringExpression>(range, string());
+			break;
+		case NodeTag::Integer:
+			make<ast::IntegerExpression>(range, get<int>());
+			break;
+		case NodeTag::Float:
+			make<ast::FloatExpression>(range, get<float>());
+			break;
+		case NodeTag::Identifier:
+			make<ast::IdentifierExpression>(range, string());
+			break;
+		case NodeTag::Array:
+			make<ast::ArrayExpression>(range, nodes<ast::Expression>());
+			break;
+		case NodeTag::Access: {
+			const auto& object = string();
+			const auto& field = string();
+			make<ast::AccessExpression>(range, object, field);
+			break;
+		}
+		case NodeTag::Object:
+			make<ast::ObjectExpression>(range, nodes<ast::KeyValueExpression>());
+			break;
+		case NodeTag::KeyValue: {
+			auto* key = node();
+			auto* value = node();
+			make<ast::KeyValueExpression>(range, key, value);
+			break;
+		}
+		case NodeTag::NumericRange: {
+			auto min = get<int>();
+			auto max = get<int>();
+			make<ast::NumericRangeExpression>(range, min, max);
+			break;
+		}
+		case NodeTag::RangedLoop: {
+			auto* declaration = node();
+			auto* range_expression = node();
+			auto* body = node();
+			make<ast::RangedLoopExpression>(range, declaration, range_expression, body);
+			break;
+		}
+		case NodeTag::ParallelLoop: {
+			auto* declaration = node();
+			auto* range_expression = node();
+			auto* body = node();
+			core::Optional<ast::BinOp> reduction{};
+			if (auto op = get<uint8_t>(); op != NO_REDUCTION) {
+				if (op > static_cast<uint8_t>(ast::BinOp::LessEqual)) {
+					throw SnapshotError("Unknown binary operator");
+				}
+				reduction = static_cast<ast::BinOp>(op);
+			}
+			make<ast::ParallelLoopExpression>(range, declaration, range_expression, body, reduction);
+			break;
+		}
+		case NodeTag::Assignment: {
+			const auto& name = string();
+			auto* body = node();
+			make<ast::AssignmentExpression>(range, name, body);
+			break;
+		}
+		case NodeTag::ElseIf: {
+			auto* declaration = node<ast::VarDeclaration>();
+			auto* condition = node();
+			auto* body = node();
+			make<ast::ElseIfStatement>(range, declaration, condition, body);
+			break;
+		}
+		case NodeTag::Else:
+			make<ast::ElseStatement>(range, node());
+			break;
+		case NodeTag::If: {
+			auto* declaration = node<ast::VarDeclaration>();
+			auto* condition = node();
+			auto* body = node();
+			auto else_ifs = nodes<ast::ElseIfStatement>();
+			auto* else_statement = node<ast::ElseStatement>();
+			make<ast::IfStatement>(range, declaration, condition, body, std::move(else_ifs), else_statement);
+			break;
+		}
+		case NodeTag::Require:
+			make<ast::RequireStatement>(range, string());
+			break;
+		default:
+			throw SnapshotError("Unknown node tag");
+		}
+	}
+
+	ysen::lang::astvm::FunctionPtr Reader::function()
+	{
+		auto index = get<uint32_t>();
+		if (index >= m_functions.size()) {
+			throw SnapshotError("Function index out of range");
+		}
+		return m_functions[index];
+	}
+
+	ysen::lang::astvm::Value Reader::value()
+	{
+		switch (static_cast<astvm::Value::ValueType>(get<uint8_t>())) {
+		case astvm::Value::ValueType::Array: {
+			astvm::Value::Array array{};
+			auto count = this->count(sizeof(uint8_t));
+			for (auto i = 0u; i < count; ++i) {
+				array.push_back(value());
+			}
+			return array;
+		}
+		case astvm::Value::ValueType::Object: {
+			astvm::Value::Object object{};
+			auto count = this->count(2 * sizeof(uint8_t));
+			for (auto i = 0u; i < count; ++i) {
+				auto key = value();
+				object.emplace(std::move(key), value());
+			}
+			return object;
+		}
+		case astvm::Value::ValueType::String: return string();
+		case astvm::Value::ValueType::Function: return function();
+		case astvm::Value::ValueType::Bool: return get<uint8_t>() != 0;
+		case astvm::Value::ValueType::Int: return get<int>();
+		case astvm::Value::ValueType::Float: return get<float>();
+		case astvm::Value::ValueType::Double: return get<double>();
+		case astvm::Value::ValueType::Undefined: return {};
+		default:
+			throw SnapshotError("Unknown value type");
+		}
+	}
+
+}
+
+std::vector<char> ysen::lang::Snapshot::serialize(const astvm::Interpreter& vm)
+{
+	return Writer{}.finish(*vm.global_scope());
+}
+
+void ysen::lang::Snapshot::deserialize(astvm::Interpreter& vm, const char* data, size_t size)
+{
+	Reader{vm, data, size}.read();
+}
+
+bool ysen::lang::Snapshot::save(const astvm::Interpreter& vm, const core::StringView& filename)
+{
+	auto data = serialize(vm);
+	return fs::write_file(filename, core::StringView{ data.data(), data.size() });
+}
+
+bool ysen::lang::Snapshot::restore(astvm::Interpreter& vm, const core::StringView& filename)
+{
+	auto file = fs::MappedFile::open(filename);
+	if (!file) {
+		return false;
+	}
+
+	deserialize(vm, file->data(), file->size());
+	return true;
+}
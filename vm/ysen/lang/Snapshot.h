@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+#include "astvm/Interpreter.h"
+#include "ysen/core/format.h"
+#include "ysen/core/String.h"
+#include "ysen/core/StringView.h"
+
+namespace ysen::lang {
+
+	class SnapshotError : public std::exception
+	{
+	public:
+		SnapshotError(core::String message)
+			: m_message(core::format("SnapshotError: {}", message))
+		{}
+
+		char const* what() const override
+		{
+			return m_message.c_str();
+		}
+	private:
+		core::String m_message{};
+	};
+
+	// The global scope of an interpreter written out as is: script functions with
+	// the syntax trees of their bodies, and variables holding plain data or
+	// functions. Restoring declares them again without lexing, parsing or running
+	// anything; the trees are built straight from the mapped file into the arena
+	// of a single program, every string the snapshot holds is stored once.
+	//
+	// Natives aren't written out but looked up by name when restoring, they have to
+	// be registered by then. Numbers are stored in the layout of the machine writing
+	// the snapshot, which is also the only one reading it back.
+	class Snapshot
+	{
+	public:
+		static constexpr uint32_t MAGIC = 0x504e5359; // YSNP
+		static constexpr uint32_t VERSION = 1;
+
+		static std::vector<char> serialize(const astvm::Interpreter&);
+		static void deserialize(astvm::Interpreter&, const char* data, size_t size);
+
+		static bool save(const astvm::Interpreter&, const core::StringView& filename);
+		// False if there is no such file, throws SnapshotError if it isn't a snapshot of this version
+		static bool restore(astvm::Interpreter&, const core::StringView& filename);
+	};
+
+}
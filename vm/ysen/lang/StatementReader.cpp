@@ -0,0 +1,84 @@
+#include "StatementReader.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Parser.h"
+#include "ast/ConstantFolder.h"
+
+ysen::lang::StatementReader::StatementReader(fs::InputReader& input, ParserOptions options)
+	: m_input(input), m_options(options)
+{}
+
+ysen::lang::ast::ProgramPtr ysen::lang::StatementReader::next()
+{
+	while (true) {
+		if (m_lexer && m_token < m_lexer->tokens().size()) {
+			Parser parser{m_options};
+
+			try {
+				auto [program, end] = parser.parse_statement(m_lexer, m_token);
+				if (is_complete(end)) {
+					m_token = end;
+
+					// Stray ';'
+					if (program->children().empty()) {
+						continue;
+					}
+
+					ast::ConstantFolder::fold(*program);
+					return program;
+				}
+			}
+			catch (ParseError&) {
+				if (is_complete(parser.cursor())) {
+					throw;
+				}
+			}
+		}
+		else if (m_exhausted) {
+			return nullptr;
+		}
+
+		refill();
+	}
+}
+
+bool ysen::lang::StatementReader::is_complete(size_t end) const
+{
+	return m_exhausted || end + LOOKAHEAD < m_lexer->tokens().size();
+}
+
+void ysen::lang::StatementReader::refill()
+{
+	core::String pending{};
+
+	if (m_lexer) {
+		// Everything from the first token not returned on, or what follows the last
+		// token, which may be the start of a comment
+		const auto& tokens = m_lexer->tokens();
+		const auto& code = m_lexer->code();
+		size_t keep{};
+		if (m_token < tokens.size()) {
+			keep = tokens[m_token].offset();
+		}
+		else if (!tokens.empty()) {
+			keep = tokens.back().end_offset();
+		}
+
+		pending = core::String{ code.c_str() + keep, code.length() - keep };
+	}
+
+	// Reads at least as much as is kept, a large statement would be relexed once per
+	// chunk otherwise
+	std::vector<char> chunk(std::max(CHUNK_SIZE, pending.length()));
+	auto read = m_input.read(chunk.data(), chunk.size());
+	pending.append(chunk.data(), read);
+
+	if (read == 0) {
+		m_exhausted = true;
+	}
+
+	m_lexer = core::adopt_shared(Lexer::lex(std::move(pending)).release());
+	m_token = 0;
+}
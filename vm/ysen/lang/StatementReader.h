@@ -0,0 +1,46 @@
+#pragma once
+#include "Lexer.h"
+#include "ParserOptions.h"
+#include "ast/node.h"
+#include "ysen/fs/InputReader.h"
+
+namespace ysen::lang {
+
+	// Pulls top-level statements out of an input one at a time. Only the text
+	// of statements not yet returned is buffered, so memory stays bounded by
+	// the largest statement rather than the input, and the first statement is
+	// available as soon as its text and a few tokens past it have been read.
+	//
+	// A statement counts as complete once LOOKAHEAD tokens follow it, the most
+	// the parser peeks ahead, and the last token of the buffer, which may have
+	// been cut off, is not one of them. A parse error close to the end of the
+	// buffer may be down to cut off input as well and only stands once the
+	// input is exhausted.
+	//
+	// Source ranges, including those of parse errors, are relative to the text
+	// buffered when the statement was read.
+	class StatementReader
+	{
+	public:
+		static constexpr size_t CHUNK_SIZE = 64 * 1024;
+		static constexpr size_t LOOKAHEAD = 3;
+
+		explicit StatementReader(fs::InputReader& input, ParserOptions options = {});
+
+		// The next statement in a program of its own, constant folded, or nullptr at the end
+		ast::ProgramPtr next();
+
+		// Bytes read but not turned into statements yet
+		size_t buffered() const { return m_lexer ? m_lexer->code().length() : 0; }
+	private:
+		bool is_complete(size_t end) const;
+		void refill();
+
+		fs::InputReader& m_input;
+		ParserOptions m_options{};
+		core::SharedPtr<Lexer> m_lexer{};
+		size_t m_token{};
+		bool m_exhausted{false};
+	};
+
+}
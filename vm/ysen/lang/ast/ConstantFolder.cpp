@@ -0,0 +1,258 @@
+#include "ConstantFolder.h"
+
+void ysen::lang::ast::ConstantFolder::fold(Program& program)
+{
+	ConstantFolder folder{program};
+	folder.fold_statements(program.children());
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::ast::ConstantFolder::fold(Program& program, ExpressionPtr expression)
+{
+	ConstantFolder folder{program};
+	return folder.fold_expression(expression);
+}
+
+ysen::lang::ast::ConstantFolder::ConstantFolder(Program& program)
+	: m_program(program)
+{}
+
+template<typename T>
+void ysen::lang::ast::ConstantFolder::fold_statements(std::vector<T*>& statements)
+{
+	for (auto i = 0u; i < statements.size(); ++i) {
+		auto* expression = dynamic_cast<Expression*>(statements[i]);
+		if (!expression) {
+			continue;
+		}
+
+		auto* folded = fold_expression(expression);
+		auto is_return = folded->is_return_expression();
+		statements[i] = folded;
+
+		if (is_return) {
+			// Execution never gets past a ret
+			statements.erase(statements.begin() + i + 1, statements.end());
+			break;
+		}
+	}
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::ast::ConstantFolder::fold_expression(ExpressionPtr expression)
+{
+	auto* node = expression;
+
+	if (auto* bin_op = dynamic_cast<BinOpExpression*>(node)) {
+		bin_op->left() = fold_expression(bin_op->left());
+		bin_op->right() = fold_expression(bin_op->right());
+
+		auto value = evaluate(*bin_op);
+		if (value.has_value()) {
+			// Comparisons produce booleans, which have no literal node and stay as is
+			if (auto literal = to_literal(bin_op->source_range(), value.value())) {
+				return literal;
+			}
+		}
+	}
+	else if (auto* scope = dynamic_cast<ScopeStatement*>(node)) {
+		fold_statements(scope->statements());
+	}
+	else if (auto* declaration = dynamic_cast<VarDeclaration*>(node)) {
+		if (declaration->expression()) {
+			declaration->expression() = fold_expression(declaration->expression());
+		}
+	}
+	else if (auto* assignment = dynamic_cast<AssignmentExpression*>(node)) {
+		assignment->body() = fold_expression(assignment->body());
+	}
+	else if (auto* ret = dynamic_cast<ReturnExpression*>(node)) {
+		ret->expression() = fold_expression(ret->expression());
+	}
+	else if (auto* call = dynamic_cast<FunctionCallExpression*>(node)) {
+		for (auto& argument : call->arguments()) {
+			argument = fold_expression(argument);
+		}
+	}
+	else if (auto* function = dynamic_cast<FunctionDeclarationStatement*>(node)) {
+		if (function->is_body_parsed()) {
+			function->set_body(fold_expression(function->body()));
+		}
+	}
+	else if (auto* lambda = dynamic_cast<FunctionExpression*>(node)) {
+		if (lambda->is_body_parsed()) {
+			lambda->set_body(fold_expression(lambda->body()));
+		}
+	}
+	else if (auto* array = dynamic_cast<ArrayExpression*>(node)) {
+		for (auto& element : array->expressions()) {
+			element = fold_expression(element);
+		}
+	}
+	else if (auto* object = dynamic_cast<ObjectExpression*>(node)) {
+		for (auto& key_value : object->key_value_expressions()) {
+			key_value->key() = fold_expression(key_value->key());
+			key_value->value() = fold_expression(key_value->value());
+		}
+	}
+	else if (auto* loop = dynamic_cast<RangedLoopExpression*>(node)) {
+		loop->body() = fold_expression(loop->body());
+	}
+	else if (auto* if_statement = dynamic_cast<IfStatement*>(node)) {
+		return fold_if(if_statement);
+	}
+
+	return expression;
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::ast::ConstantFolder::fold_if(IfStatementPtr statement)
+{
+	struct Arm
+	{
+		VarDeclarationPtr declaration{};
+		ExpressionPtr condition{};
+		ExpressionPtr body{};
+		SourceRange source_range{};
+	};
+
+	// Declarations are folded in place and never replaced
+	if (statement->declaration()) {
+		fold_expression(statement->declaration());
+	}
+	statement->condition() = fold_expression(statement->condition());
+	statement->body() = fold_expression(statement->body());
+
+	for (auto& else_if : statement->else_if_statements()) {
+		if (else_if->declaration()) {
+			fold_expression(else_if->declaration());
+		}
+		else_if->condition() = fold_expression(else_if->condition());
+		else_if->body() = fold_expression(else_if->body());
+	}
+
+	if (statement->else_statement()) {
+		statement->else_statement()->body() = fold_expression(statement->else_statement()->body());
+	}
+
+	std::vector<Arm> arms{};
+	arms.push_back({ statement->declaration(), statement->condition(), statement->body(), statement->source_range() });
+	for (const auto& else_if : statement->else_if_statements()) {
+		arms.push_back({ else_if->declaration(), else_if->condition(), else_if->body(), else_if->source_range() });
+	}
+
+	ExpressionPtr else_body = statement->else_statement() ? statement->else_statement()->body() : nullptr;
+	auto pruned = false;
+
+	for (auto i = 0u; i < arms.size(); ++i) {
+		// A declaration may have side effects and scopes the condition, keep those arms
+		auto condition = arms[i].declaration ? core::Optional<astvm::Value>{} : evaluate(*arms[i].condition);
+		if (!condition.has_value()) {
+			continue;
+		}
+
+		pruned = true;
+
+		if (condition.value().is_trueish()) {
+			// Always taken, it becomes the else of the arms before it
+			else_body = arms[i].body;
+			arms.erase(arms.begin() + i, arms.end());
+			break;
+		}
+
+		arms.erase(arms.begin() + i);
+		--i;
+	}
+
+	if (!pruned) {
+		return statement;
+	}
+
+	if (arms.empty()) {
+		if (else_body) {
+			return to_scope(else_body);
+		}
+
+		// No arm can ever be taken, evaluates to undefined like a failed if
+		return m_program.make<ScopeStatement>(statement->source_range());
+	}
+
+	std::vector<ElseIfStatementPtr> else_ifs{};
+	for (auto i = 1u; i < arms.size(); ++i) {
+		else_ifs.emplace_back(m_program.make<ElseIfStatement>(
+			arms[i].source_range,
+			arms[i].declaration,
+			arms[i].condition,
+			arms[i].body
+		));
+	}
+
+	ElseStatementPtr else_statement{};
+	if (else_body) {
+		else_statement = m_program.make<ElseStatement>(else_body->source_range(), else_body);
+	}
+
+	return m_program.make<IfStatement>(
+		statement->source_range(),
+		arms.front().declaration,
+		arms.front().condition,
+		arms.front().body,
+		std::move(else_ifs),
+		else_statement
+	);
+}
+
+ysen::core::Optional<ysen::lang::astvm::Value> ysen::lang::ast::ConstantFolder::evaluate(const Expression& expression)
+{
+	if (const auto* integer = dynamic_cast<const IntegerExpression*>(&expression)) {
+		return astvm::Value{integer->value()};
+	}
+	if (const auto* floating = dynamic_cast<const FloatExpression*>(&expression)) {
+		return astvm::Value{floating->value()};
+	}
+	if (const auto* string = dynamic_cast<const StringExpression*>(&expression)) {
+		return astvm::Value{string->value()};
+	}
+
+	const auto* bin_op = dynamic_cast<const BinOpExpression*>(&expression);
+	if (!bin_op) {
+		return {};
+	}
+
+	auto lhs = evaluate(*bin_op->left());
+	auto rhs = evaluate(*bin_op->right());
+	if (!lhs.has_value() || !rhs.has_value()) {
+		return {};
+	}
+
+	// Leave divisions by zero to fail at runtime, like they always did
+	if (bin_op->op() == BinOp::Division && rhs.value().is_falseish()) {
+		return {};
+	}
+
+	return apply_bin_op(bin_op->op(), lhs.value(), rhs.value());
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::ast::ConstantFolder::to_literal(SourceRange source_range, const astvm::Value& value)
+{
+	if (value.is_integer()) {
+		return m_program.make<IntegerExpression>(source_range, value.cast<int>());
+	}
+	if (value.is_float()) {
+		return m_program.make<FloatExpression>(source_range, value.cast<float>());
+	}
+	if (value.is_string()) {
+		return m_program.make<StringExpression>(source_range, value.string());
+	}
+
+	return nullptr;
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::ast::ConstantFolder::to_scope(ExpressionPtr body)
+{
+	// The if used to scope its body, keep declarations from leaking out of it
+	if (body->is_scope_statement()) {
+		return body;
+	}
+
+	auto* scope = m_program.make<ScopeStatement>(body->source_range());
+	scope->emit(body);
+	return scope;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "node.h"
+#include "ysen/core/Optional.h"
+
+namespace ysen::lang::ast {
+
+	// Rewrites a parsed program in place: binary operations over literals are
+	// replaced by their result, if/else-if arms with a literal condition are
+	// pruned and statements following a ret are dropped. Run it once after
+	// Parser::parse, before interpreting or generating bytecode. Function
+	// bodies the parser deferred are left alone and folded once parsed.
+	class ConstantFolder
+	{
+	public:
+		static void fold(Program&);
+		// For nodes parsed into the program after the fact, like deferred function bodies
+		static ExpressionPtr fold(Program&, ExpressionPtr);
+	private:
+		explicit ConstantFolder(Program&);
+
+		ExpressionPtr fold_expression(ExpressionPtr);
+		ExpressionPtr fold_if(IfStatementPtr);
+		template<typename T>
+		void fold_statements(std::vector<T*>&);
+
+		static core::Optional<astvm::Value> evaluate(const Expression&);
+		ExpressionPtr to_literal(SourceRange, const astvm::Value&);
+		ExpressionPtr to_scope(ExpressionPtr);
+
+		// Replacement nodes go into the program's arena, the ones they replace stay there until it dies
+		Program& m_program;
+	};
+
+}
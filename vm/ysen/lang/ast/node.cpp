@@ -1,10 +1,37 @@
 #include "node.h"
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <utility>
 
 #include "ysen/core/format.h"
 #include "ysen/core/ScopeExit.h"
+#include "ysen/lang/Parser.h"
+#include "ysen/lang/ast/ConstantFolder.h"
 #include "ysen/lang/astvm/Interpreter.h"
 
+ysen::lang::astvm::Value ysen::lang::ast::apply_bin_op(BinOp op, const astvm::Value& lhs, const astvm::Value& rhs)
+{
+	// Whether or not the array is packed, writing through array() unpacks it
+	if (lhs.is_array() || rhs.is_array()) {
+		return astvm::elementwise(op, lhs, rhs);
+	}
+
+	switch (op) {
+	case BinOp::Addition: return lhs + rhs;
+	case BinOp::Subtraction: return lhs - rhs;
+	case BinOp::Division: return lhs / rhs;
+	case BinOp::Multiplication: return lhs * rhs;
+	case BinOp::Greater: return lhs > rhs;
+	case BinOp::Less: return lhs < rhs;
+	case BinOp::GreaterEqual: return lhs > rhs || lhs == rhs;
+	case BinOp::LessEqual: return lhs < rhs || lhs == rhs;
+	default: return {};
+	}
+}
+
 ysen::lang::ast::AstNode::AstNode(SourceRange source_range)
 	: m_source_range(source_range)
 {}
@@ -22,14 +49,17 @@ void ysen::lang::ast::ScopeStatement::set_name(core::String name)
 	m_name = std::move(name);
 }
 
-void ysen::lang::ast::ScopeStatement::emit(core::SharedPtr<Statement> statement)
+void ysen::lang::ast::ScopeStatement::emit(ExpressionPtr statement)
 {
-	m_statements.emplace_back(std::move(statement));
+	m_statements.emplace_back(statement);
 }
 
 ysen::lang::astvm::Value ysen::lang::ast::ScopeStatement::visit(astvm::Interpreter& vm) const
 {
 	vm.enter_scope("anon");
+	core::ScopeExit guard{[&vm]() {
+		vm.exit_scope();
+	}};
 	astvm::Value ret{};
 
 	for (const auto &node : m_statements) {
@@ -39,7 +69,6 @@ ysen::lang::astvm::Value ysen::lang::ast::ScopeStatement::visit(astvm::Interpret
 		}
 	}
 
-	vm.exit_scope();
 	return ret;
 }
 
@@ -56,11 +85,52 @@ ysen::lang::ast::FunctionParameterExpression::FunctionParameterExpression(Source
 	: Expression(source_range), m_name(std::move(name)), m_type_name(std::move(type_name)), m_variadic(variadic)
 {}
 
-ysen::lang::ast::FunctionExpression::FunctionExpression(SourceRange source_range, std::vector<FunctionParameterExpressionPtr> params, ExpressionPtr body)
-	: Expression(source_range), m_parameters(std::move(params)), m_body(std::move(body))
+ysen::lang::ast::FunctionExpression::FunctionExpression(SourceRange source_range, std::vector<FunctionParameterExpressionPtr> params, FunctionBody body)
+	: Expression(source_range), m_parameters(std::move(params)), m_body(body)
+{}
+
+ysen::lang::ast::FunctionBody::FunctionBody(ExpressionPtr expression)
+	: m_expression(expression)
 {}
 
-ysen::lang::astvm::Value ysen::lang::ast::FunctionExpression::visit(astvm::Interpreter&) const
+ysen::lang::ast::FunctionBody::FunctionBody(Program& program, uint32_t first_token, uint32_t end_token)
+	: m_program(&program), m_first_token(first_token), m_end_token(end_token)
+{}
+
+bool ysen::lang::ast::FunctionBody::is_parsed() const
+{
+	// Published by get() on another thread
+	return std::atomic_ref{m_expression}.load(std::memory_order_acquire) != nullptr;
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::ast::FunctionBody::get() const
+{
+	std::atomic_ref expression{m_expression};
+	if (auto* parsed = expression.load(std::memory_order_acquire)) {
+		return parsed;
+	}
+
+	std::lock_guard lock{m_program->deferred_mutex()};
+	if (!m_expression) {
+		expression.store(m_program->parse_deferred(m_first_token, m_end_token), std::memory_order_release);
+	}
+
+	return m_expression;
+}
+
+void ysen::lang::ast::FunctionBody::set(ExpressionPtr expression)
+{
+	std::atomic_ref slot{m_expression};
+	if (!m_program) {
+		slot.store(expression, std::memory_order_release);
+		return;
+	}
+
+	std::lock_guard lock{m_program->deferred_mutex()};
+	slot.store(expression, std::memory_order_release);
+}
+
+ysen::lang::astvm::Value ysen::lang::ast::FunctionExpression::visit(astvm::Interpreter& vm) const
 {
 	astvm::FunctionParameterList parameters{};
 
@@ -69,21 +139,21 @@ ysen::lang::astvm::Value ysen::lang::ast::FunctionExpression::visit(astvm::Inter
 			core::adopt_shared(new astvm::FunctionParameter{
 				param->name(),
 				param->type_name(),
-				param.ptr()
+				param
 			})
 		);
 	}
 	
-	return astvm::function(core::format("lambda({})", source_range().to_string()), std::move(parameters), this);
+	return astvm::function(core::format("lambda({})", source_range().to_string()), std::move(parameters), this, vm.current_program());
 }
 
 ysen::lang::ast::FunctionDeclarationStatement::FunctionDeclarationStatement(
 	SourceRange source_range, 
 	core::String name, 
 	std::vector<FunctionParameterExpressionPtr> params,
-	ExpressionPtr body
+	FunctionBody body
 )
-	: Expression(source_range), m_name(std::move(name)), m_parameters(std::move(params)), m_body(std::move(body))
+	: Expression(source_range), m_name(std::move(name)), m_parameters(std::move(params)), m_body(body)
 {}
 
 ysen::lang::astvm::Value ysen::lang::ast::FunctionDeclarationStatement::visit(astvm::Interpreter& vm) const
@@ -94,11 +164,11 @@ ysen::lang::astvm::Value ysen::lang::ast::FunctionDeclarationStatement::visit(as
 		params.emplace_back(core::adopt_shared(new astvm::FunctionParameter(
 			param->name(), 
 			param->type_name(), 
-			param.ptr()
+			param
 		)));
 	}
 
-	auto function = core::adopt_shared(new astvm::Function(m_name, std::move(params), this));
+	auto function = core::adopt_shared(new astvm::Function(m_name, std::move(params), this, vm.current_program()));
 	vm.current_scope()->declare_function(std::move(function));
 	return {};
 }
@@ -106,18 +176,20 @@ ysen::lang::astvm::Value ysen::lang::ast::FunctionDeclarationStatement::visit(as
 void ysen::lang::ast::FunctionDeclarationStatement::generate_bytecode(bytecode::Generator& generator) const
 {
 	generator.emit_block(m_name);
+	generator.enter_frame();
 
+	// Arguments are passed in place, the callee addresses them as its first locals
 	for (const auto& param : parameters()) {
-		generator.emit<bytecode::Pop>();
-		generator.emit<bytecode::StoreVariable>(param->name());
+		generator.declare_parameter(param->name());
 	}
 	
-	m_body->generate_bytecode(generator);
+	body()->generate_bytecode(generator);
+	generator.leave_frame();
 	generator.end_block();
 }
 
-ysen::lang::ast::VarDeclaration::VarDeclaration(SourceRange source_range, core::String name, core::SharedPtr<Expression> init)
-	: Statement(source_range), m_name(std::move(name)), m_expression(std::move(init))
+ysen::lang::ast::VarDeclaration::VarDeclaration(SourceRange source_range, core::String name, ExpressionPtr init)
+	: Statement(source_range), m_name(std::move(name)), m_expression(init)
 {}
 
 ysen::lang::astvm::Value ysen::lang::ast::VarDeclaration::visit(astvm::Interpreter& vm) const
@@ -142,6 +214,11 @@ void ysen::lang::ast::VarDeclaration::generate_bytecode(bytecode::Generator& gen
 		generator.emit<bytecode::LoadImmediate>(astvm::undefined());
 	}
 
+	if (generator.in_frame()) {
+		generator.emit<bytecode::StoreLocal>(generator.declare_local(m_name));
+		return;
+	}
+
 	generator.emit<bytecode::StoreVariable>(m_name);
 }
 
@@ -151,13 +228,43 @@ ysen::lang::ast::FunctionCallExpression::FunctionCallExpression(SourceRange sour
 	: Expression(source_range), m_name(std::move(name)), m_arguments(std::move(arguments))
 {}
 
-ysen::lang::ast::Program::Program(SourceRange source_range)
-	: AstNode(source_range)
+ysen::lang::ast::Program::Program(SourceRange source_range, size_t arena_capacity)
+	: AstNode(source_range), m_arena(arena_capacity)
 {}
 
-void ysen::lang::ast::Program::emit(core::SharedPtr<AstNode> child)
+void ysen::lang::ast::Program::emit(AstNodePtr child)
+{
+	m_children.emplace_back(child);
+}
+
+void ysen::lang::ast::Program::defer_bodies(core::SharedPtr<Lexer> source, ParserOptions options)
+{
+	m_source = std::move(source);
+	m_parser_options = options;
+}
+
+void ysen::lang::ast::Program::adopt(core::SharedPtr<Program> program)
+{
+	m_children.insert(m_children.end(), program->children().begin(), program->children().end());
+	m_adopted.emplace_back(std::move(program));
+}
+
+void ysen::lang::ast::Program::retain(core::SharedPtr<Program> program)
+{
+	auto retained = std::any_of(m_adopted.begin(), m_adopted.end(), [&](const auto& adopted) {
+		return adopted.ptr() == program.ptr();
+	});
+	if (!retained) {
+		m_adopted.emplace_back(std::move(program));
+	}
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::ast::Program::parse_deferred(uint32_t first_token, uint32_t end_token)
 {
-	m_children.emplace_back(std::move(child));
+	Parser parser{m_parser_options};
+	auto* body = parser.parse_deferred(*this, *m_source, first_token, end_token);
+	// Brought into the same shape as the bodies which were parsed up front
+	return ConstantFolder::fold(*this, body);
 }
 
 ysen::lang::astvm::Value ysen::lang::ast::Program::visit(astvm::Interpreter& vm) const
@@ -185,7 +292,7 @@ ysen::lang::ast::Expression::Expression(SourceRange source_range)
 	: AstNode(source_range)
 {}
 
-ysen::lang::astvm::Value ysen::lang::ast::FunctionCallExpression::visit(astvm::Interpreter& vm) const
+ysen::lang::astvm::FunctionPtr ysen::lang::ast::FunctionCallExpression::resolve(astvm::Interpreter& vm) const
 {
 	auto function = vm.current_scope()->find_function(name());
 
@@ -193,7 +300,7 @@ ysen::lang::astvm::Value ysen::lang::ast::FunctionCallExpression::visit(astvm::I
 		auto variable = vm.current_scope()->find_variable(name());
 
 		if (!variable) {
-			return {};
+			return nullptr;
 		}
 
 		if (variable->value()->is_function()) {
@@ -202,19 +309,35 @@ ysen::lang::astvm::Value ysen::lang::ast::FunctionCallExpression::visit(astvm::I
 		else if (variable->value()->is_string()) {
 			function = vm.current_scope()->find_function(variable->value()->string());
 		}
-
-		// If not found from string or variable, exit with undefined
-		if (!function) {
-			return {}; // TODO throw error
-		}
 	}
 
+	return function;
+}
+
+std::vector<ysen::lang::astvm::Value> ysen::lang::ast::FunctionCallExpression::evaluate_arguments(astvm::Interpreter& vm) const
+{
 	std::vector<astvm::Value> values{};
 	for (const auto& arg : m_arguments) {
 		values.emplace_back(arg->visit(vm));
 	}
+	return values;
+}
+
+ysen::lang::astvm::Value ysen::lang::ast::FunctionCallExpression::visit(astvm::Interpreter& vm) const
+{
+	auto function = resolve(vm);
+
+	// If not found from string or variable, exit with undefined
+	if (!function) {
+		return {}; // TODO throw error
+	}
+
+	astvm::Arguments arguments{ m_arguments.size() };
+	for (const auto& arg : m_arguments) {
+		arguments.push(arg->visit(vm));
+	}
 
-	return function->invoke(vm, values);
+	return function->invoke(vm, arguments.span());
 }
 
 void ysen::lang::ast::FunctionCallExpression::generate_bytecode(bytecode::Generator& generator) const
@@ -224,7 +347,7 @@ void ysen::lang::ast::FunctionCallExpression::generate_bytecode(bytecode::Genera
 		generator.emit<bytecode::Push>();
 	}
 	
-	generator.emit<bytecode::Call>(m_name);
+	generator.emit<bytecode::Call>(m_name, m_arguments.size());
 }
 
 ysen::lang::ast::ReturnExpression::ReturnExpression(SourceRange source_range, ExpressionPtr expression)
@@ -234,11 +357,40 @@ ysen::lang::ast::ReturnExpression::ReturnExpression(SourceRange source_range, Ex
 ysen::lang::astvm::Value ysen::lang::ast::ReturnExpression::visit(astvm::Interpreter& vm) const
 {
 	vm.current_scope()->mark_return();
+
+	// A function returning a call to itself hands the call back to Function::invoke,
+	// which runs it in the frame of the returning function.
+	if (vm.in_function() && m_expression->is_function_call()) {
+		const auto* call = dynamic_cast<const FunctionCallExpression*>(m_expression);
+		auto function = call->resolve(vm);
+
+		if (function && !function->is_native()) {
+			auto arguments = call->evaluate_arguments(vm);
+			if (vm.can_reuse_frame(*function, arguments.size())) {
+				vm.set_tail_call(std::move(function), std::move(arguments));
+				return {};
+			}
+			return function->invoke(vm, arguments);
+		}
+	}
+
 	return m_expression->visit(vm);
 }
 
 void ysen::lang::ast::ReturnExpression::generate_bytecode(bytecode::Generator& generator) const
 {
+	if (generator.in_frame() && m_expression->is_function_call()) {
+		const auto* call = dynamic_cast<const FunctionCallExpression*>(m_expression);
+
+		for (const auto& arg : call->arguments()) {
+			arg->generate_bytecode(generator);
+			generator.emit<bytecode::Push>();
+		}
+
+		generator.emit<bytecode::TailCall>(call->name(), call->arguments().size());
+		return;
+	}
+
 	m_expression->generate_bytecode(generator);
 	generator.emit<bytecode::Ret>();
 }
@@ -251,18 +403,7 @@ ysen::lang::astvm::Value ysen::lang::ast::BinOpExpression::visit(astvm::Interpre
 {
 	auto lhs = m_left->visit(vm);
 	auto rhs = m_right->visit(vm);
-	
-	switch (m_op) {
-	case BinOp::Addition: return lhs + rhs;
-	case BinOp::Subtraction: return lhs - rhs;
-	case BinOp::Division: return lhs / rhs;
-	case BinOp::Multiplication: return lhs * rhs;
-	case BinOp::Greater: return lhs > rhs;
-	case BinOp::Less: return lhs < rhs;
-	case BinOp::GreaterEqual: return lhs > rhs || lhs == rhs;
-	case BinOp::LessEqual: return lhs < rhs || lhs == rhs;
-	default: return {};
-	}
+	return apply_bin_op(m_op, lhs, rhs);
 }
 
 void ysen::lang::ast::BinOpExpression::generate_bytecode(bytecode::Generator& generator) const
@@ -272,15 +413,7 @@ void ysen::lang::ast::BinOpExpression::generate_bytecode(bytecode::Generator& ge
 	generator.emit(core::adopt_shared(static_cast<bytecode::Instruction*>(new bytecode::Store(reg))));
 	m_right->generate_bytecode(generator);
 
-	switch (m_op) {
-	case BinOp::Addition: 
-		generator.emit(core::adopt_shared(static_cast<bytecode::Instruction*>(new bytecode::Add(reg))));
-		break;
-	case BinOp::Subtraction: break;
-	case BinOp::Division: break;
-	case BinOp::Multiplication: break;
-	default: ;
-	}
+	generator.emit_bin_op(m_op, reg);
 }
 
 ysen::lang::ast::ConstantExpression::ConstantExpression(SourceRange source_range)
@@ -347,6 +480,11 @@ ysen::lang::astvm::Value ysen::lang::ast::IdentifierExpression::visit(astvm::Int
 
 void ysen::lang::ast::IdentifierExpression::generate_bytecode(bytecode::Generator& generator) const
 {
+	if (auto local = generator.find_local(m_name); local.has_value()) {
+		generator.emit<bytecode::LoadLocal>(local.value());
+		return;
+	}
+
 	generator.emit<bytecode::LoadVariable>(m_name);
 }
 
@@ -415,13 +553,16 @@ ysen::lang::ast::NumericRangeExpression::NumericRangeExpression(SourceRange sour
 
 ysen::lang::astvm::Value ysen::lang::ast::NumericRangeExpression::visit(astvm::Interpreter&) const
 {
-	astvm::Value::Array arr{};
+	if (min() > max()) {
+		return astvm::Value::Array{};
+	}
 
-	for (auto i = min(); i <= max(); ++i) {
-		arr.emplace_back(i);
+	std::vector<int> numbers(static_cast<size_t>(static_cast<int64_t>(max()) - min()) + 1);
+	for (size_t i = 0; i < numbers.size(); ++i) {
+		numbers[i] = static_cast<int>(min() + static_cast<int64_t>(i));
 	}
 
-	return arr;
+	return core::adopt_shared(new astvm::TypedArray(std::move(numbers)));
 }
 
 ysen::lang::ast::RangedLoopExpression::RangedLoopExpression(
@@ -439,14 +580,18 @@ ysen::lang::astvm::Value ysen::lang::ast::RangedLoopExpression::visit(astvm::Int
 	auto range = range_expression()->visit(vm);
 
 	if (!(range.is_object() || range.is_string() || range.is_array())) {
-		return {}; // TODO error
+		throw astvm::NotIterable(range);
 	}
 
 	astvm::Value last_statement{};
 	
 	if (range.is_object()) {
 		for (auto [key, value] : range.object()) {
+			vm.fuel().burn();
 			vm.enter_scope("ranged_loop", astvm::ScopeType::Loopable);
+			core::ScopeExit guard{[&vm]() {
+				vm.exit_scope();
+			}};
 			declaration()->visit(vm);
 
 			// TODO: This is ugly, fix it
@@ -454,20 +599,29 @@ ysen::lang::astvm::Value ysen::lang::ast::RangedLoopExpression::visit(astvm::Int
 			*snd->value() = value;
 
 			last_statement = body()->visit(vm);
-			vm.exit_scope();
+			if (vm.current_scope()->returning()) {
+				break;
+			}
 		}
 	}
 	else if (range.is_array()) {
-		for (auto &value : range.array()) {
+		// By index, a packed array's elements are made one at a time
+		for (auto i = 0u; i < range.array_size(); ++i) {
+			vm.fuel().burn();
 			vm.enter_scope("ranged_loop", astvm::ScopeType::Loopable);
+			core::ScopeExit guard{[&vm]() {
+				vm.exit_scope();
+			}};
 			declaration()->visit(vm);
 
 			// TODO: This is ugly, fix it
 			auto& [_, snd] = *vm.current_scope()->variables().begin();
-			*snd->value() = value;
+			*snd->value() = range.array_at(i);
 
 			last_statement = body()->visit(vm);
-			vm.exit_scope();
+			if (vm.current_scope()->returning()) {
+				break;
+			}
 		}
 	}
 	else if (range.is_string()) {
@@ -477,6 +631,108 @@ ysen::lang::astvm::Value ysen::lang::ast::RangedLoopExpression::visit(astvm::Int
 	return last_statement;
 }
 
+ysen::lang::ast::ParallelLoopExpression::ParallelLoopExpression(
+	SourceRange source_range,
+	ExpressionPtr declaration,
+	ExpressionPtr range_expression,
+	ExpressionPtr body,
+	core::Optional<BinOp> reduction
+)
+	: RangedLoopExpression(source_range, declaration, range_expression, body), m_reduction(std::move(reduction))
+{}
+
+ysen::lang::astvm::Value ysen::lang::ast::ParallelLoopExpression::visit(astvm::Interpreter& vm) const
+{
+	auto range = range_expression()->visit(vm);
+
+	// The Values of a packed array are made for the loop
+	astvm::ArrayElements values{ range };
+	std::vector<const astvm::Value*> elements{};
+	if (range.is_array()) {
+		for (const auto& value : values) {
+			elements.push_back(&value);
+		}
+	}
+	else if (range.is_object()) {
+		for (const auto& [key, value] : range.object()) {
+			elements.push_back(&value);
+		}
+	}
+	else {
+		throw astvm::NotIterable(range);
+	}
+
+	// The workers have no fuel of their own, the loop pays for its elements before they start
+	vm.fuel().burn(static_cast<int64_t>(elements.size()));
+
+	auto& pool = vm.thread_pool();
+	auto shared = vm.share_current_scope();
+
+	// Made by each worker when it takes its first range, the caller's scopes are only read
+	std::vector<std::unique_ptr<astvm::Interpreter>> workers(pool.size() + 1);
+	auto run = [this](astvm::Interpreter& worker, const astvm::Value& element) {
+		worker.enter_scope("parallel_loop", astvm::ScopeType::Loopable);
+		declaration()->visit(worker);
+
+		auto& [_, variable] = *worker.current_scope()->variables().begin();
+		*variable->value() = element;
+
+		auto value = body()->visit(worker);
+		worker.exit_scope();
+		return value;
+	};
+
+	// Several ranges per worker to begin with, stealing evens out the rest
+	auto grain = std::max<size_t>(elements.size() / (workers.size() * 8), 1);
+
+	if (!m_reduction.has_value()) {
+		astvm::Value::Array results(elements.size());
+		pool.parallel_for(elements.size(), grain, [&](size_t index, size_t begin, size_t end) {
+			auto& worker = workers[index];
+			if (!worker) {
+				worker = std::make_unique<astvm::Interpreter>(vm, *shared);
+			}
+
+			for (auto i = begin; i < end; ++i) {
+				results[i] = run(*worker, *elements[i]);
+			}
+		});
+
+		return results;
+	}
+
+	// Each range is folded by the worker taking it, the ranges then in the order of the elements
+	auto op = m_reduction.value();
+	std::vector<std::vector<std::pair<size_t, astvm::Value>>> partials(workers.size());
+	pool.parallel_for(elements.size(), grain, [&](size_t index, size_t begin, size_t end) {
+		auto& worker = workers[index];
+		if (!worker) {
+			worker = std::make_unique<astvm::Interpreter>(vm, *shared);
+		}
+
+		auto partial = run(*worker, *elements[begin]);
+		for (auto i = begin + 1; i < end; ++i) {
+			partial = apply_bin_op(op, partial, run(*worker, *elements[i]));
+		}
+		partials[index].emplace_back(begin, std::move(partial));
+	});
+
+	std::vector<std::pair<size_t, astvm::Value>> ranges{};
+	for (auto& worker_partials : partials) {
+		std::move(worker_partials.begin(), worker_partials.end(), std::back_inserter(ranges));
+	}
+	std::sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) {
+		return a.first < b.first;
+	});
+
+	astvm::Value result{};
+	for (auto& [begin, partial] : ranges) {
+		result = begin == 0 ? std::move(partial) : apply_bin_op(op, result, partial);
+	}
+
+	return result;
+}
+
 ysen::lang::ast::AssignmentExpression::AssignmentExpression(SourceRange source_range, core::String name, ExpressionPtr body)
 	: Expression(source_range), m_name(std::move(name)), m_body(std::move(body))
 {}
@@ -580,3 +836,13 @@ void ysen::lang::ast::IfStatement::generate_bytecode(bytecode::Generator& genera
 
 	
 }
+
+ysen::lang::ast::RequireStatement::RequireStatement(SourceRange source_range, core::String path)
+	: Statement(source_range), m_path(std::move(path))
+{}
+
+ysen::lang::astvm::Value ysen::lang::ast::RequireStatement::visit(astvm::Interpreter& vm) const
+{
+	vm.require(m_path);
+	return {};
+}
@@ -1,6 +1,9 @@
 #pragma once
+#include <mutex>
 #include <ysen/lang/Lexer.h>
+#include <ysen/lang/ParserOptions.h>
 #include <ysen/lang/astvm/Value.h>
+#include "ysen/core/Arena.h"
 #include "ysen/core/Optional.h"
 #include "ysen/lang/bytecode/Generator.h"
 
@@ -22,6 +25,10 @@ namespace ysen::lang::ast {
 		LessEqual,
 	};
 
+	// Evaluates a binary operator with the same semantics everywhere it is
+	// applied (AST interpreter, bytecode and compile-time folding).
+	astvm::Value apply_bin_op(BinOp, const astvm::Value& lhs, const astvm::Value& rhs);
+
 	class AstNode;
 	class Program;
 	class Statement;
@@ -45,45 +52,53 @@ namespace ysen::lang::ast {
 	class ObjectExpression;
 	class KeyValueExpression;
 	class RangedLoopExpression;
+	class ParallelLoopExpression;
 	class NumericRangeExpression;
 	class AssignmentExpression;
 	class ElseIfStatement;
 	class ElseStatement;
 	class IfStatement;
+	class RequireStatement;
 	
-	using AstNodePtr = core::SharedPtr<AstNode>;
+	// Nodes live in the arena of the Program they were parsed into and die with it,
+	// only the Program itself is reference counted.
+	using AstNodePtr = AstNode*;
 	using ProgramPtr = core::SharedPtr<Program>;
-	using StatementPtr = core::SharedPtr<Statement>;
-	using ScopeStatementPtr = core::SharedPtr<ScopeStatement>;
-	using VarDeclarationPtr = core::SharedPtr<VarDeclaration>;
-	using ExpressionPtr = core::SharedPtr<Expression>;
-	using BinOpExpressionPtr = core::SharedPtr<BinOpExpression>;
-	using ConstantExpressionPtr = core::SharedPtr<ConstantExpression>;
-	using NumericExpressionPtr = core::SharedPtr<NumericExpression>;
-	using IntegerExpressionPtr = core::SharedPtr<IntegerExpression>;
-	using FloatExpressionPtr = core::SharedPtr<FloatExpression>;
-	using StringExpressionPtr = core::SharedPtr<StringExpression>;
-	using IdentifierExpressionPtr = core::SharedPtr<IdentifierExpression>;
-	using FunctionDeclarationStatementPtr = core::SharedPtr<FunctionDeclarationStatement>;
-	using FunctionCallExpressionPtr = core::SharedPtr<FunctionCallExpression>;
-	using ReturnExpressionPtr = core::SharedPtr<ReturnExpression>;
-	using FunctionExpressionPtr = core::SharedPtr<FunctionExpression>;
-	using FunctionParameterExpressionPtr = core::SharedPtr<FunctionParameterExpression>;
-	using ArrayExpressionPtr = core::SharedPtr<ArrayExpression>;
-	using AccessExpressionPtr = core::SharedPtr<AccessExpression>;
-	using ObjectExpressionPtr = core::SharedPtr<ObjectExpression>;
-	using KeyValueExpressionPtr = core::SharedPtr<KeyValueExpression>;
-	using RangedLoopExpressionPtr = core::SharedPtr<RangedLoopExpression>;
-	using NumericRangeExpressionPtr = core::SharedPtr<NumericRangeExpression>;
-	using AssignmentExpressionPtr = core::SharedPtr<AssignmentExpression>;
-	using ElseIfStatementPtr = core::SharedPtr<ElseIfStatement>;
-	using ElseStatementPtr = core::SharedPtr<ElseStatement>;
-	using IfStatementPtr = core::SharedPtr<IfStatement>;
+	using StatementPtr = Statement*;
+	using ScopeStatementPtr = ScopeStatement*;
+	using VarDeclarationPtr = VarDeclaration*;
+	using ExpressionPtr = Expression*;
+	using BinOpExpressionPtr = BinOpExpression*;
+	using ConstantExpressionPtr = ConstantExpression*;
+	using NumericExpressionPtr = NumericExpression*;
+	using IntegerExpressionPtr = IntegerExpression*;
+	using FloatExpressionPtr = FloatExpression*;
+	using StringExpressionPtr = StringExpression*;
+	using IdentifierExpressionPtr = IdentifierExpression*;
+	using FunctionDeclarationStatementPtr = FunctionDeclarationStatement*;
+	using FunctionCallExpressionPtr = FunctionCallExpression*;
+	using ReturnExpressionPtr = ReturnExpression*;
+	using FunctionExpressionPtr = FunctionExpression*;
+	using FunctionParameterExpressionPtr = FunctionParameterExpression*;
+	using ArrayExpressionPtr = ArrayExpression*;
+	using AccessExpressionPtr = AccessExpression*;
+	using ObjectExpressionPtr = ObjectExpression*;
+	using KeyValueExpressionPtr = KeyValueExpression*;
+	using RangedLoopExpressionPtr = RangedLoopExpression*;
+	using ParallelLoopExpressionPtr = ParallelLoopExpression*;
+	using NumericRangeExpressionPtr = NumericRangeExpression*;
+	using AssignmentExpressionPtr = AssignmentExpression*;
+	using ElseIfStatementPtr = ElseIfStatement*;
+	using ElseStatementPtr = ElseStatement*;
+	using IfStatementPtr = IfStatement*;
+	using RequireStatementPtr = RequireStatement*;
 	
 	class AstNode
 	{
 	public:
 		AstNode(SourceRange source_range);
+		AstNode(const AstNode&) = delete;
+		AstNode& operator=(const AstNode&) = delete;
 		virtual ~AstNode() = default;
 		SourceRange source_range() const { return m_source_range; }
 
@@ -108,6 +123,7 @@ namespace ysen::lang::ast {
 		virtual bool is_access_expression() const { return false; }
 		virtual bool is_object_expression() const { return false; }
 		virtual bool is_ranged_loop_expression() const { return false; }
+		virtual bool is_require_statement() const { return false; }
 
 		
 		virtual astvm::Value visit(astvm::Interpreter&) const { return {}; }
@@ -119,16 +135,59 @@ namespace ysen::lang::ast {
 	class Program : public AstNode
 	{
 	public:
-		Program(SourceRange);
+		Program(SourceRange, size_t arena_capacity = 16 * 1024);
 		bool is_program() const override { return true; }
 
 		const auto& children() const { return m_children; }
-		void emit(core::SharedPtr<AstNode>);
+		auto& children() { return m_children; }
+		void emit(AstNodePtr);
+
+		// Every node of the program is created through here
+		template<typename T, typename...Args>
+		T* make(Args&&...args) { return m_arena.make<T>(std::forward<Args>(args)...); }
+		const core::Arena& arena() const { return m_arena; }
+
+		// A lazily parsed program keeps its tokens to parse deferred function bodies from
+		void defer_bodies(core::SharedPtr<Lexer> source, ParserOptions options);
+		ExpressionPtr parse_deferred(uint32_t first_token, uint32_t end_token);
+		// Held while a deferred body is parsed, the workers of a parallel loop may reach it together
+		std::mutex& deferred_mutex() { return m_deferred_mutex; }
+
+		// Appends the children of a program parsed separately, which is kept alive for them
+		void adopt(core::SharedPtr<Program>);
+		// Keeps a program alive whose nodes are emitted into this one one by one
+		void retain(core::SharedPtr<Program>);
 		
 		astvm::Value visit(astvm::Interpreter&) const override;
 		void generate_bytecode(bytecode::Generator&) const override;
 	private:
-		std::vector<core::SharedPtr<AstNode>> m_children{};
+		// Declared first so the nodes are destroyed last
+		core::Arena m_arena;
+		std::vector<AstNodePtr> m_children{};
+		core::SharedPtr<Lexer> m_source{};
+		ParserOptions m_parser_options{};
+		std::vector<core::SharedPtr<Program>> m_adopted{};
+		std::mutex m_deferred_mutex{};
+	};
+
+	// Body of a function declaration or literal. The parser may only record
+	// the token range of a '{' body, it is then parsed on first access and
+	// syntax errors in it are thrown from there.
+	class FunctionBody
+	{
+	public:
+		FunctionBody(ExpressionPtr expression);
+		FunctionBody(Program& program, uint32_t first_token, uint32_t end_token);
+
+		bool is_parsed() const;
+		ExpressionPtr get() const;
+		// Replaces the parsed body, under the same lock as the parsing
+		void set(ExpressionPtr);
+	private:
+		mutable ExpressionPtr m_expression{};
+		Program* m_program{};
+		uint32_t m_first_token{};
+		uint32_t m_end_token{};
 	};
 	
 	class Expression : public AstNode
@@ -155,12 +214,13 @@ namespace ysen::lang::ast {
 		void set_name(core::String);
 		
 		const auto& statements() const { return m_statements; }
-		void emit(core::SharedPtr<Statement>);
+		auto& statements() { return m_statements; }
+		void emit(ExpressionPtr);
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 		void generate_bytecode(bytecode::Generator&) const override;
 	private:
-		std::vector<core::SharedPtr<Statement>> m_statements{};
+		std::vector<ExpressionPtr> m_statements{};
 		core::String m_name{};
 	};
 
@@ -182,49 +242,54 @@ namespace ysen::lang::ast {
 	class FunctionExpression : public Expression
 	{
 	public:
-		FunctionExpression(SourceRange, std::vector<FunctionParameterExpressionPtr>, ExpressionPtr body);
+		FunctionExpression(SourceRange, std::vector<FunctionParameterExpressionPtr>, FunctionBody body);
 		bool is_function_expression() const override { return true; }
 
 		const auto& parameters() const { return m_parameters; }
-		const auto& body() const { return m_body; }
+		ExpressionPtr body() const { return m_body.get(); }
+		void set_body(ExpressionPtr body) { m_body.set(body); }
+		bool is_body_parsed() const { return m_body.is_parsed(); }
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 	private:
 		std::vector<FunctionParameterExpressionPtr> m_parameters{};
-		ExpressionPtr m_body{};
+		FunctionBody m_body;
 	};
 	
 	class FunctionDeclarationStatement : public Expression
 	{
 	public:
-		FunctionDeclarationStatement(SourceRange, core::String, std::vector<FunctionParameterExpressionPtr>, ExpressionPtr body);
+		FunctionDeclarationStatement(SourceRange, core::String, std::vector<FunctionParameterExpressionPtr>, FunctionBody body);
 		bool is_function_declaration() const override { return true; }
 
 		const auto& name() const { return m_name; }
 		const auto& parameters() const { return m_parameters; }
-		const auto& body() const { return m_body; }
+		ExpressionPtr body() const { return m_body.get(); }
+		void set_body(ExpressionPtr body) { m_body.set(body); }
+		bool is_body_parsed() const { return m_body.is_parsed(); }
 		astvm::Value visit(astvm::Interpreter&) const override;
 		void generate_bytecode(bytecode::Generator&) const override;
 	private:
 		core::String m_name{};
 		std::vector<FunctionParameterExpressionPtr> m_parameters{};
-		ExpressionPtr m_body{};
+		FunctionBody m_body;
 	};
 
 	class VarDeclaration : public Statement
 	{
 	public:
-		VarDeclaration(SourceRange, core::String name, core::SharedPtr<Expression> init = {});
+		VarDeclaration(SourceRange, core::String name, ExpressionPtr init = nullptr);
 		bool is_var_declaration() const override { return true; }
 
 		const auto& name() const { return m_name; }
 		const auto& expression() const { return m_expression; }
+		auto& expression() { return m_expression; }
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 		void generate_bytecode(bytecode::Generator&) const override;
 	private:
 		core::String m_name{};
-		core::SharedPtr<Expression> m_expression{};
+		ExpressionPtr m_expression{};
 	};
 
 	class FunctionCallExpression : public Expression
@@ -235,6 +300,11 @@ namespace ysen::lang::ast {
 
 		const auto& name() const { return m_name; }
 		const auto& arguments() const { return m_arguments; }
+		auto& arguments() { return m_arguments; }
+
+		// Looks the callee up by name, or through a variable holding a function or its name
+		astvm::FunctionPtr resolve(astvm::Interpreter&) const;
+		std::vector<astvm::Value> evaluate_arguments(astvm::Interpreter&) const;
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 		void generate_bytecode(bytecode::Generator&) const override;
@@ -250,6 +320,7 @@ namespace ysen::lang::ast {
 		bool is_return_expression() const override { return true; }
 		
 		const auto& expression() const { return m_expression; }
+		auto& expression() { return m_expression; }
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 		void generate_bytecode(bytecode::Generator&) const override;
@@ -356,6 +427,7 @@ namespace ysen::lang::ast {
 		bool is_array_expression() const override { return true; }
 
 		const auto& expressions() const { return m_expressions; }
+		auto& expressions() { return m_expressions; }
 		
 		astvm::Value visit(astvm::Interpreter&) const override;
 	private:
@@ -384,6 +456,7 @@ namespace ysen::lang::ast {
 		bool is_object_expression() const override { return true; }
 
 		const auto& key_value_expressions() const { return m_key_value_expressions; }
+		auto& key_value_expressions() { return m_key_value_expressions; }
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 	private:
@@ -396,7 +469,9 @@ namespace ysen::lang::ast {
 		KeyValueExpression(SourceRange, ExpressionPtr key, ExpressionPtr value);
 
 		const auto& key() const { return m_key; }
+		auto& key() { return m_key; }
 		const auto& value() const { return m_value; }
+		auto& value() { return m_value; }
 	private:
 		ExpressionPtr m_key{};
 		ExpressionPtr m_value{};
@@ -425,6 +500,7 @@ namespace ysen::lang::ast {
 		const auto& declaration() const { return m_declaration; }
 		const auto& range_expression() const { return m_range_expression; }
 		const auto& body() const { return m_body; }
+		auto& body() { return m_body; }
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 	private:
@@ -433,6 +509,25 @@ namespace ysen::lang::ast {
 		ExpressionPtr m_body{};
 	};
 
+	// parallel for: the elements are split across the threads of the interpreter's
+	// pool. Every worker runs the body in an interpreter of its own, which sees the
+	// variables of the enclosing scopes read only, assigning to one throws a
+	// SharedVariableWrite. Without a reduction the loop gives the body's values as an
+	// array in the order of the elements, parallel(+) and parallel(*) fold them in
+	// that order instead.
+	class ParallelLoopExpression : public RangedLoopExpression
+	{
+	public:
+		ParallelLoopExpression(SourceRange, ExpressionPtr declaration, ExpressionPtr range_expression, ExpressionPtr body,
+			core::Optional<BinOp> reduction);
+
+		const auto& reduction() const { return m_reduction; }
+
+		astvm::Value visit(astvm::Interpreter&) const override;
+	private:
+		core::Optional<BinOp> m_reduction{};
+	};
+
 	class AssignmentExpression : public Expression
 	{
 	public:
@@ -440,6 +535,7 @@ namespace ysen::lang::ast {
 
 		const auto& name() const { return m_name; }
 		const auto& body() const { return m_body; }
+		auto& body() { return m_body; }
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 	private:
@@ -453,8 +549,11 @@ namespace ysen::lang::ast {
 		ElseIfStatement(SourceRange, VarDeclarationPtr, ExpressionPtr cond, ExpressionPtr body);
 
 		const auto& declaration() const { return m_var_declaration; }
+		auto& declaration() { return m_var_declaration; }
 		const auto& condition() const { return m_condition; }
+		auto& condition() { return m_condition; }
 		const auto& body() const { return m_body; }
+		auto& body() { return m_body; }
 
 		astvm::Value visit(astvm::Interpreter&) const override;
 	private:
@@ -468,6 +567,9 @@ namespace ysen::lang::ast {
 	public:
 		ElseStatement(SourceRange, ExpressionPtr body);
 
+		const auto& body() const { return m_body; }
+		auto& body() { return m_body; }
+
 		astvm::Value visit(astvm::Interpreter&) const override;
 	private:
 		ExpressionPtr m_body{};
@@ -478,6 +580,17 @@ namespace ysen::lang::ast {
 	public:
 		IfStatement(SourceRange, VarDeclarationPtr, ExpressionPtr cond, ExpressionPtr body, std::vector<ElseIfStatementPtr>, ElseStatementPtr);
 
+		const auto& declaration() const { return m_var_declaration; }
+		auto& declaration() { return m_var_declaration; }
+		const auto& condition() const { return m_condition; }
+		auto& condition() { return m_condition; }
+		const auto& body() const { return m_body; }
+		auto& body() { return m_body; }
+		const auto& else_if_statements() const { return m_else_if_statements; }
+		auto& else_if_statements() { return m_else_if_statements; }
+		const auto& else_statement() const { return m_else_statement; }
+		auto& else_statement() { return m_else_statement; }
+
 		astvm::Value visit(astvm::Interpreter&) const override;
 		void generate_bytecode(bytecode::Generator&) const override;
 	private:
@@ -487,4 +600,18 @@ namespace ysen::lang::ast {
 		std::vector<ElseIfStatementPtr> m_else_if_statements{};
 		ElseStatementPtr m_else_statement{};
 	};
+
+	// require "path": declares what the module at path exports, see ModuleCache
+	class RequireStatement : public Statement
+	{
+	public:
+		RequireStatement(SourceRange, core::String path);
+		bool is_require_statement() const override { return true; }
+
+		const auto& path() const { return m_path; }
+
+		astvm::Value visit(astvm::Interpreter&) const override;
+	private:
+		core::String m_path{};
+	};
 }
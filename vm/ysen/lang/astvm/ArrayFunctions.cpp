@@ -0,0 +1,384 @@
+#include "ArrayFunctions.h"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Interpreter.h"
+#include "ysen/core/format.h"
+
+namespace {
+
+	using namespace ysen;
+	using namespace ysen::lang::astvm;
+
+	ArrayElements array_argument(std::span<const Value> arguments, const char* function)
+	{
+		if (arguments.empty() || !arguments[0].is_array()) {
+			throw std::invalid_argument(core::format("{}() takes an array as its first argument", function).c_str());
+		}
+
+		return arguments[0].array();
+	}
+
+	// A function value, or the name of a function as a call through a variable would find it
+	FunctionPtr callback_argument(Interpreter& vm, std::span<const Value> arguments, size_t index, const char* function)
+	{
+		if (index < arguments.size()) {
+			const auto& argument = arguments[index];
+			if (argument.is_function()) {
+				return argument.function();
+			}
+			if (argument.is_string()) {
+				if (auto found = vm.current_scope()->find_function(argument.string())) {
+					return found;
+				}
+			}
+		}
+
+		throw std::invalid_argument(core::format("{}() takes a function as argument {}", function,
+			static_cast<unsigned int>(index + 1)).c_str());
+	}
+
+	size_t grain(const core::ThreadPool& pool, size_t count)
+	{
+		// Several ranges per worker to start with, but none so small that taking it costs more than it does
+		return std::max<size_t>(count / ((pool.size() + 1) * 8), 1024);
+	}
+
+	// range(begin, end) for ranges of [0, count) taken by the workers of the pool, or for
+	// all of it on small arrays; the results come in the order of the ranges
+	template<typename T, typename Range>
+	std::vector<T> over_ranges(Interpreter& vm, size_t count, Range&& range)
+	{
+		if (count < lang::astvm::ARRAY_PARALLEL_THRESHOLD) {
+			std::vector<T> results{};
+			results.push_back(range(0, count));
+			return results;
+		}
+
+		auto& pool = vm.thread_pool();
+		std::vector<std::vector<std::pair<size_t, T>>> partials(pool.size() + 1);
+		pool.parallel_for(count, grain(pool, count), [&](size_t worker, size_t begin, size_t end) {
+			partials[worker].emplace_back(begin, range(begin, end));
+		});
+
+		std::vector<std::pair<size_t, T>> ordered{};
+		for (auto& worker_partials : partials) {
+			std::move(worker_partials.begin(), worker_partials.end(), std::back_inserter(ordered));
+		}
+		std::sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) {
+			return a.first < b.first;
+		});
+
+		std::vector<T> results{};
+		results.reserve(ordered.size());
+		for (auto& [begin, result] : ordered) {
+			results.push_back(std::move(result));
+		}
+		return results;
+	}
+
+	// The value of callback for each element
+	void call_each(Interpreter& vm, const Function& callback, const Value::Array& array, std::span<Value> results)
+	{
+		if (callback.is_pure() && array.size() >= lang::astvm::ARRAY_PARALLEL_THRESHOLD) {
+			auto& pool = vm.thread_pool();
+			pool.parallel_for(array.size(), grain(pool, array.size()), [&](size_t, size_t begin, size_t end) {
+				for (auto i = begin; i < end; ++i) {
+					results[i] = callback.invoke(vm, std::span<const Value>{ &array[i], 1 });
+				}
+			});
+			return;
+		}
+
+		std::span<const Value> columns[] = { array };
+		callback.invoke_columns(vm, columns, results);
+	}
+
+	Value map(Interpreter& vm, std::span<const Value> arguments)
+	{
+		const auto& array = array_argument(arguments, "map");
+		auto callback = callback_argument(vm, arguments, 1, "map");
+
+		Value::Array results(array.size());
+		call_each(vm, *callback, array, results);
+		return results;
+	}
+
+	Value filter(Interpreter& vm, std::span<const Value> arguments)
+	{
+		const auto& array = array_argument(arguments, "filter");
+		auto callback = callback_argument(vm, arguments, 1, "filter");
+
+		std::vector<Value> keep(array.size());
+		call_each(vm, *callback, array, keep);
+
+		auto count = std::count_if(keep.begin(), keep.end(), [](const Value& value) {
+			return value.is_trueish();
+		});
+
+		Value::Array results{};
+		results.reserve(count);
+		for (auto i = 0u; i < array.size(); ++i) {
+			if (keep[i].is_trueish()) {
+				results.push_back(array[i]);
+			}
+		}
+		return results;
+	}
+
+	Value find(Interpreter& vm, std::span<const Value> arguments)
+	{
+		const auto& array = array_argument(arguments, "find");
+		auto callback = callback_argument(vm, arguments, 1, "find");
+
+		for (const auto& element : array) {
+			if (callback->invoke(vm, std::span<const Value>{ &element, 1 }).is_trueish()) {
+				return element;
+			}
+		}
+
+		return {};
+	}
+
+	Value reduce(Interpreter& vm, std::span<const Value> arguments)
+	{
+		const auto& array = array_argument(arguments, "reduce");
+		auto callback = callback_argument(vm, arguments, 1, "reduce");
+
+		auto has_initial = arguments.size() > 2;
+		if (array.empty()) {
+			return has_initial ? arguments[2] : Value{};
+		}
+
+		// The accumulator moves through the pair, only the element is copied each time
+		Value pair[2] = { has_initial ? arguments[2] : array[0], {} };
+		for (auto i = has_initial ? 0u : 1u; i < array.size(); ++i) {
+			pair[1] = array[i];
+			pair[0] = callback->invoke(vm, pair);
+		}
+
+		return std::move(pair[0]);
+	}
+
+	// Sorted runs merged two at a time, the merges of a round on the pool as well
+	void parallel_sort(Interpreter& vm, Value::Array& values)
+	{
+		auto less = [](const Value& a, const Value& b) {
+			return a < b;
+		};
+
+		auto& pool = vm.thread_pool();
+		auto run_size = (values.size() + pool.size()) / (pool.size() + 1);
+
+		std::vector<std::pair<size_t, size_t>> runs{};
+		std::mutex mutex{};
+		pool.parallel_for(values.size(), run_size, [&](size_t, size_t begin, size_t end) {
+			std::stable_sort(values.begin() + begin, values.begin() + end, less);
+
+			std::lock_guard lock{mutex};
+			runs.emplace_back(begin, end);
+		});
+		std::sort(runs.begin(), runs.end());
+
+		std::vector<size_t> bounds{ 0 };
+		for (const auto& [begin, end] : runs) {
+			bounds.push_back(end);
+		}
+
+		while (bounds.size() > 2) {
+			auto merges = (bounds.size() - 1) / 2;
+			pool.parallel_for(merges, 1, [&](size_t, size_t begin, size_t end) {
+				for (auto i = begin; i < end; ++i) {
+					std::inplace_merge(values.begin() + bounds[2 * i], values.begin() + bounds[2 * i + 1],
+						values.begin() + bounds[2 * i + 2], less);
+				}
+			});
+
+			std::vector<size_t> merged{ 0 };
+			for (auto i = 0u; i < merges; ++i) {
+				merged.push_back(bounds[2 * i + 2]);
+			}
+			if ((bounds.size() - 1) % 2 == 1) {
+				merged.push_back(bounds.back());
+			}
+			bounds = std::move(merged);
+		}
+	}
+
+	// Stable, so elements the comparison can't tell apart keep their order
+	Value sort(Interpreter& vm, std::span<const Value> arguments)
+	{
+		Value::Array values = array_argument(arguments, "sort");
+
+		if (arguments.size() > 1) {
+			auto callback = callback_argument(vm, arguments, 1, "sort");
+			std::stable_sort(values.begin(), values.end(), [&](const Value& a, const Value& b) {
+				Value pair[2] = { a, b };
+				return callback->invoke(vm, pair).is_trueish();
+			});
+		}
+		else if (values.size() >= lang::astvm::ARRAY_PARALLEL_THRESHOLD) {
+			parallel_sort(vm, values);
+		}
+		else {
+			std::stable_sort(values.begin(), values.end(), [](const Value& a, const Value& b) {
+				return a < b;
+			});
+		}
+
+		return values;
+	}
+
+	// Packed arrays of numbers are added up by their own kernel instead
+	const TypedArray* numbers_argument(std::span<const Value> arguments)
+	{
+		if (arguments.empty() || !arguments[0].is_packed()) {
+			return nullptr;
+		}
+
+		auto packed = arguments[0].packed().ptr();
+		return packed->element_type() != ElementType::Bool ? packed : nullptr;
+	}
+
+	Value sum(Interpreter& vm, std::span<const Value> arguments)
+	{
+		if (auto numbers = numbers_argument(arguments)) {
+			return numbers->size() > 0 ? numbers->sum() : Value{ 0 };
+		}
+
+		const auto& array = array_argument(arguments, "sum");
+		if (array.empty()) {
+			return 0;
+		}
+
+		// Ranges are added up in order, strings are concatenated the way a loop would
+		auto partials = over_ranges<Value>(vm, array.size(), [&array](size_t begin, size_t end) {
+			auto total = array[begin];
+			for (auto i = begin + 1; i < end; ++i) {
+				total = total + array[i];
+			}
+			return total;
+		});
+
+		auto total = std::move(partials.front());
+		for (auto i = 1u; i < partials.size(); ++i) {
+			total = total + partials[i];
+		}
+		return total;
+	}
+
+	// Index of the first element no other is better than
+	template<typename Better>
+	Value pick(Interpreter& vm, const Value::Array& array, Better better)
+	{
+		if (array.empty()) {
+			return {};
+		}
+
+		auto indices = over_ranges<size_t>(vm, array.size(), [&](size_t begin, size_t end) {
+			auto best = begin;
+			for (auto i = begin + 1; i < end; ++i) {
+				if (better(array[i], array[best])) {
+					best = i;
+				}
+			}
+			return best;
+		});
+
+		auto best = indices.front();
+		for (auto index : indices) {
+			if (better(array[index], array[best])) {
+				best = index;
+			}
+		}
+		return array[best];
+	}
+
+	Value min(Interpreter& vm, std::span<const Value> arguments)
+	{
+		if (auto numbers = numbers_argument(arguments)) {
+			return numbers->min();
+		}
+
+		return pick(vm, array_argument(arguments, "min"), [](const Value& a, const Value& b) {
+			return a < b;
+		});
+	}
+
+	Value max(Interpreter& vm, std::span<const Value> arguments)
+	{
+		if (auto numbers = numbers_argument(arguments)) {
+			return numbers->max();
+		}
+
+		return pick(vm, array_argument(arguments, "max"), [](const Value& a, const Value& b) {
+			return a > b;
+		});
+	}
+
+	// Sum of the products as a double
+	Value dot(Interpreter&, std::span<const Value> arguments)
+	{
+		if (arguments.size() < 2 || !arguments[0].is_array() || !arguments[1].is_array()) {
+			throw std::invalid_argument("dot() takes two arrays");
+		}
+
+		auto packed = [](const Value& value) {
+			return value.is_packed() ? value.packed() : TypedArray::pack(value.array());
+		};
+		auto a = packed(arguments[0]);
+		auto b = packed(arguments[1]);
+		if (a.is_null() || b.is_null()) {
+			if (arguments[0].array_size() == 0 && arguments[1].array_size() == 0) {
+				return 0.0;
+			}
+			throw std::invalid_argument("dot() takes arrays of numbers");
+		}
+
+		return a->dot(*b);
+	}
+
+	Value join(Interpreter&, std::span<const Value> arguments)
+	{
+		const auto& array = array_argument(arguments, "join");
+		auto separator = arguments.size() > 1 ? arguments[1].to_string() : core::String{ "," };
+
+		core::String joined{};
+		for (auto i = 0u; i < array.size(); ++i) {
+			if (i > 0) {
+				joined.append(separator);
+			}
+			joined.append(array[i].to_string());
+		}
+		return joined;
+	}
+
+}
+
+void ysen::lang::astvm::add_array_functions(Interpreter& vm)
+{
+	auto add = [&vm](const char* name, Function::FunctionSignature callable, bool pure) {
+		auto function = core::adopt_shared(new Function(name, {}, std::move(callable)));
+		if (pure) {
+			function->mark_pure();
+		}
+		vm.add(std::move(function));
+	};
+
+	add("map", map, false);
+	add("filter", filter, false);
+	add("find", find, false);
+	add("reduce", reduce, false);
+	add("sort", sort, false);
+	add("sum", sum, true);
+	add("min", min, true);
+	add("max", max, true);
+	add("dot", dot, true);
+	add("join", join, true);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+
+namespace ysen::lang::astvm {
+
+	class Interpreter;
+
+	// Arrays of at least this many elements are split across the interpreter's pool
+	constexpr size_t ARRAY_PARALLEL_THRESHOLD = 16 * 1024;
+
+	// Declares the array functions in the global scope of the interpreter:
+	//
+	//   map(array, f), filter(array, f), find(array, f), reduce(array, f[, initial]),
+	//   sort(array[, less]), sum(array), min(array), max(array), dot(a, b), join(array[, separator])
+	//
+	// f is a function or the name of one. map and filter call a script function as a
+	// batch, its scope is entered once for all elements. Large arrays are split across
+	// threads by sort, sum, min and max, and by map and filter when f is a pure native;
+	// script callbacks always run on the calling thread, in order. Packed arrays of
+	// numbers are summed, searched and multiplied by TypedArray's vector kernels.
+	void add_array_functions(Interpreter&);
+
+}
@@ -0,0 +1,208 @@
+#include "Async.h"
+
+#include <utility>
+
+namespace {
+	thread_local ysen::lang::astvm::Scheduler* t_scheduler{};
+}
+
+ysen::lang::astvm::PendingPtr ysen::lang::astvm::Pending::resolved(Value value)
+{
+	auto pending = core::make_shared<Pending>();
+	pending->resolve(std::move(value));
+	return pending;
+}
+
+bool ysen::lang::astvm::Pending::is_ready() const
+{
+	std::lock_guard lock{m_mutex};
+	return m_ready;
+}
+
+void ysen::lang::astvm::Pending::resolve(Value value)
+{
+	{
+		std::lock_guard lock{m_mutex};
+		if (m_ready) {
+			return;
+		}
+		m_value = std::move(value);
+	}
+	settle();
+}
+
+void ysen::lang::astvm::Pending::fail(std::exception_ptr error)
+{
+	{
+		std::lock_guard lock{m_mutex};
+		if (m_ready) {
+			return;
+		}
+		m_error = std::move(error);
+	}
+	settle();
+}
+
+void ysen::lang::astvm::Pending::fail(const core::String& message)
+{
+	fail(std::make_exception_ptr(AsyncError(message)));
+}
+
+void ysen::lang::astvm::Pending::settle()
+{
+	std::vector<std::function<void()>> callbacks{};
+	{
+		std::lock_guard lock{m_mutex};
+		m_ready = true;
+		callbacks = std::move(m_callbacks);
+	}
+
+	m_condition.notify_all();
+	for (auto& callback : callbacks) {
+		callback();
+	}
+}
+
+bool ysen::lang::astvm::Pending::when_ready(std::function<void()> callback)
+{
+	std::lock_guard lock{m_mutex};
+	if (m_ready) {
+		return false;
+	}
+
+	m_callbacks.push_back(std::move(callback));
+	return true;
+}
+
+void ysen::lang::astvm::Pending::wait() const
+{
+	std::unique_lock lock{m_mutex};
+	m_condition.wait(lock, [this]() { return m_ready; });
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::Pending::result() const
+{
+	std::lock_guard lock{m_mutex};
+	if (m_error) {
+		std::rethrow_exception(m_error);
+	}
+	return m_value;
+}
+
+bool ysen::lang::astvm::PendingAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+	// Settled since await_ready, the coroutine goes on without suspending
+	return pending->when_ready([handle]() { handle.resume(); });
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::await(const PendingPtr& pending)
+{
+	auto scheduler = Scheduler::current();
+	if (!pending->is_ready()) {
+		if (auto script = scheduler ? scheduler->running_script() : nullptr) {
+			// Woken on the settling thread, run() only resumes the script once it suspended
+			auto waited = pending;
+			if (waited->when_ready([scheduler, script]() { scheduler->wake(script); })) {
+				core::Fiber::suspend();
+			}
+		}
+		else {
+			pending->wait();
+		}
+	}
+
+	return pending->result();
+}
+
+ysen::lang::astvm::Scheduler::Scheduler(size_t stack_size)
+	: m_stack_size(stack_size)
+{}
+
+ysen::lang::astvm::Scheduler::~Scheduler() = default;
+
+ysen::lang::astvm::PendingPtr ysen::lang::astvm::Scheduler::spawn(std::function<Value()> body)
+{
+	auto result = core::make_shared<Pending>();
+	auto script = std::make_unique<Script>([body = std::move(body), result]() mutable {
+		try {
+			result->resolve(body());
+		}
+		catch (...) {
+			result->fail(std::current_exception());
+		}
+	}, m_stack_size);
+
+	{
+		std::lock_guard lock{m_mutex};
+		m_ready.push_back(script.get());
+		m_scripts.emplace(script.get(), std::move(script));
+	}
+
+	m_condition.notify_one();
+	return result;
+}
+
+void ysen::lang::astvm::Scheduler::run()
+{
+	auto outer = std::exchange(t_scheduler, this);
+
+	for (;;) {
+		Script* script{};
+		{
+			std::unique_lock lock{m_mutex};
+			m_condition.wait(lock, [this]() { return !m_ready.empty() || m_scripts.empty(); });
+			if (m_ready.empty()) {
+				break;
+			}
+
+			script = m_ready.front();
+			m_ready.pop_front();
+		}
+
+		m_running = script;
+		script->fiber.resume();
+		m_running = nullptr;
+
+		if (script->fiber.is_finished()) {
+			std::lock_guard lock{m_mutex};
+			m_scripts.erase(script);
+		}
+	}
+
+	t_scheduler = outer;
+}
+
+size_t ysen::lang::astvm::Scheduler::size() const
+{
+	std::lock_guard lock{m_mutex};
+	return m_scripts.size();
+}
+
+ysen::lang::astvm::Scheduler* ysen::lang::astvm::Scheduler::current()
+{
+	return t_scheduler;
+}
+
+void ysen::lang::astvm::Scheduler::yield()
+{
+	auto scheduler = current();
+	if (auto script = scheduler ? scheduler->running_script() : nullptr) {
+		scheduler->wake(script);
+		core::Fiber::suspend();
+	}
+}
+
+ysen::lang::astvm::Scheduler::Script* ysen::lang::astvm::Scheduler::running_script() const
+{
+	// A fiber the script started itself is none of the scheduler's
+	return m_running && core::Fiber::current() == &m_running->fiber ? m_running : nullptr;
+}
+
+void ysen::lang::astvm::Scheduler::wake(Script* script)
+{
+	{
+		std::lock_guard lock{m_mutex};
+		m_ready.push_back(script);
+	}
+	m_condition.notify_one();
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "Value.h"
+#include "ysen/core/Fiber.h"
+#include "ysen/core/format.h"
+#include "ysen/core/SharedPtr.h"
+#include "ysen/core/String.h"
+
+namespace ysen::lang::astvm {
+
+	class AsyncError : public std::exception
+	{
+	public:
+		explicit AsyncError(const core::String& message)
+			: m_message(core::format("AsyncError: {}", message))
+		{}
+
+		char const* what() const override
+		{
+			return m_message.c_str();
+		}
+	private:
+		core::String m_message{};
+	};
+
+	class Pending;
+	using PendingPtr = core::SharedPtr<Pending>;
+
+	// The result of a native which finishes later. Settled once, by resolve or fail,
+	// from any thread.
+	class Pending
+	{
+	public:
+		Pending() = default;
+		Pending(const Pending&) = delete;
+		Pending& operator=(const Pending&) = delete;
+
+		static PendingPtr resolved(Value);
+
+		bool is_ready() const;
+		void resolve(Value);
+		void fail(std::exception_ptr);
+		void fail(const core::String& message);
+
+		// Registers callback to be called on the thread settling the pending. False
+		// if it already is settled, the callback is dropped then.
+		bool when_ready(std::function<void()> callback);
+		// Blocks the thread until settled
+		void wait() const;
+		// The value once settled, a failure is rethrown
+		Value result() const;
+	private:
+		void settle();
+
+		mutable std::mutex m_mutex{};
+		mutable std::condition_variable m_condition{};
+		bool m_ready{};
+		Value m_value{};
+		std::exception_ptr m_error{};
+		std::vector<std::function<void()>> m_callbacks{};
+	};
+
+	// Lets a coroutine co_await a pending, it continues on the thread settling it
+	struct PendingAwaiter
+	{
+		PendingPtr pending{};
+
+		bool await_ready() const { return pending->is_ready(); }
+		bool await_suspend(std::coroutine_handle<> handle);
+		Value await_resume() const { return pending->result(); }
+	};
+
+	inline PendingAwaiter operator co_await(PendingPtr pending)
+	{
+		return PendingAwaiter{ std::move(pending) };
+	}
+
+	// Return type of a native written as a coroutine. It runs right away, up to its
+	// first co_await that has to wait; co_return or an exception settles pending().
+	// Once it waited it no longer runs on the interpreter's thread, so it shouldn't
+	// touch the interpreter after its first co_await.
+	class Task
+	{
+	public:
+		struct promise_type
+		{
+			PendingPtr pending{ core::make_shared<Pending>() };
+
+			Task get_return_object() { return Task{ pending }; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_value(Value value) { pending->resolve(std::move(value)); }
+			void unhandled_exception() { pending->fail(std::current_exception()); }
+		};
+
+		const PendingPtr& pending() const { return m_pending; }
+	private:
+		explicit Task(PendingPtr pending)
+			: m_pending(std::move(pending))
+		{}
+
+		PendingPtr m_pending{};
+	};
+
+	// The value of a pending, rethrowing its failure. A script run by a Scheduler is
+	// parked until then while the scheduler runs the others, any other thread blocks.
+	Value await(const PendingPtr&);
+
+	// Runs many scripts on the thread calling run(), each on a fiber of its own. A
+	// script awaiting a native is parked with all of its frames and the thread goes on
+	// with the others, so threads don't have to grow with the requests in flight.
+	class Scheduler
+	{
+	public:
+		explicit Scheduler(size_t stack_size = core::Fiber::DEFAULT_STACK_SIZE);
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+		~Scheduler();
+
+		// Queues body to run on a fiber, its value or exception settles the result
+		PendingPtr spawn(std::function<Value()> body);
+		// Runs the queued scripts until all of them finished, sleeping while all that
+		// are left are parked
+		void run();
+		// Scripts which haven't finished yet
+		size_t size() const;
+
+		// The scheduler whose script is running on this thread, nullptr outside of one
+		static Scheduler* current();
+		// Puts the running script at the back of the queue and runs the others first,
+		// does nothing outside of a script
+		static void yield();
+	private:
+		struct Script
+		{
+			Script(std::function<void()> body, size_t stack_size)
+				: fiber(std::move(body), stack_size)
+			{}
+
+			core::Fiber fiber;
+		};
+		friend Value await(const PendingPtr&);
+
+		Script* running_script() const;
+		void wake(Script*);
+
+		size_t m_stack_size{};
+		mutable std::mutex m_mutex{};
+		std::condition_variable m_condition{};
+		std::deque<Script*> m_ready{};
+		std::unordered_map<const Script*, std::unique_ptr<Script>> m_scripts{};
+		Script* m_running{};
+	};
+
+	namespace details {
+		// A native's result as a Value, awaited if the native is asynchronous
+		template<typename Result>
+		Value settle(Result&& result)
+		{
+			using T = std::remove_cvref_t<Result>;
+
+			if constexpr (std::is_same_v<T, Task>) {
+				return await(result.pending());
+			}
+			else if constexpr (std::is_same_v<T, PendingPtr>) {
+				return await(result);
+			}
+			else {
+				return Value(std::forward<Result>(result));
+			}
+		}
+	}
+
+}
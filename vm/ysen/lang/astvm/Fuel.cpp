@@ -0,0 +1,50 @@
+#include "Fuel.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Async.h"
+
+namespace {
+	// Never runs out in practice, with room below it for burn(steps)
+	constexpr auto UNBOUNDED = std::numeric_limits<int64_t>::max() / 2;
+}
+
+ysen::lang::astvm::Fuel::Fuel(FuelBudget budget)
+{
+	set_budget(budget);
+}
+
+void ysen::lang::astvm::Fuel::set_budget(FuelBudget budget)
+{
+	m_budget = budget;
+	m_used = 0;
+	grant();
+}
+
+void ysen::lang::astvm::Fuel::exhausted()
+{
+	// The steps of the safepoint that ran out are counted too
+	m_used = used();
+
+	if (m_budget.limit > 0 && m_used > m_budget.limit) {
+		m_granted = 0;
+		m_left = 0;
+		throw OutOfFuel(m_budget.limit);
+	}
+
+	if (m_budget.slice > 0) {
+		Scheduler::yield();
+	}
+
+	grant();
+}
+
+void ysen::lang::astvm::Fuel::grant()
+{
+	m_granted = m_budget.slice > 0 ? m_budget.slice : UNBOUNDED;
+	if (m_budget.limit > 0) {
+		m_granted = std::min(m_granted, m_budget.limit - m_used);
+	}
+	m_left = m_granted;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include "ysen/core/format.h"
+#include "ysen/core/String.h"
+
+namespace ysen::lang::astvm {
+
+	// Thrown at the safepoint a script runs out of its fuel at
+	class OutOfFuel : public std::exception
+	{
+	public:
+		explicit OutOfFuel(int64_t limit)
+			: m_message(core::format("OutOfFuel: script used up its budget of {} steps", limit))
+		{}
+
+		char const* what() const override
+		{
+			return m_message.c_str();
+		}
+	private:
+		core::String m_message{};
+	};
+
+	// Steps a script may take, counted at its safepoints: the back-edges of loops and
+	// calls of script functions. 0 leaves either one unbounded.
+	struct FuelBudget
+	{
+		// Steps in all before the script is stopped with OutOfFuel
+		int64_t limit{};
+		// Steps at a time before a script run by a Scheduler lets the others go first
+		int64_t slice{};
+	};
+
+	class Fuel
+	{
+	public:
+		explicit Fuel(FuelBudget budget = {});
+
+		// Starts counting anew
+		void set_budget(FuelBudget);
+		const FuelBudget& budget() const { return m_budget; }
+		int64_t used() const { return m_used + (m_granted - m_left); }
+
+		// A safepoint, one decrement unless a slice or the limit ran out
+		void burn()
+		{
+			if (--m_left < 0) {
+				exhausted();
+			}
+		}
+
+		// Several steps at once, for work that doesn't pass the safepoints
+		void burn(int64_t steps)
+		{
+			m_left -= steps;
+			if (m_left < 0) {
+				exhausted();
+			}
+		}
+	private:
+		void exhausted();
+		void grant();
+
+		FuelBudget m_budget{};
+		// Steps counted before the current grant
+		int64_t m_used{};
+		int64_t m_granted{};
+		int64_t m_left{};
+	};
+
+}
@@ -1,20 +1,22 @@
 #include "Interpreter.h"
+
+#include <algorithm>
+#include <memory>
+
 #include "Value.h"
 #include "ysen/core/format.h"
+#include "ysen/core/ScopeExit.h"
 
 ysen::lang::astvm::FunctionParameter::FunctionParameter(core::String name, core::String type_name, const ast::AstNode* node)
 	: m_name(std::move(name)), m_type_name(std::move(type_name)), m_ast_node(node)
 {}
 
-ysen::lang::astvm::Function::Function(core::String name, FunctionParameterList parameters, const ast::AstNode* ast_node)
-	: m_name(std::move(name)), m_parameters(std::move(parameters)), m_ast_node(ast_node)
+ysen::lang::astvm::Function::Function(core::String name, FunctionParameterList parameters, const ast::AstNode* ast_node, ast::ProgramPtr program)
+	: m_name(std::move(name)), m_parameters(std::move(parameters)), m_ast_node(ast_node), m_program(std::move(program))
 {
-	m_callable = [this](Interpreter& vm, const std::vector<Value>& arguments) {
-		core::println("calling function '{}'", this->name());
+	m_callable = [this](Interpreter& vm, std::span<const Value> arguments) {
 		vm.unpack_arguments(arguments, this->parameters());
-		return m_ast_node->is_function_declaration() ?
-			dynamic_cast<const ast::FunctionDeclarationStatement*>(m_ast_node)->body()->visit(vm) :
-			dynamic_cast<const ast::FunctionExpression*>(m_ast_node)->body()->visit(vm);
+		return body()->visit(vm);
 	};
 }
 
@@ -22,20 +24,232 @@ ysen::lang::astvm::Function::Function(core::String name, FunctionParameterList p
 	: m_name(std::move(name)), m_parameters(std::move(parameters)), m_callable(std::move(function))
 {}
 
-ysen::lang::astvm::Value ysen::lang::astvm::Function::invoke(Interpreter& vm, const std::vector<Value>& arguments) const
+ysen::lang::astvm::Value ysen::lang::astvm::Function::invoke(Interpreter& vm, std::span<const Value> arguments) const
 {
+	if (is_native()) {
+		return m_callable(vm, arguments);
+	}
+
+	vm.fuel().burn();
 	vm.enter_scope(m_name, ScopeType::Returnable);
+	vm.current_scope()->set_function(this);
+	// Also left when the body throws, running out of fuel included
+	core::ScopeExit guard{[&vm]() {
+		vm.exit_scope();
+	}};
 	auto ret = m_callable(vm, arguments);
-	vm.exit_scope();
+
+	// A ret of a call to itself in tail position runs here, in this invocation's
+	// scope, instead of nesting another invoke on the C++ stack.
+	for (auto tail_call = vm.take_tail_call(); tail_call.has_value(); tail_call = vm.take_tail_call()) {
+		vm.fuel().burn();
+		auto [function, tail_arguments] = tail_call.release_value();
+		vm.current_scope()->reset(function->name());
+		ret = function->m_callable(vm, tail_arguments);
+	}
+
 	return ret;
 }
 
+// The scope of a script function kept across the rows of a batch. The variables a
+// row's arguments are declared as stay, their values are assigned by the next row
+// with as many arguments.
+class ysen::lang::astvm::Function::BatchFrame
+{
+public:
+	BatchFrame(Interpreter& vm, const Function& function)
+		: m_vm(vm), m_function(function), m_body(function.body())
+	{
+		m_vm.enter_scope(m_function.name(), ScopeType::Returnable);
+		m_vm.current_scope()->set_function(&m_function);
+	}
+
+	BatchFrame(const BatchFrame&) = delete;
+	BatchFrame& operator=(const BatchFrame&) = delete;
+
+	~BatchFrame()
+	{
+		m_vm.exit_scope();
+	}
+
+	Value call(std::span<const Value> arguments)
+	{
+		if (m_is_declared && arguments.size() == m_values.size()) {
+			for (auto i = 0u; i < arguments.size(); ++i) {
+				*m_values[i] = arguments[i];
+			}
+		}
+		else {
+			declare(arguments);
+		}
+
+		auto ret = m_body->visit(m_vm);
+
+		for (auto tail_call = m_vm.take_tail_call(); tail_call.has_value(); tail_call = m_vm.take_tail_call()) {
+			m_vm.fuel().burn();
+			auto [function, tail_arguments] = tail_call.release_value();
+			m_vm.current_scope()->reset(function->name());
+			ret = function->m_callable(m_vm, tail_arguments);
+			m_is_declared = false;
+		}
+
+		if (m_is_declared) {
+			m_vm.current_scope()->rewind(m_variables);
+		}
+
+		return ret;
+	}
+private:
+	// As Interpreter::unpack_arguments, a parameter and its __arg share their value
+	void declare(std::span<const Value> arguments)
+	{
+		auto& scope = m_vm.current_scope();
+		scope->reset(m_function.name());
+		m_values.clear();
+		m_variables.clear();
+
+		const auto& parameters = m_function.parameters();
+		for (auto i = 0u; i < arguments.size(); ++i) {
+			auto value = astvm::value(arguments[i]);
+			if (i < parameters.size()) {
+				m_variables.push_back(astvm::var(parameters[i]->name(), value));
+			}
+			m_variables.push_back(astvm::var(core::format("__arg{}", i), value));
+			m_values.push_back(std::move(value));
+		}
+		m_variables.push_back(astvm::var("__argc", astvm::value(static_cast<int>(arguments.size()))));
+
+		for (const auto& variable : m_variables) {
+			scope->declare_variable(variable);
+		}
+		m_is_declared = true;
+	}
+
+	Interpreter& m_vm;
+	const Function& m_function;
+	ast::ExpressionPtr m_body{};
+	std::vector<ValuePtr> m_values{};
+	std::vector<VariablePtr> m_variables{};
+	bool m_is_declared{};
+};
+
+template<typename RowAt>
+void ysen::lang::astvm::Function::invoke_rows(Interpreter& vm, size_t count, RowAt&& row_at, std::span<Value> results) const
+{
+	if (is_native()) {
+		for (auto i = 0u; i < count; ++i) {
+			results[i] = m_callable(vm, row_at(i));
+		}
+		return;
+	}
+
+	BatchFrame frame{ vm, *this };
+	for (auto i = 0u; i < count; ++i) {
+		vm.fuel().burn();
+		results[i] = frame.call(row_at(i));
+	}
+}
+
+void ysen::lang::astvm::Function::invoke_batch(Interpreter& vm, std::span<const std::span<const Value>> rows, std::span<Value> results) const
+{
+	if (results.size() != rows.size()) {
+		throw std::invalid_argument("A batch needs a result per row");
+	}
+
+	invoke_rows(vm, rows.size(), [&](size_t row) {
+		return rows[row];
+	}, results);
+}
+
+void ysen::lang::astvm::Function::invoke_columns(Interpreter& vm, std::span<const std::span<const Value>> columns, std::span<Value> results) const
+{
+	for (const auto& column : columns) {
+		if (column.size() < results.size()) {
+			throw std::invalid_argument("A column is shorter than the batch");
+		}
+	}
+
+	// The row is gathered into the same values each time
+	std::vector<Value> arguments(columns.size());
+	invoke_rows(vm, results.size(), [&](size_t row) {
+		for (auto i = 0u; i < columns.size(); ++i) {
+			arguments[i] = columns[i][row];
+		}
+		return std::span<const Value>{ arguments };
+	}, results);
+}
+
+ysen::lang::ast::ExpressionPtr ysen::lang::astvm::Function::body() const
+{
+	return m_ast_node->is_function_declaration() ?
+		dynamic_cast<const ast::FunctionDeclarationStatement*>(m_ast_node)->body() :
+		dynamic_cast<const ast::FunctionExpression*>(m_ast_node)->body();
+}
+
+ysen::lang::astvm::Arguments::Arguments(size_t count)
+	: m_is_inline(count <= INLINE_CAPACITY)
+{
+	if (!m_is_inline) {
+		m_heap.reserve(count);
+	}
+}
+
+ysen::lang::astvm::Arguments::~Arguments()
+{
+	if (m_is_inline) {
+		std::destroy_n(std::launder(reinterpret_cast<Value*>(m_inline)), m_size);
+	}
+}
+
+void ysen::lang::astvm::Arguments::push(Value value)
+{
+	if (!m_is_inline) {
+		m_heap.push_back(std::move(value));
+		return;
+	}
+
+	if (m_size == INLINE_CAPACITY) {
+		throw std::length_error("More arguments than counted");
+	}
+
+	new (m_inline + m_size * sizeof(Value)) Value(std::move(value));
+	++m_size;
+}
+
+std::span<const ysen::lang::astvm::Value> ysen::lang::astvm::Arguments::span() const
+{
+	if (m_is_inline) {
+		return { inline_values(), m_size };
+	}
+
+	return m_heap;
+}
+
 ysen::lang::astvm::Variable::Variable(core::String name, ValuePtr value, const ast::AstNode* ast_node)
 	: m_name(std::move(name)), m_value(std::move(value)), m_ast_node(ast_node)
 {}
 
+ysen::lang::astvm::SharedVariableWrite::SharedVariableWrite(const core::String& name)
+	: m_message(core::format("Variable '{}' is shared by the workers of a parallel loop and can't be assigned in it", name))
+{}
+
+ysen::lang::astvm::NotIterable::NotIterable(const Value& value)
+	: m_message(core::format("Cannot iterate over {} in a for loop", value.to_formatted_string()))
+{}
+
+ysen::lang::astvm::VariablePtr ysen::lang::astvm::Variable::share() const
+{
+	auto shared = core::make_shared<Variable>(m_name, m_value, m_ast_node);
+	shared->m_shared = true;
+	return shared;
+}
+
 void ysen::lang::astvm::Variable::set_value(Value value)
 {
+	if (m_shared) {
+		throw SharedVariableWrite(m_name);
+	}
+
 	*m_value = std::move(value);
 }
 
@@ -58,6 +272,11 @@ void ysen::lang::astvm::Scope::declare_function(FunctionPtr fn)
 	m_functions[fn->name()] = std::move(fn);
 }
 
+void ysen::lang::astvm::Scope::remove_function(const core::String& name)
+{
+	m_functions.erase(name);
+}
+
 void ysen::lang::astvm::Scope::declare_variable(VariablePtr var)
 {
 	m_variables[var->name()] = std::move(var);
@@ -65,11 +284,12 @@ void ysen::lang::astvm::Scope::declare_variable(VariablePtr var)
 
 ysen::lang::astvm::FunctionPtr ysen::lang::astvm::Scope::find_function(const core::String& name)
 {
-	if (m_functions.contains(name)) {
-		return m_functions[name];
+	// Only looked up, the scopes of a parallel loop's caller are searched by all its workers
+	if (auto function = m_functions.find(name); function != m_functions.end()) {
+		return function->second;
 	}
 
-	if (m_variables.contains(name) && m_variables[name]->value()->is_function()) {
+	if (auto variable = m_variables.find(name); variable != m_variables.end() && variable->second->value()->is_function()) {
 		return nullptr;
 	}
 
@@ -78,8 +298,8 @@ ysen::lang::astvm::FunctionPtr ysen::lang::astvm::Scope::find_function(const cor
 
 ysen::lang::astvm::VariablePtr ysen::lang::astvm::Scope::find_variable(const core::String& name)
 {
-	if (m_variables.contains(name)) {
-		return m_variables[name];
+	if (auto variable = m_variables.find(name); variable != m_variables.end()) {
+		return variable->second;
 	}
 
 	return m_parent ? m_parent->find_variable(name) : nullptr;
@@ -98,29 +318,132 @@ void ysen::lang::astvm::Scope::mark_return()
 	}
 }
 
+void ysen::lang::astvm::Scope::reset(core::String name)
+{
+	m_name = std::move(name);
+	m_functions.clear();
+	m_variables.clear();
+	m_returning = false;
+}
+
+void ysen::lang::astvm::Scope::rewind(std::span<const VariablePtr> kept)
+{
+	m_functions.clear();
+	m_returning = false;
+
+	if (m_variables.size() == kept.size()) {
+		return;
+	}
+
+	std::erase_if(m_variables, [&](const auto& entry) {
+		return std::none_of(kept.begin(), kept.end(), [&](const VariablePtr& variable) {
+			return variable.ptr() == entry.second.ptr();
+		});
+	});
+}
+
 ysen::lang::astvm::Interpreter::Interpreter()
 {
 	enter_scope("global");
 }
 
+ysen::lang::astvm::Interpreter::Interpreter(const Interpreter& parent, Scope& shared)
+	: m_program(parent.m_program), m_require_handler(parent.m_require_handler), m_thread_pool(&parent.thread_pool())
+{
+	// Returnable without counting as a function, so nothing the body marks reaches the
+	// caller's scopes. The parser keeps ret out of the body.
+	m_scopes.emplace_back(core::adopt_shared(new Scope{ &shared, "global", ScopeType::Returnable }));
+}
+
 ysen::lang::astvm::ValuePtr ysen::lang::astvm::Interpreter::execute(const ast::AstNode* node)
 {
 	return core::make_shared<Value>(node->visit(*this));
 }
 
+ysen::lang::astvm::ValuePtr ysen::lang::astvm::Interpreter::execute(const ast::ProgramPtr& program)
+{
+	// Programs may be executed from within natives called by another program
+	auto previous = m_program;
+	m_program = program;
+	core::ScopeExit guard{[this, &previous]() {
+		m_program = std::move(previous);
+	}};
+
+	// A ret at the top level of the program run before leaves the global scope returning
+	current_scope()->clear_return();
+	return execute(program.ptr());
+}
+
+void ysen::lang::astvm::Interpreter::reload_functions(const ast::ProgramPtr& program, const std::vector<ast::FunctionDeclarationStatementPtr>& changed,
+	const std::vector<core::String>& removed)
+{
+	auto& global = m_scopes.front();
+	for (const auto& name : removed) {
+		global->remove_function(name);
+	}
+
+	// Declaring is all a declaration does when visited, the global scope just has to be current
+	auto previous_program = m_program;
+	auto previous_scopes = std::move(m_scopes);
+	m_program = program;
+	m_scopes = { previous_scopes.front() };
+	core::ScopeExit guard{[&]() {
+		m_program = std::move(previous_program);
+		m_scopes = std::move(previous_scopes);
+	}};
+
+	for (const auto* declaration : changed) {
+		declaration->visit(*this);
+	}
+}
+
 void ysen::lang::astvm::Interpreter::enter_scope(core::String name, ScopeType type)
 {
+	if (type == ScopeType::Returnable) {
+		++m_function_depth;
+	}
+
 	m_scopes.emplace_back(core::adopt_shared(new Scope{ m_scopes.empty() ? nullptr : m_scopes.back().ptr(), std::move(name), type }));
 }
 
 void ysen::lang::astvm::Interpreter::exit_scope()
 {
 	if (!m_scopes.empty()) {
+		if (m_scopes.back()->type() == ScopeType::Returnable) {
+			--m_function_depth;
+		}
+
 		m_scopes.pop_back();
 	}
 }
 
-void ysen::lang::astvm::Interpreter::unpack_arguments(const std::vector<Value>& arguments, const FunctionParameterList& parameters)
+ysen::lang::astvm::ScopePtr ysen::lang::astvm::Interpreter::share_current_scope()
+{
+	auto shared = core::adopt_shared(new Scope{ current_scope().ptr(), "parallel", ScopeType::Other });
+
+	for (const auto* scope = current_scope().ptr(); scope; scope = scope->parent()) {
+		for (const auto& [name, variable] : scope->variables()) {
+			// Inner scopes come first, what they declare hides the same names further up
+			if (!shared->variables().contains(name)) {
+				shared->declare_variable(variable->share());
+			}
+		}
+	}
+
+	return shared;
+}
+
+ysen::core::ThreadPool& ysen::lang::astvm::Interpreter::thread_pool() const
+{
+	if (m_thread_pool) {
+		return *m_thread_pool;
+	}
+
+	static core::ThreadPool pool{};
+	return pool;
+}
+
+void ysen::lang::astvm::Interpreter::unpack_arguments(std::span<const Value> arguments, const FunctionParameterList& parameters)
 {
 	auto index{0u};
 	for (const auto& arg : arguments) {
@@ -138,8 +461,52 @@ void ysen::lang::astvm::Interpreter::unpack_arguments(const std::vector<Value>&
 	}
 
 	current_scope()->declare_variable(astvm::var("__argc", astvm::value(static_cast<int>(arguments.size()))));
+}
 
-	core::println("Unpacked {} arguments in scope '{}'", arguments.size(), current_scope()->qualified_name());
+bool ysen::lang::astvm::Interpreter::can_reuse_frame(const Function& function, size_t argument_count) const
+{
+	const auto& parameters = function.parameters();
+	auto is_redeclared = [&](const core::String& name) {
+		if (name == "__argc") {
+			return true;
+		}
+		for (auto i = 0u; i < argument_count; ++i) {
+			if ((i < parameters.size() && name == parameters[i]->name()) || name == core::format("__arg{}", i)) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	for (auto scope = m_scopes.rbegin(); scope != m_scopes.rend(); ++scope) {
+		if (!(*scope)->functions().empty()) {
+			return false;
+		}
+		for (const auto& [name, variable] : (*scope)->variables()) {
+			if (!is_redeclared(name)) {
+				return false;
+			}
+		}
+		if ((*scope)->type() == ScopeType::Returnable) {
+			return (*scope)->function() == &function;
+		}
+	}
+
+	return false;
+}
+
+void ysen::lang::astvm::Interpreter::set_tail_call(FunctionPtr function, std::vector<Value> arguments)
+{
+	m_tail_call = TailCall{ std::move(function), std::move(arguments) };
+}
+
+ysen::core::Optional<ysen::lang::astvm::Interpreter::TailCall> ysen::lang::astvm::Interpreter::take_tail_call()
+{
+	if (!m_tail_call.has_value()) {
+		return {};
+	}
+
+	return m_tail_call.release_value();
 }
 
 void ysen::lang::astvm::Interpreter::add(VariablePtr v)
@@ -151,3 +518,10 @@ void ysen::lang::astvm::Interpreter::add(FunctionPtr f)
 {
 	m_scopes[0]->declare_function(std::move(f));
 }
+
+void ysen::lang::astvm::Interpreter::require(const core::String& path)
+{
+	if (m_require_handler) {
+		m_require_handler(*this, path);
+	}
+}
@@ -1,8 +1,18 @@
 #pragma once
+#include <cstddef>
 #include <functional>
 #include <map>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include "../ast/node.h"
+#include "Async.h"
+#include "Fuel.h"
 #include "Value.h"
+#include "ysen/core/ThreadPool.h"
 
 namespace ysen::lang::astvm {
 
@@ -33,30 +43,99 @@ namespace ysen::lang::astvm {
 	class Function
 	{
 	public:
-		using FunctionSignature = std::function<Value(Interpreter&, const std::vector<Value>&)>;
+		using FunctionSignature = std::function<Value(Interpreter&, std::span<const Value>)>;
 		
 	public:
-		Function(core::String name, FunctionParameterList parameters, const ast::AstNode* ast_node);
+		Function(core::String name, FunctionParameterList parameters, const ast::AstNode* ast_node, ast::ProgramPtr program = nullptr);
 		Function(core::String name, FunctionParameterList parameters, FunctionSignature function);
 		
 		auto& name() const { return m_name; }
 		auto& parameters() const { return m_parameters; }
 		auto& ast_node() const { return m_ast_node; }
+		auto& program() const { return m_program; }
+		bool is_native() const { return m_ast_node == nullptr; }
 
-		Value invoke(Interpreter&, const std::vector<Value>& arguments) const;
+		// A pure native only reads its arguments and never the interpreter, the array
+		// functions call it on several threads at once
+		bool is_pure() const { return m_pure; }
+		void mark_pure() { m_pure = true; }
+
+		// Natives run without a scope of their own
+		Value invoke(Interpreter&, std::span<const Value> arguments) const;
+
+		// Calls the function once per row of arguments, results holds a value per row.
+		// A script function enters its scope once for the whole batch; its parameters
+		// are declared by the first row and only assigned by the rows that follow.
+		void invoke_batch(Interpreter&, std::span<const std::span<const Value>> rows, std::span<Value> results) const;
+		// As invoke_batch, with argument i of row r at columns[i][r]
+		void invoke_columns(Interpreter&, std::span<const std::span<const Value>> columns, std::span<Value> results) const;
 
 		template<typename Fty>
 		std::function<Fty> cast(Interpreter&) const; 
 	private:
+		class BatchFrame;
+
+		template<typename RowAt>
+		void invoke_rows(Interpreter&, size_t count, RowAt&& row_at, std::span<Value> results) const;
+		ast::ExpressionPtr body() const;
+
 		core::String m_name{};
 		FunctionParameterList m_parameters{};
 		const ast::AstNode* m_ast_node{};
+		// Owns m_ast_node, which lives in the program's arena
+		ast::ProgramPtr m_program{};
 		FunctionSignature m_callable{};
+		bool m_pure{};
 	};
 
 	using FunctionPtr = core::SharedPtr<Function>;
+
+	// Arguments of a call, kept on the C++ stack up to INLINE_CAPACITY of them so
+	// that most calls don't allocate
+	class Arguments
+	{
+	public:
+		static constexpr size_t INLINE_CAPACITY = 4;
+
+		explicit Arguments(size_t count);
+		Arguments(const Arguments&) = delete;
+		Arguments& operator=(const Arguments&) = delete;
+		~Arguments();
+
+		void push(Value);
+		std::span<const Value> span() const;
+	private:
+		const Value* inline_values() const { return std::launder(reinterpret_cast<const Value*>(m_inline)); }
+
+		alignas(Value) std::byte m_inline[INLINE_CAPACITY * sizeof(Value)];
+		size_t m_size{};
+		bool m_is_inline{};
+		std::vector<Value> m_heap{};
+	};
+
 	using FunctionMap = std::map<core::String, FunctionPtr>;
 
+	// Thrown when the body of a parallel loop assigns to a variable of the scopes the
+	// loop is in, all workers would write it at once
+	class SharedVariableWrite : public std::exception
+	{
+	public:
+		explicit SharedVariableWrite(const core::String& name);
+		char const* what() const override { return m_message.c_str(); }
+	private:
+		core::String m_message{};
+	};
+
+	// Thrown when a for loop, sequential or parallel, is given a value it can't iterate over
+	class NotIterable : public std::exception
+	{
+	public:
+		explicit NotIterable(const Value&);
+		char const* what() const override { return m_message.c_str(); }
+	private:
+		core::String m_message{};
+	};
+
 	class Variable
 	{
 	public:
@@ -67,11 +146,16 @@ namespace ysen::lang::astvm {
 		auto& value() { return m_value; }
 		auto& ast_node() const { return m_ast_node; }
 
+		bool is_shared() const { return m_shared; }
+		// The same variable for the workers of a parallel loop, set_value throws a SharedVariableWrite
+		core::SharedPtr<Variable> share() const;
+
 		void set_value(Value value);
 	private:
 		core::String m_name{};
 		ValuePtr m_value{};
 		const ast::AstNode* m_ast_node{};
+		bool m_shared{};
 	};
 	using VariablePtr = core::SharedPtr<Variable>;
 	using VariableMap = std::map<core::String, VariablePtr>;
@@ -90,6 +174,7 @@ namespace ysen::lang::astvm {
 
 		auto* parent() const { return m_parent; }
 		auto& name() const { return m_name; }
+		ScopeType type() const { return m_scope_type; }
 		core::String qualified_name() const;
 
 		auto& functions() const { return m_functions; }
@@ -97,18 +182,30 @@ namespace ysen::lang::astvm {
 		auto& variables() { return m_variables; }
 
 		void declare_function(FunctionPtr);
+		void remove_function(const core::String& name);
 		void declare_variable(VariablePtr);
 
 		FunctionPtr find_function(const core::String& name);
 		VariablePtr find_variable(const core::String& name);
 
+		// The script function a returnable scope was entered for
+		const Function* function() const { return m_function; }
+		void set_function(const Function* function) { m_function = function; }
+
 		bool returning() const { return m_returning; }
 		void mark_return();
+		void clear_return() { m_returning = false; }
+
+		// Clears the scope so the next function of a tail call can reuse it
+		void reset(core::String name);
+		// Drops whatever a call declared besides the variables kept, for the next call of a batch
+		void rewind(std::span<const VariablePtr> kept);
 	private:
 		Scope *m_parent{};
 		core::String m_name{};
 		FunctionMap m_functions{};
 		VariableMap m_variables{};
+		const Function* m_function{};
 		bool m_returning{false};
 		ScopeType m_scope_type{};
 	};
@@ -119,21 +216,76 @@ namespace ysen::lang::astvm {
 	{
 	public:
 		Interpreter();
+		// Runs a worker of a parallel loop started by parent, its global scope is a child
+		// of shared and stops a ret from leaving it
+		Interpreter(const Interpreter& parent, Scope& shared);
 		ValuePtr execute(const ast::AstNode* node);
-
+		// Functions declared while running the program keep it alive
+		ValuePtr execute(const ast::ProgramPtr& program);
+		const auto& current_program() const { return m_program; }
+		// Swaps the global functions a reload changed for the declarations of program,
+		// those whose declarations are gone are forgotten
+		void reload_functions(const ast::ProgramPtr& program, const std::vector<ast::FunctionDeclarationStatementPtr>& changed,
+			const std::vector<core::String>& removed);
+
+		const auto& global_scope() const { return m_scopes.front(); }
+		auto& global_scope() { return m_scopes.front(); }
 		const auto& current_scope() const { return m_scopes.back(); }
 		auto& current_scope() { return m_scopes.back(); }
 		void enter_scope(core::String name, ScopeType = ScopeType::Other);
 		void exit_scope();
 
 		// Unpacks argument list into current scope.
-		void unpack_arguments(const std::vector<Value>& arguments, const FunctionParameterList& parameters);
+		void unpack_arguments(std::span<const Value> arguments, const FunctionParameterList& parameters);
 
 		void add(VariablePtr);
 		void add(FunctionPtr);
 
+		// Called for require statements with the path as written, without a handler
+		// they do nothing
+		using RequireHandler = std::function<void(Interpreter&, const core::String& path)>;
+		void set_require_handler(RequireHandler handler) { m_require_handler = std::move(handler); }
+		void require(const core::String& path);
+
+		// True while a script function is running, i.e. a ret has a frame to leave
+		bool in_function() const { return m_function_depth > 0; }
+
+		// Scope for the workers of a parallel loop started from the current scope. Every
+		// variable visible from here is shadowed by a shared one with the same value,
+		// functions are found through the scopes above it.
+		ScopePtr share_current_scope();
+
+		// Counted down at the back-edges of loops and at calls of script functions. The
+		// workers of a parallel loop don't count, the loop takes a step per element up front.
+		Fuel& fuel() { return m_fuel; }
+		const Fuel& fuel() const { return m_fuel; }
+
+		// Pool parallel loops run on, without one they share a pool of the process with
+		// a thread per core
+		void set_thread_pool(core::ThreadPool* pool) { m_thread_pool = pool; }
+		core::ThreadPool& thread_pool() const;
+
+		struct TailCall
+		{
+			FunctionPtr function{};
+			std::vector<Value> arguments{};
+		};
+		// True when a ret function(...) with argument_count arguments may reuse the frame
+		// of the running function: it calls itself, and the call declares again everything
+		// declared between here and its scope. Scopes are dynamic, anything else stays
+		// visible to the callee and keeps its frame.
+		bool can_reuse_frame(const Function&, size_t argument_count) const;
+		void set_tail_call(FunctionPtr, std::vector<Value> arguments);
+		core::Optional<TailCall> take_tail_call();
+
 	private:
 		ScopeList m_scopes{};
+		size_t m_function_depth{};
+		core::Optional<TailCall> m_tail_call{};
+		ast::ProgramPtr m_program{};
+		RequireHandler m_require_handler{};
+		core::ThreadPool* m_thread_pool{};
+		Fuel m_fuel{};
 	};
 
 	inline ValuePtr value(Value value)
@@ -146,48 +298,28 @@ namespace ysen::lang::astvm {
 		return core::make_shared<Variable>(std::move(name), std::move(value), nullptr);
 	}
 
-	inline FunctionPtr function(core::String name, FunctionParameterList parameters, const ast::AstNode* ast_node)
+	inline FunctionPtr function(core::String name, FunctionParameterList parameters, const ast::AstNode* ast_node, ast::ProgramPtr program = nullptr)
 	{
-		return core::make_shared<Function>(std::move(name), std::move(parameters), ast_node);
+		return core::make_shared<Function>(std::move(name), std::move(parameters), ast_node, std::move(program));
 	}
 
 	namespace details {
 		template<typename Ret, typename...Args>
 		struct FunctionLambda<Ret(Args...)>
 		{
-			using Cont = std::vector<Value>;
-			
 			FunctionLambda(Interpreter& vm, const Function& function)
 				: vm(vm), function(function)
 			{}
 			
 			Ret operator()(Args&&... args) const
 			{
-				auto cont = pack(std::forward<Args>(args)...);
-				return function.invoke(vm, cont).cast<Ret>();
+				Arguments arguments{ sizeof...(Args) };
+				(arguments.push(Value(std::forward<Args>(args))), ...);
+				return function.invoke(vm, arguments.span()).cast<Ret>();
 			}
 
 			Interpreter& vm;
 			const Function& function;
-
-			template<typename...Ts>
-			Cont pack(Ts&&...args) const
-			{
-				Cont cont{};
-				pack_ex(cont, std::forward<Ts>(args)...);
-				return cont;
-			}
-
-			template<typename Arg, typename...Rest>
-			void pack_ex(Cont &cont, Arg&& arg, Rest&&...rest) const
-			{
-				cont.emplace_back(std::forward<Arg>(arg));
-				pack_ex(cont, std::forward<Rest>(rest)...);
-			}
-
-			void pack_ex(Cont &cont) const
-			{}
-			
 		};
 
 		template<typename Ret, typename...Args>
@@ -212,6 +344,8 @@ namespace ysen::lang::astvm {
 		template<typename R, typename...A>
 		struct FunctionTraits<R(A...)> : FunctionTraitsBase<R, A...> {};
 		template<typename R, typename...A>
+		struct FunctionTraits<R(*)(A...)> : FunctionTraitsBase<R, A...> {};
+		template<typename R, typename...A>
 		struct FunctionTraits<R(A...) const> : FunctionTraitsBase<R, A...> {};
 		template<typename R, typename...A>
 		struct FunctionTraits<R(A...) const &> : FunctionTraitsBase<R, A...> {};
@@ -257,56 +391,141 @@ namespace ysen::lang::astvm {
 			}
 		};
 
-		template<typename T1, typename T2 = std::remove_cvref_t<T1>>
-		struct ArgumentDeducer
+		// A parameter of a native converted from its argument. Values, strings, arrays
+		// and objects are handed out by reference to the argument where it already is
+		// one, a by-value parameter copies from there.
+		template<typename T, typename Decayed = std::remove_cvref_t<T>>
+		struct Argument
+		{
+			explicit Argument(const Value& value)
+				: m_value(value.cast<Decayed>())
+			{}
+
+			Decayed get() { return std::move(m_value); }
+
+			Decayed m_value;
+		};
+
+		template<typename T>
+		struct Argument<T, Value>
 		{
-			static T2 deduce(const Value& v)
+			explicit Argument(const Value& value)
+				: m_value(value)
+			{}
+
+			const Value& get() const { return m_value; }
+
+			const Value& m_value;
+		};
+
+		template<typename T>
+		struct Argument<T, core::String>
+		{
+			explicit Argument(const Value& value)
+				: m_string(value.is_string() ? &value.string() : nullptr)
 			{
-				return v.cast<T2>();
+				if (!m_string) {
+					m_converted = value.to_string();
+					m_string = &m_converted;
+				}
 			}
+
+			const core::String& get() const { return *m_string; }
+
+			const core::String* m_string{};
+			core::String m_converted{};
 		};
 
 		template<typename T>
-		struct ArgumentDeducer<T, Value>
+		struct Argument<T, core::StringView> : Argument<const core::String&>
 		{
-			static Value deduce(const Value& v)
+			using Argument<const core::String&>::Argument;
+
+			core::StringView get() const { return *m_string; }
+		};
+
+		template<typename T>
+		struct Argument<T, std::string_view> : Argument<const core::String&>
+		{
+			using Argument<const core::String&>::Argument;
+
+			std::string_view get() const { return { m_string->c_str(), m_string->length() }; }
+		};
+
+		// The Values of a packed array are made for the call
+		template<typename T>
+		struct Argument<T, Value::Array>
+		{
+			explicit Argument(const Value& value)
+				: m_elements(value)
 			{
-				return v;
+				if (!value.is_array()) {
+					throw BadValueCast();
+				}
 			}
+
+			const Value::Array& get() const { return m_elements.get(); }
+
+			ArrayElements m_elements;
 		};
 
-		
-		
-		template<size_t Pos, size_t Size, typename Traits>
-		struct Caller
+		// The elements of an array
+		template<typename T>
+		struct Argument<T, std::span<const Value>> : Argument<const Value::Array&>
 		{
-			template<typename Callable, typename...Deduced>
-			static auto invoke(const std::vector<Value>& arguments, Callable &&callable, Deduced&&...deduced)
+			using Argument<const Value::Array&>::Argument;
+
+			std::span<const Value> get() const { return this->m_elements.get(); }
+		};
+
+		template<typename T>
+		struct Argument<T, Value::Object>
+		{
+			explicit Argument(const Value& value)
+				: m_value(value)
 			{
-				using ArgumentType = typename Traits::template ArgTypeAt<Pos>;
-				
-				return Caller<Pos + 1, Size, Traits>::invoke(
-					arguments,
-					std::forward<Callable>(callable),
-					std::forward<Deduced>(deduced)...,
-					ArgumentDeducer<ArgumentType>::deduce(arguments.at(Pos))
-				);
+				if (!value.is_object()) {
+					throw BadValueCast();
+				}
 			}
+
+			const Value::Object& get() const { return m_value.object(); }
+
+			const Value& m_value;
 		};
 
-		template<size_t Size, typename Traits>
-		struct Caller<Size, Size, Traits>
+		template<typename Traits>
+		struct Caller
 		{
-			template<typename Callable, typename...Deduced>
-			static auto invoke(const std::vector<Value>&, Callable &&callable, Deduced&&...deduced)
+			template<typename Callable>
+			static Value invoke(const Callable& callable, std::span<const Value> arguments)
+			{
+				if (arguments.size() < Traits::ARITY) {
+					throw std::out_of_range("Too few arguments for native function");
+				}
+
+				return call(callable, arguments, std::make_index_sequence<Traits::ARITY>{});
+			}
+
+			template<typename Callable, size_t...Indices>
+			static Value call(const Callable& callable, std::span<const Value> arguments, std::index_sequence<Indices...>)
 			{
-				return std::forward<Callable>(callable)(std::forward<Deduced>(deduced)...);
+				// Converted in place, the holders may refer to themselves
+				std::tuple<Argument<typename Traits::template ArgTypeAt<Indices>>...> converted{ arguments[Indices]... };
+
+				if constexpr (std::is_void_v<typename Traits::ReturnType>) {
+					callable(std::get<Indices>(converted).get()...);
+					return {};
+				}
+				else {
+					return settle(callable(std::get<Indices>(converted).get()...));
+				}
 			}
 		};
 		
 		struct FunctionBuilder
 		{
-			template<typename Callable, typename Traits = FunctionTraits<Callable>>
+			template<typename Callable, typename Traits = FunctionTraits<std::remove_cvref_t<Callable>>>
 			static FunctionPtr build(core::String name, Callable&& callable)
 			{
 				return core::adopt_shared(new Function(
@@ -316,20 +535,32 @@ namespace ysen::lang::astvm {
 				));
 			}
 
-			template<typename Callable, typename Traits = FunctionTraits<Callable>>
+			// The callable is kept as it is, FunctionSignature is the only type erasure on the way to it
+			template<typename Callable, typename Traits = FunctionTraits<std::remove_cvref_t<Callable>>>
 			static auto build_lambda(Callable&& callable)
 			{
-				return [callable = std::function<typename Traits::Signature>{callable}](Interpreter& vm, const std::vector<Value>& arguments) -> Value {
-					using NewTraits = FunctionTraits<decltype(callable)>;
-
-					if constexpr (std::is_same_v<typename NewTraits::template ArgTypeAt<0>, VariadicFunction>) {
-						return callable(VariadicFunction{}, arguments);
+				return [callable = std::forward<Callable>(callable)](Interpreter&, std::span<const Value> arguments) -> Value {
+					if constexpr (IsVariadic<Traits>::value) {
+						using Values = std::remove_cvref_t<typename Traits::template ArgTypeAt<1>>;
+
+						if constexpr (std::is_same_v<Values, std::vector<Value>>) {
+							return settle(callable(VariadicFunction{}, Values{ arguments.begin(), arguments.end() }));
+						}
+						else {
+							return settle(callable(VariadicFunction{}, arguments));
+						}
 					}
-					if constexpr (!std::is_same_v<typename NewTraits::template ArgTypeAt<0>, VariadicFunction>) {
-						return Caller<0, NewTraits::ARITY, NewTraits>::invoke(arguments, callable);
+					else {
+						return Caller<Traits>::invoke(callable, arguments);
 					}
 				};
 			}
+
+			// (VariadicFunction, std::span<const Value>) takes the arguments as they are
+			template<typename Traits, bool = (Traits::ARITY > 0)>
+			struct IsVariadic : std::false_type {};
+			template<typename Traits>
+			struct IsVariadic<Traits, true> : std::is_same<std::remove_cvref_t<typename Traits::template ArgTypeAt<0>>, VariadicFunction> {};
 		};
 	}
 
@@ -339,6 +570,8 @@ namespace ysen::lang::astvm {
 		return details::FunctionLambda<Fty>{vm, *this};
 	}
 
+	// A callable returning a Task or a PendingPtr is awaited, the script calling it
+	// waits for the result without blocking a Scheduler's thread
 	template<typename Callable>
 	FunctionPtr function(core::String name, Callable&& callable)
 	{
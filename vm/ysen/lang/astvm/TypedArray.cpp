@@ -0,0 +1,538 @@
+#include "TypedArray.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Value.h"
+#include "../ast/node.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define YSEN_TYPED_ARRAY_SSE2 1
+#endif
+
+namespace {
+
+	using ysen::lang::ast::BinOp;
+	using ysen::lang::astvm::BadValueCast;
+	using ysen::lang::astvm::ElementType;
+	using ysen::lang::astvm::TypedArray;
+	using ysen::lang::astvm::Value;
+
+	// One side of an elementwise operator, a scalar points at its own copy
+	struct Operand
+	{
+		ElementType type{};
+		bool is_scalar{};
+		size_t size{};
+		const void* data{};
+		// An array that wasn't packed yet is packed for the operator
+		ysen::lang::astvm::TypedArrayPtr packed{};
+		int i{};
+		float f{};
+		double d{};
+		uint8_t b{};
+	};
+
+	void make_operand(const Value& value, Operand& operand)
+	{
+		if (value.is_array()) {
+			operand.packed = value.is_packed() ? value.packed() : TypedArray::pack(value.array());
+			if (operand.packed.is_null()) {
+				throw BadValueCast();
+			}
+
+			const auto& packed = *operand.packed;
+			operand.type = packed.element_type();
+			operand.size = packed.size();
+			switch (operand.type) {
+			case ElementType::Int: operand.data = packed.ints().data(); break;
+			case ElementType::Float: operand.data = packed.floats().data(); break;
+			case ElementType::Double: operand.data = packed.doubles().data(); break;
+			case ElementType::Bool: operand.data = packed.bools().data(); break;
+			}
+			return;
+		}
+
+		operand.is_scalar = true;
+		switch (value.type()) {
+		case Value::ValueType::Int:
+			operand.type = ElementType::Int;
+			operand.i = value.get<int>();
+			operand.data = &operand.i;
+			break;
+		case Value::ValueType::Float:
+			operand.type = ElementType::Float;
+			operand.f = value.get<float>();
+			operand.data = &operand.f;
+			break;
+		case Value::ValueType::Double:
+			operand.type = ElementType::Double;
+			operand.d = value.get<double>();
+			operand.data = &operand.d;
+			break;
+		case Value::ValueType::Bool:
+			operand.type = ElementType::Bool;
+			operand.b = value.get<bool>();
+			operand.data = &operand.b;
+			break;
+		default:
+			throw BadValueCast();
+		}
+	}
+
+	bool is_comparison(BinOp op)
+	{
+		return op == BinOp::Greater || op == BinOp::GreaterEqual || op == BinOp::Less || op == BinOp::LessEqual;
+	}
+
+	// One loop per shape of the operands, so that the compiler can vectorize each
+	template<typename L, typename R, typename Out, typename Op>
+	void apply(const Operand& left, const Operand& right, Out* out, size_t count, Op op)
+	{
+		auto lhs = static_cast<const L*>(left.data);
+		auto rhs = static_cast<const R*>(right.data);
+
+		if (left.is_scalar) {
+			const auto value = *lhs;
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = op(value, rhs[i]);
+			}
+		}
+		else if (right.is_scalar) {
+			const auto value = *rhs;
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = op(lhs[i], value);
+			}
+		}
+		else {
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = op(lhs[i], rhs[i]);
+			}
+		}
+	}
+
+	template<typename L, typename R>
+	void arithmetic(BinOp op, const Operand& left, const Operand& right, L* out, size_t count)
+	{
+		switch (op) {
+		case BinOp::Addition:
+			apply<L, R>(left, right, out, count, [](L a, R b) { return static_cast<L>(a + static_cast<L>(b)); });
+			break;
+		case BinOp::Subtraction:
+			apply<L, R>(left, right, out, count, [](L a, R b) { return static_cast<L>(a - static_cast<L>(b)); });
+			break;
+		case BinOp::Multiplication:
+			apply<L, R>(left, right, out, count, [](L a, R b) { return static_cast<L>(a * static_cast<L>(b)); });
+			break;
+		case BinOp::Division:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> L {
+				if constexpr (std::is_integral_v<L>) {
+					auto divisor = static_cast<L>(b);
+					return divisor != 0 ? a / divisor : 0;
+				}
+				else {
+					return a / static_cast<L>(b);
+				}
+			});
+			break;
+		default:;
+		}
+	}
+
+	template<typename T>
+	bool equal(T a, T b)
+	{
+		if constexpr (std::is_floating_point_v<T>) {
+			return std::abs(a - b) < 1e-9;
+		}
+		else {
+			return a == b;
+		}
+	}
+
+	// As Value's operators, >= and <= are > and < or equal, and only values of one type are equal
+	template<typename L, typename R>
+	void compare(BinOp op, const Operand& left, const Operand& right, uint8_t* out, size_t count)
+	{
+		constexpr auto same_type = std::is_same_v<L, R>;
+
+		switch (op) {
+		case BinOp::Greater:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t { return a > static_cast<L>(b); });
+			break;
+		case BinOp::Less:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t { return a < static_cast<L>(b); });
+			break;
+		case BinOp::GreaterEqual:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t {
+				if constexpr (same_type) {
+					return a > b || equal(a, b);
+				}
+				else {
+					return a > static_cast<L>(b);
+				}
+			});
+			break;
+		case BinOp::LessEqual:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t {
+				if constexpr (same_type) {
+					return a < b || equal(a, b);
+				}
+				else {
+					return a < static_cast<L>(b);
+				}
+			});
+			break;
+		default:;
+		}
+	}
+
+	template<typename L, typename R>
+	Value combine(BinOp op, const Operand& left, const Operand& right, size_t count)
+	{
+		if (is_comparison(op)) {
+			std::vector<uint8_t> out(count);
+			compare<L, R>(op, left, right, out.data(), count);
+			return ysen::core::adopt_shared(new TypedArray(std::move(out)));
+		}
+
+		std::vector<L> out(count);
+		arithmetic<L, R>(op, left, right, out.data(), count);
+		return ysen::core::adopt_shared(new TypedArray(std::move(out)));
+	}
+
+	template<typename L>
+	Value combine(BinOp op, const Operand& left, const Operand& right, size_t count)
+	{
+		switch (right.type) {
+		case ElementType::Int: return combine<L, int>(op, left, right, count);
+		case ElementType::Float: return combine<L, float>(op, left, right, count);
+		case ElementType::Double: return combine<L, double>(op, left, right, count);
+		case ElementType::Bool: return combine<L, uint8_t>(op, left, right, count);
+		}
+
+		throw BadValueCast();
+	}
+
+	template<typename T>
+	Value pick(std::span<const T> values, bool smallest)
+	{
+		if (values.empty()) {
+			return {};
+		}
+
+		// Four lanes each keep their own best, the lanes are compared at the end
+		T lanes[4] = { values[0], values[0], values[0], values[0] };
+		size_t i = 0;
+		for (; i + 4 <= values.size(); i += 4) {
+			for (size_t lane = 0; lane < 4; ++lane) {
+				auto value = values[i + lane];
+				lanes[lane] = smallest ? (value < lanes[lane] ? value : lanes[lane]) : (value > lanes[lane] ? value : lanes[lane]);
+			}
+		}
+		for (; i < values.size(); ++i) {
+			lanes[0] = smallest ? (values[i] < lanes[0] ? values[i] : lanes[0]) : (values[i] > lanes[0] ? values[i] : lanes[0]);
+		}
+
+		auto best = lanes[0];
+		for (auto lane : lanes) {
+			best = smallest ? (lane < best ? lane : best) : (lane > best ? lane : best);
+		}
+		return best;
+	}
+
+	template<typename T>
+	T add_up(std::span<const T> values)
+	{
+		T lanes[4]{};
+		size_t i = 0;
+		for (; i + 4 <= values.size(); i += 4) {
+			for (size_t lane = 0; lane < 4; ++lane) {
+				lanes[lane] = static_cast<T>(lanes[lane] + values[i + lane]);
+			}
+		}
+		for (; i < values.size(); ++i) {
+			lanes[0] = static_cast<T>(lanes[0] + values[i]);
+		}
+		return static_cast<T>((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]));
+	}
+
+	int add_up(std::span<const int> values)
+	{
+		size_t i = 0;
+		// Unsigned, so that a sum past INT_MAX wraps around as the vector adds do
+		unsigned int total = 0;
+#ifdef YSEN_TYPED_ARRAY_SSE2
+		auto lanes = _mm_setzero_si128();
+		for (; i + 4 <= values.size(); i += 4) {
+			lanes = _mm_add_epi32(lanes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values.data() + i)));
+		}
+		alignas(16) unsigned int parts[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(parts), lanes);
+		total = parts[0] + parts[1] + parts[2] + parts[3];
+#endif
+		for (; i < values.size(); ++i) {
+			total += static_cast<unsigned int>(values[i]);
+		}
+		return static_cast<int>(total);
+	}
+
+	double add_up(std::span<const double> values)
+	{
+		size_t i = 0;
+		double total = 0;
+#ifdef YSEN_TYPED_ARRAY_SSE2
+		auto first = _mm_setzero_pd();
+		auto second = _mm_setzero_pd();
+		for (; i + 4 <= values.size(); i += 4) {
+			first = _mm_add_pd(first, _mm_loadu_pd(values.data() + i));
+			second = _mm_add_pd(second, _mm_loadu_pd(values.data() + i + 2));
+		}
+		alignas(16) double parts[2];
+		_mm_store_pd(parts, _mm_add_pd(first, second));
+		total = parts[0] + parts[1];
+#endif
+		for (; i < values.size(); ++i) {
+			total += values[i];
+		}
+		return total;
+	}
+
+	double dot_doubles(std::span<const double> a, std::span<const double> b)
+	{
+		size_t i = 0;
+		double total = 0;
+#ifdef YSEN_TYPED_ARRAY_SSE2
+		auto first = _mm_setzero_pd();
+		auto second = _mm_setzero_pd();
+		for (; i + 4 <= a.size(); i += 4) {
+			first = _mm_add_pd(first, _mm_mul_pd(_mm_loadu_pd(a.data() + i), _mm_loadu_pd(b.data() + i)));
+			second = _mm_add_pd(second, _mm_mul_pd(_mm_loadu_pd(a.data() + i + 2), _mm_loadu_pd(b.data() + i + 2)));
+		}
+		alignas(16) double parts[2];
+		_mm_store_pd(parts, _mm_add_pd(first, second));
+		total = parts[0] + parts[1];
+#endif
+		for (; i < a.size(); ++i) {
+			total += a[i] * b[i];
+		}
+		return total;
+	}
+
+	template<typename A, typename B>
+	double dot_mixed(std::span<const A> a, std::span<const B> b)
+	{
+		double lanes[4]{};
+		size_t i = 0;
+		for (; i + 4 <= a.size(); i += 4) {
+			for (size_t lane = 0; lane < 4; ++lane) {
+				lanes[lane] += static_cast<double>(a[i + lane]) * static_cast<double>(b[i + lane]);
+			}
+		}
+		for (; i < a.size(); ++i) {
+			lanes[0] += static_cast<double>(a[i]) * static_cast<double>(b[i]);
+		}
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+
+	template<typename A>
+	double dot_with(std::span<const A> a, const TypedArray& other)
+	{
+		switch (other.element_type()) {
+		case ElementType::Int: return dot_mixed(a, other.ints());
+		case ElementType::Float: return dot_mixed(a, other.floats());
+		case ElementType::Double: return dot_mixed(a, other.doubles());
+		case ElementType::Bool: return dot_mixed(a, other.bools());
+		}
+		return 0;
+	}
+
+}
+
+const char* ysen::lang::astvm::element_type_name(ElementType type)
+{
+	switch (type) {
+	case ElementType::Int: return "int";
+	case ElementType::Float: return "float";
+	case ElementType::Double: return "double";
+	case ElementType::Bool: return "bool";
+	}
+	return "unknown";
+}
+
+ysen::lang::astvm::TypedArray::TypedArray(std::vector<int> values)
+	: m_type(ElementType::Int), m_size(values.size()), m_ints(std::move(values))
+{}
+
+ysen::lang::astvm::TypedArray::TypedArray(std::vector<float> values)
+	: m_type(ElementType::Float), m_size(values.size()), m_floats(std::move(values))
+{}
+
+ysen::lang::astvm::TypedArray::TypedArray(std::vector<double> values)
+	: m_type(ElementType::Double), m_size(values.size()), m_doubles(std::move(values))
+{}
+
+ysen::lang::astvm::TypedArray::TypedArray(std::vector<uint8_t> values)
+	: m_type(ElementType::Bool), m_size(values.size()), m_bools(std::move(values))
+{}
+
+ysen::lang::astvm::TypedArray::~TypedArray() = default;
+
+ysen::lang::astvm::TypedArrayPtr ysen::lang::astvm::TypedArray::pack(std::span<const Value> values)
+{
+	if (values.empty()) {
+		return {};
+	}
+
+	auto type = values.front().type();
+	auto same = std::all_of(values.begin(), values.end(), [type](const Value& value) {
+		return value.type() == type;
+	});
+	if (!same) {
+		return {};
+	}
+
+	auto collect = [values]<typename T>(std::vector<T> out) {
+		out.reserve(values.size());
+		for (const auto& value : values) {
+			out.push_back(value.get<T>());
+		}
+		return core::adopt_shared(new TypedArray(std::move(out)));
+	};
+
+	switch (type) {
+	case Value::ValueType::Int: return collect(std::vector<int>{});
+	case Value::ValueType::Float: return collect(std::vector<float>{});
+	case Value::ValueType::Double: return collect(std::vector<double>{});
+	case Value::ValueType::Bool: return collect(std::vector<uint8_t>{});
+	default: return {};
+	}
+}
+
+std::span<const int> ysen::lang::astvm::TypedArray::ints() const
+{
+	if (m_type != ElementType::Int) {
+		throw BadValueCast();
+	}
+	return m_ints;
+}
+
+std::span<const float> ysen::lang::astvm::TypedArray::floats() const
+{
+	if (m_type != ElementType::Float) {
+		throw BadValueCast();
+	}
+	return m_floats;
+}
+
+std::span<const double> ysen::lang::astvm::TypedArray::doubles() const
+{
+	if (m_type != ElementType::Double) {
+		throw BadValueCast();
+	}
+	return m_doubles;
+}
+
+std::span<const uint8_t> ysen::lang::astvm::TypedArray::bools() const
+{
+	if (m_type != ElementType::Bool) {
+		throw BadValueCast();
+	}
+	return m_bools;
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::TypedArray::at(size_t index) const
+{
+	switch (m_type) {
+	case ElementType::Int: return m_ints[index];
+	case ElementType::Float: return m_floats[index];
+	case ElementType::Double: return m_doubles[index];
+	case ElementType::Bool: return m_bools[index] != 0;
+	}
+	return {};
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::TypedArray::sum() const
+{
+	switch (m_type) {
+	case ElementType::Int: return add_up(std::span<const int>{ m_ints });
+	case ElementType::Float: return add_up(std::span<const float>{ m_floats });
+	case ElementType::Double: return add_up(std::span<const double>{ m_doubles });
+	default: throw BadValueCast();
+	}
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::TypedArray::min() const
+{
+	switch (m_type) {
+	case ElementType::Int: return pick(std::span<const int>{ m_ints }, true);
+	case ElementType::Float: return pick(std::span<const float>{ m_floats }, true);
+	case ElementType::Double: return pick(std::span<const double>{ m_doubles }, true);
+	default: throw BadValueCast();
+	}
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::TypedArray::max() const
+{
+	switch (m_type) {
+	case ElementType::Int: return pick(std::span<const int>{ m_ints }, false);
+	case ElementType::Float: return pick(std::span<const float>{ m_floats }, false);
+	case ElementType::Double: return pick(std::span<const double>{ m_doubles }, false);
+	default: throw BadValueCast();
+	}
+}
+
+double ysen::lang::astvm::TypedArray::dot(const TypedArray& other) const
+{
+	if (m_size != other.m_size) {
+		throw std::invalid_argument("dot() takes arrays of the same length");
+	}
+
+	switch (m_type) {
+	case ElementType::Int: return dot_with(std::span<const int>{ m_ints }, other);
+	case ElementType::Float: return dot_with(std::span<const float>{ m_floats }, other);
+	case ElementType::Double:
+		if (other.m_type == ElementType::Double) {
+			return dot_doubles(m_doubles, other.m_doubles);
+		}
+		return dot_with(std::span<const double>{ m_doubles }, other);
+	case ElementType::Bool: return dot_with(std::span<const uint8_t>{ m_bools }, other);
+	}
+	return 0;
+}
+
+std::vector<ysen::lang::astvm::Value> ysen::lang::astvm::TypedArray::values() const
+{
+	std::vector<Value> values{};
+	values.reserve(m_size);
+	for (size_t i = 0; i < m_size; ++i) {
+		values.push_back(at(i));
+	}
+	return values;
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::elementwise(ast::BinOp op, const Value& lhs, const Value& rhs)
+{
+	Operand left{};
+	Operand right{};
+	make_operand(lhs, left);
+	make_operand(rhs, right);
+
+	if (left.is_scalar && right.is_scalar) {
+		throw BadValueCast();
+	}
+	if (!left.is_scalar && !right.is_scalar && left.size != right.size) {
+		throw std::invalid_argument("Elementwise operator on arrays of different lengths");
+	}
+
+	auto count = left.is_scalar ? right.size : left.size;
+	switch (left.type) {
+	case ElementType::Int: return combine<int>(op, left, right, count);
+	case ElementType::Float: return combine<float>(op, left, right, count);
+	case ElementType::Double: return combine<double>(op, left, right, count);
+	default: throw BadValueCast();
+	}
+}
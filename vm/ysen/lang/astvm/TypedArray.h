@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "ysen/core/SharedPtr.h"
+
+namespace ysen::lang::ast {
+	enum class BinOp;
+}
+
+namespace ysen::lang::astvm {
+
+	class Value;
+
+	enum class ElementType
+	{
+		Int,
+		Float,
+		Double,
+		Bool,
+	};
+
+	const char* element_type_name(ElementType);
+
+	class TypedArray;
+	using TypedArrayPtr = core::SharedPtr<TypedArray>;
+
+	// An array whose elements are all ints, floats, doubles or bools, kept as the
+	// plain numbers. Never changed once made, values holding one share it; writing
+	// through Value::array() turns a value's array back into Values first.
+	class TypedArray
+	{
+	public:
+		explicit TypedArray(std::vector<int> values);
+		explicit TypedArray(std::vector<float> values);
+		explicit TypedArray(std::vector<double> values);
+		explicit TypedArray(std::vector<uint8_t> values);
+		TypedArray(const TypedArray&) = delete;
+		TypedArray& operator=(const TypedArray&) = delete;
+		~TypedArray();
+
+		// Null unless the values are all of one of the element types
+		static TypedArrayPtr pack(std::span<const Value> values);
+
+		ElementType element_type() const { return m_type; }
+		size_t size() const { return m_size; }
+
+		// Throw a BadValueCast for any other element type
+		std::span<const int> ints() const;
+		std::span<const float> floats() const;
+		std::span<const double> doubles() const;
+		std::span<const uint8_t> bools() const;
+
+		Value at(size_t index) const;
+
+		// Throw a BadValueCast for arrays of bools. The sum is of the array's type, its
+		// lanes are added separately so floating point sums may round differently than
+		// a loop; min and max are undefined for an empty array.
+		Value sum() const;
+		Value min() const;
+		Value max() const;
+		// Sum of the products as doubles, throws std::invalid_argument for arrays of different lengths
+		double dot(const TypedArray&) const;
+
+		// The elements as Values, made anew on every call
+		std::vector<Value> values() const;
+	private:
+		ElementType m_type{};
+		size_t m_size{};
+		std::vector<int> m_ints{};
+		std::vector<float> m_floats{};
+		std::vector<double> m_doubles{};
+		std::vector<uint8_t> m_bools{};
+	};
+
+	// lhs op rhs elementwise, where one side is an array of numbers of one type and the
+	// other a number or such an array as long. As for single values the right elements
+	// are cast to the type of the left ones, comparisons give bools and integer division
+	// by zero gives 0. Throws std::invalid_argument for arrays of different lengths, +
+	// doesn't concatenate, and BadValueCast for operands that have no elementwise form.
+	Value elementwise(ast::BinOp, const Value& lhs, const Value& rhs);
+
+}
@@ -3,17 +3,26 @@
 #include "Interpreter.h"
 
 ysen::lang::astvm::Value::Value(const Value& other)
-	: m_type(other.m_type), m_array(other.m_array), m_object(other.m_object), m_string(other.m_string),
+	: m_type(other.m_type), m_array(other.m_array), m_packed(other.m_packed), m_object(other.m_object), m_string(other.m_string),
 	m_function(other.m_function), m_trivial(other.m_trivial)
 {}
 
 ysen::lang::astvm::Value::Value(Value&& other) noexcept
-	: m_type(other.m_type), m_array(std::move(other.m_array)), m_object(std::move(other.m_object)),
+	: m_type(other.m_type), m_array(std::move(other.m_array)), m_packed(std::move(other.m_packed)), m_object(std::move(other.m_object)),
 	m_string(std::move(other.m_string)), m_function(std::move(other.m_function)), m_trivial(other.m_trivial)
 {}
 
 ysen::lang::astvm::Value::Value(Array v)
-	: m_type(ValueType::Array), m_array(std::move(v))
+	: m_type(ValueType::Array), m_packed(TypedArray::pack(v))
+{
+	// Packed wherever an array of numbers is made, natives' results included
+	if (m_packed.is_null()) {
+		m_array = std::move(v);
+	}
+}
+
+ysen::lang::astvm::Value::Value(TypedArrayPtr v)
+	: m_type(ValueType::Array), m_packed(std::move(v))
 {}
 
 ysen::lang::astvm::Value::Value(Object v)
@@ -79,11 +88,11 @@ ysen::core::String ysen::lang::astvm::Value::to_formatted_string() const
 		builder.append("[");
 
 		core::String array_list{};
-		for (const auto& elem : m_array) {
+		for (auto i = 0u; i < array_size(); ++i) {
 			if (!array_list.empty()) {
 				array_list.push(' ');
 			}
-			array_list.append(elem.to_formatted_string());
+			array_list.append(array_at(i).to_formatted_string());
 			array_list.append(",");
 		}
 		
@@ -137,7 +146,7 @@ bool ysen::lang::astvm::Value::is_trueish() const
 	}
 
 	if (is_array()) {
-		return !m_array.empty();
+		return m_packed.is_null() ? !m_array.empty() : m_packed->size() > 0;
 	}
 
 	if (is_object()) {
@@ -247,16 +256,16 @@ bool ysen::lang::astvm::Value::operator>(const Value& other) const
 		}
 	case ValueType::Double:
 		{
-			if (other.m_type == ValueType::Float) {
-				return m_trivial.f > other.m_trivial.f;
+			if (other.m_type == ValueType::Double) {
+				return m_trivial.d > other.m_trivial.d;
 			}
 
 			if (other.is_trivial()) {
-				return m_trivial.f > other.cast<float>();
+				return m_trivial.d > other.cast<double>();
 			}
 
 			if (other.is_string() && (other.string().is_integer() || other.string().is_float())) {
-				return m_trivial.f > other.string().to_float();
+				return m_trivial.d > other.string().to_float();
 			}
 
 			return false;
@@ -370,16 +379,16 @@ bool ysen::lang::astvm::Value::operator<(const Value& other) const
 		}
 	case ValueType::Double:
 		{
-			if (other.m_type == ValueType::Float) {
-				return m_trivial.f < other.m_trivial.f;
+			if (other.m_type == ValueType::Double) {
+				return m_trivial.d < other.m_trivial.d;
 			}
 
 			if (other.is_trivial()) {
-				return m_trivial.f < other.cast<float>();
+				return m_trivial.d < other.cast<double>();
 			}
 
 			if (other.is_string() && (other.string().is_integer() || other.string().is_float())) {
-				return m_trivial.f < other.string().to_float();
+				return m_trivial.d < other.string().to_float();
 			}
 
 			return false;
@@ -446,9 +455,30 @@ ysen::lang::astvm::Value ysen::lang::astvm::Value::operator*(const Value& other)
 	return casted_type_bin_op(other, std::multiplies<>{});
 }
 
+ysen::lang::astvm::ArrayElements ysen::lang::astvm::Value::array() const
+{
+	return ArrayElements{ *this };
+}
+
+ysen::lang::astvm::Value ysen::lang::astvm::Value::array_at(size_t index) const
+{
+	return m_packed.is_null() ? m_array[index] : m_packed->at(index);
+}
+
+ysen::lang::astvm::Value::Array& ysen::lang::astvm::Value::array()
+{
+	if (!m_packed.is_null()) {
+		m_array = m_packed->values();
+		m_packed.release();
+	}
+
+	return m_array;
+}
+
 void ysen::lang::astvm::Value::reset()
 {
 	m_array.clear();
+	m_packed.release();
 	m_object.clear();
 	m_string = {};
 	m_trivial = {};
@@ -460,6 +490,7 @@ ysen::lang::astvm::Value& ysen::lang::astvm::Value::operator=(const Value& v)
 	reset();
 	m_type = v.m_type;
 	m_array = v.m_array;
+	m_packed = v.m_packed;
 	m_object = v.m_object;
 	m_string = v.m_string;
 	m_function = v.m_function;
@@ -471,6 +502,7 @@ ysen::lang::astvm::Value& ysen::lang::astvm::Value::operator=(Value&& v) noexcep
 	reset();
 	m_type = v.m_type;
 	m_array = std::move(v.m_array);
+	m_packed = std::move(v.m_packed);
 	m_object = std::move(v.m_object);
 	m_string = std::move(v.m_string);
 	m_function = std::move(v.m_function);
@@ -481,7 +513,10 @@ ysen::lang::astvm::Value& ysen::lang::astvm::Value::operator=(Array v)
 {
 	reset();
 	m_type = ValueType::Array;
-	m_array = std::move(v);
+	m_packed = TypedArray::pack(v);
+	if (m_packed.is_null()) {
+		m_array = std::move(v);
+	}
 	return *this;
 }
 ysen::lang::astvm::Value& ysen::lang::astvm::Value::operator=(Object v)
@@ -546,3 +581,14 @@ size_t std::hash<ysen::lang::astvm::Value>::operator()(const ysen::lang::astvm::
 {
 	return v.hash();
 }
+
+ysen::lang::astvm::ArrayElements::ArrayElements(const Value& value)
+{
+	if (value.is_packed()) {
+		m_unpacked = value.packed()->values();
+		m_array = &m_unpacked;
+	}
+	else {
+		m_array = &value.m_array;
+	}
+}
@@ -1,9 +1,11 @@
 #pragma once
+#include <span>
 #include <unordered_map>
 #include <vector>
 #include "ysen/core/fnv1a.h"
 #include "ysen/core/SharedPtr.h"
 #include "ysen/Core/String.h"
+#include "TypedArray.h"
 
 namespace ysen::lang::astvm {
 	class Value;
@@ -20,6 +22,7 @@ namespace std {
 namespace ysen::lang::astvm {
 	class Function;
 	using FunctionPtr = core::SharedPtr<Function>;
+	class ArrayElements;
 
 	namespace details {
 		template<typename T>
@@ -67,6 +70,7 @@ namespace ysen::lang::astvm {
 		Value() = default;
 		Value(const Value&);
 		Value(Value&&) noexcept;
+		// Packed when the values are all numbers or bools of one type
 		Value(Array);
 		Value(Object);
 		Value(core::String);
@@ -76,12 +80,21 @@ namespace ysen::lang::astvm {
 		Value(float);
 		Value(double);
 		Value(FunctionPtr);
+		// An array, packed
+		Value(TypedArrayPtr);
 
 		core::String to_string() const;
 		core::String to_formatted_string() const;
 		
-		const Array& array() const { return m_array; }
-		Array& array() { return m_array; }
+		// The elements as Values. A packed array has none, they are made for the
+		// ArrayElements returned and go with it; array_size() and array_at() don't make any.
+		ArrayElements array() const;
+		// Unpacks a packed array, the Values can be changed from here on
+		Array& array();
+		size_t array_size() const { return m_packed.is_null() ? m_array.size() : m_packed->size(); }
+		Value array_at(size_t index) const;
+		bool is_packed() const { return !m_packed.is_null(); }
+		const TypedArrayPtr& packed() const { return m_packed; }
 		const Object& object() const { return m_object; }
 		Object& object() { return m_object; }
 		const core::String& string() const { return m_string; }
@@ -96,12 +109,16 @@ namespace ysen::lang::astvm {
 		
 		size_t hash() const;
 
+		ValueType type() const { return m_type; }
 		bool is_undefined() const { return m_type == ValueType::Undefined; }
 		bool is_null() const { return m_type == ValueType::Null; }
 		bool is_function() const { return m_type == ValueType::Function; }
 		bool is_string() const { return m_type == ValueType::String; }
 		bool is_array() const { return m_type == ValueType::Array; }
 		bool is_object() const { return m_type == ValueType::Object; }
+		bool is_bool() const { return m_type == ValueType::Bool; }
+		bool is_integer() const { return m_type == ValueType::Int; }
+		bool is_float() const { return m_type == ValueType::Float; }
 		bool is_trivial() const { return m_type >= ValueType::Bool && m_type <= ValueType::Double; }
 		bool is_trueish() const;
 		bool is_falseish() const;
@@ -128,6 +145,8 @@ namespace ysen::lang::astvm {
 		Value& operator=(double);
 		Value& operator=(FunctionPtr);
 	private:
+		friend class ArrayElements;
+
 		template<typename Op>
 		Value same_type_bin_op(const Value&, Op&& op) const;
 
@@ -137,6 +156,8 @@ namespace ysen::lang::astvm {
 	private:
 		ValueType m_type{ValueType::Undefined};
 		Array m_array{};
+		// In place of m_array while the array is packed
+		TypedArrayPtr m_packed{};
 		Object m_object{};
 		core::String m_string{};
 		FunctionPtr m_function{};
@@ -219,7 +240,7 @@ namespace ysen::lang::astvm {
 				throw std::exception("Cannot cast to Array");
 			}
 
-			return m_array;
+			return array();
 		}
 		throw BadValueCast();
 	}
@@ -276,5 +297,29 @@ namespace ysen::lang::astvm {
 		throw std::exception();
 	}
 
+	// The elements of an array as Values, for code that only takes those: the Values
+	// of an array that isn't packed, or a copy of a packed one's for as long as this lives.
+	class ArrayElements
+	{
+	public:
+		explicit ArrayElements(const Value&);
+		// Would refer to the copy of another
+		ArrayElements(const ArrayElements&) = delete;
+		ArrayElements& operator=(const ArrayElements&) = delete;
+
+		const Value::Array& get() const { return *m_array; }
+		operator const Value::Array&() const { return *m_array; }
+		operator std::span<const Value>() const { return *m_array; }
+
+		auto begin() const { return m_array->begin(); }
+		auto end() const { return m_array->end(); }
+		size_t size() const { return m_array->size(); }
+		bool empty() const { return m_array->empty(); }
+		const Value& operator[](size_t index) const { return (*m_array)[index]; }
+	private:
+		Value::Array m_unpacked{};
+		const Value::Array* m_array{};
+	};
+
 	inline Value undefined() { return {}; }
 }
@@ -1,7 +1,8 @@
 #include "BytecodeInterpreter.h"
 
-#include <format>
+#include <algorithm>
 
+#include "Generator.h"
 #include "Register.h"
 #include "ysen/lang/ast/node.h"
 
@@ -16,29 +17,41 @@ ysen::lang::astvm::Value ysen::lang::bytecode::BytecodeInterpreter::execute(cons
 	}
 
 	m_executable_program = &program;
-	m_stack_frame.push({ entry_point, entry_point->instructions().begin() });
-	while (!m_stack_frame.empty() && m_stack_frame.top().pc != m_stack_frame.top().block->instructions().end()) {
-		const auto *block = m_stack_frame.top().block;
-		auto& pc = m_stack_frame.top().pc;
+	m_frames.clear();
+	m_stack_pointer = 0;
+	enter_frame(entry_point, 0);
 
-		core::String s{std::format("{:20}\t\t\tacc={}", (*pc)->to_string().c_str(), accumulator().to_formatted_string().c_str()).c_str()};
-		core::println(s);
+	while (!m_frames.empty()) {
+		auto& frame = m_frames.back();
 
-		auto b = m_stack_frame.size();
+		if (frame.pc == frame.block->instructions().end()) {
+			pop_stack_frame(); // Falling off the end of a block is an implicit ret
+			continue;
+		}
+
+		const auto *block = frame.block;
+		auto& pc = frame.pc;
+
+		auto b = m_frames.size();
 		(*pc)->execute(*this);
 
-		if (b != m_stack_frame.size()) {
-			continue; // a ret
+		if (b != m_frames.size()) {
+			// A ret, or a tail call which already dropped the caller's frame
+			if (m_call.has_value()) {
+				auto call = m_call.release_value();
+				enter_frame(call.block, call.argument_count);
+			}
+			continue;
 		}
-		
+
 		++pc;
 
 		if (m_jump.has_value()) {
 			pc = block->instructions().begin() + m_jump.release_value();
 		}
 		else if (m_call.has_value()) {
-			const auto* frame_block = m_call.release_value();
-			m_stack_frame.push({ frame_block, frame_block->instructions().begin() });
+			auto call = m_call.release_value();
+			enter_frame(call.block, call.argument_count);
 		}
 	}
 
@@ -57,26 +70,82 @@ ysen::lang::astvm::Value& ysen::lang::bytecode::BytecodeInterpreter::register_va
 
 void ysen::lang::bytecode::BytecodeInterpreter::set_jump_point(size_t jump)
 {
+	m_fuel.burn();
 	m_jump = jump;
 }
 
-void ysen::lang::bytecode::BytecodeInterpreter::set_call(const core::String& name)
+void ysen::lang::bytecode::BytecodeInterpreter::set_call(const core::String& name, size_t argument_count)
 {
-	m_call = m_executable_program->block_by_name(name);
+	const auto* block = m_executable_program->block_by_name(name);
+
+	if (!block) {
+		// Unknown callee, discard the arguments and evaluate to undefined
+		m_stack_pointer -= argument_count;
+		m_accumulator = astvm::undefined();
+		return;
+	}
+
+	m_fuel.burn();
+	m_call = PendingCall{ block, argument_count };
+}
+
+void ysen::lang::bytecode::BytecodeInterpreter::set_tail_call(const core::String& name, size_t argument_count)
+{
+	const auto* block = m_executable_program->block_by_name(name);
+
+	if (!block) {
+		set_call(name, argument_count);
+		pop_stack_frame(); // still returns, with undefined
+		return;
+	}
+
+	m_fuel.burn();
+
+	// Slide the arguments down to the base of the current frame and drop it,
+	// the callee then enters in place of the caller.
+	auto base = m_frames.back().base;
+	std::move(m_stack.begin() + (m_stack_pointer - argument_count), m_stack.begin() + m_stack_pointer, m_stack.begin() + base);
+	m_stack_pointer = base + argument_count;
+	m_frames.pop_back();
+	m_call = PendingCall{ block, argument_count };
 }
 
 void ysen::lang::bytecode::BytecodeInterpreter::push()
 {
-	m_stack.push(m_accumulator);	
+	ensure_stack_capacity(m_stack_pointer + 1);
+	m_stack[m_stack_pointer++] = std::move(m_accumulator);
 }
 
 void ysen::lang::bytecode::BytecodeInterpreter::pop()
 {
-	m_accumulator = m_stack.top();
-	m_stack.pop();
+	m_accumulator = std::move(m_stack[--m_stack_pointer]);
 }
 
 void ysen::lang::bytecode::BytecodeInterpreter::pop_stack_frame()
 {
-	m_stack_frame.pop();
+	m_stack_pointer = m_frames.back().base;
+	m_frames.pop_back();
+}
+
+void ysen::lang::bytecode::BytecodeInterpreter::enter_frame(const Block* block, size_t argument_count)
+{
+	// The arguments were pushed by the caller and already sit in the first slots
+	// of the new frame, only missing arguments and declared locals need clearing.
+	auto base = m_stack_pointer - argument_count;
+	auto window = std::max(block->local_count(), block->parameter_count());
+	ensure_stack_capacity(base + window);
+
+	for (auto i = std::min(argument_count, block->parameter_count()); i < window; ++i) {
+		m_stack[base + i] = astvm::undefined();
+	}
+
+	m_stack_pointer = base + window;
+	m_frames.push_back({ block, block->instructions().begin(), base });
+}
+
+void ysen::lang::bytecode::BytecodeInterpreter::ensure_stack_capacity(size_t size)
+{
+	if (m_stack.size() < size) {
+		m_stack.resize(std::max(size, m_stack.size() * 2));
+	}
 }
@@ -1,9 +1,9 @@
 #pragma once
-#include <stack>
 #include <vector>
 
 #include "Instruction.h"
 #include "ysen/core/Optional.h"
+#include "ysen/lang/astvm/Fuel.h"
 #include "ysen/lang/astvm/Value.h"
 
 namespace ysen::lang::bytecode {
@@ -19,29 +19,48 @@ namespace ysen::lang::bytecode {
 		astvm::Value& variable(const core::String& name);
 		astvm::Value& accumulator() { return m_accumulator; }
 		astvm::Value& register_value(const Register&);
+		astvm::Value& local(size_t index) { return m_stack[m_frames.back().base + index]; }
+
+		// Counted down at taken branches and at calls
+		astvm::Fuel& fuel() { return m_fuel; }
 
 		void set_jump_point(size_t);
-		void set_call(const core::String& name);
+		void set_call(const core::String& name, size_t argument_count);
+		void set_tail_call(const core::String& name, size_t argument_count);
 
 		void push();
 		void pop();
 		void pop_stack_frame();
+	private:
+		void enter_frame(const Block*, size_t argument_count);
+		void ensure_stack_capacity(size_t);
 	private:
 		const ExecutableProgram* m_executable_program{};
 		std::unordered_map<size_t, astvm::Value> m_registers{};
 		astvm::Value m_accumulator{};
 		core::Optional<size_t> m_jump{};
-		core::Optional<const Block*> m_call{};
+		struct PendingCall
+		{
+			const Block* block{};
+			size_t argument_count{};
+		};
+		core::Optional<PendingCall> m_call{};
 		std::unordered_map<core::String, astvm::Value> m_variables{};
 		struct StackFrame
 		{
 			const Block* block{};
 			InstructionIterator pc{};
+			size_t base{}; // frame pointer, index of the first local in m_stack
 		};
-		
-		std::stack<StackFrame> m_stack_frame{};
-		std::stack<astvm::Value> m_stack{};
-		
+
+		// A single contiguous value stack shared by all frames. Each frame owns the
+		// window [base, base + block->local_count()), arguments are pushed by the
+		// caller directly into the callee's first slots and a return simply resets
+		// the stack pointer back to the frame base.
+		std::vector<StackFrame> m_frames{};
+		std::vector<astvm::Value> m_stack{};
+		size_t m_stack_pointer{};
+		astvm::Fuel m_fuel{};
 	};
-	
+
 }
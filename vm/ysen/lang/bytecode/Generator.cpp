@@ -1,6 +1,9 @@
 #include "Generator.h"
 
+#include <stdexcept>
+
 #include "ysen/core/format.h"
+#include "ysen/lang/ast/node.h"
 
 ysen::lang::bytecode::Instruction& ysen::lang::bytecode::Block::emit(InstructionPtr instr)
 {
@@ -19,6 +22,12 @@ ysen::core::String ysen::lang::bytecode::Block::to_string() const
 	return formatted;
 }
 
+void ysen::lang::bytecode::Block::set_frame_layout(size_t parameter_count, size_t local_count)
+{
+	m_parameter_count = parameter_count;
+	m_local_count = local_count;
+}
+
 ysen::lang::bytecode::Block& ysen::lang::bytecode::Block::emit_sub_block(BlockType type)
 {
 	return *m_children.emplace_back(
@@ -47,7 +56,7 @@ void ysen::lang::bytecode::ExecutableProgram::end_block()
 const ysen::lang::bytecode::Block* ysen::lang::bytecode::ExecutableProgram::block_by_name(const core::String& name
 ) const
 {
-	auto iterator = std::find_if(m_blocks.begin(), m_blocks.end(), [&name](auto block) {
+	auto iterator = std::find_if(m_blocks.begin(), m_blocks.end(), [&name](const auto& block) {
 		return block->name() == name;
 	});
 
@@ -71,6 +80,22 @@ ysen::lang::bytecode::Instruction& ysen::lang::bytecode::Generator::emit(Instruc
 	return m_program.current_block().emit(std::move(instr));
 }
 
+ysen::lang::bytecode::Instruction& ysen::lang::bytecode::Generator::emit_bin_op(ast::BinOp op, Register lhs)
+{
+	switch (op) {
+	case ast::BinOp::Addition: return emit<Add>(lhs);
+	case ast::BinOp::Subtraction: return emit<Sub>(lhs);
+	case ast::BinOp::Division: return emit<Div>(lhs);
+	case ast::BinOp::Multiplication: return emit<Mul>(lhs);
+	case ast::BinOp::Greater: return emit<Greater>(lhs);
+	case ast::BinOp::GreaterEqual: return emit<GreaterEqual>(lhs);
+	case ast::BinOp::Less: return emit<Less>(lhs);
+	case ast::BinOp::LessEqual: return emit<LessEqual>(lhs);
+	}
+
+	throw std::logic_error(core::format("No instruction for binary operator {}", static_cast<int>(op)).c_str());
+}
+
 ysen::lang::bytecode::Block& ysen::lang::bytecode::Generator::emit_block(core::String name) 
 {
 	return m_program.emit_block(std::move(name));
@@ -81,6 +106,51 @@ void ysen::lang::bytecode::Generator::end_block()
 	m_program.end_block();
 }
 
+void ysen::lang::bytecode::Generator::enter_frame()
+{
+	m_frames.push({});
+}
+
+void ysen::lang::bytecode::Generator::leave_frame()
+{
+	const auto& frame = m_frames.top();
+	m_program.current_block().set_frame_layout(frame.parameter_count, frame.locals.size());
+	m_frames.pop();
+}
+
+size_t ysen::lang::bytecode::Generator::declare_parameter(const core::String& name)
+{
+	auto index = declare_local(name);
+	++m_frames.top().parameter_count;
+	return index;
+}
+
+size_t ysen::lang::bytecode::Generator::declare_local(const core::String& name)
+{
+	auto& locals = m_frames.top().locals;
+	if (auto it = locals.find(name); it != locals.end()) {
+		return it->second;
+	}
+
+	auto index = locals.size();
+	locals.emplace(name, index);
+	return index;
+}
+
+ysen::core::Optional<size_t> ysen::lang::bytecode::Generator::find_local(const core::String& name) const
+{
+	if (m_frames.empty()) {
+		return {};
+	}
+
+	const auto& locals = m_frames.top().locals;
+	if (auto it = locals.find(name); it != locals.end()) {
+		return it->second;
+	}
+
+	return {};
+}
+
 ysen::lang::bytecode::Register ysen::lang::bytecode::Generator::allocate_register()
 {
 	return m_registers.emplace_back(Register{m_registers.size()});
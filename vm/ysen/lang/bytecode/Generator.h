@@ -1,4 +1,5 @@
 #pragma once
+#include <map>
 #include <stack>
 #include <vector>
 
@@ -6,6 +7,11 @@
 #include "Instruction.h"
 #include "Label.h"
 #include "Register.h"
+#include "ysen/core/Optional.h"
+
+namespace ysen::lang::ast {
+	enum class BinOp;
+}
 
 namespace ysen::lang::bytecode {
 
@@ -41,6 +47,12 @@ namespace ysen::lang::bytecode {
 		const auto& name() const { return m_label.name(); }
 		BlockType type() const { return m_type; }
 
+		// Frame layout: the first parameter_count() locals are the arguments
+		// passed in place by the caller, the rest are declared locals.
+		size_t parameter_count() const { return m_parameter_count; }
+		size_t local_count() const { return m_local_count; }
+		void set_frame_layout(size_t parameter_count, size_t local_count);
+
 		Block& emit_sub_block(BlockType = BlockType::Other);
 	private:
 		Label create_sub_label() const;
@@ -48,6 +60,8 @@ namespace ysen::lang::bytecode {
 		Label m_label;
 		InstructionList m_instructions{};
 		BlockType m_type{};
+		size_t m_parameter_count{};
+		size_t m_local_count{};
 		std::vector<core::SharedPtr<Block>> m_children{};
 	};
 
@@ -83,12 +97,30 @@ namespace ysen::lang::bytecode {
 			return *ptr;
 		}
 		Instruction& emit(InstructionPtr);
+		// Emits acc = lhs <op> acc
+		Instruction& emit_bin_op(ast::BinOp, Register lhs);
 		Block& emit_block(core::String name);
 		void end_block();
+
+		// Frames map names to local slots of the block currently being generated.
+		// Outside of a frame (i.e. in "main") names resolve to global variables.
+		void enter_frame();
+		void leave_frame();
+		bool in_frame() const { return !m_frames.empty(); }
+		size_t declare_parameter(const core::String& name);
+		size_t declare_local(const core::String& name);
+		core::Optional<size_t> find_local(const core::String& name) const;
 		
 		Register allocate_register();
 	private:
+		struct FrameLayout
+		{
+			std::map<core::String, size_t> locals{};
+			size_t parameter_count{};
+		};
+
 		std::vector<Register> m_registers{};
+		std::stack<FrameLayout> m_frames{};
 		ExecutableProgram m_program{};
 	};
 
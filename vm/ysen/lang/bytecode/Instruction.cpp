@@ -3,6 +3,7 @@
 
 #include "BytecodeInterpreter.h"
 #include "ysen/core/format.h"
+#include "ysen/lang/ast/node.h"
 
 void ysen::lang::bytecode::Load::execute(BytecodeInterpreter& vm) const
 {
@@ -54,9 +55,29 @@ ysen::core::String ysen::lang::bytecode::StoreVariable::to_string() const
 	return core::format("storev '{}'", m_name);
 }
 
+void ysen::lang::bytecode::LoadLocal::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = vm.local(m_index);
+}
+
+ysen::core::String ysen::lang::bytecode::LoadLocal::to_string() const
+{
+	return core::format("loadl [fp+{}]", static_cast<unsigned int>(m_index));
+}
+
+void ysen::lang::bytecode::StoreLocal::execute(BytecodeInterpreter& vm) const
+{
+	vm.local(m_index) = vm.accumulator();
+}
+
+ysen::core::String ysen::lang::bytecode::StoreLocal::to_string() const
+{
+	return core::format("storel [fp+{}]", static_cast<unsigned int>(m_index));
+}
+
 void ysen::lang::bytecode::Add::execute(BytecodeInterpreter& vm) const
 {
-	vm.accumulator() = vm.accumulator() + vm.register_value(m_source);
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::Addition, vm.register_value(m_source), vm.accumulator());
 }
 
 ysen::core::String ysen::lang::bytecode::Add::to_string() const
@@ -64,14 +85,116 @@ ysen::core::String ysen::lang::bytecode::Add::to_string() const
 	return core::format("add {}", m_source.to_string());
 }
 
+void ysen::lang::bytecode::Sub::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::Subtraction, vm.register_value(m_source), vm.accumulator());
+}
+
+ysen::core::String ysen::lang::bytecode::Sub::to_string() const
+{
+	return core::format("sub {}", m_source.to_string());
+}
+
+void ysen::lang::bytecode::Mul::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::Multiplication, vm.register_value(m_source), vm.accumulator());
+}
+
+ysen::core::String ysen::lang::bytecode::Mul::to_string() const
+{
+	return core::format("mul {}", m_source.to_string());
+}
+
+void ysen::lang::bytecode::Div::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::Division, vm.register_value(m_source), vm.accumulator());
+}
+
+ysen::core::String ysen::lang::bytecode::Div::to_string() const
+{
+	return core::format("div {}", m_source.to_string());
+}
+
+void ysen::lang::bytecode::Greater::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::Greater, vm.register_value(m_source), vm.accumulator());
+}
+
+ysen::core::String ysen::lang::bytecode::Greater::to_string() const
+{
+	return core::format("gt {}", m_source.to_string());
+}
+
+void ysen::lang::bytecode::GreaterEqual::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::GreaterEqual, vm.register_value(m_source), vm.accumulator());
+}
+
+ysen::core::String ysen::lang::bytecode::GreaterEqual::to_string() const
+{
+	return core::format("ge {}", m_source.to_string());
+}
+
+void ysen::lang::bytecode::Less::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::Less, vm.register_value(m_source), vm.accumulator());
+}
+
+ysen::core::String ysen::lang::bytecode::Less::to_string() const
+{
+	return core::format("lt {}", m_source.to_string());
+}
+
+void ysen::lang::bytecode::LessEqual::execute(BytecodeInterpreter& vm) const
+{
+	vm.accumulator() = ast::apply_bin_op(ast::BinOp::LessEqual, vm.register_value(m_source), vm.accumulator());
+}
+
+ysen::core::String ysen::lang::bytecode::LessEqual::to_string() const
+{
+	return core::format("le {}", m_source.to_string());
+}
+
+void ysen::lang::bytecode::Jump::execute(BytecodeInterpreter& vm) const
+{
+	vm.set_jump_point(m_target);
+}
+
+ysen::core::String ysen::lang::bytecode::Jump::to_string() const
+{
+	return core::format("jmp {}", static_cast<unsigned int>(m_target));
+}
+
+void ysen::lang::bytecode::JumpIfFalse::execute(BytecodeInterpreter& vm) const
+{
+	if (vm.accumulator().is_falseish()) {
+		vm.set_jump_point(m_target);
+	}
+}
+
+ysen::core::String ysen::lang::bytecode::JumpIfFalse::to_string() const
+{
+	return core::format("jf {}", static_cast<unsigned int>(m_target));
+}
+
 void ysen::lang::bytecode::Call::execute(BytecodeInterpreter& vm) const
 {
-	vm.set_call(m_name);
+	vm.set_call(m_name, m_argument_count);
 }
 
 ysen::core::String ysen::lang::bytecode::Call::to_string() const
 {
-	return core::format("call '{}'", m_name);
+	return core::format("call '{}', {}", m_name, static_cast<unsigned int>(m_argument_count));
+}
+
+void ysen::lang::bytecode::TailCall::execute(BytecodeInterpreter& vm) const
+{
+	vm.set_tail_call(m_name, m_argument_count);
+}
+
+ysen::core::String ysen::lang::bytecode::TailCall::to_string() const
+{
+	return core::format("tcall '{}', {}", m_name, static_cast<unsigned int>(m_argument_count));
 }
 
 void ysen::lang::bytecode::Push::execute(BytecodeInterpreter& vm) const
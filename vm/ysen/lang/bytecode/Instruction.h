@@ -95,7 +95,7 @@ namespace ysen::lang::bytecode {
 		core::String m_name{};
 	};
 
-	// add $1, $2, $3 ($3 = $1 + $2)
+	// add $1 (acc = $1 + acc)
 	class Add : public Instruction
 	{
 	public:
@@ -111,17 +111,218 @@ namespace ysen::lang::bytecode {
 		Register m_source;
 	};
 
+	// sub $1 (acc = $1 - acc)
+	class Sub : public Instruction
+	{
+	public:
+		Sub(Register source)
+			: m_source(source)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+		
+		const auto& lhs() const { return m_source; }
+	private:
+		Register m_source;
+	};
+
+	// mul $1 (acc = $1 * acc)
+	class Mul : public Instruction
+	{
+	public:
+		Mul(Register source)
+			: m_source(source)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+		
+		const auto& lhs() const { return m_source; }
+	private:
+		Register m_source;
+	};
+
+	// div $1 (acc = $1 / acc)
+	class Div : public Instruction
+	{
+	public:
+		Div(Register source)
+			: m_source(source)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+		
+		const auto& lhs() const { return m_source; }
+	private:
+		Register m_source;
+	};
+
+	// gt $1 (acc = $1 > acc)
+	class Greater : public Instruction
+	{
+	public:
+		Greater(Register source)
+			: m_source(source)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+		
+		const auto& lhs() const { return m_source; }
+	private:
+		Register m_source;
+	};
+
+	// ge $1 (acc = $1 >= acc)
+	class GreaterEqual : public Instruction
+	{
+	public:
+		GreaterEqual(Register source)
+			: m_source(source)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+		
+		const auto& lhs() const { return m_source; }
+	private:
+		Register m_source;
+	};
+
+	// lt $1 (acc = $1 < acc)
+	class Less : public Instruction
+	{
+	public:
+		Less(Register source)
+			: m_source(source)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+		
+		const auto& lhs() const { return m_source; }
+	private:
+		Register m_source;
+	};
+
+	// le $1 (acc = $1 <= acc)
+	class LessEqual : public Instruction
+	{
+	public:
+		LessEqual(Register source)
+			: m_source(source)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+		
+		const auto& lhs() const { return m_source; }
+	private:
+		Register m_source;
+	};
+
+	// jmp target (continue at instruction index target of the current block)
+	class Jump : public Instruction
+	{
+	public:
+		Jump(size_t target = 0)
+			: m_target(target)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+
+		size_t target() const { return m_target; }
+		void set_target(size_t target) { m_target = target; }
+	private:
+		size_t m_target{};
+	};
+
+	// jf target (jump to target if acc is false-ish)
+	class JumpIfFalse : public Instruction
+	{
+	public:
+		JumpIfFalse(size_t target = 0)
+			: m_target(target)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+
+		size_t target() const { return m_target; }
+		void set_target(size_t target) { m_target = target; }
+	private:
+		size_t m_target{};
+	};
+
+	// loadl [fp+index] (acc = local at index in the current frame)
+	class LoadLocal : public Instruction
+	{
+	public:
+		LoadLocal(size_t index)
+			: m_index(index)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+
+		size_t index() const { return m_index; }
+	private:
+		size_t m_index{};
+	};
+
+	// storel [fp+index] (local at index in the current frame = acc)
+	class StoreLocal : public Instruction
+	{
+	public:
+		StoreLocal(size_t index)
+			: m_index(index)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+
+		size_t index() const { return m_index; }
+	private:
+		size_t m_index{};
+	};
+
+	// call 'name', argc (the top argc stack values become the callee's first locals)
 	class Call : public Instruction
 	{
 	public:
-		Call(core::String name)
-			: m_name(std::move(name))
+		Call(core::String name, size_t argument_count)
+			: m_name(std::move(name)), m_argument_count(argument_count)
+		{}
+
+		void execute(BytecodeInterpreter&) const override;
+		core::String to_string() const override;
+
+		const auto& name() const { return m_name; }
+		size_t argument_count() const { return m_argument_count; }
+	private:
+		core::String m_name{};
+		size_t m_argument_count{};
+	};
+
+	// tcall 'name', argc (call in tail position, the callee replaces the current frame)
+	class TailCall : public Instruction
+	{
+	public:
+		TailCall(core::String name, size_t argument_count)
+			: m_name(std::move(name)), m_argument_count(argument_count)
 		{}
 
 		void execute(BytecodeInterpreter&) const override;
 		core::String to_string() const override;
+
+		const auto& name() const { return m_name; }
+		size_t argument_count() const { return m_argument_count; }
 	private:
 		core::String m_name{};
+		size_t m_argument_count{};
 	};
 
 	class Push : public Instruction
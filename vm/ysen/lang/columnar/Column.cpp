@@ -0,0 +1,105 @@
+#include "Column.h"
+
+const char* ysen::lang::columnar::column_type_name(ColumnType type)
+{
+	switch (type) {
+	case ColumnType::Int: return "int";
+	case ColumnType::Double: return "double";
+	case ColumnType::String: return "string";
+	case ColumnType::Bool: return "bool";
+	default: return "unknown";
+	}
+}
+
+ysen::lang::columnar::Column::Column(std::span<const int> values)
+	: m_type(ColumnType::Int), m_data(values.data()), m_size(values.size())
+{}
+
+ysen::lang::columnar::Column::Column(std::span<const double> values)
+	: m_type(ColumnType::Double), m_data(values.data()), m_size(values.size())
+{}
+
+ysen::lang::columnar::Column::Column(std::span<const core::String> values)
+	: m_type(ColumnType::String), m_data(values.data()), m_size(values.size())
+{}
+
+ysen::lang::columnar::Column::Column(std::span<const uint8_t> values)
+	: m_type(ColumnType::Bool), m_data(values.data()), m_size(values.size())
+{}
+
+ysen::lang::columnar::Column::Column(std::vector<int> values)
+	: m_type(ColumnType::Int), m_size(values.size()), m_ints(std::move(values))
+{
+	m_data = m_ints.data();
+}
+
+ysen::lang::columnar::Column::Column(std::vector<double> values)
+	: m_type(ColumnType::Double), m_size(values.size()), m_doubles(std::move(values))
+{
+	m_data = m_doubles.data();
+}
+
+ysen::lang::columnar::Column::Column(std::vector<core::String> values)
+	: m_type(ColumnType::String), m_size(values.size()), m_strings(std::move(values))
+{
+	m_data = m_strings.data();
+}
+
+ysen::lang::columnar::Column::Column(std::vector<uint8_t> values)
+	: m_type(ColumnType::Bool), m_size(values.size()), m_bools(std::move(values))
+{
+	m_data = m_bools.data();
+}
+
+std::span<const int> ysen::lang::columnar::Column::ints() const
+{
+	return { static_cast<const int*>(checked_data(ColumnType::Int)), m_size };
+}
+
+std::span<const double> ysen::lang::columnar::Column::doubles() const
+{
+	return { static_cast<const double*>(checked_data(ColumnType::Double)), m_size };
+}
+
+std::span<const ysen::core::String> ysen::lang::columnar::Column::strings() const
+{
+	return { static_cast<const core::String*>(checked_data(ColumnType::String)), m_size };
+}
+
+std::span<const uint8_t> ysen::lang::columnar::Column::bools() const
+{
+	return { static_cast<const uint8_t*>(checked_data(ColumnType::Bool)), m_size };
+}
+
+const void* ysen::lang::columnar::Column::checked_data(ColumnType type) const
+{
+	if (m_type != type) {
+		throw ColumnarError(core::format("A {} column read as {}", column_type_name(m_type), column_type_name(type)));
+	}
+
+	return m_data;
+}
+
+ysen::lang::columnar::Batch::Batch(size_t size)
+	: m_size(size)
+{}
+
+void ysen::lang::columnar::Batch::bind(core::String name, Column column)
+{
+	if (name.length() == 0) {
+		throw ColumnarError("A column needs a name");
+	}
+
+	if (column.size() != m_size) {
+		throw ColumnarError(core::format("Column '{}' has {} rows, the batch {}", name,
+			static_cast<unsigned int>(column.size()), static_cast<unsigned int>(m_size)));
+	}
+
+	m_columns.insert_or_assign(std::move(name), std::move(column));
+}
+
+const ysen::lang::columnar::Column* ysen::lang::columnar::Batch::find(const core::String& name) const
+{
+	auto it = m_columns.find(name);
+	return it != m_columns.end() ? &it->second : nullptr;
+}
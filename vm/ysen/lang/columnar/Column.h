@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <span>
+#include <vector>
+
+#include "ysen/core/format.h"
+#include "ysen/core/String.h"
+
+namespace ysen::lang::columnar {
+
+	class ColumnarError : public std::exception
+	{
+	public:
+		ColumnarError(core::String message)
+			: m_message(core::format("ColumnarError: {}", message))
+		{}
+
+		char const* what() const override
+		{
+			return m_message.c_str();
+		}
+	private:
+		core::String m_message{};
+	};
+
+	enum class ColumnType
+	{
+		Int,
+		Double,
+		String,
+		// One byte per row, 0 or 1
+		Bool,
+	};
+
+	const char* column_type_name(ColumnType);
+
+	// The values of one field over the rows of a batch. A column made from a span
+	// borrows it, the host keeps the data alive while the column is used; columns
+	// kernels produce own their values. Moving a column keeps its data in place.
+	class Column
+	{
+	public:
+		Column() = default;
+		Column(std::span<const int>);
+		Column(std::span<const double>);
+		Column(std::span<const core::String>);
+		Column(std::span<const uint8_t>);
+		Column(std::vector<int>);
+		Column(std::vector<double>);
+		Column(std::vector<core::String>);
+		Column(std::vector<uint8_t>);
+
+		Column(const Column&) = delete;
+		Column& operator=(const Column&) = delete;
+		Column(Column&&) noexcept = default;
+		Column& operator=(Column&&) noexcept = default;
+
+		ColumnType type() const { return m_type; }
+		size_t size() const { return m_size; }
+
+		// Throw a ColumnarError for a column of another type
+		std::span<const int> ints() const;
+		std::span<const double> doubles() const;
+		std::span<const core::String> strings() const;
+		std::span<const uint8_t> bools() const;
+	private:
+		const void* checked_data(ColumnType) const;
+
+		ColumnType m_type{ColumnType::Int};
+		const void* m_data{};
+		size_t m_size{};
+		std::vector<int> m_ints{};
+		std::vector<double> m_doubles{};
+		std::vector<core::String> m_strings{};
+		std::vector<uint8_t> m_bools{};
+	};
+
+	// Columns by the identifiers expressions refer to them with, all of them as
+	// long as the batch
+	class Batch
+	{
+	public:
+		explicit Batch(size_t size);
+
+		void bind(core::String name, Column column);
+		const Column* find(const core::String& name) const;
+
+		size_t size() const { return m_size; }
+	private:
+		size_t m_size{};
+		std::map<core::String, Column> m_columns{};
+	};
+
+}
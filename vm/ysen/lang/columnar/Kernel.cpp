@@ -0,0 +1,507 @@
+#include "Kernel.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <type_traits>
+
+#include "../Lexer.h"
+#include "../Parser.h"
+#include "../ast/ConstantFolder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define YSEN_COLUMNAR_SSE2 1
+#endif
+
+// The rows of a step in the current block: a constant is a single value for all
+// of them, a loaded column points into the batch, the rest into its own buffer
+struct ysen::lang::columnar::details::Register
+{
+	ColumnType type{};
+	bool is_scalar{};
+	const void* data{};
+	std::vector<int> ints{};
+	std::vector<double> doubles{};
+	std::vector<core::String> strings{};
+	std::vector<uint8_t> bools{};
+};
+
+namespace {
+
+	using ysen::lang::ast::BinOp;
+	using ysen::lang::columnar::ColumnType;
+	using ysen::lang::columnar::ColumnarError;
+	using ysen::lang::columnar::details::Register;
+
+	bool is_comparison(BinOp op)
+	{
+		return op == BinOp::Greater || op == BinOp::GreaterEqual || op == BinOp::Less || op == BinOp::LessEqual;
+	}
+
+	bool is_numeric(ColumnType type)
+	{
+		return type == ColumnType::Int || type == ColumnType::Double;
+	}
+
+	ColumnType result_type(BinOp op, ColumnType left, ColumnType right)
+	{
+		if (is_comparison(op)) {
+			if ((is_numeric(left) && is_numeric(right)) || (left == ColumnType::String && right == ColumnType::String)) {
+				return ColumnType::Bool;
+			}
+		}
+		else if (is_numeric(left) && is_numeric(right)) {
+			return left;
+		}
+		else if (left == ColumnType::String && op == BinOp::Addition && right != ColumnType::Bool) {
+			return ColumnType::String;
+		}
+
+		throw ColumnarError(ysen::core::format("No columnar form for an operator on {} and {}",
+			ysen::lang::columnar::column_type_name(left), ysen::lang::columnar::column_type_name(right)));
+	}
+
+	// One loop per shape of the operands, so that the compiler can vectorize each
+	template<typename L, typename R, typename Out, typename Op>
+	void apply(const L* left, bool left_scalar, const R* right, bool right_scalar, Out* out, size_t count, Op op)
+	{
+		if (left_scalar && !right_scalar) {
+			const auto& value = *left;
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = op(value, right[i]);
+			}
+		}
+		else if (right_scalar && !left_scalar) {
+			const auto& value = *right;
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = op(left[i], value);
+			}
+		}
+		else {
+			for (size_t i = 0; i < count; ++i) {
+				out[i] = op(left[i], right[i]);
+			}
+		}
+	}
+
+	template<typename L, typename R, typename Out, typename Op>
+	void apply(const Register& left, const Register& right,
+		Out* out, size_t count, Op op)
+	{
+		apply(static_cast<const L*>(left.data), left.is_scalar, static_cast<const R*>(right.data), right.is_scalar, out, count, op);
+	}
+
+	template<typename L, typename R>
+	void arithmetic(BinOp op, const Register& left, const Register& right,
+		L* out, size_t count)
+	{
+		switch (op) {
+		case BinOp::Addition:
+			apply<L, R>(left, right, out, count, [](L a, R b) { return static_cast<L>(a + static_cast<L>(b)); });
+			break;
+		case BinOp::Subtraction:
+			apply<L, R>(left, right, out, count, [](L a, R b) { return static_cast<L>(a - static_cast<L>(b)); });
+			break;
+		case BinOp::Multiplication:
+			apply<L, R>(left, right, out, count, [](L a, R b) { return static_cast<L>(a * static_cast<L>(b)); });
+			break;
+		case BinOp::Division:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> L {
+				if constexpr (std::is_integral_v<L>) {
+					auto divisor = static_cast<L>(b);
+					return divisor != 0 ? a / divisor : 0;
+				}
+				else {
+					return a / static_cast<L>(b);
+				}
+			});
+			break;
+		default:;
+		}
+	}
+
+	template<typename T>
+	bool equal(T a, T b)
+	{
+		if constexpr (std::is_floating_point_v<T>) {
+			return std::abs(a - b) < 1e-9;
+		}
+		else {
+			return a == b;
+		}
+	}
+
+	// As Value's operators, >= and <= are > and < or equal, and only values of one type are equal
+	template<typename L, typename R>
+	void compare(BinOp op, const Register& left, const Register& right,
+		uint8_t* out, size_t count)
+	{
+		constexpr auto same_type = std::is_same_v<L, R>;
+
+		switch (op) {
+		case BinOp::Greater:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t { return a > static_cast<L>(b); });
+			break;
+		case BinOp::Less:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t { return a < static_cast<L>(b); });
+			break;
+		case BinOp::GreaterEqual:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t {
+				if constexpr (same_type) {
+					return a > b || equal(a, b);
+				}
+				else {
+					return a > static_cast<L>(b);
+				}
+			});
+			break;
+		case BinOp::LessEqual:
+			apply<L, R>(left, right, out, count, [](L a, R b) -> uint8_t {
+				if constexpr (same_type) {
+					return a < b || equal(a, b);
+				}
+				else {
+					return a < static_cast<L>(b);
+				}
+			});
+			break;
+		default:;
+		}
+	}
+
+	void compare_strings(BinOp op, const Register& left, const Register& right,
+		uint8_t* out, size_t count)
+	{
+		using ysen::core::String;
+
+		switch (op) {
+		case BinOp::Greater:
+			apply<String, String>(left, right, out, count, [](const String& a, const String& b) -> uint8_t { return a > b; });
+			break;
+		case BinOp::Less:
+			apply<String, String>(left, right, out, count, [](const String& a, const String& b) -> uint8_t { return a < b; });
+			break;
+		case BinOp::GreaterEqual:
+			apply<String, String>(left, right, out, count, [](const String& a, const String& b) -> uint8_t { return a > b || a == b; });
+			break;
+		case BinOp::LessEqual:
+			apply<String, String>(left, right, out, count, [](const String& a, const String& b) -> uint8_t { return a < b || a == b; });
+			break;
+		default:;
+		}
+	}
+
+	template<typename R>
+	void concatenate(const Register& left, const Register& right,
+		ysen::core::String* out, size_t count)
+	{
+		using ysen::core::String;
+
+		apply<String, R>(left, right, out, count, [](const String& a, const R& b) {
+			if constexpr (std::is_same_v<R, String>) {
+				return a + b;
+			}
+			else {
+				return a + ysen::core::to_string(b);
+			}
+		});
+	}
+
+	template<typename L>
+	void numeric(BinOp op, const Register& left, const Register& right,
+		Register& out, size_t count)
+	{
+		if (is_comparison(op)) {
+			out.bools.resize(count);
+			out.data = out.bools.data();
+			if (right.type == ColumnType::Int) {
+				compare<L, int>(op, left, right, out.bools.data(), count);
+			}
+			else {
+				compare<L, double>(op, left, right, out.bools.data(), count);
+			}
+			return;
+		}
+
+		auto& values = [&]() -> std::vector<L>& {
+			if constexpr (std::is_same_v<L, int>) {
+				return out.ints;
+			}
+			else {
+				return out.doubles;
+			}
+		}();
+		values.resize(count);
+		out.data = values.data();
+
+		if (right.type == ColumnType::Int) {
+			arithmetic<L, int>(op, left, right, values.data(), count);
+		}
+		else {
+			arithmetic<L, double>(op, left, right, values.data(), count);
+		}
+	}
+
+	void binary(BinOp op, const Register& left, const Register& right,
+		Register& out, size_t count)
+	{
+		switch (left.type) {
+		case ColumnType::Int:
+			numeric<int>(op, left, right, out, count);
+			break;
+		case ColumnType::Double:
+			numeric<double>(op, left, right, out, count);
+			break;
+		case ColumnType::String:
+			if (is_comparison(op)) {
+				out.bools.resize(count);
+				out.data = out.bools.data();
+				compare_strings(op, left, right, out.bools.data(), count);
+				break;
+			}
+
+			out.strings.resize(count);
+			out.data = out.strings.data();
+			switch (right.type) {
+			case ColumnType::Int: concatenate<int>(left, right, out.strings.data(), count); break;
+			case ColumnType::Double: concatenate<double>(left, right, out.strings.data(), count); break;
+			default: concatenate<ysen::core::String>(left, right, out.strings.data(), count); break;
+			}
+			break;
+		default:;
+		}
+	}
+
+	template<typename T>
+	void copy_rows(const Register& from, std::vector<T>& to, size_t offset, size_t count)
+	{
+		const auto* data = static_cast<const T*>(from.data);
+		if (from.is_scalar) {
+			std::fill_n(to.begin() + offset, count, *data);
+		}
+		else {
+			std::copy_n(data, count, to.begin() + offset);
+		}
+	}
+
+	// Appends offset + i for each row i of the block whose byte is set
+	void compact(const uint8_t* mask, size_t count, uint32_t offset, std::vector<uint32_t>& rows)
+	{
+		size_t i = 0;
+#ifdef YSEN_COLUMNAR_SSE2
+		for (; i + 16 <= count; i += 16) {
+			auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i));
+			auto bits = ~static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128()))) & 0xffffu;
+			while (bits != 0) {
+				rows.push_back(offset + static_cast<uint32_t>(i) + std::countr_zero(bits));
+				bits &= bits - 1;
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			if (mask[i]) {
+				rows.push_back(offset + static_cast<uint32_t>(i));
+			}
+		}
+	}
+
+}
+
+ysen::lang::columnar::Kernel ysen::lang::columnar::Kernel::compile(const ast::Expression& expression)
+{
+	Kernel kernel{};
+	kernel.compile_node(expression);
+	return kernel;
+}
+
+ysen::lang::columnar::Kernel ysen::lang::columnar::Kernel::compile(const core::String& code)
+{
+	auto lexer = core::adopt_shared(Lexer::lex(code).release());
+	auto program = Parser{}.parse(std::move(lexer));
+	ast::ConstantFolder::fold(*program);
+
+	const auto& children = program->children();
+	if (children.size() != 1 || !children.front()->is_expression()) {
+		throw ColumnarError("A kernel is compiled from a single expression");
+	}
+
+	return compile(static_cast<const ast::Expression&>(*children.front()));
+}
+
+ysen::lang::columnar::ColumnType ysen::lang::columnar::Kernel::result_type(const Batch& batch) const
+{
+	return resolve(batch).back();
+}
+
+ysen::lang::columnar::Column ysen::lang::columnar::Kernel::evaluate(const Batch& batch) const
+{
+	auto types = resolve(batch);
+	std::vector<details::Register> registers(m_steps.size());
+
+	std::vector<int> ints{};
+	std::vector<double> doubles{};
+	std::vector<core::String> strings{};
+	std::vector<uint8_t> bools{};
+	switch (types.back()) {
+	case ColumnType::Int: ints.resize(batch.size()); break;
+	case ColumnType::Double: doubles.resize(batch.size()); break;
+	case ColumnType::String: strings.resize(batch.size()); break;
+	case ColumnType::Bool: bools.resize(batch.size()); break;
+	}
+
+	for (size_t offset = 0; offset < batch.size(); offset += BLOCK_SIZE) {
+		auto count = std::min(BLOCK_SIZE, batch.size() - offset);
+		run_block(batch, types, registers, offset, count);
+
+		const auto& result = registers.back();
+		switch (result.type) {
+		case ColumnType::Int: copy_rows(result, ints, offset, count); break;
+		case ColumnType::Double: copy_rows(result, doubles, offset, count); break;
+		case ColumnType::String: copy_rows(result, strings, offset, count); break;
+		case ColumnType::Bool: copy_rows(result, bools, offset, count); break;
+		}
+	}
+
+	switch (types.back()) {
+	case ColumnType::Int: return Column{ std::move(ints) };
+	case ColumnType::Double: return Column{ std::move(doubles) };
+	case ColumnType::String: return Column{ std::move(strings) };
+	default: return Column{ std::move(bools) };
+	}
+}
+
+std::vector<uint32_t> ysen::lang::columnar::Kernel::select(const Batch& batch) const
+{
+	auto types = resolve(batch);
+	if (types.back() != ColumnType::Bool) {
+		throw ColumnarError(core::format("Rows are selected by a comparison, not a {}", column_type_name(types.back())));
+	}
+
+	std::vector<details::Register> registers(m_steps.size());
+	std::vector<uint32_t> rows{};
+	for (size_t offset = 0; offset < batch.size(); offset += BLOCK_SIZE) {
+		auto count = std::min(BLOCK_SIZE, batch.size() - offset);
+		run_block(batch, types, registers, offset, count);
+
+		const auto& result = registers.back();
+		const auto* mask = static_cast<const uint8_t*>(result.data);
+		if (!result.is_scalar) {
+			compact(mask, count, static_cast<uint32_t>(offset), rows);
+		}
+		else if (*mask) {
+			for (size_t i = 0; i < count; ++i) {
+				rows.push_back(static_cast<uint32_t>(offset + i));
+			}
+		}
+	}
+
+	return rows;
+}
+
+uint32_t ysen::lang::columnar::Kernel::compile_node(const ast::Expression& expression)
+{
+	Step step{};
+
+	if (expression.is_bin_op_expression()) {
+		const auto& bin_op = static_cast<const ast::BinOpExpression&>(expression);
+		step.kind = StepKind::BinOp;
+		step.op = bin_op.op();
+		step.left = compile_node(*bin_op.left());
+		step.right = compile_node(*bin_op.right());
+	}
+	else if (expression.is_identifier_expression()) {
+		step.kind = StepKind::Load;
+		step.name = static_cast<const ast::IdentifierExpression&>(expression).name();
+	}
+	else if (expression.is_integer_expression()) {
+		step.kind = StepKind::Constant;
+		step.type = ColumnType::Int;
+		step.int_value = static_cast<const ast::IntegerExpression&>(expression).value();
+	}
+	else if (expression.is_float_expression()) {
+		step.kind = StepKind::Constant;
+		step.type = ColumnType::Double;
+		step.double_value = static_cast<const ast::FloatExpression&>(expression).value();
+	}
+	else if (expression.is_string_expression()) {
+		step.kind = StepKind::Constant;
+		step.type = ColumnType::String;
+		step.string_value = static_cast<const ast::StringExpression&>(expression).value();
+	}
+	else {
+		throw ColumnarError(core::format("No columnar form for the expression at {}", expression.source_range().to_string()));
+	}
+
+	m_steps.push_back(std::move(step));
+	return static_cast<uint32_t>(m_steps.size() - 1);
+}
+
+std::vector<ysen::lang::columnar::ColumnType> ysen::lang::columnar::Kernel::resolve(const Batch& batch) const
+{
+	std::vector<ColumnType> types{};
+	types.reserve(m_steps.size());
+
+	for (const auto& step : m_steps) {
+		switch (step.kind) {
+		case StepKind::Load:
+			{
+				const auto* column = batch.find(step.name);
+				if (!column) {
+					throw ColumnarError(core::format("No column '{}' in the batch", step.name));
+				}
+				types.push_back(column->type());
+				break;
+			}
+		case StepKind::Constant:
+			types.push_back(step.type);
+			break;
+		case StepKind::BinOp:
+			types.push_back(::result_type(step.op, types[step.left], types[step.right]));
+			break;
+		}
+	}
+
+	return types;
+}
+
+void ysen::lang::columnar::Kernel::run_block(const Batch& batch, const std::vector<ColumnType>& types, std::vector<details::Register>& registers,
+	size_t offset, size_t count) const
+{
+	for (auto i = 0u; i < m_steps.size(); ++i) {
+		const auto& step = m_steps[i];
+		auto& out = registers[i];
+		out.type = types[i];
+
+		switch (step.kind) {
+		case StepKind::Load:
+			{
+				const auto* column = batch.find(step.name);
+				out.is_scalar = false;
+				switch (out.type) {
+				case ColumnType::Int: out.data = column->ints().data() + offset; break;
+				case ColumnType::Double: out.data = column->doubles().data() + offset; break;
+				case ColumnType::String: out.data = column->strings().data() + offset; break;
+				case ColumnType::Bool: out.data = column->bools().data() + offset; break;
+				}
+				break;
+			}
+		case StepKind::Constant:
+			out.is_scalar = true;
+			switch (out.type) {
+			case ColumnType::Int: out.data = &step.int_value; break;
+			case ColumnType::Double: out.data = &step.double_value; break;
+			default: out.data = &step.string_value; break;
+			}
+			break;
+		case StepKind::BinOp:
+			{
+				const auto& left = registers[step.left];
+				const auto& right = registers[step.right];
+				out.is_scalar = left.is_scalar && right.is_scalar;
+				binary(step.op, left, right, out, out.is_scalar ? 1 : count);
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Column.h"
+#include "../ast/node.h"
+#include "ysen/core/String.h"
+
+namespace ysen::lang::columnar {
+
+	namespace details {
+		struct Register;
+	}
+
+	// An expression of identifiers, literals and binary operators compiled to run
+	// over whole columns: each operator is a loop over a block of rows, the
+	// identifiers name the columns of a batch. Operators follow the interpreter,
+	// the right operand is cast to the type of the left one; integer division by
+	// zero gives 0. Float literals are taken as doubles.
+	//
+	// Types are resolved against the columns of each batch, an operator the
+	// interpreter has no value for (arithmetic on strings other than +, on bools,
+	// comparing strings with numbers) throws a ColumnarError.
+	class Kernel
+	{
+	public:
+		// Rows per block, the intermediate columns of a block stay in cache
+		static constexpr size_t BLOCK_SIZE = 4096;
+
+		// Throws a ColumnarError for any other kind of node
+		static Kernel compile(const ast::Expression&);
+		// The code is a single expression, lexed, parsed and folded first
+		static Kernel compile(const core::String& code);
+
+		ColumnType result_type(const Batch&) const;
+
+		// The value of the expression for each row of the batch
+		Column evaluate(const Batch&) const;
+		// Rows of the batch for which the expression, a comparison, holds
+		std::vector<uint32_t> select(const Batch&) const;
+	private:
+		enum class StepKind
+		{
+			Load,
+			Constant,
+			BinOp,
+		};
+
+		// Steps are in post order, operands come before their operator
+		struct Step
+		{
+			StepKind kind{};
+			ColumnType type{};
+			core::String name{};
+			int int_value{};
+			double double_value{};
+			core::String string_value{};
+			ast::BinOp op{};
+			uint32_t left{};
+			uint32_t right{};
+		};
+
+		uint32_t compile_node(const ast::Expression&);
+		std::vector<ColumnType> resolve(const Batch&) const;
+		// Runs the steps over rows [offset, offset + count), the last register holds the result
+		void run_block(const Batch&, const std::vector<ColumnType>& types, std::vector<details::Register>&, size_t offset, size_t count) const;
+
+		std::vector<Step> m_steps{};
+	};
+
+}
@@ -0,0 +1,455 @@
+#include "Builder.h"
+
+#include <algorithm>
+
+ysen::lang::ir::ModulePtr ysen::lang::ir::Builder::build(const ast::Program& program)
+{
+	auto module = core::adopt_shared(new Module);
+	Builder builder{*module};
+	builder.build_program(program);
+	return module;
+}
+
+void ysen::lang::ir::Builder::build_program(const ast::Program& program)
+{
+	std::vector<const ast::FunctionDeclarationStatement*> functions{};
+
+	// Everything declared at the top level of the program lives in the global
+	// variable table, functions may read or assign it at any point.
+	for (const auto& child : program.children()) {
+		if (const auto* declaration = dynamic_cast<const ast::VarDeclaration*>(child)) {
+			m_globals.insert(declaration->name());
+		}
+		else if (const auto* assignment = dynamic_cast<const ast::AssignmentExpression*>(child)) {
+			m_globals.insert(assignment->name());
+		}
+		else if (const auto* function = dynamic_cast<const ast::FunctionDeclarationStatement*>(child)) {
+			functions.push_back(function);
+		}
+	}
+
+	m_function = &m_module.create_function(Module::ENTRY_POINT, {});
+	m_in_entry_point = true;
+	switch_to(m_function->create_block());
+	seal(current());
+	enter_scope();
+
+	Instruction* last{};
+	for (const auto& child : program.children()) {
+		if (child->is_function_declaration()) {
+			last = undefined();
+			continue;
+		}
+
+		last = build_node(*child);
+	}
+
+	current().append(Opcode::Return).operands().push_back(last ? last : undefined());
+	exit_scope();
+	finish_function();
+
+	m_in_entry_point = false;
+	for (const auto* function : functions) {
+		build_function(*function);
+	}
+}
+
+void ysen::lang::ir::Builder::build_function(const ast::FunctionDeclarationStatement& declaration)
+{
+	std::vector<core::String> parameters{};
+	for (const auto& parameter : declaration.parameters()) {
+		if (parameter->variadic()) {
+			throw UnsupportedConstruct(core::format("variadic parameter '{}'", parameter->name()));
+		}
+
+		parameters.push_back(parameter->name());
+	}
+
+	m_function = &m_module.create_function(declaration.name(), parameters);
+	switch_to(m_function->create_block());
+	seal(current());
+	enter_scope();
+
+	for (auto i = 0u; i < parameters.size(); ++i) {
+		auto& parameter = current().append(Opcode::Parameter);
+		parameter.set_index(i);
+		parameter.set_name(parameters[i]);
+		write_variable(declare(parameters[i]), m_current, &parameter);
+	}
+
+	auto* value = build_node(*declaration.body());
+	current().append(Opcode::Return).operands().push_back(value);
+	exit_scope();
+	finish_function();
+}
+
+void ysen::lang::ir::Builder::finish_function()
+{
+	m_function->simplify_phis();
+
+	// Lay the blocks out in reverse post order, unreachable ones go last
+	auto order = m_function->reverse_post_order();
+	std::map<const BasicBlock*, size_t> position{};
+	for (auto i = 0u; i < order.size(); ++i) {
+		position[order[i]] = i;
+	}
+
+	std::stable_sort(m_function->blocks().begin(), m_function->blocks().end(), [&position](const auto& a, const auto& b) {
+		auto pa = position.contains(a.ptr()) ? position[a.ptr()] : position.size();
+		auto pb = position.contains(b.ptr()) ? position[b.ptr()] : position.size();
+		return pa < pb;
+	});
+
+	m_definitions.clear();
+	m_sealed.clear();
+	m_incomplete_phis.clear();
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_node(const ast::AstNode& node)
+{
+	if (const auto* integer = dynamic_cast<const ast::IntegerExpression*>(&node)) {
+		return constant(integer->value());
+	}
+	if (const auto* floating = dynamic_cast<const ast::FloatExpression*>(&node)) {
+		return constant(floating->value());
+	}
+	if (const auto* string = dynamic_cast<const ast::StringExpression*>(&node)) {
+		return constant(string->value());
+	}
+	if (const auto* scope = dynamic_cast<const ast::ScopeStatement*>(&node)) {
+		return build_scope(*scope);
+	}
+	if (const auto* declaration = dynamic_cast<const ast::VarDeclaration*>(&node)) {
+		return build_var_declaration(*declaration);
+	}
+	if (const auto* assignment = dynamic_cast<const ast::AssignmentExpression*>(&node)) {
+		return build_assignment(*assignment);
+	}
+	if (const auto* identifier = dynamic_cast<const ast::IdentifierExpression*>(&node)) {
+		return build_identifier(*identifier);
+	}
+	if (const auto* bin_op = dynamic_cast<const ast::BinOpExpression*>(&node)) {
+		return build_bin_op(*bin_op);
+	}
+	if (const auto* call = dynamic_cast<const ast::FunctionCallExpression*>(&node)) {
+		return build_call(*call);
+	}
+	if (const auto* ret = dynamic_cast<const ast::ReturnExpression*>(&node)) {
+		return build_return(*ret);
+	}
+	if (const auto* if_statement = dynamic_cast<const ast::IfStatement*>(&node)) {
+		return build_if(*if_statement);
+	}
+	if (const auto* loop = dynamic_cast<const ast::RangedLoopExpression*>(&node)) {
+		return build_ranged_loop(*loop);
+	}
+
+	throw UnsupportedConstruct(core::format("node at {}", node.source_range().to_string()));
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_scope(const ast::ScopeStatement& scope)
+{
+	enter_scope();
+
+	Instruction* value{};
+	for (const auto& statement : scope.statements()) {
+		value = build_node(*statement);
+	}
+
+	exit_scope();
+	return value ? value : undefined();
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_var_declaration(const ast::VarDeclaration& declaration)
+{
+	auto* value = declaration.expression() ? build_node(*declaration.expression()) : undefined();
+
+	if (m_in_entry_point && m_scopes.size() == 1) {
+		auto& store = current().append(Opcode::StoreGlobal);
+		store.set_name(declaration.name());
+		store.operands().push_back(value);
+		return value;
+	}
+
+	write_variable(declare(declaration.name()), m_current, value);
+	return value;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_assignment(const ast::AssignmentExpression& assignment)
+{
+	auto* value = build_node(*assignment.body());
+
+	if (const auto* variable = find(assignment.name())) {
+		write_variable(*variable, m_current, value);
+	}
+	else if (m_globals.contains(assignment.name())) {
+		auto& store = current().append(Opcode::StoreGlobal);
+		store.set_name(assignment.name());
+		store.operands().push_back(value);
+	}
+	else {
+		// Assigning an unknown name declares it in the current scope
+		write_variable(declare(assignment.name()), m_current, value);
+	}
+
+	return value;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_identifier(const ast::IdentifierExpression& identifier)
+{
+	if (const auto* variable = find(identifier.name())) {
+		return read_variable(*variable, m_current);
+	}
+
+	if (!m_in_entry_point && !m_globals.contains(identifier.name())) {
+		// Could be a local of any caller, the interpreter scopes dynamically
+		throw UnsupportedConstruct(core::format("dynamically scoped name '{}'", identifier.name()));
+	}
+
+	auto& load = current().append(Opcode::LoadGlobal);
+	load.set_name(identifier.name());
+	return &load;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_bin_op(const ast::BinOpExpression& expression)
+{
+	auto* lhs = build_node(*expression.left());
+	auto* rhs = build_node(*expression.right());
+	return bin_op(expression.op(), lhs, rhs);
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_call(const ast::FunctionCallExpression& call)
+{
+	if (find(call.name())) {
+		throw UnsupportedConstruct(core::format("call through variable '{}'", call.name()));
+	}
+
+	std::vector<Instruction*> arguments{};
+	for (const auto& argument : call.arguments()) {
+		arguments.push_back(build_node(*argument));
+	}
+
+	auto& instruction = current().append(Opcode::Call);
+	instruction.set_name(call.name());
+	instruction.operands() = std::move(arguments);
+	return &instruction;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_return(const ast::ReturnExpression& ret)
+{
+	auto* value = build_node(*ret.expression());
+	current().append(Opcode::Return).operands().push_back(value);
+
+	// Anything following the ret is unreachable, keep building into a detached block
+	switch_to(m_function->create_block());
+	seal(current());
+	return value;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_if(const ast::IfStatement& statement)
+{
+	auto result = declare_hidden();
+	auto& join = m_function->create_block();
+
+	auto build_arm = [&](const ast::VarDeclarationPtr& declaration, const ast::ExpressionPtr& condition, const ast::ExpressionPtr& body) {
+		enter_scope();
+
+		if (declaration) {
+			build_var_declaration(*declaration);
+		}
+
+		auto& taken = m_function->create_block();
+		auto& next = m_function->create_block();
+		branch(build_node(*condition), taken, next);
+		seal(taken);
+		seal(next);
+
+		switch_to(taken);
+		write_variable(result, m_current, build_node(*body));
+		jump(join);
+
+		exit_scope();
+		switch_to(next);
+	};
+
+	build_arm(statement.declaration(), statement.condition(), statement.body());
+
+	for (const auto& else_if : statement.else_if_statements()) {
+		build_arm(else_if->declaration(), else_if->condition(), else_if->body());
+	}
+
+	write_variable(result, m_current, statement.else_statement() ? build_node(*statement.else_statement()->body()) : undefined());
+	jump(join);
+
+	seal(join);
+	switch_to(join);
+	return read_variable(result, m_current);
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::build_ranged_loop(const ast::RangedLoopExpression& loop)
+{
+	// Only counted loops over a literal range are lowered, iterating arrays and
+	// objects needs runtime support the bytecode doesn't have yet.
+	const auto* range = dynamic_cast<const ast::NumericRangeExpression*>(loop.range_expression());
+	const auto* declaration = dynamic_cast<const ast::VarDeclaration*>(loop.declaration());
+
+	if (!range || !declaration) {
+		throw UnsupportedConstruct(core::format("ranged loop at {}", loop.source_range().to_string()));
+	}
+
+	auto result = declare_hidden();
+	auto counter = declare_hidden();
+	write_variable(result, m_current, undefined());
+	write_variable(counter, m_current, constant(range->min()));
+
+	auto& header = m_function->create_block();
+	auto& body = m_function->create_block();
+	auto& exit = m_function->create_block();
+
+	jump(header);
+	switch_to(header);
+	auto* index = read_variable(counter, m_current);
+	branch(bin_op(ast::BinOp::LessEqual, index, constant(range->max())), body, exit);
+	seal(body);
+
+	switch_to(body);
+	enter_scope();
+	write_variable(declare(declaration->name()), m_current, index);
+	write_variable(result, m_current, build_node(*loop.body()));
+	write_variable(counter, m_current, bin_op(ast::BinOp::Addition, read_variable(counter, m_current), constant(1)));
+	exit_scope();
+	jump(header);
+
+	seal(header);
+	seal(exit);
+	switch_to(exit);
+	return read_variable(result, m_current);
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::bin_op(ast::BinOp op, Instruction* lhs, Instruction* rhs)
+{
+	auto& instruction = current().append(Opcode::BinOp);
+	instruction.set_bin_op(op);
+	instruction.operands().push_back(lhs);
+	instruction.operands().push_back(rhs);
+	return &instruction;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::constant(astvm::Value value)
+{
+	auto& instruction = current().append(Opcode::Constant);
+	instruction.set_constant(std::move(value));
+	return &instruction;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::undefined()
+{
+	return constant({});
+}
+
+void ysen::lang::ir::Builder::switch_to(BasicBlock& block)
+{
+	m_current = &block;
+}
+
+void ysen::lang::ir::Builder::jump(BasicBlock& target)
+{
+	current().append(Opcode::Jump).blocks().push_back(&target);
+	target.predecessors().push_back(m_current);
+}
+
+void ysen::lang::ir::Builder::branch(Instruction* condition, BasicBlock& if_true, BasicBlock& if_false)
+{
+	auto& instruction = current().append(Opcode::Branch);
+	instruction.operands().push_back(condition);
+	instruction.blocks().push_back(&if_true);
+	instruction.blocks().push_back(&if_false);
+	if_true.predecessors().push_back(m_current);
+	if_false.predecessors().push_back(m_current);
+}
+
+ysen::lang::ir::Builder::VariableId ysen::lang::ir::Builder::declare(const core::String& name)
+{
+	auto id = m_next_variable++;
+	m_scopes.back()[name] = id;
+	return id;
+}
+
+ysen::lang::ir::Builder::VariableId ysen::lang::ir::Builder::declare_hidden()
+{
+	return m_next_variable++;
+}
+
+const ysen::lang::ir::Builder::VariableId* ysen::lang::ir::Builder::find(const core::String& name) const
+{
+	for (auto scope = m_scopes.rbegin(); scope != m_scopes.rend(); ++scope) {
+		auto iterator = scope->find(name);
+		if (iterator != scope->end()) {
+			return &iterator->second;
+		}
+	}
+
+	return nullptr;
+}
+
+void ysen::lang::ir::Builder::write_variable(VariableId variable, BasicBlock* block, Instruction* value)
+{
+	m_definitions[variable][block] = value;
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::read_variable(VariableId variable, BasicBlock* block)
+{
+	auto& definitions = m_definitions[variable];
+	auto iterator = definitions.find(block);
+
+	if (iterator != definitions.end()) {
+		return iterator->second;
+	}
+
+	return read_variable_recursive(variable, block);
+}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::Builder::read_variable_recursive(VariableId variable, BasicBlock* block)
+{
+	Instruction* value{};
+
+	if (!m_sealed.contains(block)) {
+		// Not all predecessors are known yet, complete the phi once they are
+		value = &block->prepend(Opcode::Phi);
+		m_incomplete_phis[block].emplace_back(variable, value);
+	}
+	else if (block->predecessors().size() == 1) {
+		value = read_variable(variable, block->predecessors().front());
+	}
+	else if (block->predecessors().empty()) {
+		value = &block->prepend(Opcode::Constant); // never written, undefined
+	}
+	else {
+		value = &block->prepend(Opcode::Phi);
+		write_variable(variable, block, value); // breaks cycles through loops
+		add_phi_operands(variable, value);
+	}
+
+	write_variable(variable, block, value);
+	return value;
+}
+
+void ysen::lang::ir::Builder::add_phi_operands(VariableId variable, Instruction* phi)
+{
+	for (auto* predecessor : phi->parent()->predecessors()) {
+		auto* value = read_variable(variable, predecessor);
+		phi->operands().push_back(value);
+		phi->blocks().push_back(predecessor);
+	}
+}
+
+void ysen::lang::ir::Builder::seal(BasicBlock& block)
+{
+	auto incomplete = std::move(m_incomplete_phis[&block]);
+	m_incomplete_phis.erase(&block);
+	m_sealed.insert(&block);
+
+	for (auto& [variable, phi] : incomplete) {
+		add_phi_operands(variable, phi);
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <map>
+#include <set>
+#include <vector>
+
+#include "IR.h"
+#include "ysen/core/format.h"
+
+namespace ysen::lang::ir {
+
+	// Thrown for AST constructs the IR cannot express yet (arrays, objects,
+	// lambdas, nested functions...). Callers fall back to direct AST codegen.
+	class UnsupportedConstruct : public std::exception
+	{
+	public:
+		UnsupportedConstruct(core::String construct)
+			: m_message(core::format("UnsupportedConstruct: {}", construct))
+		{}
+
+		char const* what() const override
+		{
+			return m_message.c_str();
+		}
+	private:
+		core::String m_message{};
+	};
+
+	// Builds SSA directly from the AST using on-the-fly phi placement: every
+	// variable read looks up the reaching definition through the predecessors,
+	// placing phis at joins. Blocks are "sealed" once all their predecessors
+	// are known, loop headers only after the loop body has been built.
+	class Builder
+	{
+	public:
+		static ModulePtr build(const ast::Program&);
+	private:
+		using VariableId = size_t;
+
+		Builder(Module& module)
+			: m_module(module)
+		{}
+
+		void build_program(const ast::Program&);
+		void build_function(const ast::FunctionDeclarationStatement&);
+		void finish_function();
+
+		Instruction* build_node(const ast::AstNode&);
+		Instruction* build_scope(const ast::ScopeStatement&);
+		Instruction* build_var_declaration(const ast::VarDeclaration&);
+		Instruction* build_assignment(const ast::AssignmentExpression&);
+		Instruction* build_identifier(const ast::IdentifierExpression&);
+		Instruction* build_bin_op(const ast::BinOpExpression&);
+		Instruction* build_call(const ast::FunctionCallExpression&);
+		Instruction* build_return(const ast::ReturnExpression&);
+		Instruction* build_if(const ast::IfStatement&);
+		Instruction* build_ranged_loop(const ast::RangedLoopExpression&);
+
+		Instruction* bin_op(ast::BinOp, Instruction* lhs, Instruction* rhs);
+		Instruction* constant(astvm::Value);
+		Instruction* undefined();
+
+		BasicBlock& current() { return *m_current; }
+		void switch_to(BasicBlock&);
+		void jump(BasicBlock& target);
+		void branch(Instruction* condition, BasicBlock& if_true, BasicBlock& if_false);
+
+		// Lexical scopes, each maps a source name to the variable it declares
+		void enter_scope() { m_scopes.emplace_back(); }
+		void exit_scope() { m_scopes.pop_back(); }
+		VariableId declare(const core::String& name);
+		VariableId declare_hidden();
+		const VariableId* find(const core::String& name) const;
+
+		void write_variable(VariableId, BasicBlock*, Instruction*);
+		Instruction* read_variable(VariableId, BasicBlock*);
+		Instruction* read_variable_recursive(VariableId, BasicBlock*);
+		void add_phi_operands(VariableId, Instruction* phi);
+		void seal(BasicBlock&);
+	private:
+		Module& m_module;
+		Function* m_function{};
+		BasicBlock* m_current{};
+		bool m_in_entry_point{};
+
+		std::set<core::String> m_globals{};
+		std::vector<std::map<core::String, VariableId>> m_scopes{};
+		VariableId m_next_variable{};
+
+		std::map<VariableId, std::map<const BasicBlock*, Instruction*>> m_definitions{};
+		std::set<const BasicBlock*> m_sealed{};
+		std::map<const BasicBlock*, std::vector<std::pair<VariableId, Instruction*>>> m_incomplete_phis{};
+	};
+
+}
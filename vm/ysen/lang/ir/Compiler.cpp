@@ -0,0 +1,197 @@
+#include "Compiler.h"
+
+#include "Builder.h"
+#include "ysen/core/format.h"
+
+namespace {
+
+	using namespace ysen;
+	using namespace ysen::lang;
+
+	void lower_function(ir::Function& function, bytecode::Generator& generator, bytecode::Register scratch)
+	{
+		generator.emit_block(function.name());
+
+		auto order = function.reverse_post_order();
+		auto slot_count = function.parameters().size();
+		std::map<const ir::Instruction*, size_t> slots{};
+		std::map<const ir::Instruction*, size_t> incoming_slots{};
+
+		// Parameters already sit in the first slots, passed in place by the caller
+		for (auto* block : order) {
+			for (const auto& instruction : block->instructions()) {
+				if (instruction->opcode() == ir::Opcode::Parameter) {
+					slots[instruction.ptr()] = instruction->index();
+				}
+				else if (instruction->defines_value() && !instruction->is_constant()) {
+					slots[instruction.ptr()] = slot_count++;
+				}
+
+				// Predecessors write a phi's incoming value to a separate slot, so
+				// all phis of a block are assigned in parallel on entry.
+				if (instruction->is_phi()) {
+					incoming_slots[instruction.ptr()] = slot_count++;
+				}
+			}
+		}
+
+		// Skips reloading a value the accumulator still holds from the previous
+		// instruction, reset at every block start since blocks can be jumped to.
+		const ir::Instruction* accumulator{};
+
+		auto load = [&](const ir::Instruction* value) {
+			if (value == accumulator) {
+				return;
+			}
+
+			accumulator = value;
+			if (value->is_constant()) {
+				generator.emit<bytecode::LoadImmediate>(value->constant());
+			}
+			else {
+				generator.emit<bytecode::LoadLocal>(slots.at(value));
+			}
+		};
+
+		auto position = [&generator]() {
+			return generator.program().current_block().instructions().size();
+		};
+
+		std::map<const ir::BasicBlock*, size_t> offsets{};
+		std::vector<std::pair<bytecode::Jump*, const ir::BasicBlock*>> jumps{};
+		std::vector<std::pair<bytecode::JumpIfFalse*, const ir::BasicBlock*>> conditional_jumps{};
+
+		for (auto i = 0u; i < order.size(); ++i) {
+			auto* block = order[i];
+			const auto* next = i + 1 < order.size() ? order[i + 1] : nullptr;
+			offsets[block] = position();
+			accumulator = nullptr;
+
+			const auto& instructions = block->instructions();
+			for (auto j = 0u; j < instructions.size(); ++j) {
+				const auto& instruction = instructions[j];
+
+				if (instruction->is_terminator()) {
+					for (auto* successor : block->successors()) {
+						for (const auto& phi : successor->instructions()) {
+							if (!phi->is_phi()) {
+								continue;
+							}
+
+							for (auto k = 0u; k < phi->blocks().size(); ++k) {
+								if (phi->blocks()[k] == block) {
+									load(phi->operand(k));
+									generator.emit<bytecode::StoreLocal>(incoming_slots.at(phi.ptr()));
+									break;
+								}
+							}
+						}
+					}
+				}
+
+				switch (instruction->opcode()) {
+				case ir::Opcode::Constant:
+				case ir::Opcode::Parameter:
+					break;
+				case ir::Opcode::Phi:
+					generator.emit<bytecode::LoadLocal>(incoming_slots.at(instruction.ptr()));
+					generator.emit<bytecode::StoreLocal>(slots.at(instruction.ptr()));
+					accumulator = instruction.ptr();
+					break;
+				case ir::Opcode::LoadGlobal:
+					generator.emit<bytecode::LoadVariable>(instruction->name());
+					generator.emit<bytecode::StoreLocal>(slots.at(instruction.ptr()));
+					accumulator = instruction.ptr();
+					break;
+				case ir::Opcode::StoreGlobal:
+					load(instruction->operand(0));
+					generator.emit<bytecode::StoreVariable>(instruction->name());
+					break;
+				case ir::Opcode::BinOp:
+					load(instruction->operand(0));
+					generator.emit<bytecode::Store>(scratch);
+					load(instruction->operand(1));
+					generator.emit_bin_op(instruction->bin_op(), scratch);
+					generator.emit<bytecode::StoreLocal>(slots.at(instruction.ptr()));
+					accumulator = instruction.ptr();
+					break;
+				case ir::Opcode::Call:
+					for (auto* argument : instruction->operands()) {
+						load(argument);
+						generator.emit<bytecode::Push>();
+						accumulator = nullptr; // push moves the accumulator out
+					}
+
+					// call immediately returned is a tail call, the callee takes over the frame
+					if (j + 1 < instructions.size() && instructions[j + 1]->opcode() == ir::Opcode::Return &&
+						instructions[j + 1]->operand(0) == instruction.ptr() && function.use_count(instruction.ptr()) == 1) {
+						generator.emit<bytecode::TailCall>(instruction->name(), instruction->operands().size());
+						++j;
+						break;
+					}
+
+					generator.emit<bytecode::Call>(instruction->name(), instruction->operands().size());
+					generator.emit<bytecode::StoreLocal>(slots.at(instruction.ptr()));
+					accumulator = instruction.ptr();
+					break;
+				case ir::Opcode::Jump:
+					if (instruction->blocks()[0] != next) {
+						jumps.emplace_back(&generator.emit<bytecode::Jump>(), instruction->blocks()[0]);
+					}
+					break;
+				case ir::Opcode::Branch:
+					load(instruction->operand(0));
+					conditional_jumps.emplace_back(&generator.emit<bytecode::JumpIfFalse>(), instruction->blocks()[1]);
+					if (instruction->blocks()[0] != next) {
+						jumps.emplace_back(&generator.emit<bytecode::Jump>(), instruction->blocks()[0]);
+					}
+					break;
+				case ir::Opcode::Return:
+					load(instruction->operand(0));
+					generator.emit<bytecode::Ret>();
+					break;
+				}
+			}
+		}
+
+		for (auto& [jump, target] : jumps) {
+			jump->set_target(offsets.at(target));
+		}
+		for (auto& [jump, target] : conditional_jumps) {
+			jump->set_target(offsets.at(target));
+		}
+
+		generator.program().current_block().set_frame_layout(function.parameters().size(), slot_count);
+		generator.end_block();
+	}
+
+}
+
+void ysen::lang::ir::lower(Module& module, bytecode::Generator& generator)
+{
+	// Only ever live between a load and the operation consuming it
+	auto scratch = generator.allocate_register();
+
+	for (auto& function : module.functions()) {
+		lower_function(*function, generator, scratch);
+	}
+}
+
+ysen::core::Optional<ysen::core::String> ysen::lang::ir::compile(const ast::Program& program, bytecode::Generator& generator, const PassOptions& options)
+{
+	try {
+		auto module = Builder::build(program);
+		PassManager{options}.run(*module);
+		lower(*module, generator);
+	}
+	catch (UnsupportedConstruct& unsupported) {
+		if (!options.ast_fallback) {
+			throw;
+		}
+
+		program.generate_bytecode(generator);
+		return core::String{ unsupported.what() };
+	}
+
+	return {};
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "IR.h"
+#include "Passes.h"
+#include "ysen/core/Optional.h"
+#include "ysen/core/String.h"
+#include "ysen/lang/bytecode/Generator.h"
+
+namespace ysen::lang::ir {
+
+	// Lowers every function of the module into a bytecode block of the same
+	// name. Each SSA value gets its own frame slot, constants are materialized
+	// at their uses and phis are resolved by copies in the predecessors.
+	void lower(Module&, bytecode::Generator&);
+
+	// AST -> SSA -> optimization passes -> bytecode. Programs using constructs
+	// the IR cannot express are generated straight from the AST instead, which
+	// doesn't know all of them either; the construct is returned then.
+	core::Optional<core::String> compile(const ast::Program&, bytecode::Generator&, const PassOptions& = {});
+
+}
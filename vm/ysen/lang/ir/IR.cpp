@@ -0,0 +1,512 @@
+#include "IR.h"
+
+#include <algorithm>
+#include <set>
+
+#include "ysen/core/format.h"
+
+namespace {
+
+	ysen::core::String value_name(const ysen::lang::ir::Instruction* instruction)
+	{
+		if (!instruction) {
+			return "<null>";
+		}
+
+		return ysen::core::format("%{}", static_cast<unsigned int>(instruction->id()));
+	}
+
+}
+
+ysen::core::String ysen::lang::ir::to_string(Opcode opcode)
+{
+	switch (opcode) {
+	case Opcode::Constant: return "const";
+	case Opcode::Parameter: return "param";
+	case Opcode::LoadGlobal: return "loadg";
+	case Opcode::StoreGlobal: return "storeg";
+	case Opcode::BinOp: return "binop";
+	case Opcode::Call: return "call";
+	case Opcode::Phi: return "phi";
+	case Opcode::Jump: return "jmp";
+	case Opcode::Branch: return "br";
+	case Opcode::Return: return "ret";
+	}
+
+	return "unknown";
+}
+
+ysen::core::String ysen::lang::ir::to_string(ast::BinOp op)
+{
+	switch (op) {
+	case ast::BinOp::Addition: return "add";
+	case ast::BinOp::Subtraction: return "sub";
+	case ast::BinOp::Division: return "div";
+	case ast::BinOp::Multiplication: return "mul";
+	case ast::BinOp::Greater: return "gt";
+	case ast::BinOp::GreaterEqual: return "ge";
+	case ast::BinOp::Less: return "lt";
+	case ast::BinOp::LessEqual: return "le";
+	}
+
+	return "unknown";
+}
+
+ysen::lang::ir::Instruction::Instruction(Opcode opcode, BasicBlock* parent)
+	: m_opcode(opcode), m_parent(parent)
+{}
+
+bool ysen::lang::ir::Instruction::is_terminator() const
+{
+	return m_opcode == Opcode::Jump || m_opcode == Opcode::Branch || m_opcode == Opcode::Return;
+}
+
+bool ysen::lang::ir::Instruction::is_pure() const
+{
+	switch (m_opcode) {
+	case Opcode::Constant:
+	case Opcode::Parameter:
+	case Opcode::BinOp:
+	case Opcode::Phi:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool ysen::lang::ir::Instruction::defines_value() const
+{
+	return !is_terminator() && m_opcode != Opcode::StoreGlobal;
+}
+
+void ysen::lang::ir::Instruction::replace_operand(Instruction* from, Instruction* to)
+{
+	std::replace(m_operands.begin(), m_operands.end(), from, to);
+}
+
+void ysen::lang::ir::Instruction::remove_incoming(BasicBlock* block)
+{
+	for (auto i = 0u; i < m_blocks.size();) {
+		if (m_blocks[i] == block) {
+			m_blocks.erase(m_blocks.begin() + i);
+			m_operands.erase(m_operands.begin() + i);
+			continue;
+		}
+
+		++i;
+	}
+}
+
+void ysen::lang::ir::Instruction::replace_block(BasicBlock* from, BasicBlock* to)
+{
+	std::replace(m_blocks.begin(), m_blocks.end(), from, to);
+}
+
+ysen::core::String ysen::lang::ir::Instruction::to_string() const
+{
+	core::String operands{};
+	for (auto i = 0u; i < m_operands.size(); ++i) {
+		if (i != 0) {
+			operands.append(", ");
+		}
+
+		if (m_opcode == Opcode::Phi) {
+			operands.append(core::format("[{}, {}]", value_name(m_operands[i]), m_blocks[i]->label()));
+		}
+		else {
+			operands.append(value_name(m_operands[i]));
+		}
+	}
+
+	switch (m_opcode) {
+	case Opcode::Constant: return core::format("{} = const {}", value_name(this), m_constant.to_formatted_string());
+	case Opcode::Parameter: return core::format("{} = param #{} '{}'", value_name(this), static_cast<unsigned int>(m_index), m_name);
+	case Opcode::LoadGlobal: return core::format("{} = loadg '{}'", value_name(this), m_name);
+	case Opcode::StoreGlobal: return core::format("storeg '{}', {}", m_name, operands);
+	case Opcode::BinOp: return core::format("{} = {} {}", value_name(this), ir::to_string(m_bin_op), operands);
+	case Opcode::Call: return core::format("{} = call '{}'({})", value_name(this), m_name, operands);
+	case Opcode::Phi: return core::format("{} = phi {}", value_name(this), operands);
+	case Opcode::Jump: return core::format("jmp {}", m_blocks.at(0)->label());
+	case Opcode::Branch: return core::format("br {}, {}, {}", operands, m_blocks.at(0)->label(), m_blocks.at(1)->label());
+	case Opcode::Return: return core::format("ret {}", operands);
+	}
+
+	return "unknown";
+}
+
+ysen::lang::ir::BasicBlock::BasicBlock(Function* parent, size_t id)
+	: m_parent(parent), m_id(id)
+{}
+
+ysen::lang::ir::Instruction* ysen::lang::ir::BasicBlock::terminator() const
+{
+	if (m_instructions.empty() || !m_instructions.back()->is_terminator()) {
+		return nullptr;
+	}
+
+	return const_cast<Instruction*>(m_instructions.back().ptr());
+}
+
+ysen::lang::ir::Instruction& ysen::lang::ir::BasicBlock::append(Opcode opcode)
+{
+	return *m_instructions.emplace_back(core::adopt_shared(new Instruction(opcode, this)));
+}
+
+ysen::lang::ir::Instruction& ysen::lang::ir::BasicBlock::prepend(Opcode opcode)
+{
+	auto instruction = core::adopt_shared(new Instruction(opcode, this));
+	auto* ptr = instruction.ptr();
+	m_instructions.insert(m_instructions.begin(), std::move(instruction));
+	return *ptr;
+}
+
+void ysen::lang::ir::BasicBlock::insert_before(const Instruction* position, InstructionPtr instruction)
+{
+	auto iterator = std::find_if(m_instructions.begin(), m_instructions.end(), [position](const auto& i) {
+		return i.ptr() == position;
+	});
+
+	instruction->set_parent(this);
+	m_instructions.insert(iterator, std::move(instruction));
+}
+
+void ysen::lang::ir::BasicBlock::insert_before_terminator(InstructionPtr instruction)
+{
+	instruction->set_parent(this);
+	auto position = is_terminated() ? m_instructions.end() - 1 : m_instructions.end();
+	m_instructions.insert(position, std::move(instruction));
+}
+
+ysen::lang::ir::InstructionPtr ysen::lang::ir::BasicBlock::take(Instruction* instruction)
+{
+	auto iterator = std::find_if(m_instructions.begin(), m_instructions.end(), [instruction](const auto& i) {
+		return i.ptr() == instruction;
+	});
+
+	if (iterator == m_instructions.end()) {
+		return nullptr;
+	}
+
+	auto taken = *iterator;
+	m_instructions.erase(iterator);
+	return taken;
+}
+
+void ysen::lang::ir::BasicBlock::erase(Instruction* instruction)
+{
+	take(instruction);
+}
+
+std::vector<ysen::lang::ir::BasicBlock*> ysen::lang::ir::BasicBlock::successors() const
+{
+	auto* term = terminator();
+	if (!term) {
+		return {};
+	}
+
+	return term->blocks();
+}
+
+ysen::core::String ysen::lang::ir::BasicBlock::label() const
+{
+	return core::format("bb{}", static_cast<unsigned int>(m_id));
+}
+
+ysen::core::String ysen::lang::ir::BasicBlock::to_string() const
+{
+	core::String formatted{};
+	formatted.append(core::format("{}:\n", label()));
+
+	for (const auto& instruction : m_instructions) {
+		formatted.append(core::format("\t{}\n", instruction->to_string()));
+	}
+
+	return formatted;
+}
+
+ysen::lang::ir::Function::Function(core::String name, std::vector<core::String> parameters)
+	: m_name(std::move(name)), m_parameters(std::move(parameters))
+{}
+
+ysen::lang::ir::BasicBlock& ysen::lang::ir::Function::create_block()
+{
+	return *m_blocks.emplace_back(core::adopt_shared(new BasicBlock(this, m_next_block_id++)));
+}
+
+void ysen::lang::ir::Function::erase_block(BasicBlock* block)
+{
+	m_blocks.erase(std::remove_if(m_blocks.begin(), m_blocks.end(), [block](const auto& b) {
+		return b.ptr() == block;
+	}), m_blocks.end());
+}
+
+void ysen::lang::ir::Function::compute_predecessors()
+{
+	for (auto& block : m_blocks) {
+		block->predecessors().clear();
+	}
+
+	for (auto& block : m_blocks) {
+		for (auto* successor : block->successors()) {
+			auto& predecessors = successor->predecessors();
+			if (std::find(predecessors.begin(), predecessors.end(), block.ptr()) == predecessors.end()) {
+				predecessors.push_back(block.ptr());
+			}
+		}
+	}
+}
+
+std::vector<ysen::lang::ir::BasicBlock*> ysen::lang::ir::Function::reverse_post_order() const
+{
+	std::vector<BasicBlock*> order{};
+	if (!entry()) {
+		return order;
+	}
+
+	// Like successors(), the order hands out the blocks for the passes to change
+	auto* entry_block = const_cast<BasicBlock*>(entry());
+	std::set<const BasicBlock*> visited{};
+	std::vector<std::pair<BasicBlock*, size_t>> stack{};
+	stack.emplace_back(entry_block, 0);
+	visited.insert(entry_block);
+
+	while (!stack.empty()) {
+		auto& [block, next] = stack.back();
+		auto successors = block->successors();
+
+		if (next < successors.size()) {
+			auto* successor = successors[next++];
+			if (!visited.contains(successor)) {
+				visited.insert(successor);
+				stack.emplace_back(successor, 0);
+			}
+			continue;
+		}
+
+		order.push_back(block);
+		stack.pop_back();
+	}
+
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+std::map<const ysen::lang::ir::BasicBlock*, ysen::lang::ir::BasicBlock*> ysen::lang::ir::Function::compute_dominators() const
+{
+	auto order = reverse_post_order();
+	std::map<const BasicBlock*, size_t> position{};
+	std::map<const BasicBlock*, std::vector<BasicBlock*>> predecessors{};
+
+	for (auto i = 0u; i < order.size(); ++i) {
+		position[order[i]] = i;
+	}
+
+	for (auto* block : order) {
+		for (auto* successor : block->successors()) {
+			predecessors[successor].push_back(block);
+		}
+	}
+
+	std::map<const BasicBlock*, BasicBlock*> idom{};
+	if (order.empty()) {
+		return idom;
+	}
+
+	idom[order.front()] = order.front();
+
+	auto intersect = [&](BasicBlock* a, BasicBlock* b) {
+		while (a != b) {
+			while (position[a] > position[b]) {
+				a = idom[a];
+			}
+			while (position[b] > position[a]) {
+				b = idom[b];
+			}
+		}
+		return a;
+	};
+
+	auto changed = true;
+	while (changed) {
+		changed = false;
+
+		for (auto i = 1u; i < order.size(); ++i) {
+			auto* block = order[i];
+			BasicBlock* new_idom{};
+
+			for (auto* predecessor : predecessors[block]) {
+				if (!idom.contains(predecessor)) {
+					continue;
+				}
+
+				new_idom = new_idom ? intersect(predecessor, new_idom) : predecessor;
+			}
+
+			if (new_idom && idom[block] != new_idom) {
+				idom[block] = new_idom;
+				changed = true;
+			}
+		}
+	}
+
+	return idom;
+}
+
+bool ysen::lang::ir::Function::dominates(const std::map<const BasicBlock*, BasicBlock*>& idom, const BasicBlock* a, const BasicBlock* b)
+{
+	while (true) {
+		if (a == b) {
+			return true;
+		}
+
+		auto iterator = idom.find(b);
+		if (iterator == idom.end() || iterator->second == b) {
+			return false;
+		}
+
+		b = iterator->second;
+	}
+}
+
+void ysen::lang::ir::Function::replace_all_uses(Instruction* from, Instruction* to)
+{
+	for (auto& block : m_blocks) {
+		for (auto& instruction : block->instructions()) {
+			instruction->replace_operand(from, to);
+		}
+	}
+}
+
+bool ysen::lang::ir::Function::simplify_phis()
+{
+	auto simplified = false;
+	auto changed = true;
+
+	while (changed) {
+		changed = false;
+
+		for (auto& block : m_blocks) {
+			std::vector<Instruction*> phis{};
+			for (auto& instruction : block->instructions()) {
+				if (instruction->is_phi()) {
+					phis.push_back(instruction.ptr());
+				}
+			}
+
+			for (auto* phi : phis) {
+				Instruction* same{};
+				auto trivial = true;
+
+				for (auto* operand : phi->operands()) {
+					if (operand == same || operand == phi) {
+						continue;
+					}
+
+					if (same) {
+						trivial = false;
+						break;
+					}
+
+					same = operand;
+				}
+
+				// A phi only referencing itself sits in dead code, DCE takes care of it
+				if (!trivial || !same) {
+					continue;
+				}
+
+				replace_all_uses(phi, same);
+				block->erase(phi);
+				changed = simplified = true;
+			}
+		}
+	}
+
+	return simplified;
+}
+
+size_t ysen::lang::ir::Function::use_count(const Instruction* value) const
+{
+	size_t count{};
+	for (const auto& block : m_blocks) {
+		for (const auto& instruction : block->instructions()) {
+			count += std::count(instruction->operands().begin(), instruction->operands().end(), value);
+		}
+	}
+	return count;
+}
+
+size_t ysen::lang::ir::Function::instruction_count() const
+{
+	size_t count{};
+	for (const auto& block : m_blocks) {
+		count += block->instructions().size();
+	}
+	return count;
+}
+
+void ysen::lang::ir::Function::renumber()
+{
+	size_t value_id{};
+	size_t block_id{};
+
+	for (auto& block : m_blocks) {
+		block->set_id(block_id++);
+
+		for (auto& instruction : block->instructions()) {
+			if (instruction->defines_value()) {
+				instruction->set_id(value_id++);
+			}
+		}
+	}
+}
+
+ysen::core::String ysen::lang::ir::Function::to_string()
+{
+	renumber();
+
+	core::String parameters{};
+	for (const auto& parameter : m_parameters) {
+		if (!parameters.empty()) {
+			parameters.append(", ");
+		}
+		parameters.append(parameter);
+	}
+
+	core::String formatted{};
+	formatted.append(core::format("fun {}({}):\n", m_name, parameters));
+
+	for (const auto& block : m_blocks) {
+		formatted.append(block->to_string());
+	}
+
+	return formatted;
+}
+
+ysen::lang::ir::Function& ysen::lang::ir::Module::create_function(core::String name, std::vector<core::String> parameters)
+{
+	return *m_functions.emplace_back(core::adopt_shared(new Function(std::move(name), std::move(parameters))));
+}
+
+ysen::lang::ir::Function* ysen::lang::ir::Module::find(const core::String& name) const
+{
+	for (const auto& function : m_functions) {
+		if (function->name() == name) {
+			return const_cast<Function*>(function.ptr());
+		}
+	}
+
+	return nullptr;
+}
+
+ysen::core::String ysen::lang::ir::Module::to_string()
+{
+	core::String formatted{};
+
+	for (auto& function : m_functions) {
+		formatted.append(function->to_string());
+		formatted.push('\n');
+	}
+
+	return formatted;
+}
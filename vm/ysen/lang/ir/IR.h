@@ -0,0 +1,175 @@
+#pragma once
+#include <map>
+#include <vector>
+
+#include "ysen/core/SharedPtr.h"
+#include "ysen/core/String.h"
+#include "ysen/lang/ast/node.h"
+#include "ysen/lang/astvm/Value.h"
+
+// An SSA-form intermediate representation that sits between the AST and the
+// bytecode. Every Instruction that produces a value *is* that value, operands
+// refer directly to their defining instructions.
+namespace ysen::lang::ir {
+
+	class BasicBlock;
+	class Function;
+
+	enum class Opcode
+	{
+		Constant,		// %v = const <constant>
+		Parameter,		// %v = param #index
+		LoadGlobal,		// %v = loadg 'name'
+		StoreGlobal,	// storeg 'name', %a
+		BinOp,			// %v = <op> %a, %b
+		Call,			// %v = call 'name'(%a...)
+		Phi,			// %v = phi [%a, bbX]...
+		Jump,			// jmp bbX
+		Branch,			// br %c, bbX, bbY
+		Return,			// ret %a
+	};
+
+	class Instruction
+	{
+	public:
+		Instruction(Opcode, BasicBlock* parent);
+
+		Opcode opcode() const { return m_opcode; }
+		BasicBlock* parent() const { return m_parent; }
+		void set_parent(BasicBlock* parent) { m_parent = parent; }
+		size_t id() const { return m_id; }
+		void set_id(size_t id) { m_id = id; }
+
+		const auto& operands() const { return m_operands; }
+		auto& operands() { return m_operands; }
+		Instruction* operand(size_t index) const { return m_operands.at(index); }
+		// Branch targets for terminators, incoming blocks (parallel to operands) for phis
+		const auto& blocks() const { return m_blocks; }
+		auto& blocks() { return m_blocks; }
+
+		const astvm::Value& constant() const { return m_constant; }
+		void set_constant(astvm::Value constant) { m_constant = std::move(constant); }
+		const core::String& name() const { return m_name; }
+		void set_name(core::String name) { m_name = std::move(name); }
+		ast::BinOp bin_op() const { return m_bin_op; }
+		void set_bin_op(ast::BinOp op) { m_bin_op = op; }
+		size_t index() const { return m_index; }
+		void set_index(size_t index) { m_index = index; }
+
+		bool is_terminator() const;
+		bool is_pure() const;
+		bool defines_value() const;
+		bool is_constant() const { return m_opcode == Opcode::Constant; }
+		bool is_phi() const { return m_opcode == Opcode::Phi; }
+
+		void replace_operand(Instruction* from, Instruction* to);
+		void remove_incoming(BasicBlock*);
+		void replace_block(BasicBlock* from, BasicBlock* to);
+
+		core::String to_string() const;
+	private:
+		Opcode m_opcode{};
+		BasicBlock* m_parent{};
+		size_t m_id{};
+		std::vector<Instruction*> m_operands{};
+		std::vector<BasicBlock*> m_blocks{};
+		astvm::Value m_constant{};
+		core::String m_name{};
+		ast::BinOp m_bin_op{};
+		size_t m_index{};
+	};
+	using InstructionPtr = core::SharedPtr<Instruction>;
+
+	class BasicBlock
+	{
+	public:
+		BasicBlock(Function* parent, size_t id);
+
+		Function* parent() const { return m_parent; }
+		size_t id() const { return m_id; }
+		void set_id(size_t id) { m_id = id; }
+
+		const auto& instructions() const { return m_instructions; }
+		auto& instructions() { return m_instructions; }
+		Instruction* terminator() const;
+		bool is_terminated() const { return terminator() != nullptr; }
+
+		Instruction& append(Opcode);
+		Instruction& prepend(Opcode);
+		void insert_before(const Instruction* position, InstructionPtr);
+		void insert_before_terminator(InstructionPtr);
+		InstructionPtr take(Instruction*);
+		void erase(Instruction*);
+
+		std::vector<BasicBlock*> successors() const;
+		// Valid after Function::compute_predecessors()
+		const auto& predecessors() const { return m_predecessors; }
+		auto& predecessors() { return m_predecessors; }
+
+		core::String label() const;
+		core::String to_string() const;
+	private:
+		Function* m_parent{};
+		size_t m_id{};
+		std::vector<InstructionPtr> m_instructions{};
+		std::vector<BasicBlock*> m_predecessors{};
+	};
+	using BasicBlockPtr = core::SharedPtr<BasicBlock>;
+
+	class Function
+	{
+	public:
+		Function(core::String name, std::vector<core::String> parameters);
+
+		const auto& name() const { return m_name; }
+		const auto& parameters() const { return m_parameters; }
+
+		const auto& blocks() const { return m_blocks; }
+		auto& blocks() { return m_blocks; }
+		const BasicBlock* entry() const { return m_blocks.empty() ? nullptr : m_blocks.front().ptr(); }
+		BasicBlock* entry() { return m_blocks.empty() ? nullptr : m_blocks.front().ptr(); }
+		BasicBlock& create_block();
+		void erase_block(BasicBlock*);
+
+		void compute_predecessors();
+		std::vector<BasicBlock*> reverse_post_order() const;
+		// Immediate dominators, computed over reverse_post_order()
+		std::map<const BasicBlock*, BasicBlock*> compute_dominators() const;
+		static bool dominates(const std::map<const BasicBlock*, BasicBlock*>&, const BasicBlock* a, const BasicBlock* b);
+
+		void replace_all_uses(Instruction* from, Instruction* to);
+		// Removes phis whose operands are all the same value (or the phi itself)
+		bool simplify_phis();
+		size_t use_count(const Instruction*) const;
+		size_t instruction_count() const;
+
+		void renumber();
+		core::String to_string();
+	private:
+		core::String m_name{};
+		std::vector<core::String> m_parameters{};
+		std::vector<BasicBlockPtr> m_blocks{};
+		size_t m_next_block_id{};
+	};
+	using FunctionPtr = core::SharedPtr<Function>;
+
+	class Module
+	{
+	public:
+		static constexpr auto ENTRY_POINT = "main";
+
+		const auto& functions() const { return m_functions; }
+		auto& functions() { return m_functions; }
+		Function& create_function(core::String name, std::vector<core::String> parameters);
+		Function* find(const core::String& name) const;
+
+		core::String to_string();
+	private:
+		std::vector<FunctionPtr> m_functions{};
+	};
+	using ModulePtr = core::SharedPtr<Module>;
+
+	core::String to_string(Opcode);
+	core::String to_string(ast::BinOp);
+
+}
@@ -0,0 +1,501 @@
+#include "Passes.h"
+
+#include <algorithm>
+#include <set>
+#include <tuple>
+
+#include "ysen/core/format.h"
+
+namespace {
+
+	using namespace ysen;
+	using namespace ysen::lang;
+
+	std::vector<ir::Instruction*> snapshot(const ir::BasicBlock& block)
+	{
+		std::vector<ir::Instruction*> instructions{};
+		for (const auto& instruction : block.instructions()) {
+			instructions.push_back(const_cast<ir::Instruction*>(instruction.ptr()));
+		}
+		return instructions;
+	}
+
+	bool same_constant(const ir::Instruction* a, const ir::Instruction* b)
+	{
+		if (a == b) {
+			return true;
+		}
+
+		return a->is_constant() && b->is_constant() &&
+			a->constant() == b->constant() &&
+			a->constant().to_formatted_string() == b->constant().to_formatted_string();
+	}
+
+	// Integer division by zero traps, only divisions by a known non-zero value
+	// may be evaluated early or speculatively.
+	bool is_safe_division(const ir::Instruction* instruction)
+	{
+		if (instruction->opcode() != ir::Opcode::BinOp || instruction->bin_op() != ast::BinOp::Division) {
+			return true;
+		}
+
+		const auto* divisor = instruction->operand(1);
+		return divisor->is_constant() && divisor->constant().is_trivial() && divisor->constant().is_trueish();
+	}
+
+	void remove_phi_incoming(ir::BasicBlock* block, ir::BasicBlock* predecessor)
+	{
+		for (auto& instruction : block->instructions()) {
+			if (instruction->is_phi()) {
+				instruction->remove_incoming(predecessor);
+			}
+		}
+	}
+
+}
+
+bool ysen::lang::ir::ConstantPropagation::run(Function& function, Module&)
+{
+	auto changed = false;
+	auto progress = true;
+
+	while (progress) {
+		progress = false;
+
+		for (auto& block : function.blocks()) {
+			for (auto* instruction : snapshot(*block)) {
+				if (instruction->opcode() == Opcode::BinOp) {
+					auto* lhs = instruction->operand(0);
+					auto* rhs = instruction->operand(1);
+
+					if (!lhs->is_constant() || !rhs->is_constant() || !is_safe_division(instruction)) {
+						continue;
+					}
+
+					auto folded = core::adopt_shared(new Instruction(Opcode::Constant, block.ptr()));
+					folded->set_constant(ast::apply_bin_op(instruction->bin_op(), lhs->constant(), rhs->constant()));
+					block->insert_before(instruction, folded);
+					function.replace_all_uses(instruction, folded.ptr());
+					block->erase(instruction);
+					progress = true;
+				}
+				else if (instruction->is_phi() && !instruction->operands().empty()) {
+					auto* first = instruction->operand(0);
+					auto all_same = std::all_of(instruction->operands().begin(), instruction->operands().end(), [&](const auto* operand) {
+						return operand == instruction || same_constant(first, operand);
+					});
+
+					if (!all_same || first == instruction) {
+						continue;
+					}
+
+					function.replace_all_uses(instruction, first);
+					block->erase(instruction);
+					progress = true;
+				}
+				else if (instruction->opcode() == Opcode::Branch && instruction->operand(0)->is_constant()) {
+					auto condition = instruction->operand(0)->constant().is_trueish();
+					auto* taken = instruction->blocks()[condition ? 0 : 1];
+					auto* not_taken = instruction->blocks()[condition ? 1 : 0];
+
+					if (taken != not_taken) {
+						remove_phi_incoming(not_taken, block.ptr());
+					}
+
+					block->erase(instruction);
+					block->append(Opcode::Jump).blocks().push_back(taken);
+					progress = true;
+				}
+			}
+		}
+
+		progress = function.simplify_phis() || progress;
+		changed = changed || progress;
+	}
+
+	return changed;
+}
+
+bool ysen::lang::ir::CommonSubexpressionElimination::run(Function& function, Module&)
+{
+	auto idom = function.compute_dominators();
+	std::map<const BasicBlock*, std::vector<BasicBlock*>> children{};
+
+	for (auto* block : function.reverse_post_order()) {
+		auto* parent = idom[block];
+		if (parent != block) {
+			children[parent].push_back(block);
+		}
+	}
+
+	using Key = std::tuple<ast::BinOp, Instruction*, Instruction*>;
+	std::vector<std::map<Key, Instruction*>> scopes{};
+	auto changed = false;
+
+	auto lookup = [&scopes](const Key& key) -> Instruction* {
+		for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+			auto iterator = scope->find(key);
+			if (iterator != scope->end()) {
+				return iterator->second;
+			}
+		}
+		return nullptr;
+	};
+
+	// Walk the dominator tree depth first, a value is available in every block
+	// dominated by the block defining it.
+	std::vector<std::pair<BasicBlock*, bool>> worklist{};
+	if (function.entry()) {
+		worklist.emplace_back(function.entry(), false);
+	}
+
+	while (!worklist.empty()) {
+		auto [block, visited] = worklist.back();
+		worklist.pop_back();
+
+		if (visited) {
+			scopes.pop_back();
+			continue;
+		}
+
+		scopes.emplace_back();
+		worklist.emplace_back(block, true);
+
+		// Global loads can only be forwarded locally, a call may write any global
+		std::map<core::String, Instruction*> globals{};
+
+		for (auto* instruction : snapshot(*block)) {
+			switch (instruction->opcode()) {
+			case Opcode::BinOp:
+				{
+					Key key{ instruction->bin_op(), instruction->operand(0), instruction->operand(1) };
+
+					if (auto* available = lookup(key)) {
+						function.replace_all_uses(instruction, available);
+						block->erase(instruction);
+						changed = true;
+					}
+					else {
+						scopes.back()[key] = instruction;
+					}
+				}
+				break;
+			case Opcode::LoadGlobal:
+				if (globals.contains(instruction->name())) {
+					function.replace_all_uses(instruction, globals[instruction->name()]);
+					block->erase(instruction);
+					changed = true;
+				}
+				else {
+					globals[instruction->name()] = instruction;
+				}
+				break;
+			case Opcode::StoreGlobal:
+				globals[instruction->name()] = instruction->operand(0);
+				break;
+			case Opcode::Call:
+				globals.clear();
+				break;
+			default:
+				break;
+			}
+		}
+
+		for (auto* child : children[block]) {
+			worklist.emplace_back(child, false);
+		}
+	}
+
+	return changed;
+}
+
+bool ysen::lang::ir::LoopInvariantCodeMotion::run(Function& function, Module&)
+{
+	function.compute_predecessors();
+	auto idom = function.compute_dominators();
+	auto order = function.reverse_post_order();
+	auto changed = false;
+
+	// Innermost loops first so that hoisted values can move further out
+	for (auto header = order.rbegin(); header != order.rend(); ++header) {
+		std::set<BasicBlock*> loop{ *header };
+		std::vector<BasicBlock*> worklist{};
+
+		for (auto* predecessor : (*header)->predecessors()) {
+			if (idom.contains(predecessor) && Function::dominates(idom, *header, predecessor)) {
+				worklist.push_back(predecessor); // back edge
+			}
+		}
+
+		if (worklist.empty()) {
+			continue;
+		}
+
+		while (!worklist.empty()) {
+			auto* block = worklist.back();
+			worklist.pop_back();
+
+			if (loop.insert(block).second) {
+				for (auto* predecessor : block->predecessors()) {
+					if (idom.contains(predecessor)) {
+						worklist.push_back(predecessor);
+					}
+				}
+			}
+		}
+
+		std::vector<BasicBlock*> outside{};
+		for (auto* predecessor : (*header)->predecessors()) {
+			if (idom.contains(predecessor) && !loop.contains(predecessor)) {
+				outside.push_back(predecessor);
+			}
+		}
+
+		if (outside.size() != 1 || outside.front()->successors().size() != 1) {
+			continue; // no dedicated preheader
+		}
+
+		auto* preheader = outside.front();
+		auto is_invariant = [&loop](const Instruction* instruction) {
+			return std::all_of(instruction->operands().begin(), instruction->operands().end(), [&loop](const auto* operand) {
+				return !loop.contains(operand->parent());
+			});
+		};
+
+		auto progress = true;
+		while (progress) {
+			progress = false;
+
+			for (auto* block : order) {
+				if (!loop.contains(block)) {
+					continue;
+				}
+
+				for (auto* instruction : snapshot(*block)) {
+					auto hoistable = instruction->opcode() == Opcode::Constant || instruction->opcode() == Opcode::BinOp;
+
+					if (!hoistable || !is_invariant(instruction) || !is_safe_division(instruction)) {
+						continue;
+					}
+
+					preheader->insert_before_terminator(block->take(instruction));
+					progress = changed = true;
+				}
+			}
+		}
+	}
+
+	return changed;
+}
+
+bool ysen::lang::ir::DeadCodeElimination::run(Function& function, Module&)
+{
+	auto changed = false;
+
+	// Unreachable blocks
+	auto order = function.reverse_post_order();
+	std::set<const BasicBlock*> reachable{ order.begin(), order.end() };
+	std::vector<BasicBlock*> unreachable{};
+
+	for (auto& block : function.blocks()) {
+		if (!reachable.contains(block.ptr())) {
+			unreachable.push_back(block.ptr());
+		}
+	}
+
+	for (auto* block : unreachable) {
+		for (auto* successor : block->successors()) {
+			remove_phi_incoming(successor, block);
+		}
+	}
+
+	for (auto* block : unreachable) {
+		function.erase_block(block);
+		changed = true;
+	}
+
+	changed = function.simplify_phis() || changed;
+
+	// Straight jump chains, a block only reached through an unconditional jump
+	// is appended to its predecessor.
+	auto merged = true;
+	while (merged) {
+		merged = false;
+		function.compute_predecessors();
+
+		for (auto& block : function.blocks()) {
+			auto* terminator = block->terminator();
+			if (!terminator || terminator->opcode() != Opcode::Jump) {
+				continue;
+			}
+
+			auto* target = terminator->blocks().front();
+			if (target == block.ptr() || target == function.entry() || target->predecessors().size() != 1) {
+				continue;
+			}
+
+			block->erase(terminator);
+			for (auto& instruction : target->instructions()) {
+				instruction->set_parent(block.ptr());
+				block->instructions().push_back(instruction);
+			}
+
+			for (auto* successor : block->successors()) {
+				for (auto& instruction : successor->instructions()) {
+					if (instruction->is_phi()) {
+						instruction->replace_block(target, block.ptr());
+					}
+				}
+			}
+
+			function.erase_block(target);
+			merged = changed = true;
+			break;
+		}
+	}
+
+	// Unused pure values
+	auto progress = true;
+	while (progress) {
+		progress = false;
+
+		for (auto& block : function.blocks()) {
+			for (auto* instruction : snapshot(*block)) {
+				if (!instruction->is_pure()) {
+					continue;
+				}
+
+				auto self_uses = std::count(instruction->operands().begin(), instruction->operands().end(), instruction);
+				if (function.use_count(instruction) - self_uses != 0) {
+					continue;
+				}
+
+				block->erase(instruction);
+				progress = changed = true;
+			}
+		}
+	}
+
+	return changed;
+}
+
+bool ysen::lang::ir::Inliner::can_inline(const Function& caller, const Function& callee) const
+{
+	if (&caller == &callee) {
+		return false;
+	}
+
+	auto order = callee.reverse_post_order();
+	if (order.size() != 1 || order.front()->instructions().size() > m_threshold) {
+		return false; // only straight-line bodies
+	}
+
+	auto* terminator = order.front()->terminator();
+	if (!terminator || terminator->opcode() != Opcode::Return) {
+		return false;
+	}
+
+	return std::none_of(order.front()->instructions().begin(), order.front()->instructions().end(), [&](const auto& instruction) {
+		return instruction->opcode() == Opcode::Call && (instruction->name() == callee.name() || instruction->name() == caller.name());
+	});
+}
+
+bool ysen::lang::ir::Inliner::run(Function& function, Module& module)
+{
+	auto changed = false;
+
+	for (auto& block : function.blocks()) {
+		for (auto* call : snapshot(*block)) {
+			if (call->opcode() != Opcode::Call) {
+				continue;
+			}
+
+			auto* callee = module.find(call->name());
+			if (!callee || !can_inline(function, *callee)) {
+				continue;
+			}
+
+			std::map<const Instruction*, Instruction*> values{};
+			Instruction* result{};
+
+			for (const auto& instruction : callee->entry()->instructions()) {
+				if (instruction->opcode() == Opcode::Parameter) {
+					if (instruction->index() < call->operands().size()) {
+						values[instruction.ptr()] = call->operand(instruction->index());
+						continue;
+					}
+
+					// Missing arguments are undefined
+					auto missing = core::adopt_shared(new Instruction(Opcode::Constant, block.ptr()));
+					values[instruction.ptr()] = missing.ptr();
+					block->insert_before(call, std::move(missing));
+					continue;
+				}
+
+				if (instruction->opcode() == Opcode::Return) {
+					result = values[instruction->operand(0)];
+					break;
+				}
+
+				auto clone = core::adopt_shared(new Instruction(instruction->opcode(), block.ptr()));
+				clone->set_constant(instruction->constant());
+				clone->set_name(instruction->name());
+				clone->set_bin_op(instruction->bin_op());
+				clone->set_index(instruction->index());
+
+				for (auto* operand : instruction->operands()) {
+					clone->operands().push_back(values[operand]);
+				}
+
+				values[instruction.ptr()] = clone.ptr();
+				block->insert_before(call, std::move(clone));
+			}
+
+			function.replace_all_uses(call, result);
+			block->erase(call);
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+ysen::lang::ir::PassManager::PassManager(PassOptions options)
+	: m_options(options)
+{
+	if (m_options.inlining) {
+		m_passes.emplace_back(core::adopt_shared(static_cast<Pass*>(new Inliner(m_options.inline_threshold))));
+	}
+	if (m_options.common_subexpression_elimination) {
+		m_passes.emplace_back(core::adopt_shared(static_cast<Pass*>(new CommonSubexpressionElimination)));
+	}
+	// After CSE, forwarded global loads expose more constants
+	if (m_options.constant_propagation) {
+		m_passes.emplace_back(core::adopt_shared(static_cast<Pass*>(new ConstantPropagation)));
+	}
+	if (m_options.loop_invariant_code_motion) {
+		m_passes.emplace_back(core::adopt_shared(static_cast<Pass*>(new LoopInvariantCodeMotion)));
+	}
+	if (m_options.dead_code_elimination) {
+		m_passes.emplace_back(core::adopt_shared(static_cast<Pass*>(new DeadCodeElimination)));
+	}
+}
+
+void ysen::lang::ir::PassManager::run(Module& module)
+{
+	if (m_options.dump_ir) {
+		core::println("; IR before optimization\n{}", module.to_string());
+	}
+
+	for (auto& pass : m_passes) {
+		auto changed = false;
+
+		for (auto& function : module.functions()) {
+			changed = pass->run(*function, module) || changed;
+		}
+
+		if (m_options.dump_ir) {
+			core::println("; IR after {}{}\n{}", pass->name(), changed ? "" : " (unchanged)", module.to_string());
+		}
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+
+#include "IR.h"
+
+namespace ysen::lang::ir {
+
+	struct PassOptions
+	{
+		bool constant_propagation{true};
+		bool common_subexpression_elimination{true};
+		bool loop_invariant_code_motion{true};
+		bool dead_code_elimination{true};
+		bool inlining{true};
+		size_t inline_threshold{24}; // max instruction count of an inlined callee
+		bool dump_ir{false}; // print the module before and after every pass
+		bool ast_fallback{true}; // generate what the IR can't express from the AST, instead of throwing UnsupportedConstruct
+	};
+
+	class Pass
+	{
+	public:
+		virtual ~Pass() = default;
+
+		virtual const char* name() const = 0;
+		// Returns true if the function was changed
+		virtual bool run(Function&, Module&) = 0;
+	};
+	using PassPtr = core::SharedPtr<Pass>;
+
+	// Folds binary operations on constants, phis merging the same constant and
+	// branches on a constant condition.
+	class ConstantPropagation : public Pass
+	{
+	public:
+		const char* name() const override { return "constant-propagation"; }
+		bool run(Function&, Module&) override;
+	};
+
+	// Dominator scoped value numbering of pure operations, plus forwarding of
+	// global loads within a block until the next call or store.
+	class CommonSubexpressionElimination : public Pass
+	{
+	public:
+		const char* name() const override { return "cse"; }
+		bool run(Function&, Module&) override;
+	};
+
+	// Hoists pure operations whose operands are defined outside of a natural
+	// loop into the loop preheader.
+	class LoopInvariantCodeMotion : public Pass
+	{
+	public:
+		const char* name() const override { return "licm"; }
+		bool run(Function&, Module&) override;
+	};
+
+	// Removes unreachable blocks and unused pure values and merges straight
+	// jump chains.
+	class DeadCodeElimination : public Pass
+	{
+	public:
+		const char* name() const override { return "dce"; }
+		bool run(Function&, Module&) override;
+	};
+
+	// Inlines calls to small, straight-line, non recursive functions.
+	class Inliner : public Pass
+	{
+	public:
+		Inliner(size_t threshold)
+			: m_threshold(threshold)
+		{}
+
+		const char* name() const override { return "inliner"; }
+		bool run(Function&, Module&) override;
+	private:
+		bool can_inline(const Function& caller, const Function& callee) const;
+	private:
+		size_t m_threshold{};
+	};
+
+	class PassManager
+	{
+	public:
+		PassManager(PassOptions);
+
+		void run(Module&);
+	private:
+		PassOptions m_options{};
+		std::vector<PassPtr> m_passes{};
+	};
+
+}